@@ -28,7 +28,6 @@
 
 #include "py/nlr.h"
 #include "py/objlist.h"
-#include "py/objstringio.h"
 #include "py/parsenum.h"
 #include "py/runtime.h"
 #include "py/stream.h"
@@ -57,32 +56,69 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_ujson_dumps_obj, mod_ujson_dumps);
 // strings).  It does 1 pass over the input stream.  It tries to be fast and
 // small in code size, while not using more RAM than necessary.
 
+// Input is read through a buffer: for streams it is refilled by calling the
+// stream's read method with the size of the buffer, and for loads() the
+// buffer is just the str/bytes data itself.
+
 typedef struct _ujson_stream_t {
     mp_obj_t stream_obj;
-    mp_uint_t (*read)(mp_obj_t obj, void *buf, mp_uint_t size, int *errcode);
+    mp_uint_t (*read)(mp_obj_t obj, void *buf, mp_uint_t size, int *errcode); // NULL if no stream
     int errcode;
     byte cur;
+    const byte *ptr; // next byte to be read
+    const byte *end;
+    byte *buf;
+    size_t buf_size;
 } ujson_stream_t;
 
 #define S_EOF (0) // null is not allowed in json stream so is ok as EOF marker
-#define S_END(s) ((s).cur == S_EOF)
-#define S_CUR(s) ((s).cur)
-#define S_NEXT(s) (ujson_stream_next(&(s)))
+#define S_END(s) ((s)->cur == S_EOF)
+#define S_CUR(s) ((s)->cur)
+#define S_NEXT(s) (ujson_stream_next(s))
 
-STATIC byte ujson_stream_next(ujson_stream_t *s) {
-    mp_uint_t ret = s->read(s->stream_obj, &s->cur, 1, &s->errcode);
-    if (s->errcode != 0) {
-        mp_raise_OSError(s->errcode);
+STATIC byte ujson_stream_fill(ujson_stream_t *s) {
+    mp_uint_t ret = 0;
+    if (s->read != NULL) {
+        ret = s->read(s->stream_obj, s->buf, s->buf_size, &s->errcode);
+        if (ret == MP_STREAM_ERROR) {
+            mp_raise_OSError(s->errcode);
+        }
     }
     if (ret == 0) {
         s->cur = S_EOF;
+    } else {
+        s->ptr = s->buf;
+        s->end = s->buf + ret;
+        s->cur = *s->ptr++;
     }
     return s->cur;
 }
 
-STATIC mp_obj_t mod_ujson_load(mp_obj_t stream_obj) {
+static inline byte ujson_stream_next(ujson_stream_t *s) {
+    if (s->ptr < s->end) {
+        s->cur = *s->ptr++;
+        return s->cur;
+    }
+    return ujson_stream_fill(s);
+}
+
+STATIC void ujson_stream_init(ujson_stream_t *s, mp_obj_t stream_obj, byte *buf, size_t buf_size) {
     const mp_stream_p_t *stream_p = mp_get_stream_raise(stream_obj, MP_STREAM_OP_READ);
-    ujson_stream_t s = {stream_obj, stream_p->read, 0, 0};
+    s->stream_obj = stream_obj;
+    s->read = stream_p->read;
+    s->errcode = 0;
+    s->cur = S_EOF;
+    s->ptr = NULL;
+    s->end = NULL;
+    s->buf = buf;
+    s->buf_size = buf_size;
+}
+
+// Parse one JSON value from the stream, which must have its first character
+// loaded in cur.  If whole is true then the value must make up the rest of the
+// input.  Otherwise parsing stops right after the value, and if there is no
+// more input then MP_OBJ_STOP_ITERATION is returned.
+STATIC mp_obj_t ujson_parse(ujson_stream_t *s, bool whole) {
     vstr_t vstr;
     vstr_init(&vstr, 8);
     mp_obj_list_t stack; // we use a list as a simple stack for nested JSON
@@ -91,15 +127,26 @@ STATIC mp_obj_t mod_ujson_load(mp_obj_t stream_obj) {
     mp_obj_t stack_top = MP_OBJ_NULL;
     mp_obj_type_t *stack_top_type = NULL;
     mp_obj_t stack_key = MP_OBJ_NULL;
-    S_NEXT(s);
     for (;;) {
         cont:
         if (S_END(s)) {
-            break;
+            if (!whole && stack_top == MP_OBJ_NULL) {
+                vstr_clear(&vstr);
+                return MP_OBJ_STOP_ITERATION;
+            }
+            // no value, or input ended inside a compound object
+            goto fail;
         }
         mp_obj_t next = MP_OBJ_NULL;
         bool enter = false;
         byte cur = S_CUR(s);
+        if ((cur == ']' || cur == '}') && stack_top != MP_OBJ_NULL && stack.len == 0) {
+            // finished; compound object
+            // don't read ahead past the closing bracket, so that parsing a value
+            // from a stream doesn't wait for input belonging to the next value
+            s->cur = ' ';
+            goto success;
+        }
         S_NEXT(s);
         switch (cur) {
             case ',':
@@ -206,10 +253,6 @@ STATIC mp_obj_t mod_ujson_load(mp_obj_t stream_obj) {
                     // no object at all
                     goto fail;
                 }
-                if (stack.len == 0) {
-                    // finished; compound object
-                    goto success;
-                }
                 stack.len -= 1;
                 stack_top = stack.items[stack.len];
                 stack_top_type = mp_obj_get_type(stack_top);
@@ -253,13 +296,15 @@ STATIC mp_obj_t mod_ujson_load(mp_obj_t stream_obj) {
         }
     }
     success:
-    // eat trailing whitespace
-    while (unichar_isspace(S_CUR(s))) {
-        S_NEXT(s);
-    }
-    if (!S_END(s)) {
-        // unexpected chars
-        goto fail;
+    if (whole) {
+        // eat trailing whitespace
+        while (unichar_isspace(S_CUR(s))) {
+            S_NEXT(s);
+        }
+        if (!S_END(s)) {
+            // unexpected chars
+            goto fail;
+        }
     }
     if (stack_top == MP_OBJ_NULL || stack.len != 0) {
         // not exactly 1 object
@@ -271,22 +316,66 @@ STATIC mp_obj_t mod_ujson_load(mp_obj_t stream_obj) {
     fail:
     nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "syntax error in JSON"));
 }
+
+STATIC mp_obj_t mod_ujson_load(mp_obj_t stream_obj) {
+    byte buf[MICROPY_PY_UJSON_READ_BUF_SIZE];
+    ujson_stream_t s;
+    ujson_stream_init(&s, stream_obj, buf, sizeof(buf));
+    S_NEXT(&s);
+    return ujson_parse(&s, true);
+}
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_ujson_load_obj, mod_ujson_load);
 
 STATIC mp_obj_t mod_ujson_loads(mp_obj_t obj) {
     size_t len;
     const char *buf = mp_obj_str_get_data(obj, &len);
-    vstr_t vstr = {len, len, (char*)buf, true};
-    mp_obj_stringio_t sio = {{&mp_type_stringio}, &vstr, 0};
-    return mod_ujson_load(MP_OBJ_FROM_PTR(&sio));
+    // parse straight from the str/bytes data, there is no stream to refill from
+    ujson_stream_t s = {MP_OBJ_NULL, NULL, 0, 0, (const byte*)buf, (const byte*)buf + len, NULL, 0};
+    S_NEXT(&s);
+    return ujson_parse(&s, true);
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_ujson_loads_obj, mod_ujson_loads);
 
+// iterload(stream) returns an iterator over a stream of concatenated, or
+// whitespace/newline separated, JSON values.  The read buffer and lookahead
+// character are kept between values so each value is parsed exactly once.
+
+typedef struct _mp_obj_ujson_iter_t {
+    mp_obj_base_t base;
+    ujson_stream_t s;
+    byte buf[];
+} mp_obj_ujson_iter_t;
+
+STATIC mp_obj_t ujson_iter_iternext(mp_obj_t self_in) {
+    mp_obj_ujson_iter_t *self = MP_OBJ_TO_PTR(self_in);
+    if (S_END(&self->s)) {
+        // first call, or at the end of the input so far: load the lookahead
+        S_NEXT(&self->s);
+    }
+    return ujson_parse(&self->s, false);
+}
+
+STATIC const mp_obj_type_t ujson_iter_type = {
+    { &mp_type_type },
+    .name = MP_QSTR_iterator,
+    .getiter = mp_identity_getiter,
+    .iternext = ujson_iter_iternext,
+};
+
+STATIC mp_obj_t mod_ujson_iterload(mp_obj_t stream_obj) {
+    mp_obj_ujson_iter_t *o = m_new_obj_var(mp_obj_ujson_iter_t, byte, MICROPY_PY_UJSON_READ_BUF_SIZE);
+    o->base.type = &ujson_iter_type;
+    ujson_stream_init(&o->s, stream_obj, o->buf, MICROPY_PY_UJSON_READ_BUF_SIZE);
+    return MP_OBJ_FROM_PTR(o);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_ujson_iterload_obj, mod_ujson_iterload);
+
 STATIC const mp_rom_map_elem_t mp_module_ujson_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR_ujson) },
     { MP_ROM_QSTR(MP_QSTR_dumps), MP_ROM_PTR(&mod_ujson_dumps_obj) },
     { MP_ROM_QSTR(MP_QSTR_load), MP_ROM_PTR(&mod_ujson_load_obj) },
     { MP_ROM_QSTR(MP_QSTR_loads), MP_ROM_PTR(&mod_ujson_loads_obj) },
+    { MP_ROM_QSTR(MP_QSTR_iterload), MP_ROM_PTR(&mod_ujson_iterload_obj) },
 };
 
 STATIC MP_DEFINE_CONST_DICT(mp_module_ujson_globals, mp_module_ujson_globals_table);
@@ -37,9 +37,12 @@
 #include "re1.5/re1.5.h"
 
 #define FLAG_DEBUG 0x1000
+#define FLAG_BACKTRACK 0x2000
+#define FLAG_PIKEVM 0x4000
 
 typedef struct _mp_obj_re_t {
     mp_obj_base_t base;
+    bool use_pikevm;
     ByteProg re;
 } mp_obj_re_t;
 
@@ -92,6 +95,25 @@ STATIC void re_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t
     mp_printf(print, "<re %p>", self);
 }
 
+// Run the compiled program over subj with the engine selected for it.
+STATIC int re_exec_prog(mp_obj_re_t *self, Subject *subj, const char **caps, int caps_num, bool is_anchored) {
+    #if MICROPY_PY_URE_PIKEVM
+    if (self->use_pikevm) {
+        // small programs get their thread lists on the C stack
+        size_t work_size = re1_5_pikevm_worksize(&self->re, caps_num);
+        if (work_size <= 128 * sizeof(void*)) {
+            void *work[128];
+            return re1_5_pikevm(&self->re, subj, caps, caps_num, is_anchored, work);
+        }
+        void *work = m_new(byte, work_size);
+        int res = re1_5_pikevm(&self->re, subj, caps, caps_num, is_anchored, work);
+        m_del(byte, work, work_size);
+        return res;
+    }
+    #endif
+    return re1_5_recursiveloopprog(&self->re, subj, caps, caps_num, is_anchored);
+}
+
 STATIC mp_obj_t ure_exec(bool is_anchored, uint n_args, const mp_obj_t *args) {
     (void)n_args;
     mp_obj_re_t *self = MP_OBJ_TO_PTR(args[0]);
@@ -103,7 +125,7 @@ STATIC mp_obj_t ure_exec(bool is_anchored, uint n_args, const mp_obj_t *args) {
     mp_obj_match_t *match = m_new_obj_var(mp_obj_match_t, char*, caps_num);
     // cast is a workaround for a bug in msvc: it treats const char** as a const pointer instead of a pointer to pointer to const char
     memset((char*)match->caps, 0, caps_num * sizeof(char*));
-    int res = re1_5_recursiveloopprog(&self->re, &subj, match->caps, caps_num, is_anchored);
+    int res = re_exec_prog(self, &subj, match->caps, caps_num, is_anchored);
     if (res == 0) {
         m_del_var(mp_obj_match_t, char*, caps_num, match);
         return mp_const_none;
@@ -143,7 +165,7 @@ STATIC mp_obj_t re_split(size_t n_args, const mp_obj_t *args) {
     while (true) {
         // cast is a workaround for a bug in msvc: it treats const char** as a const pointer instead of a pointer to pointer to const char
         memset((char**)caps, 0, caps_num * sizeof(char*));
-        int res = re1_5_recursiveloopprog(&self->re, &subj, caps, caps_num, false);
+        int res = re_exec_prog(self, &subj, caps, caps_num, false);
 
         // if we didn't have a match, or had an empty match, it's time to stop
         if (!res || caps[0] == caps[1]) {
@@ -182,18 +204,45 @@ STATIC const mp_obj_type_t re_type = {
     .locals_dict = (void*)&re_locals_dict,
 };
 
-STATIC mp_obj_t mod_re_compile(size_t n_args, const mp_obj_t *args) {
-    const char *re_str = mp_obj_str_get_str(args[0]);
+#if MICROPY_PY_URE_PIKEVM
+// The backtracking engine is faster on simple patterns, but is exponential
+// (and recurses per subject char) once the program branches, so branching
+// programs go to the Pike VM.
+STATIC bool re_prog_branches(ByteProg *prog) {
+    const char *pc = prog->insts + NON_ANCHORED_PREFIX;
+    const char *top = prog->insts + prog->bytelen;
+    while (pc < top) {
+        switch (*pc) {
+            case Split:
+            case RSplit:
+                return true;
+            case Class:
+            case ClassNot:
+                pc += (unsigned char)pc[1] * 2 + 2;
+                break;
+            case Char:
+            case NamedClass:
+            case Jmp:
+            case Save:
+                pc += 2;
+                break;
+            default:
+                pc += 1;
+                break;
+        }
+    }
+    return false;
+}
+#endif
+
+STATIC mp_obj_t re_compile(mp_obj_t re_in, int flags) {
+    const char *re_str = mp_obj_str_get_str(re_in);
     int size = re1_5_sizecode(re_str);
     if (size == -1) {
         goto error;
     }
     mp_obj_re_t *o = m_new_obj_var(mp_obj_re_t, char, size);
     o->base.type = &re_type;
-    int flags = 0;
-    if (n_args > 1) {
-        flags = mp_obj_get_int(args[1]);
-    }
     int error = re1_5_compilecode(&o->re, re_str);
     if (error != 0) {
 error:
@@ -202,13 +251,66 @@ error:
     if (flags & FLAG_DEBUG) {
         re1_5_dumpcode(&o->re);
     }
+    #if MICROPY_PY_URE_PIKEVM
+    if (flags & FLAG_PIKEVM) {
+        o->use_pikevm = true;
+    } else if (flags & FLAG_BACKTRACK) {
+        o->use_pikevm = false;
+    } else {
+        o->use_pikevm = re_prog_branches(&o->re);
+    }
+    #else
+    o->use_pikevm = false;
+    #endif
     return MP_OBJ_FROM_PTR(o);
 }
+
+// Compile with default flags, going through the cache of recently compiled
+// patterns if it is enabled.
+STATIC mp_obj_t re_compile_cached(mp_obj_t re_in) {
+    #if MICROPY_PY_URE_CACHE_SIZE
+    mp_obj_t (*cache)[2] = MP_STATE_VM(ure_cache);
+    size_t i;
+    for (i = 0; i < MICROPY_PY_URE_CACHE_SIZE && cache[i][0] != MP_OBJ_NULL; i++) {
+        if (cache[i][0] == re_in || mp_obj_equal(cache[i][0], re_in)) {
+            break;
+        }
+    }
+    mp_obj_t re;
+    if (i < MICROPY_PY_URE_CACHE_SIZE && cache[i][0] != MP_OBJ_NULL) {
+        re = cache[i][1];
+    } else {
+        re = re_compile(re_in, 0);
+        if (i == MICROPY_PY_URE_CACHE_SIZE) {
+            // evict the least recently used entry
+            i -= 1;
+        }
+    }
+    // move the entry to the front
+    memmove(cache[1], cache[0], i * sizeof(cache[0]));
+    cache[0][0] = re_in;
+    cache[0][1] = re;
+    return re;
+    #else
+    return re_compile(re_in, 0);
+    #endif
+}
+
+STATIC mp_obj_t mod_re_compile(size_t n_args, const mp_obj_t *args) {
+    int flags = 0;
+    if (n_args > 1) {
+        flags = mp_obj_get_int(args[1]);
+    }
+    if (flags == 0) {
+        return re_compile_cached(args[0]);
+    }
+    return re_compile(args[0], flags);
+}
 MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_re_compile_obj, 1, 2, mod_re_compile);
 
 STATIC mp_obj_t mod_re_exec(bool is_anchored, uint n_args, const mp_obj_t *args) {
     (void)n_args;
-    mp_obj_t self = mod_re_compile(1, args);
+    mp_obj_t self = re_compile_cached(args[0]);
 
     const mp_obj_t args2[] = {self, args[1]};
     mp_obj_t match = ure_exec(is_anchored, 2, args2);
@@ -231,6 +333,10 @@ STATIC const mp_rom_map_elem_t mp_module_re_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR_match), MP_ROM_PTR(&mod_re_match_obj) },
     { MP_ROM_QSTR(MP_QSTR_search), MP_ROM_PTR(&mod_re_search_obj) },
     { MP_ROM_QSTR(MP_QSTR_DEBUG), MP_ROM_INT(FLAG_DEBUG) },
+    #if MICROPY_PY_URE_PIKEVM
+    { MP_ROM_QSTR(MP_QSTR_BACKTRACK), MP_ROM_INT(FLAG_BACKTRACK) },
+    { MP_ROM_QSTR(MP_QSTR_PIKEVM), MP_ROM_INT(FLAG_PIKEVM) },
+    #endif
 };
 
 STATIC MP_DEFINE_CONST_DICT(mp_module_re_globals, mp_module_re_globals_table);
@@ -247,6 +353,9 @@ const mp_obj_module_t mp_module_ure = {
 #include "re1.5/compilecode.c"
 #include "re1.5/dumpcode.c"
 #include "re1.5/recursiveloop.c"
+#if MICROPY_PY_URE_PIKEVM
+#include "re1.5/pikevm.c"
+#endif
 #include "re1.5/charclass.c"
 
 #endif //MICROPY_PY_URE
@@ -32,6 +32,7 @@
 #include "py/runtime0.h"
 #include "py/runtime.h"
 #include "py/smallint.h"
+#include "py/gc.h"
 
 #if MICROPY_PY_UTIMEQ
 
@@ -135,6 +136,7 @@ STATIC mp_obj_t mod_utimeq_heappush(size_t n_args, const mp_obj_t *args) {
     heap->items[l].id = utimeq_id++;
     heap->items[l].callback = args[2];
     heap->items[l].args = args[3];
+    gc_write_barrier(heap);
     heap_siftdown(heap, 0, heap->len);
     heap->len++;
     return mp_const_none;
@@ -155,6 +157,7 @@ STATIC mp_obj_t mod_utimeq_heappop(mp_obj_t heap_in, mp_obj_t list_ref) {
     ret->items[0] = MP_OBJ_NEW_SMALL_INT(item->time);
     ret->items[1] = item->callback;
     ret->items[2] = item->args;
+    gc_write_barrier(ret->items);
     heap->len -= 1;
     heap->items[0] = heap->items[heap->len];
     heap->items[heap->len].callback = MP_OBJ_NULL; // so we don't retain a pointer
@@ -8,6 +8,12 @@
     ((code ? memmove(code + at + num, code + at, pc - at) : (void)0), pc += num)
 #define REL(at, to) (to - at - 2)
 #define EMIT(at, byte) (code ? (code[at] = byte) : (void)(at))
+// jump offsets are stored in a signed byte, so fail if one doesn't fit
+#define EMIT_REL(at, rel) do { \
+        int _rel = (rel); \
+        if (_rel < -128 || _rel > 127) return NULL; \
+        EMIT(at, _rel); \
+    } while (0)
 #define PC (prog->bytelen)
 
 static const char *_compilecode(const char *re, ByteProg *prog, int sizecode)
@@ -60,6 +66,7 @@ static const char *_compilecode(const char *re, ByteProg *prog, int sizecode)
                 }
                 EMIT(PC++, *re);
             }
+            if (cnt > 255) return NULL; // too many ranges for the count byte
             EMIT(term + 1, cnt);
             break;
         }
@@ -97,7 +104,7 @@ static const char *_compilecode(const char *re, ByteProg *prog, int sizecode)
             } else {
                 EMIT(term, Split);
             }
-            EMIT(term + 1, REL(term, PC));
+            EMIT_REL(term + 1, REL(term, PC));
             prog->len++;
             term = PC;
             break;
@@ -105,7 +112,7 @@ static const char *_compilecode(const char *re, ByteProg *prog, int sizecode)
             if (PC == term) return NULL; // nothing to repeat
             INSERT_CODE(term, 2, PC);
             EMIT(PC, Jmp);
-            EMIT(PC + 1, REL(PC, term));
+            EMIT_REL(PC + 1, REL(PC, term));
             PC += 2;
             if (re[1] == '?') {
                 EMIT(term, RSplit);
@@ -113,7 +120,7 @@ static const char *_compilecode(const char *re, ByteProg *prog, int sizecode)
             } else {
                 EMIT(term, Split);
             }
-            EMIT(term + 1, REL(term, PC));
+            EMIT_REL(term + 1, REL(term, PC));
             prog->len += 2;
             term = PC;
             break;
@@ -125,20 +132,20 @@ static const char *_compilecode(const char *re, ByteProg *prog, int sizecode)
             } else {
                 EMIT(PC, RSplit);
             }
-            EMIT(PC + 1, REL(PC, term));
+            EMIT_REL(PC + 1, REL(PC, term));
             PC += 2;
             prog->len++;
             term = PC;
             break;
         case '|':
             if (alt_label) {
-                EMIT(alt_label, REL(alt_label, PC) + 1);
+                EMIT_REL(alt_label, REL(alt_label, PC) + 1);
             }
             INSERT_CODE(start, 2, PC);
             EMIT(PC++, Jmp);
             alt_label = PC++;
             EMIT(start, Split);
-            EMIT(start + 1, REL(start, PC));
+            EMIT_REL(start + 1, REL(start, PC));
             prog->len += 2;
             term = PC;
             break;
@@ -156,7 +163,7 @@ static const char *_compilecode(const char *re, ByteProg *prog, int sizecode)
     }
 
     if (alt_label) {
-        EMIT(alt_label, REL(alt_label, PC) + 1);
+        EMIT_REL(alt_label, REL(alt_label, PC) + 1);
     }
     return re;
 }
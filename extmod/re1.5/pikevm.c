@@ -0,0 +1,163 @@
+// Copyright 2007-2009 Russ Cox.  All Rights Reserved.
+// Copyright 2017 Paul Sokolovsky.
+// Use of this source code is governed by a BSD-style
+// license that can be found in the LICENSE file.
+
+#include "re1.5.h"
+
+// Pike VM: simulates all threads of the program in lock step over the
+// subject, so run time is O(len(subject) * len(program)) and C stack use is
+// bounded by the program size, independent of the subject.  Threads are
+// kept in priority order, which gives the same (leftmost-first) result as
+// the backtracking matchers.
+//
+// The caller provides a work area of re1_5_pikevm_worksize() bytes: two
+// thread lists, each with room for one thread per bytecode offset (a pc is
+// added at most once per step), followed by the per-offset step marks.
+
+typedef struct {
+	const char **clist;
+	const char **nlist;
+	int ncl, nnl;
+	int stride;
+	unsigned int *mark;
+	unsigned int step;
+	char *insts;
+	Subject *input;
+	int nsubp;
+} PikeVM;
+
+int
+re1_5_pikevm_worksize(ByteProg *prog, int nsubp)
+{
+	return prog->bytelen * (2 * (1 + nsubp) * sizeof(const char*) + sizeof(unsigned int));
+}
+
+// Add the thread at pc, following all non-consuming instructions.
+static void
+addthread(PikeVM *vm, const char **list, int *n, char *pc, const char *sp, const char **subp)
+{
+	const char *old;
+	int off;
+
+	for(;;) {
+		if(vm->mark[pc - vm->insts] == vm->step)
+			return;
+		vm->mark[pc - vm->insts] = vm->step;
+		switch(*pc) {
+		case Jmp:
+			off = (signed char)pc[1];
+			pc = pc + 2 + off;
+			continue;
+		case Split:
+			off = (signed char)pc[1];
+			addthread(vm, list, n, pc + 2, sp, subp);
+			pc = pc + 2 + off;
+			continue;
+		case RSplit:
+			off = (signed char)pc[1];
+			addthread(vm, list, n, pc + 2 + off, sp, subp);
+			pc = pc + 2;
+			continue;
+		case Save:
+			off = (unsigned char)pc[1];
+			if(off >= vm->nsubp) {
+				pc += 2;
+				continue;
+			}
+			old = subp[off];
+			subp[off] = sp;
+			addthread(vm, list, n, pc + 2, sp, subp);
+			subp[off] = old;
+			return;
+		case Bol:
+			if(sp != vm->input->begin)
+				return;
+			pc++;
+			continue;
+		case Eol:
+			if(sp != vm->input->end)
+				return;
+			pc++;
+			continue;
+		}
+		// consumer or Match: becomes a thread for the next step
+		const char **t = list + (*n)++ * vm->stride;
+		t[0] = pc;
+		memcpy((char*)(t + 1), subp, vm->nsubp * sizeof(const char*));
+		return;
+	}
+}
+
+int
+re1_5_pikevm(ByteProg *prog, Subject *input, const char **subp, int nsubp, int is_anchored, void *work)
+{
+	PikeVM vm;
+	const char **tmp;
+	const char *sp;
+	char *pc;
+	int i, matched;
+
+	vm.stride = 1 + nsubp;
+	vm.clist = work;
+	vm.nlist = vm.clist + prog->bytelen * vm.stride;
+	vm.mark = (unsigned int*)(vm.nlist + prog->bytelen * vm.stride);
+	memset(vm.mark, 0, prog->bytelen * sizeof(unsigned int));
+	vm.step = 1;
+	vm.insts = prog->insts;
+	vm.input = input;
+	vm.nsubp = nsubp;
+	vm.ncl = 0;
+	vm.nnl = 0;
+
+	// subp is used as scratch space while adding threads; it is NULL on entry
+	addthread(&vm, vm.clist, &vm.ncl, HANDLE_ANCHORED(prog->insts, is_anchored), input->begin, subp);
+	matched = 0;
+	for(sp = input->begin; vm.ncl > 0; sp++) {
+		vm.step++;
+		for(i = 0; i < vm.ncl; i++) {
+			const char **t = vm.clist + i * vm.stride;
+			pc = (char*)t[0];
+			if(inst_is_consumer(*pc)) {
+				if(sp >= input->end)
+					continue;
+			}
+			switch(*pc++) {
+			case Char:
+				if(*sp != *pc++)
+					continue;
+				break;
+			case Any:
+				break;
+			case Class:
+			case ClassNot:
+				if(!_re1_5_classmatch(pc, sp))
+					continue;
+				pc += *(unsigned char*)pc * 2 + 1;
+				break;
+			case NamedClass:
+				if(!_re1_5_namedclassmatch(pc, sp))
+					continue;
+				pc++;
+				break;
+			case Match:
+				// record the match and cut off all lower priority threads
+				memcpy((char*)subp, t + 1, nsubp * sizeof(const char*));
+				matched = 1;
+				goto cut;
+			default:
+				re1_5_fatal("pikevm");
+			}
+			addthread(&vm, vm.nlist, &vm.nnl, pc, sp + 1, (const char**)(t + 1));
+		}
+	cut:
+		if(sp >= input->end)
+			break;
+		tmp = vm.clist;
+		vm.clist = vm.nlist;
+		vm.nlist = tmp;
+		vm.ncl = vm.nnl;
+		vm.nnl = 0;
+	}
+	return matched;
+}
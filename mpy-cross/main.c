@@ -106,11 +106,16 @@ STATIC int usage(char **argv) {
 "-s : source filename to embed in the compiled bytecode (defaults to input file)\n"
 "-v : verbose (trace various operations); can be multiple\n"
 "-O[N] : apply bytecode optimizations of level N\n"
+"-fpeephole : run the bytecode peephole pass (the default)\n"
+"-fno-peephole : don't run the bytecode peephole pass\n"
 "\n"
 "Target specific options:\n"
 "-msmall-int-bits=number : set the maximum bits used to encode a small-int\n"
 "-mno-unicode : don't support unicode in compiled strings\n"
 "-mcache-lookup-bc : cache map lookups in the bytecode\n"
+"-march=<arch> : set architecture for native emitter; x64\n"
+"-mcode-state-words=number : set the size in words of mp_code_state_t (default 6)\n"
+"-mnlr-buf-words=number : set the size in words of nlr_buf_t (default 11)\n"
 "\n"
 "Implementation specific options:\n", argv[0]
 );
@@ -195,6 +200,15 @@ MP_NOINLINE int main_(int argc, char **argv) {
     mp_dynamic_compiler.small_int_bits = 31;
     mp_dynamic_compiler.opt_cache_map_lookup_in_bytecode = 0;
     mp_dynamic_compiler.py_builtins_str_unicode = 1;
+    mp_dynamic_compiler.native_arch = MP_NATIVE_ARCH_NONE;
+    // native code accesses these structures directly, so their sizes must match
+    // the target; the defaults are for the unix port on x64:
+    // - mp_code_state_t is 5 words, plus 1 with MICROPY_STACKLESS and 1 with
+    //   MICROPY_VM_SAMPLING
+    // - nlr_buf_t is 2 words plus 8 saved registers, plus 1 with
+    //   MICROPY_ENABLE_PYSTACK
+    mp_dynamic_compiler.native_code_state_words = 6;
+    mp_dynamic_compiler.native_nlr_buf_words = 11;
 
     const char *input_file = NULL;
     const char *output_file = NULL;
@@ -214,6 +228,10 @@ MP_NOINLINE int main_(int argc, char **argv) {
                     MP_STATE_VM(mp_optimise_value) = 0;
                     for (char *p = argv[a] + 1; *p && *p == 'O'; p++, MP_STATE_VM(mp_optimise_value)++);
                 }
+            } else if (strcmp(argv[a], "-fno-peephole") == 0) {
+                MP_STATE_VM(mp_bc_peephole) = false;
+            } else if (strcmp(argv[a], "-fpeephole") == 0) {
+                MP_STATE_VM(mp_bc_peephole) = true;
             } else if (strcmp(argv[a], "-o") == 0) {
                 if (a + 1 >= argc) {
                     exit(usage(argv));
@@ -242,6 +260,28 @@ MP_NOINLINE int main_(int argc, char **argv) {
                 mp_dynamic_compiler.py_builtins_str_unicode = 0;
             } else if (strcmp(argv[a], "-municode") == 0) {
                 mp_dynamic_compiler.py_builtins_str_unicode = 1;
+            } else if (strncmp(argv[a], "-mcode-state-words=", sizeof("-mcode-state-words=") - 1) == 0) {
+                char *end;
+                long words = strtol(argv[a] + sizeof("-mcode-state-words=") - 1, &end, 0);
+                if (*end || words <= 0 || words > 255) {
+                    return usage(argv);
+                }
+                mp_dynamic_compiler.native_code_state_words = words;
+            } else if (strncmp(argv[a], "-mnlr-buf-words=", sizeof("-mnlr-buf-words=") - 1) == 0) {
+                char *end;
+                long words = strtol(argv[a] + sizeof("-mnlr-buf-words=") - 1, &end, 0);
+                if (*end || words <= 0 || words > 255) {
+                    return usage(argv);
+                }
+                mp_dynamic_compiler.native_nlr_buf_words = words;
+            } else if (strncmp(argv[a], "-march=", sizeof("-march=") - 1) == 0) {
+                const char *arch = argv[a] + sizeof("-march=") - 1;
+                if (strcmp(arch, "x64") == 0) {
+                    mp_dynamic_compiler.native_arch = MP_NATIVE_ARCH_X64;
+                } else {
+                    mp_printf(&mp_stderr_print, "unrecognised arch\n");
+                    exit(1);
+                }
             } else {
                 return usage(argv);
             }
@@ -259,6 +299,12 @@ MP_NOINLINE int main_(int argc, char **argv) {
         exit(1);
     }
 
+    if ((emit_opt == MP_EMIT_OPT_NATIVE_PYTHON || emit_opt == MP_EMIT_OPT_VIPER)
+        && mp_dynamic_compiler.native_arch == MP_NATIVE_ARCH_NONE) {
+        mp_printf(&mp_stderr_print, "native emitter needs -march\n");
+        exit(1);
+    }
+
     int ret = compile_and_save(input_file, output_file, source_file);
 
     #if MICROPY_PY_MICROPYTHON_MEM_INFO
@@ -72,8 +72,38 @@ void mp_arg_check_num(size_t n_args, size_t n_kw, size_t n_args_min, size_t n_ar
     }
 }
 
+#if MICROPY_OPT_KW_CALL_CACHE
+// For keyword args given as a fixed table (the (name, value) pairs of a call)
+// return the index in allowed of each of them, or 0xff if there is none.
+STATIC const uint8_t *arg_parse_kw_slots(size_t n_pos, mp_map_t *kws, size_t n_allowed, const mp_arg_t *allowed, uint8_t *slots) {
+    if (!kws->is_fixed || kws->used == 0 || n_allowed >= 0xff) {
+        return NULL;
+    }
+    const mp_obj_t *kw = (const mp_obj_t*)kws->table;
+    const uint8_t *cached = mp_kw_cache_lookup(allowed, n_pos, kws->used, kw);
+    if (cached != NULL || kws->used > MICROPY_OPT_KW_CALL_CACHE_MAX_KW) {
+        return cached;
+    }
+    for (size_t k = 0; k < kws->used; k++) {
+        slots[k] = 0xff;
+        for (size_t i = 0; i < n_allowed; i++) {
+            if (kws->table[k].key == MP_OBJ_NEW_QSTR(allowed[i].qst)) {
+                slots[k] = i;
+                break;
+            }
+        }
+    }
+    mp_kw_cache_store(allowed, n_pos, kws->used, kw, slots);
+    return slots;
+}
+#endif
+
 void mp_arg_parse_all(size_t n_pos, const mp_obj_t *pos, mp_map_t *kws, size_t n_allowed, const mp_arg_t *allowed, mp_arg_val_t *out_vals) {
     size_t pos_found = 0, kws_found = 0;
+    #if MICROPY_OPT_KW_CALL_CACHE
+    uint8_t new_kw_slots[MICROPY_OPT_KW_CALL_CACHE_MAX_KW];
+    const uint8_t *kw_slots = arg_parse_kw_slots(n_pos, kws, n_allowed, allowed, new_kw_slots);
+    #endif
     for (size_t i = 0; i < n_allowed; i++) {
         mp_obj_t given_arg;
         if (i < n_pos) {
@@ -83,7 +113,20 @@ void mp_arg_parse_all(size_t n_pos, const mp_obj_t *pos, mp_map_t *kws, size_t n
             pos_found++;
             given_arg = pos[i];
         } else {
-            mp_map_elem_t *kw = mp_map_lookup(kws, MP_OBJ_NEW_QSTR(allowed[i].qst), MP_MAP_LOOKUP);
+            mp_map_elem_t *kw = NULL;
+            #if MICROPY_OPT_KW_CALL_CACHE
+            if (kw_slots != NULL) {
+                for (size_t k = 0; k < kws->used; k++) {
+                    if (kw_slots[k] == i) {
+                        kw = &kws->table[k];
+                        break;
+                    }
+                }
+            } else
+            #endif
+            {
+                kw = mp_map_lookup(kws, MP_OBJ_NEW_QSTR(allowed[i].qst), MP_MAP_LOOKUP);
+            }
             if (kw == NULL) {
                 if (allowed[i].flags & MP_ARG_REQUIRED) {
                     if (MICROPY_ERROR_REPORTING == MICROPY_ERROR_REPORTING_TERSE) {
@@ -84,6 +84,24 @@
 #define OPCODE_CALL_RM32         (0xff) /* /2 */
 #define OPCODE_LEAVE             (0xc9)
 
+// SSE2 opcodes, all following a 0x0f escape byte
+#define OPCODE_SSE_PREFIX_66     (0x66)
+#define OPCODE_SSE_PREFIX_F2     (0xf2)
+#define OPCODE_SSE_PREFIX_F3     (0xf3)
+#define OPCODE_MOVSD_M64_TO_X    (0x10) /* 0xf2 0x0f 0x10 /r */
+#define OPCODE_MOVSD_X_TO_M64    (0x11) /* 0xf2 0x0f 0x11 /r */
+#define OPCODE_MOVSS_X_TO_M32    (0x11) /* 0xf3 0x0f 0x11 /r */
+#define OPCODE_CVTSI2SD_R64_TO_X (0x2a) /* 0xf2 REX.W 0x0f 0x2a /r */
+#define OPCODE_CVTTSD2SI_X_TO_R64 (0x2c) /* 0xf2 REX.W 0x0f 0x2c /r */
+#define OPCODE_UCOMISD_X_WITH_X  (0x2e) /* 0x66 0x0f 0x2e /r */
+#define OPCODE_ADDSD_X_TO_X      (0x58) /* 0xf2 0x0f 0x58 /r */
+#define OPCODE_MULSD_X_TO_X      (0x59) /* 0xf2 0x0f 0x59 /r */
+#define OPCODE_CVTSD_X_TO_X      (0x5a) /* 0xf2 (sd2ss) or 0xf3 (ss2sd) 0x0f 0x5a /r */
+#define OPCODE_SUBSD_X_FROM_X    (0x5c) /* 0xf2 0x0f 0x5c /r */
+#define OPCODE_DIVSD_X_BY_X      (0x5e) /* 0xf2 0x0f 0x5e /r */
+#define OPCODE_MOVQ_R64_TO_X     (0x6e) /* 0x66 REX.W 0x0f 0x6e /r */
+#define OPCODE_MOVQ_X_TO_R64     (0x7e) /* 0x66 REX.W 0x0f 0x7e /r */
+
 #define MODRM_R64(x)    (((x) & 0x7) << 3)
 #define MODRM_RM_DISP0  (0x00)
 #define MODRM_RM_DISP8  (0x40)
@@ -184,13 +202,17 @@ STATIC void asm_x64_write_r64_disp(asm_x64_t *as, int r64, int disp_r64, int dis
     assert(disp_r64 != ASM_X64_REG_RSP);
 
     if (disp_r64 == ASM_X64_REG_R12) {
-        // special case for r12; not fully implemented
-        assert(SIGNED_FIT8(disp_offset));
-        asm_x64_write_byte_3(as, MODRM_R64(r64) | MODRM_RM_DISP8 | MODRM_RM_R64(disp_r64), 0x24, IMM32_L0(disp_offset));
+        // special case for r12, which needs a SIB byte
+        if (SIGNED_FIT8(disp_offset)) {
+            asm_x64_write_byte_3(as, MODRM_R64(r64) | MODRM_RM_DISP8 | MODRM_RM_R64(disp_r64), 0x24, IMM32_L0(disp_offset));
+        } else {
+            asm_x64_write_byte_2(as, MODRM_R64(r64) | MODRM_RM_DISP32 | MODRM_RM_R64(disp_r64), 0x24);
+            asm_x64_write_word32(as, disp_offset);
+        }
         return;
     }
 
-    if (disp_offset == 0 && disp_r64 != ASM_X64_REG_RBP) {
+    if (disp_offset == 0 && (disp_r64 & 7) != ASM_X64_REG_RBP) {
         asm_x64_write_byte_1(as, MODRM_R64(r64) | MODRM_RM_DISP0 | MODRM_RM_R64(disp_r64));
     } else if (SIGNED_FIT8(disp_offset)) {
         asm_x64_write_byte_2(as, MODRM_R64(r64) | MODRM_RM_DISP8 | MODRM_RM_R64(disp_r64), IMM32_L0(disp_offset));
@@ -248,7 +270,8 @@ void asm_x64_mov_r64_r64(asm_x64_t *as, int dest_r64, int src_r64) {
 }
 
 void asm_x64_mov_r8_to_mem8(asm_x64_t *as, int src_r64, int dest_r64, int dest_disp) {
-    if (src_r64 < 8 && dest_r64 < 8) {
+    // without a REX prefix registers 4-7 would select AH, CH, DH and BH
+    if (src_r64 < 4 && dest_r64 < 8) {
         asm_x64_write_byte_1(as, OPCODE_MOV_R8_TO_RM8);
     } else {
         asm_x64_write_byte_2(as, REX_PREFIX | REX_R_FROM_R64(src_r64) | REX_B_FROM_R64(dest_r64), OPCODE_MOV_R8_TO_RM8);
@@ -281,31 +304,28 @@ void asm_x64_mov_r64_to_mem64(asm_x64_t *as, int src_r64, int dest_r64, int dest
 }
 
 void asm_x64_mov_mem8_to_r64zx(asm_x64_t *as, int src_r64, int src_disp, int dest_r64) {
-    assert(src_r64 < 8);
-    if (dest_r64 < 8) {
+    if (src_r64 < 8 && dest_r64 < 8) {
         asm_x64_write_byte_2(as, 0x0f, OPCODE_MOVZX_RM8_TO_R64);
     } else {
-        asm_x64_write_byte_3(as, REX_PREFIX | REX_R, 0x0f, OPCODE_MOVZX_RM8_TO_R64);
+        asm_x64_write_byte_3(as, REX_PREFIX | REX_R_FROM_R64(dest_r64) | REX_B_FROM_R64(src_r64), 0x0f, OPCODE_MOVZX_RM8_TO_R64);
     }
     asm_x64_write_r64_disp(as, dest_r64, src_r64, src_disp);
 }
 
 void asm_x64_mov_mem16_to_r64zx(asm_x64_t *as, int src_r64, int src_disp, int dest_r64) {
-    assert(src_r64 < 8);
-    if (dest_r64 < 8) {
+    if (src_r64 < 8 && dest_r64 < 8) {
         asm_x64_write_byte_2(as, 0x0f, OPCODE_MOVZX_RM16_TO_R64);
     } else {
-        asm_x64_write_byte_3(as, REX_PREFIX | REX_R, 0x0f, OPCODE_MOVZX_RM16_TO_R64);
+        asm_x64_write_byte_3(as, REX_PREFIX | REX_R_FROM_R64(dest_r64) | REX_B_FROM_R64(src_r64), 0x0f, OPCODE_MOVZX_RM16_TO_R64);
     }
     asm_x64_write_r64_disp(as, dest_r64, src_r64, src_disp);
 }
 
 void asm_x64_mov_mem32_to_r64zx(asm_x64_t *as, int src_r64, int src_disp, int dest_r64) {
-    assert(src_r64 < 8);
-    if (dest_r64 < 8) {
+    if (src_r64 < 8 && dest_r64 < 8) {
         asm_x64_write_byte_1(as, OPCODE_MOV_RM64_TO_R64);
     } else {
-        asm_x64_write_byte_2(as, REX_PREFIX | REX_R, OPCODE_MOV_RM64_TO_R64);
+        asm_x64_write_byte_2(as, REX_PREFIX | REX_R_FROM_R64(dest_r64) | REX_B_FROM_R64(src_r64), OPCODE_MOV_RM64_TO_R64);
     }
     asm_x64_write_r64_disp(as, dest_r64, src_r64, src_disp);
 }
@@ -344,8 +364,7 @@ STATIC void asm_x64_mov_i32_to_r64(asm_x64_t *as, int src_i32, int dest_r64) {
 void asm_x64_mov_i64_to_r64(asm_x64_t *as, int64_t src_i64, int dest_r64) {
     // cpu defaults to i32 to r64
     // to mov i64 to r64 need to use REX prefix
-    assert(dest_r64 < 8);
-    asm_x64_write_byte_2(as, REX_PREFIX | REX_W, OPCODE_MOV_I64_TO_R64 | dest_r64);
+    asm_x64_write_byte_2(as, REX_PREFIX | REX_W | REX_B_FROM_R64(dest_r64), OPCODE_MOV_I64_TO_R64 | (dest_r64 & 7));
     asm_x64_write_word64(as, src_i64);
 }
 
@@ -475,6 +494,83 @@ void asm_x64_setcc_r8(asm_x64_t *as, int jcc_type, int dest_r8) {
     asm_x64_write_byte_3(as, OPCODE_SETCC_RM8_A, OPCODE_SETCC_RM8_B | jcc_type, MODRM_R64(0) | MODRM_RM_REG | MODRM_RM_R64(dest_r8));
 }
 
+// SSE2 instructions are encoded as: mandatory prefix, optional REX, 0x0f, opcode, modrm
+STATIC void asm_x64_write_sse_op(asm_x64_t *as, int prefix, int rex, int op) {
+    if (rex == 0) {
+        asm_x64_write_byte_3(as, prefix, 0x0f, op);
+    } else {
+        asm_x64_write_byte_2(as, prefix, REX_PREFIX | rex);
+        asm_x64_write_byte_2(as, 0x0f, op);
+    }
+}
+
+STATIC void asm_x64_sse_r_r(asm_x64_t *as, int prefix, int rex_w, int op, int reg, int rm) {
+    asm_x64_write_sse_op(as, prefix, rex_w | REX_R_FROM_R64(reg) | REX_B_FROM_R64(rm), op);
+    asm_x64_write_byte_1(as, MODRM_R64(reg) | MODRM_RM_REG | MODRM_RM_R64(rm));
+}
+
+STATIC void asm_x64_sse_r_disp(asm_x64_t *as, int prefix, int op, int reg, int disp_r64, int disp_offset) {
+    asm_x64_write_sse_op(as, prefix, REX_R_FROM_R64(reg) | REX_B_FROM_R64(disp_r64), op);
+    asm_x64_write_r64_disp(as, reg, disp_r64, disp_offset);
+}
+
+void asm_x64_movq_r64_to_xmm(asm_x64_t *as, int dest_xmm, int src_r64) {
+    asm_x64_sse_r_r(as, OPCODE_SSE_PREFIX_66, REX_W, OPCODE_MOVQ_R64_TO_X, dest_xmm, src_r64);
+}
+
+void asm_x64_movq_xmm_to_r64(asm_x64_t *as, int dest_r64, int src_xmm) {
+    asm_x64_sse_r_r(as, OPCODE_SSE_PREFIX_66, REX_W, OPCODE_MOVQ_X_TO_R64, src_xmm, dest_r64);
+}
+
+void asm_x64_movsd_mem64_to_xmm(asm_x64_t *as, int src_r64, int src_disp, int dest_xmm) {
+    asm_x64_sse_r_disp(as, OPCODE_SSE_PREFIX_F2, OPCODE_MOVSD_M64_TO_X, dest_xmm, src_r64, src_disp);
+}
+
+void asm_x64_movsd_xmm_to_mem64(asm_x64_t *as, int src_xmm, int dest_r64, int dest_disp) {
+    asm_x64_sse_r_disp(as, OPCODE_SSE_PREFIX_F2, OPCODE_MOVSD_X_TO_M64, src_xmm, dest_r64, dest_disp);
+}
+
+void asm_x64_movss_xmm_to_mem32(asm_x64_t *as, int src_xmm, int dest_r64, int dest_disp) {
+    asm_x64_sse_r_disp(as, OPCODE_SSE_PREFIX_F3, OPCODE_MOVSS_X_TO_M32, src_xmm, dest_r64, dest_disp);
+}
+
+void asm_x64_cvtss2sd_mem32_to_xmm(asm_x64_t *as, int src_r64, int src_disp, int dest_xmm) {
+    asm_x64_sse_r_disp(as, OPCODE_SSE_PREFIX_F3, OPCODE_CVTSD_X_TO_X, dest_xmm, src_r64, src_disp);
+}
+
+void asm_x64_cvtsd2ss_xmm_xmm(asm_x64_t *as, int dest_xmm, int src_xmm) {
+    asm_x64_sse_r_r(as, OPCODE_SSE_PREFIX_F2, 0, OPCODE_CVTSD_X_TO_X, dest_xmm, src_xmm);
+}
+
+void asm_x64_cvtsi2sd_r64_to_xmm(asm_x64_t *as, int dest_xmm, int src_r64) {
+    asm_x64_sse_r_r(as, OPCODE_SSE_PREFIX_F2, REX_W, OPCODE_CVTSI2SD_R64_TO_X, dest_xmm, src_r64);
+}
+
+void asm_x64_cvttsd2si_xmm_to_r64(asm_x64_t *as, int dest_r64, int src_xmm) {
+    asm_x64_sse_r_r(as, OPCODE_SSE_PREFIX_F2, REX_W, OPCODE_CVTTSD2SI_X_TO_R64, dest_r64, src_xmm);
+}
+
+void asm_x64_addsd_xmm_xmm(asm_x64_t *as, int dest_xmm, int src_xmm) {
+    asm_x64_sse_r_r(as, OPCODE_SSE_PREFIX_F2, 0, OPCODE_ADDSD_X_TO_X, dest_xmm, src_xmm);
+}
+
+void asm_x64_subsd_xmm_xmm(asm_x64_t *as, int dest_xmm, int src_xmm) {
+    asm_x64_sse_r_r(as, OPCODE_SSE_PREFIX_F2, 0, OPCODE_SUBSD_X_FROM_X, dest_xmm, src_xmm);
+}
+
+void asm_x64_mulsd_xmm_xmm(asm_x64_t *as, int dest_xmm, int src_xmm) {
+    asm_x64_sse_r_r(as, OPCODE_SSE_PREFIX_F2, 0, OPCODE_MULSD_X_TO_X, dest_xmm, src_xmm);
+}
+
+void asm_x64_divsd_xmm_xmm(asm_x64_t *as, int dest_xmm, int src_xmm) {
+    asm_x64_sse_r_r(as, OPCODE_SSE_PREFIX_F2, 0, OPCODE_DIVSD_X_BY_X, dest_xmm, src_xmm);
+}
+
+// sets the flags as an unsigned comparison of a with b; unordered sets ZF, PF and CF
+void asm_x64_ucomisd_xmm_with_xmm(asm_x64_t *as, int src_xmm_a, int src_xmm_b) {
+    asm_x64_sse_r_r(as, OPCODE_SSE_PREFIX_66, 0, OPCODE_UCOMISD_X_WITH_X, src_xmm_a, src_xmm_b);
+}
+
 STATIC mp_uint_t get_label_dest(asm_x64_t *as, mp_uint_t label) {
     assert(label < as->base.max_num_labels);
     return as->base.label_offsets[label];
@@ -535,10 +631,14 @@ void asm_x64_entry(asm_x64_t *as, int num_locals) {
     asm_x64_push_r64(as, ASM_X64_REG_RBX);
     asm_x64_push_r64(as, ASM_X64_REG_R12);
     asm_x64_push_r64(as, ASM_X64_REG_R13);
+    asm_x64_push_r64(as, ASM_X64_REG_R14);
+    asm_x64_push_r64(as, ASM_X64_REG_R15);
     as->num_locals = num_locals;
 }
 
 void asm_x64_exit(asm_x64_t *as) {
+    asm_x64_pop_r64(as, ASM_X64_REG_R15);
+    asm_x64_pop_r64(as, ASM_X64_REG_R14);
     asm_x64_pop_r64(as, ASM_X64_REG_R13);
     asm_x64_pop_r64(as, ASM_X64_REG_R12);
     asm_x64_pop_r64(as, ASM_X64_REG_RBX);
@@ -611,6 +711,11 @@ void asm_x64_call_i1(asm_x64_t *as, void* func, int i1) {
 }
 */
 
+void asm_x64_call_r64(asm_x64_t *as, int src_r64) {
+    assert(src_r64 < 8);
+    asm_x64_write_byte_2(as, OPCODE_CALL_RM32, MODRM_R64(2) | MODRM_RM_REG | MODRM_RM_R64(src_r64));
+}
+
 void asm_x64_call_ind(asm_x64_t *as, void *ptr, int temp_r64) {
     assert(temp_r64 < 8);
 #ifdef __LP64__
@@ -619,7 +724,7 @@ void asm_x64_call_ind(asm_x64_t *as, void *ptr, int temp_r64) {
     // If we get here, sizeof(int) == sizeof(void*).
     asm_x64_mov_i64_to_r64_optimised(as, (int64_t)(unsigned int)ptr, temp_r64);
 #endif
-    asm_x64_write_byte_2(as, OPCODE_CALL_RM32, MODRM_R64(2) | MODRM_RM_REG | MODRM_RM_R64(temp_r64));
+    asm_x64_call_r64(as, temp_r64);
     // this reduces code size by 2 bytes per call, but doesn't seem to speed it up at all
     // doesn't work anymore because calls are 64 bits away
     /*
@@ -59,12 +59,20 @@
 #define ASM_X64_REG_R14 (14)
 #define ASM_X64_REG_R15 (15)
 
+// SSE registers, only used for float arithmetic; all are caller-save
+#define ASM_X64_REG_XMM0 (0)
+#define ASM_X64_REG_XMM1 (1)
+
 // condition codes, used for jcc and setcc (despite their j-name!)
 #define ASM_X64_CC_JB  (0x2) // below, unsigned
+#define ASM_X64_CC_JAE (0x3) // above or equal, unsigned
 #define ASM_X64_CC_JZ  (0x4)
 #define ASM_X64_CC_JE  (0x4)
 #define ASM_X64_CC_JNZ (0x5)
 #define ASM_X64_CC_JNE (0x5)
+#define ASM_X64_CC_JA  (0x7) // above, unsigned
+#define ASM_X64_CC_JP  (0xa) // parity, set by an unordered float comparison
+#define ASM_X64_CC_JNP (0xb)
 #define ASM_X64_CC_JL  (0xc) // less, signed
 #define ASM_X64_CC_JGE (0xd) // greater or equal, signed
 #define ASM_X64_CC_JLE (0xe) // less or equal, signed
@@ -105,6 +113,20 @@ void asm_x64_mul_r64_r64(asm_x64_t* as, int dest_r64, int src_r64);
 void asm_x64_cmp_r64_with_r64(asm_x64_t* as, int src_r64_a, int src_r64_b);
 void asm_x64_test_r8_with_r8(asm_x64_t* as, int src_r64_a, int src_r64_b);
 void asm_x64_setcc_r8(asm_x64_t* as, int jcc_type, int dest_r8);
+void asm_x64_movq_r64_to_xmm(asm_x64_t *as, int dest_xmm, int src_r64);
+void asm_x64_movq_xmm_to_r64(asm_x64_t *as, int dest_r64, int src_xmm);
+void asm_x64_movsd_mem64_to_xmm(asm_x64_t *as, int src_r64, int src_disp, int dest_xmm);
+void asm_x64_movsd_xmm_to_mem64(asm_x64_t *as, int src_xmm, int dest_r64, int dest_disp);
+void asm_x64_movss_xmm_to_mem32(asm_x64_t *as, int src_xmm, int dest_r64, int dest_disp);
+void asm_x64_cvtss2sd_mem32_to_xmm(asm_x64_t *as, int src_r64, int src_disp, int dest_xmm);
+void asm_x64_cvtsd2ss_xmm_xmm(asm_x64_t *as, int dest_xmm, int src_xmm);
+void asm_x64_cvtsi2sd_r64_to_xmm(asm_x64_t *as, int dest_xmm, int src_r64);
+void asm_x64_cvttsd2si_xmm_to_r64(asm_x64_t *as, int dest_r64, int src_xmm);
+void asm_x64_addsd_xmm_xmm(asm_x64_t *as, int dest_xmm, int src_xmm);
+void asm_x64_subsd_xmm_xmm(asm_x64_t *as, int dest_xmm, int src_xmm);
+void asm_x64_mulsd_xmm_xmm(asm_x64_t *as, int dest_xmm, int src_xmm);
+void asm_x64_divsd_xmm_xmm(asm_x64_t *as, int dest_xmm, int src_xmm);
+void asm_x64_ucomisd_xmm_with_xmm(asm_x64_t *as, int src_xmm_a, int src_xmm_b);
 void asm_x64_jmp_label(asm_x64_t* as, mp_uint_t label);
 void asm_x64_jcc_label(asm_x64_t* as, int jcc_type, mp_uint_t label);
 void asm_x64_entry(asm_x64_t* as, int num_locals);
@@ -112,6 +134,7 @@ void asm_x64_exit(asm_x64_t* as);
 void asm_x64_mov_local_to_r64(asm_x64_t* as, int src_local_num, int dest_r64);
 void asm_x64_mov_r64_to_local(asm_x64_t* as, int src_r64, int dest_local_num);
 void asm_x64_mov_local_addr_to_r64(asm_x64_t* as, int local_num, int dest_r64);
+void asm_x64_call_r64(asm_x64_t* as, int src_r64);
 void asm_x64_call_ind(asm_x64_t* as, void* ptr, int temp_r32);
 
 #if GENERIC_ASM_API
@@ -137,7 +160,9 @@ void asm_x64_call_ind(asm_x64_t* as, void* ptr, int temp_r32);
 #define REG_LOCAL_1 ASM_X64_REG_RBX
 #define REG_LOCAL_2 ASM_X64_REG_R12
 #define REG_LOCAL_3 ASM_X64_REG_R13
-#define REG_LOCAL_NUM (3)
+#define REG_LOCAL_4 ASM_X64_REG_R14
+#define REG_LOCAL_5 ASM_X64_REG_R15
+#define REG_LOCAL_NUM (5)
 
 #define ASM_T               asm_x64_t
 #define ASM_END_PASS        asm_x64_end_pass
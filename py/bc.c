@@ -34,6 +34,7 @@
 #include "py/runtime0.h"
 #include "py/bc0.h"
 #include "py/bc.h"
+#include "py/runtime.h"
 
 #if 0 // print debugging info
 #define DEBUG_PRINT (1)
@@ -64,6 +65,35 @@ mp_uint_t mp_decode_uint_value(const byte *ptr) {
     return mp_decode_uint(&ptr);
 }
 
+// Returns the source line of the given offset into the bytecode, looking it up
+// in the line-number table of the code info, which line_info points to.
+size_t mp_bytecode_get_source_line(const byte *line_info, size_t bc) {
+    size_t source_line = 1;
+    size_t c;
+    while ((c = *line_info)) {
+        size_t b, l;
+        if ((c & 0x80) == 0) {
+            // 0b0LLBBBBB encoding
+            b = c & 0x1f;
+            l = c >> 5;
+            line_info += 1;
+        } else {
+            // 0b1LLLBBBB 0bLLLLLLLL encoding (l's LSB in second byte)
+            b = c & 0xf;
+            l = ((c << 4) & 0x700) | line_info[1];
+            line_info += 2;
+        }
+        if (bc >= b) {
+            bc -= b;
+            source_line += l;
+        } else {
+            // found source line corresponding to bytecode offset
+            break;
+        }
+    }
+    return source_line;
+}
+
 STATIC NORETURN void fun_pos_args_mismatch(mp_obj_fun_bc_t *f, size_t expected, size_t given) {
 #if MICROPY_ERROR_REPORTING == MICROPY_ERROR_REPORTING_TERSE
     // generic message, used also for other argument issues
@@ -181,30 +211,59 @@ void mp_setup_code_state(mp_code_state_t *code_state, size_t n_args, size_t n_kw
         // get pointer to arg_names array
         const mp_obj_t *arg_names = (const mp_obj_t*)self->const_table;
 
-        for (size_t i = 0; i < n_kw; i++) {
-            // the keys in kwargs are expected to be qstr objects
-            mp_obj_t wanted_arg_name = kwargs[2 * i];
-            for (size_t j = 0; j < n_pos_args + n_kwonly_args; j++) {
-                if (wanted_arg_name == arg_names[j]) {
+        #if MICROPY_OPT_KW_CALL_CACHE
+        // If an earlier call with the same number of positional args and the
+        // same keyword names passed all the checks below, then this one will
+        // too, and the keyword args only need copying to their slots.
+        const uint8_t *kw_slots = NULL;
+        uint8_t new_kw_slots[MICROPY_OPT_KW_CALL_CACHE_MAX_KW];
+        if (n_pos_args + n_kwonly_args < 0xff) {
+            kw_slots = mp_kw_cache_lookup(self->bytecode, n_args, n_kw, kwargs);
+        }
+        if (kw_slots != NULL) {
+            for (size_t i = 0; i < n_kw; i++) {
+                if (kw_slots[i] == 0xff) {
+                    mp_obj_dict_store(dict, kwargs[2 * i], kwargs[2 * i + 1]);
+                } else {
+                    code_state->state[n_state - 1 - kw_slots[i]] = kwargs[2 * i + 1];
+                }
+            }
+        } else
+        #endif
+        {
+            for (size_t i = 0; i < n_kw; i++) {
+                // the keys in kwargs are expected to be qstr objects
+                mp_obj_t wanted_arg_name = kwargs[2 * i];
+                size_t j;
+                for (j = 0; j < n_pos_args + n_kwonly_args; j++) {
+                    if (wanted_arg_name == arg_names[j]) {
+                        break;
+                    }
+                }
+                #if MICROPY_OPT_KW_CALL_CACHE
+                if (i < MICROPY_OPT_KW_CALL_CACHE_MAX_KW) {
+                    new_kw_slots[i] = j < n_pos_args + n_kwonly_args ? j : 0xff;
+                }
+                #endif
+                if (j < n_pos_args + n_kwonly_args) {
                     if (code_state->state[n_state - 1 - j] != MP_OBJ_NULL) {
                         nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_TypeError,
                             "function got multiple values for argument '%q'", MP_OBJ_QSTR_VALUE(wanted_arg_name)));
                     }
                     code_state->state[n_state - 1 - j] = kwargs[2 * i + 1];
-                    goto continue2;
+                    continue;
                 }
-            }
-            // Didn't find name match with positional args
-            if ((scope_flags & MP_SCOPE_FLAG_VARKEYWORDS) == 0) {
-                if (MICROPY_ERROR_REPORTING == MICROPY_ERROR_REPORTING_TERSE) {
-                    mp_raise_TypeError("unexpected keyword argument");
-                } else {
-                    nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_TypeError,
-                        "unexpected keyword argument '%q'", MP_OBJ_QSTR_VALUE(wanted_arg_name)));
+                // Didn't find name match with positional args
+                if ((scope_flags & MP_SCOPE_FLAG_VARKEYWORDS) == 0) {
+                    if (MICROPY_ERROR_REPORTING == MICROPY_ERROR_REPORTING_TERSE) {
+                        mp_raise_TypeError("unexpected keyword argument");
+                    } else {
+                        nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_TypeError,
+                            "unexpected keyword argument '%q'", MP_OBJ_QSTR_VALUE(wanted_arg_name)));
+                    }
                 }
+                mp_obj_dict_store(dict, kwargs[2 * i], kwargs[2 * i + 1]);
             }
-            mp_obj_dict_store(dict, kwargs[2 * i], kwargs[2 * i + 1]);
-continue2:;
         }
 
         DEBUG_printf("Args with kws flattened: ");
@@ -223,10 +282,15 @@ continue2:;
         dump_args(code_state->state + n_state - n_pos_args - n_kwonly_args, n_pos_args + n_kwonly_args);
 
         // Check that all mandatory positional args are specified
-        while (d < &code_state->state[n_state]) {
-            if (*d++ == MP_OBJ_NULL) {
-                nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_TypeError,
-                    "function missing required positional argument #%d", &code_state->state[n_state] - d));
+        #if MICROPY_OPT_KW_CALL_CACHE
+        if (kw_slots == NULL)
+        #endif
+        {
+            while (d < &code_state->state[n_state]) {
+                if (*d++ == MP_OBJ_NULL) {
+                    nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_TypeError,
+                        "function missing required positional argument #%d", &code_state->state[n_state] - d));
+                }
             }
         }
 
@@ -247,6 +311,12 @@ continue2:;
             }
         }
 
+        #if MICROPY_OPT_KW_CALL_CACHE
+        if (kw_slots == NULL && n_pos_args + n_kwonly_args < 0xff) {
+            mp_kw_cache_store(self->bytecode, n_args, n_kw, kwargs, new_kw_slots);
+        }
+        #endif
+
     } else {
         // no keyword arguments given
         if (n_kwonly_args != 0) {
@@ -278,6 +348,45 @@ continue2:;
     dump_args(code_state->state, n_state);
 }
 
+#if MICROPY_OPT_SIMPLE_ARGS_CALL
+// Fast version of mp_setup_code_state for a function with the
+// MP_SCOPE_FLAG_SIMPLE_ARGS flag that is called with exactly n_pos_args
+// positional args and no keyword args.  There are no defaults, var-args or
+// cells to deal with, so the args are copied straight into the state.  The
+// entry conditions on code_state are the same, except that ip is not used.
+void mp_setup_code_state_simple(mp_code_state_t *code_state, size_t n_args, const mp_obj_t *args) {
+    mp_obj_fun_bc_t *self = code_state->fun_bc;
+    const byte *ip = self->bytecode;
+
+    // get params, skipping the ones we already know about
+    size_t n_state = mp_decode_uint(&ip);
+    mp_decode_uint(&ip); // skip n_exc_stack
+    ip += 4; // skip scope_flags, n_pos_args, n_kwonly_args, n_def_pos_args
+
+    #if MICROPY_STACKLESS
+    code_state->prev = NULL;
+    #endif
+
+    code_state->sp = &code_state->state[0] - 1;
+    code_state->exc_sp = (mp_exc_stack_t*)(code_state->state + n_state) - 1;
+
+    // args go in reverse order at the top of the state, the rest is zeroed
+    mp_obj_t *fastn = &code_state->state[n_state - 1];
+    for (size_t i = 0; i < n_args; i++) {
+        fastn[-i] = args[i];
+    }
+    memset(code_state->state, 0, (n_state - n_args) * sizeof(*code_state->state));
+
+    // jump over code info and the empty list of closed over variables
+    ip += mp_decode_uint_value(ip);
+    assert(*ip == 255);
+    code_state->ip = ip + 1;
+
+    DEBUG_printf("Calling simple: n_args=%d\n", n_args);
+    dump_args(code_state->state, n_state);
+}
+#endif
+
 #if MICROPY_PERSISTENT_CODE_LOAD || MICROPY_PERSISTENT_CODE_SAVE
 
 // The following table encodes the number of bytes that a specific opcode
@@ -309,7 +418,7 @@ STATIC const byte opcode_format_table[64] = {
     OC4(B, B, V, V), // 0x20-0x23
     OC4(Q, Q, Q, B), // 0x24-0x27
     OC4(V, V, Q, Q), // 0x28-0x2b
-    OC4(U, U, U, U), // 0x2c-0x2f
+    OC4(B, B, B, U), // 0x2c-0x2f
     OC4(B, B, B, B), // 0x30-0x33
     OC4(B, O, O, O), // 0x34-0x37
     OC4(O, O, U, U), // 0x38-0x3b
@@ -386,6 +495,9 @@ uint mp_opcode_format(const byte *ip, size_t *opcode_size) {
             *ip == MP_BC_RAISE_VARARGS
             || *ip == MP_BC_MAKE_CLOSURE
             || *ip == MP_BC_MAKE_CLOSURE_DEFARGS
+            || *ip == MP_BC_LOAD_FAST_LOAD_FAST
+            || *ip == MP_BC_STORE_FAST_LOAD_FAST
+            || *ip == MP_BC_LOAD_FAST_LOAD_CONST_SMALL_INT
             #if MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE
             || *ip == MP_BC_LOAD_NAME
             || *ip == MP_BC_LOAD_GLOBAL
@@ -58,6 +58,11 @@
 #define MP_BC_DELETE_NAME        (0x2a) // qstr
 #define MP_BC_DELETE_GLOBAL      (0x2b) // qstr
 
+// superinstructions emitted by the peephole pass, see py/emitbc.c
+#define MP_BC_LOAD_FAST_LOAD_FAST            (0x2c) // byte: local | local << 4
+#define MP_BC_STORE_FAST_LOAD_FAST           (0x2d) // byte: local | local << 4
+#define MP_BC_LOAD_FAST_LOAD_CONST_SMALL_INT (0x2e) // byte: local | int << 4
+
 #define MP_BC_DUP_TOP            (0x30)
 #define MP_BC_DUP_TOP_TWO        (0x31)
 #define MP_BC_POP_TOP            (0x32)
@@ -115,4 +120,15 @@
 #define MP_BC_UNARY_OP_MULTI             (0xd0) // + op(7)
 #define MP_BC_BINARY_OP_MULTI            (0xd7) // + op(36)
 
+// Specialised forms of some of the above opcodes.  These are never emitted or
+// saved; with MICROPY_OPT_QUICKEN the VM writes them over the original opcode
+// in bytecode that is in RAM, and writes the original back if the operands
+// don't have the types that the form is specialised for.
+#define MP_BC_QUICK_BINARY_OP_SMALL_INT_MULTI (0x00) // + n(11)
+#define MP_BC_QUICK_BINARY_OP_STR_MULTI       (0x0b) // + n(2)
+#define MP_BC_QUICK_LOAD_SUBSCR_LIST          (0x0d)
+#define MP_BC_QUICK_LOAD_SUBSCR_DICT          (0x0e)
+#define MP_BC_QUICK_STORE_SUBSCR_LIST         (0x0f)
+#define MP_BC_QUICK_BINARY_OP_FLOAT_MULTI     (0x48) // + n(8)
+
 #endif // __MICROPY_INCLUDED_PY_BC0_H__
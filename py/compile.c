@@ -35,6 +35,7 @@
 #include "py/compile.h"
 #include "py/runtime.h"
 #include "py/asmbase.h"
+#include "py/persistentcode.h"
 
 #if MICROPY_ENABLE_COMPILER
 
@@ -790,6 +791,13 @@ STATIC bool compile_built_in_decorator(compiler_t *comp, int name_len, mp_parse_
         compile_syntax_error(comp, name_nodes[1], "invalid micropython decorator");
     }
 
+    #if MICROPY_DYNAMIC_COMPILER && MICROPY_EMIT_NATIVE
+    if ((*emit_options == MP_EMIT_OPT_NATIVE_PYTHON || *emit_options == MP_EMIT_OPT_VIPER)
+        && mp_dynamic_compiler.native_arch == MP_NATIVE_ARCH_NONE) {
+        compile_syntax_error(comp, name_nodes[1], "no arch selected for native code");
+    }
+    #endif
+
     return true;
 }
 
@@ -3212,7 +3220,11 @@ STATIC void compile_scope_inline_asm(compiler_t *comp, scope_t *scope, pass_kind
             void *f = mp_asm_base_get_code((mp_asm_base_t*)comp->emit_inline_asm);
             mp_emit_glue_assign_native(comp->scope_cur->raw_code, MP_CODE_NATIVE_ASM,
                 f, mp_asm_base_get_code_size((mp_asm_base_t*)comp->emit_inline_asm),
-                NULL, comp->scope_cur->num_pos_args, 0, type_sig);
+                NULL,
+                #if MICROPY_PERSISTENT_CODE_SAVE
+                0, NULL, 0,
+                #endif
+                comp->scope_cur->num_pos_args, 0, type_sig);
         }
     }
 
@@ -3302,6 +3314,20 @@ STATIC void scope_compute_things(scope_t *scope) {
             scope->num_locals += num_free;
         }
     }
+
+    // a function that takes only positional args and has no cell vars can
+    // have its state set up by a straight copy of the args when called with
+    // exactly that many positional args
+    if (SCOPE_IS_FUNC_LIKE(scope->kind)
+        && (scope->scope_flags & (MP_SCOPE_FLAG_VARARGS | MP_SCOPE_FLAG_VARKEYWORDS)) == 0
+        && scope->num_kwonly_args == 0) {
+        for (int i = 0; i < scope->id_info_len; i++) {
+            if (scope->id_info[i].kind == ID_INFO_KIND_CELL) {
+                return;
+            }
+        }
+        scope->scope_flags |= MP_SCOPE_FLAG_SIMPLE_ARGS;
+    }
 }
 
 #if !MICROPY_PERSISTENT_CODE_SAVE
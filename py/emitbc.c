@@ -58,6 +58,18 @@ struct _emit_t {
     mp_uint_t max_num_labels;
     mp_uint_t *label_offsets;
 
+    #if MICROPY_COMP_BC_PEEPHOLE
+    // State of the peephole pass.  Its decisions only depend on the sequence
+    // of emit calls, so they are the same in MP_PASS_CODE_SIZE and MP_PASS_EMIT.
+    bool peephole; // whether the pass is enabled for this scope
+    bool dead_code; // whether the code emitted now is unreachable
+    byte last_op; // last fusable opcode emitted, if nonzero
+    mp_uint_t last_op_offset; // offset of last_op
+    mp_uint_t num_pending_labels; // labels assigned since the last write
+    mp_uint_t pending_labels[4];
+    mp_uint_t *label_jumps; // label that the JUMP at each label goes to
+    #endif
+
     size_t code_info_offset;
     size_t code_info_size;
     size_t bytecode_offset;
@@ -80,10 +92,16 @@ emit_t *emit_bc_new(void) {
 void emit_bc_set_max_num_labels(emit_t *emit, mp_uint_t max_num_labels) {
     emit->max_num_labels = max_num_labels;
     emit->label_offsets = m_new(mp_uint_t, emit->max_num_labels);
+    #if MICROPY_COMP_BC_PEEPHOLE
+    emit->label_jumps = m_new(mp_uint_t, emit->max_num_labels);
+    #endif
 }
 
 void emit_bc_free(emit_t *emit) {
     m_del(mp_uint_t, emit->label_offsets, emit->max_num_labels);
+    #if MICROPY_COMP_BC_PEEPHOLE
+    m_del(mp_uint_t, emit->label_jumps, emit->max_num_labels);
+    #endif
     m_del_obj(emit_t, emit);
 }
 
@@ -171,6 +189,13 @@ STATIC void emit_write_code_info_bytes_lines(emit_t *emit, mp_uint_t bytes_to_sk
 // all functions must go through this one to emit byte code
 STATIC byte *emit_get_cur_to_write_bytecode(emit_t *emit, int num_bytes_to_write) {
     //printf("emit %d\n", num_bytes_to_write);
+    #if MICROPY_COMP_BC_PEEPHOLE
+    if (emit->dead_code) {
+        // unreachable code is discarded
+        return emit->dummy_data;
+    }
+    emit->num_pending_labels = 0;
+    #endif
     if (emit->pass < MP_PASS_EMIT) {
         emit->bytecode_offset += num_bytes_to_write;
         return emit->dummy_data;
@@ -182,6 +207,18 @@ STATIC byte *emit_get_cur_to_write_bytecode(emit_t *emit, int num_bytes_to_write
     }
 }
 
+#if !MICROPY_PERSISTENT_CODE
+// aligns the bytecode offset, unless the code is being discarded
+STATIC void emit_align_bytecode(emit_t *emit, size_t align) {
+    #if MICROPY_COMP_BC_PEEPHOLE
+    if (emit->dead_code) {
+        return;
+    }
+    #endif
+    emit->bytecode_offset = (size_t)MP_ALIGN(emit->bytecode_offset, align);
+}
+#endif
+
 STATIC void emit_write_bytecode_byte(emit_t *emit, byte b1) {
     byte *c = emit_get_cur_to_write_bytecode(emit, 1);
     c[0] = b1;
@@ -193,6 +230,53 @@ STATIC void emit_write_bytecode_byte_byte(emit_t* emit, byte b1, byte b2) {
     c[1] = b2;
 }
 
+#if MICROPY_COMP_BC_PEEPHOLE
+// Code following an unconditional jump, return or raise is unreachable until
+// the next label is assigned.
+STATIC void emit_bc_end_of_flow(emit_t *emit) {
+    if (emit->peephole) {
+        emit->dead_code = true;
+    }
+}
+
+// Remember that op was just written as a single byte, so the next instruction
+// can fuse with it.
+STATIC void emit_bc_peephole_note(emit_t *emit, byte op) {
+    emit->last_op = op;
+    emit->last_op_offset = emit->bytecode_offset - 1;
+}
+
+// Returns the opcode written just before the current position if it can be
+// fused with the next instruction, or 0.  Fusing must not hide a label or the
+// start of a source line.
+STATIC byte emit_bc_peephole_last_op(emit_t *emit) {
+    if (!emit->peephole || emit->dead_code
+        || emit->last_op_offset + 1 != emit->bytecode_offset
+        || emit->last_source_line_offset > emit->last_op_offset) {
+        return 0;
+    }
+    return emit->last_op;
+}
+
+// Replaces the opcode returned by emit_bc_peephole_last_op with a
+// superinstruction taking a single byte argument.
+STATIC void emit_bc_peephole_fuse(emit_t *emit, byte op, byte arg) {
+    emit->bytecode_offset = emit->last_op_offset;
+    emit->last_op = 0;
+    emit_write_bytecode_byte_byte(emit, op, arg);
+}
+
+// Returns the final destination of a jump to label, skipping over labels that
+// just hold another jump.  The number of hops is bounded so a loop of jumps
+// is not followed forever.
+STATIC mp_uint_t emit_bc_thread_jump(emit_t *emit, mp_uint_t label) {
+    for (int i = 0; i < 8 && emit->label_jumps[label] != (mp_uint_t)-1; ++i) {
+        label = emit->label_jumps[label];
+    }
+    return label;
+}
+#endif
+
 // Similar to emit_write_bytecode_uint(), just some extra handling to encode sign
 STATIC void emit_write_bytecode_byte_int(emit_t *emit, byte b1, mp_int_t num) {
     emit_write_bytecode_byte(emit, b1);
@@ -254,7 +338,7 @@ STATIC void emit_write_bytecode_byte_obj(emit_t *emit, byte b, mp_obj_t obj) {
     #else
     // aligns the pointer so it is friendly to GC
     emit_write_bytecode_byte(emit, b);
-    emit->bytecode_offset = (size_t)MP_ALIGN(emit->bytecode_offset, sizeof(mp_obj_t));
+    emit_align_bytecode(emit, sizeof(mp_obj_t));
     mp_obj_t *c = (mp_obj_t*)emit_get_cur_to_write_bytecode(emit, sizeof(mp_obj_t));
     // Verify thar c is already uint-aligned
     assert(c == MP_ALIGN(c, sizeof(mp_obj_t)));
@@ -270,7 +354,7 @@ STATIC void emit_write_bytecode_byte_raw_code(emit_t *emit, byte b, mp_raw_code_
     #else
     // aligns the pointer so it is friendly to GC
     emit_write_bytecode_byte(emit, b);
-    emit->bytecode_offset = (size_t)MP_ALIGN(emit->bytecode_offset, sizeof(void*));
+    emit_align_bytecode(emit, sizeof(void*));
     void **c = (void**)emit_get_cur_to_write_bytecode(emit, sizeof(void*));
     // Verify thar c is already uint-aligned
     assert(c == MP_ALIGN(c, sizeof(void*)));
@@ -294,6 +378,20 @@ STATIC void emit_write_bytecode_byte_unsigned_label(emit_t *emit, byte b1, mp_ui
 
 // signed labels are relative to ip following this instruction, stored as 16 bits, in excess
 STATIC void emit_write_bytecode_byte_signed_label(emit_t *emit, byte b1, mp_uint_t label) {
+    #if MICROPY_COMP_BC_PEEPHOLE
+    if (emit->peephole) {
+        if (emit->pass < MP_PASS_EMIT) {
+            if (b1 == MP_BC_JUMP && !emit->dead_code) {
+                // a jump to any of the labels here can go straight to label
+                for (mp_uint_t i = 0; i < emit->num_pending_labels; ++i) {
+                    emit->label_jumps[emit->pending_labels[i]] = label;
+                }
+            }
+        } else {
+            label = emit_bc_thread_jump(emit, label);
+        }
+    }
+    #endif
     int bytecode_offset;
     if (emit->pass < MP_PASS_EMIT) {
         bytecode_offset = 0;
@@ -316,6 +414,17 @@ void mp_emit_bc_start_pass(emit_t *emit, pass_kind_t pass, scope_t *scope) {
     if (pass < MP_PASS_EMIT) {
         memset(emit->label_offsets, -1, emit->max_num_labels * sizeof(mp_uint_t));
     }
+    #if MICROPY_COMP_BC_PEEPHOLE
+    if (pass == MP_PASS_SCOPE) {
+        emit->peephole = MP_STATE_VM(mp_bc_peephole);
+    }
+    if (pass < MP_PASS_EMIT) {
+        memset(emit->label_jumps, -1, emit->max_num_labels * sizeof(mp_uint_t));
+    }
+    emit->dead_code = false;
+    emit->last_op = 0;
+    emit->num_pending_labels = 0;
+    #endif
     emit->bytecode_offset = 0;
     emit->code_info_offset = 0;
 
@@ -498,6 +607,13 @@ void mp_emit_bc_label_assign(emit_t *emit, mp_uint_t l) {
         //printf("l%d: (at %d vs %d)\n", l, emit->bytecode_offset, emit->label_offsets[l]);
         assert(emit->label_offsets[l] == emit->bytecode_offset);
     }
+    #if MICROPY_COMP_BC_PEEPHOLE
+    emit->dead_code = false;
+    emit->last_op = 0;
+    if (emit->num_pending_labels < MP_ARRAY_SIZE(emit->pending_labels)) {
+        emit->pending_labels[emit->num_pending_labels++] = l;
+    }
+    #endif
 }
 
 void mp_emit_bc_import_name(emit_t *emit, qstr qst) {
@@ -530,6 +646,15 @@ void mp_emit_bc_load_const_tok(emit_t *emit, mp_token_kind_t tok) {
 
 void mp_emit_bc_load_const_small_int(emit_t *emit, mp_int_t arg) {
     emit_bc_pre(emit, 1);
+    #if MICROPY_COMP_BC_PEEPHOLE
+    if (0 <= arg && arg <= 15) {
+        byte op = emit_bc_peephole_last_op(emit);
+        if (MP_BC_LOAD_FAST_MULTI <= op && op < MP_BC_LOAD_FAST_MULTI + 16) {
+            emit_bc_peephole_fuse(emit, MP_BC_LOAD_FAST_LOAD_CONST_SMALL_INT, (op - MP_BC_LOAD_FAST_MULTI) | arg << 4);
+            return;
+        }
+    }
+    #endif
     if (-16 <= arg && arg <= 47) {
         emit_write_bytecode_byte(emit, MP_BC_LOAD_CONST_SMALL_INT_MULTI + 16 + arg);
     } else {
@@ -556,7 +681,20 @@ void mp_emit_bc_load_fast(emit_t *emit, qstr qst, mp_uint_t local_num) {
     (void)qst;
     emit_bc_pre(emit, 1);
     if (local_num <= 15) {
+        #if MICROPY_COMP_BC_PEEPHOLE
+        byte op = emit_bc_peephole_last_op(emit);
+        if (MP_BC_LOAD_FAST_MULTI <= op && op < MP_BC_LOAD_FAST_MULTI + 16) {
+            emit_bc_peephole_fuse(emit, MP_BC_LOAD_FAST_LOAD_FAST, (op - MP_BC_LOAD_FAST_MULTI) | local_num << 4);
+            return;
+        } else if (MP_BC_STORE_FAST_MULTI <= op && op < MP_BC_STORE_FAST_MULTI + 16) {
+            emit_bc_peephole_fuse(emit, MP_BC_STORE_FAST_LOAD_FAST, (op - MP_BC_STORE_FAST_MULTI) | local_num << 4);
+            return;
+        }
+        #endif
         emit_write_bytecode_byte(emit, MP_BC_LOAD_FAST_MULTI + local_num);
+        #if MICROPY_COMP_BC_PEEPHOLE
+        emit_bc_peephole_note(emit, MP_BC_LOAD_FAST_MULTI + local_num);
+        #endif
     } else {
         emit_write_bytecode_byte_uint(emit, MP_BC_LOAD_FAST_N, local_num);
     }
@@ -614,6 +752,9 @@ void mp_emit_bc_store_fast(emit_t *emit, qstr qst, mp_uint_t local_num) {
     emit_bc_pre(emit, -1);
     if (local_num <= 15) {
         emit_write_bytecode_byte(emit, MP_BC_STORE_FAST_MULTI + local_num);
+        #if MICROPY_COMP_BC_PEEPHOLE
+        emit_bc_peephole_note(emit, MP_BC_STORE_FAST_MULTI + local_num);
+        #endif
     } else {
         emit_write_bytecode_byte_uint(emit, MP_BC_STORE_FAST_N, local_num);
     }
@@ -708,6 +849,9 @@ void mp_emit_bc_rot_three(emit_t *emit) {
 void mp_emit_bc_jump(emit_t *emit, mp_uint_t label) {
     emit_bc_pre(emit, 0);
     emit_write_bytecode_byte_signed_label(emit, MP_BC_JUMP, label);
+    #if MICROPY_COMP_BC_PEEPHOLE
+    emit_bc_end_of_flow(emit);
+    #endif
 }
 
 void mp_emit_bc_pop_jump_if(emit_t *emit, bool cond, mp_uint_t label) {
@@ -744,6 +888,9 @@ void mp_emit_bc_unwind_jump(emit_t *emit, mp_uint_t label, mp_uint_t except_dept
         emit_write_bytecode_byte_signed_label(emit, MP_BC_UNWIND_JUMP, label & ~MP_EMIT_BREAK_FROM_FOR);
         emit_write_bytecode_byte(emit, ((label & MP_EMIT_BREAK_FROM_FOR) ? 0x80 : 0) | except_depth);
     }
+    #if MICROPY_COMP_BC_PEEPHOLE
+    emit_bc_end_of_flow(emit);
+    #endif
 }
 
 void mp_emit_bc_setup_with(emit_t *emit, mp_uint_t label) {
@@ -930,12 +1077,18 @@ void mp_emit_bc_return_value(emit_t *emit) {
     emit_bc_pre(emit, -1);
     emit->last_emit_was_return_value = true;
     emit_write_bytecode_byte(emit, MP_BC_RETURN_VALUE);
+    #if MICROPY_COMP_BC_PEEPHOLE
+    emit_bc_end_of_flow(emit);
+    #endif
 }
 
 void mp_emit_bc_raise_varargs(emit_t *emit, mp_uint_t n_args) {
     assert(n_args <= 2);
     emit_bc_pre(emit, -n_args);
     emit_write_bytecode_byte_byte(emit, MP_BC_RAISE_VARARGS, n_args);
+    #if MICROPY_COMP_BC_PEEPHOLE
+    emit_bc_end_of_flow(emit);
+    #endif
 }
 
 void mp_emit_bc_yield_value(emit_t *emit) {
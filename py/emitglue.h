@@ -39,6 +39,23 @@ typedef enum {
     MP_CODE_NATIVE_ASM,
 } mp_raw_code_kind_t;
 
+// Kinds of value in native code that depend on the runtime executing it, and
+// that are patched when the code is loaded from an .mpy file
+typedef enum {
+    MP_NATIVE_RELOC_QSTR,       // a qstr
+    MP_NATIVE_RELOC_QSTR_OBJ,   // a qstr as an object
+    MP_NATIVE_RELOC_OBJ,        // a constant object
+    MP_NATIVE_RELOC_FUN_TABLE,  // an entry of mp_fun_table, given by its index
+    MP_NATIVE_RELOC_RAW_CODE,   // the raw code of a nested function
+} mp_native_reloc_kind_t;
+
+// A machine word in native code that holds a runtime-dependent value
+typedef struct _mp_native_reloc_t {
+    uint32_t offset;
+    uint32_t kind;
+    mp_uint_t value;
+} mp_native_reloc_t;
+
 typedef struct _mp_raw_code_t {
     mp_raw_code_kind_t kind : 3;
     mp_uint_t scope_flags : 7;
@@ -57,6 +74,12 @@ typedef struct _mp_raw_code_t {
             void *fun_data;
             const mp_uint_t *const_table;
             mp_uint_t type_sig; // for viper, compressed as 2-bit types; ret is MSB, then arg0, arg1, etc
+            #if MICROPY_PERSISTENT_CODE_SAVE
+            mp_uint_t fun_data_len;
+            mp_uint_t prelude_offset;
+            const mp_native_reloc_t *relocs;
+            mp_uint_t n_reloc;
+            #endif
         } u_native;
     } data;
 } mp_raw_code_t;
@@ -69,7 +92,12 @@ void mp_emit_glue_assign_bytecode(mp_raw_code_t *rc, const byte *code, mp_uint_t
     uint16_t n_obj, uint16_t n_raw_code,
     #endif
     mp_uint_t scope_flags);
-void mp_emit_glue_assign_native(mp_raw_code_t *rc, mp_raw_code_kind_t kind, void *fun_data, mp_uint_t fun_len, const mp_uint_t *const_table, mp_uint_t n_pos_args, mp_uint_t scope_flags, mp_uint_t type_sig);
+void mp_emit_glue_assign_native(mp_raw_code_t *rc, mp_raw_code_kind_t kind, void *fun_data, mp_uint_t fun_len,
+    const mp_uint_t *const_table,
+    #if MICROPY_PERSISTENT_CODE_SAVE
+    mp_uint_t prelude_offset, const mp_native_reloc_t *relocs, mp_uint_t n_reloc,
+    #endif
+    mp_uint_t n_pos_args, mp_uint_t scope_flags, mp_uint_t type_sig);
 
 mp_obj_t mp_make_function_from_raw_code(const mp_raw_code_t *rc, mp_obj_t def_args, mp_obj_t def_kw_args);
 mp_obj_t mp_make_closure_from_raw_code(const mp_raw_code_t *rc, mp_uint_t n_closed_over, const mp_obj_t *args);
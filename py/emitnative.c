@@ -123,6 +123,7 @@ STATIC byte mp_f_n_args[MP_F_NUMBER_OF] = {
     [MP_F_NEW_CELL] = 1,
     [MP_F_MAKE_CLOSURE_FROM_RAW_CODE] = 3,
     [MP_F_SETUP_CODE_STATE] = 5,
+    [MP_F_NATIVE_YIELD_FROM] = 3,
 };
 
 #include "py/asmx86.h"
@@ -152,6 +153,15 @@ STATIC byte mp_f_n_args[MP_F_NUMBER_OF] = {
 
 #endif
 
+// Whether to record the runtime-dependent values in the generated code, so
+// that it can be saved as persistent code; only x64 supports this so far
+#define N_PERSISTENT (MICROPY_PERSISTENT_CODE_SAVE && N_X64)
+
+// Whether the viper float, ptrf and ptrd types are supported; a float value
+// is the bit pattern of a double held in a general purpose register or stack
+// slot, and is only moved to an SSE register to do arithmetic on it
+#define N_FLOAT (MICROPY_EMIT_NATIVE_FLOAT && N_X64)
+
 #define EMIT_NATIVE_VIPER_TYPE_ERROR(emit, ...) do { \
         *emit->error_slot = mp_obj_new_exception_msg_varg(&mp_type_ViperTypeError, __VA_ARGS__); \
     } while (0)
@@ -173,6 +183,9 @@ typedef enum {
     VTYPE_PTR8 = 0x00 | MP_NATIVE_TYPE_PTR8,
     VTYPE_PTR16 = 0x00 | MP_NATIVE_TYPE_PTR16,
     VTYPE_PTR32 = 0x00 | MP_NATIVE_TYPE_PTR32,
+    VTYPE_FLOAT = 0x00 | MP_NATIVE_TYPE_FLOAT,
+    VTYPE_PTRF = 0x00 | MP_NATIVE_TYPE_PTRF,
+    VTYPE_PTRD = 0x00 | MP_NATIVE_TYPE_PTRD,
 
     VTYPE_PTR_NONE = 0x50 | MP_NATIVE_TYPE_PTR,
 
@@ -190,6 +203,11 @@ STATIC qstr vtype_to_qstr(vtype_kind_t vtype) {
         case VTYPE_PTR8: return MP_QSTR_ptr8;
         case VTYPE_PTR16: return MP_QSTR_ptr16;
         case VTYPE_PTR32: return MP_QSTR_ptr32;
+        #if N_FLOAT
+        case VTYPE_FLOAT: return MP_QSTR_float;
+        case VTYPE_PTRF: return MP_QSTR_ptrf;
+        case VTYPE_PTRD: return MP_QSTR_ptrd;
+        #endif
         case VTYPE_PTR_NONE: default: return MP_QSTR_None;
     }
 }
@@ -203,6 +221,33 @@ typedef struct _stack_info_t {
     } data;
 } stack_info_t;
 
+// a load or store of a local, recorded in the stack-size pass; the weight
+// starts at 1 and is multiplied for each loop that the use is inside
+typedef struct _local_use_t {
+    uint16_t local_num;
+    uint16_t weight;
+} local_use_t;
+
+#define LOCAL_USE_LOOP_FACTOR (8)
+#define LOCAL_USE_WEIGHT_MAX (0xffff)
+
+// marks a local that is not held in a register
+#define LOCAL_REG_NONE (-1)
+
+// the callee-saved registers that can hold locals, in order of allocation
+STATIC const int8_t reg_local_table[REG_LOCAL_NUM] = {
+    REG_LOCAL_1, REG_LOCAL_2, REG_LOCAL_3,
+    #if REG_LOCAL_NUM > 3
+    REG_LOCAL_4, REG_LOCAL_5,
+    #endif
+};
+
+// an exception handler (nlr_buf_t) that is active at the current point in the code
+typedef struct _exc_stack_entry_t {
+    mp_uint_t label;
+    mp_uint_t local_idx;
+} exc_stack_entry_t;
+
 struct _emit_t {
     mp_obj_t *error_slot;
     int pass;
@@ -214,6 +259,19 @@ struct _emit_t {
     mp_uint_t local_vtype_alloc;
     vtype_kind_t *local_vtype;
 
+    // where each local lives: in a register, or else for viper in a slot of
+    // the C-stack frame (for native code the home of a local is the state)
+    int8_t *local_reg;
+    uint16_t *local_slot;
+    mp_uint_t n_local_slots;
+
+    // uses of locals in the stack-size pass, and the position in that list
+    // of each label, used to choose which locals get registers
+    mp_uint_t local_use_alloc;
+    mp_uint_t local_use_len;
+    local_use_t *local_use;
+    mp_uint_t *label_use_pos;
+
     mp_uint_t stack_info_alloc;
     stack_info_t *stack_info;
     vtype_kind_t saved_stack_vtype;
@@ -224,6 +282,25 @@ struct _emit_t {
     int stack_start;
     int stack_size;
 
+    mp_uint_t exc_stack_alloc;
+    mp_uint_t exc_stack_size;
+    exc_stack_entry_t *exc_stack;
+
+    // for generators: the labels beyond those used by the compiler, and the
+    // labels of the points where execution can resume after a yield
+    bool is_generator;
+    mp_uint_t gen_label_base;
+    mp_uint_t gen_next_label;
+    mp_uint_t gen_resume_alloc;
+    mp_uint_t gen_resume_len;
+    mp_uint_t *gen_resume;
+
+    #if N_PERSISTENT
+    mp_uint_t reloc_alloc;
+    mp_uint_t reloc_len;
+    mp_native_reloc_t *relocs;
+    #endif
+
     bool last_emit_was_return_value;
 
     scope_t *scope;
@@ -236,6 +313,7 @@ emit_t *EXPORT_FUN(new)(mp_obj_t *error_slot, mp_uint_t max_num_labels) {
     emit->error_slot = error_slot;
     emit->as = m_new0(ASM_T, 1);
     mp_asm_base_init(&emit->as->base, max_num_labels);
+    emit->gen_label_base = max_num_labels;
     return emit;
 }
 
@@ -243,7 +321,16 @@ void EXPORT_FUN(free)(emit_t *emit) {
     mp_asm_base_deinit(&emit->as->base, false);
     m_del_obj(ASM_T, emit->as);
     m_del(vtype_kind_t, emit->local_vtype, emit->local_vtype_alloc);
+    m_del(int8_t, emit->local_reg, emit->local_vtype_alloc);
+    m_del(uint16_t, emit->local_slot, emit->local_vtype_alloc);
+    m_del(local_use_t, emit->local_use, emit->local_use_alloc);
+    m_del(mp_uint_t, emit->label_use_pos, emit->gen_label_base);
     m_del(stack_info_t, emit->stack_info, emit->stack_info_alloc);
+    m_del(exc_stack_entry_t, emit->exc_stack, emit->exc_stack_alloc);
+    m_del(mp_uint_t, emit->gen_resume, emit->gen_resume_alloc);
+    #if N_PERSISTENT
+    m_del(mp_native_reloc_t, emit->relocs, emit->reloc_alloc);
+    #endif
     m_del_obj(emit_t, emit);
 }
 
@@ -264,6 +351,11 @@ STATIC void emit_native_set_native_type(emit_t *emit, mp_uint_t op, mp_uint_t ar
                 case MP_QSTR_ptr8: type = VTYPE_PTR8; break;
                 case MP_QSTR_ptr16: type = VTYPE_PTR16; break;
                 case MP_QSTR_ptr32: type = VTYPE_PTR32; break;
+                #if N_FLOAT
+                case MP_QSTR_float: type = VTYPE_FLOAT; break;
+                case MP_QSTR_ptrf: type = VTYPE_PTRF; break;
+                case MP_QSTR_ptrd: type = VTYPE_PTRD; break;
+                #endif
                 default: EMIT_NATIVE_VIPER_TYPE_ERROR(emit, "unknown type '%q'", arg2); return;
             }
             if (op == MP_EMIT_NATIVE_TYPE_RETURN) {
@@ -282,7 +374,327 @@ STATIC void emit_post_push_reg(emit_t *emit, vtype_kind_t vtype, int reg);
 STATIC void emit_native_load_fast(emit_t *emit, qstr qst, mp_uint_t local_num);
 STATIC void emit_native_store_fast(emit_t *emit, qstr qst, mp_uint_t local_num);
 
+// The generated code depends on the size of these structures in the runtime
+// that executes it, which for a cross compiler is given by its configuration
+#if MICROPY_DYNAMIC_COMPILER
+#define STATE_START (mp_dynamic_compiler.native_code_state_words)
+#define NLR_BUF_WORDS (mp_dynamic_compiler.native_nlr_buf_words)
+#else
 #define STATE_START (sizeof(mp_code_state_t) / sizeof(mp_uint_t))
+#define NLR_BUF_WORDS (sizeof(nlr_buf_t) / sizeof(mp_uint_t))
+#endif
+
+#if N_PERSISTENT
+// Record that the machine word just emitted holds a runtime-dependent value.
+STATIC void emit_native_add_reloc(emit_t *emit, mp_native_reloc_kind_t kind, mp_uint_t value) {
+    if (emit->pass != MP_PASS_EMIT) {
+        return;
+    }
+    if (emit->reloc_len >= emit->reloc_alloc) {
+        emit->relocs = m_renew(mp_native_reloc_t, emit->relocs, emit->reloc_alloc, emit->reloc_alloc + 16);
+        emit->reloc_alloc += 16;
+    }
+    mp_native_reloc_t *r = &emit->relocs[emit->reloc_len++];
+    r->offset = mp_asm_base_get_code_pos(&emit->as->base) - ASM_WORD_SIZE;
+    r->kind = kind;
+    r->value = value;
+}
+#endif
+
+// Load a value that depends on the runtime into a register.  If aligned then
+// the value is stored aligned in the code, so the GC can find it.  When saving
+// persistent code the value is always stored as a full machine word, so it
+// can be patched when the code is loaded.
+STATIC void emit_native_mov_reg_reloc(emit_t *emit, int reg, mp_native_reloc_kind_t kind, mp_uint_t value, bool aligned) {
+    mp_uint_t imm = value;
+    if (kind == MP_NATIVE_RELOC_QSTR_OBJ) {
+        imm = (mp_uint_t)MP_OBJ_NEW_QSTR(value);
+    } else if (kind == MP_NATIVE_RELOC_FUN_TABLE) {
+        imm = (mp_uint_t)mp_fun_table[value];
+    }
+    #if N_PERSISTENT
+    if (aligned) {
+        asm_x64_mov_i64_to_r64_aligned(emit->as, imm, reg);
+    } else {
+        asm_x64_mov_i64_to_r64(emit->as, imm, reg);
+    }
+    emit_native_add_reloc(emit, kind, value);
+    #else
+    if (aligned) {
+        ASM_MOV_ALIGNED_IMM_TO_REG(emit->as, imm, reg);
+    } else {
+        ASM_MOV_IMM_TO_REG(emit->as, imm, reg);
+    }
+    #endif
+}
+
+// Load an object that is an immediate on the value stack into a register.
+STATIC void emit_native_mov_reg_const(emit_t *emit, int reg, mp_obj_t obj) {
+    #if N_PERSISTENT
+    if (MP_OBJ_IS_QSTR(obj)) {
+        emit_native_mov_reg_reloc(emit, reg, MP_NATIVE_RELOC_QSTR_OBJ, MP_OBJ_QSTR_VALUE(obj), false);
+        return;
+    } else if (obj != MP_OBJ_NULL && MP_OBJ_IS_OBJ(obj)) {
+        emit_native_mov_reg_reloc(emit, reg, MP_NATIVE_RELOC_OBJ, (mp_uint_t)obj, false);
+        return;
+    }
+    #endif
+    ASM_MOV_IMM_TO_REG(emit->as, (mp_uint_t)obj, reg);
+}
+
+STATIC void emit_native_mov_local_const(emit_t *emit, int local_num, mp_obj_t obj, int reg_temp) {
+    #if N_PERSISTENT
+    if (obj != MP_OBJ_NULL && !MP_OBJ_IS_SMALL_INT(obj)) {
+        emit_native_mov_reg_const(emit, reg_temp, obj);
+        ASM_MOV_REG_TO_LOCAL(emit->as, reg_temp, local_num);
+        return;
+    }
+    #endif
+    ASM_MOV_IMM_TO_LOCAL_USING(emit->as, (mp_uint_t)obj, local_num, reg_temp);
+}
+
+// Call an entry of mp_fun_table.
+STATIC void emit_native_call_ind(emit_t *emit, mp_fun_kind_t fun_kind) {
+    #if N_PERSISTENT
+    emit_native_mov_reg_reloc(emit, REG_RET, MP_NATIVE_RELOC_FUN_TABLE, fun_kind, false);
+    asm_x64_call_r64(emit->as, REG_RET);
+    #else
+    ASM_CALL_IND(emit->as, mp_fun_table[fun_kind], fun_kind);
+    #endif
+}
+
+// A generator runs with its state mirrored in the C-stack frame, at the same
+// offsets as in the heap-allocated code_state of the generator instance.  The
+// slots before the state hold the pointer to that code_state and the value to
+// throw in, and an nlr_buf_t that catches all exceptions follows the state.
+#define LOCAL_IDX_GEN_STATE (0)
+#define LOCAL_IDX_GEN_THROW (1)
+#define LOCAL_IDX_GEN_NLR(emit) (STATE_START + (emit)->n_state)
+
+// Fixed labels used by a generator, beyond those used by the compiler
+#define GEN_LABEL_DISPATCH(emit) ((emit)->gen_label_base)
+#define GEN_LABEL_START(emit) ((emit)->gen_label_base + 1)
+#define GEN_LABEL_EXC(emit) ((emit)->gen_label_base + 2)
+
+// Heap offsets are kept small so that every architecture can encode them
+#define GEN_STATE_WINDOW (16)
+
+STATIC mp_uint_t emit_native_gen_new_label(emit_t *emit) {
+    mp_asm_base_t *as = &emit->as->base;
+    if (emit->gen_next_label >= as->max_num_labels) {
+        size_t n = as->max_num_labels;
+        as->label_offsets = m_renew(size_t, as->label_offsets, n, n + 8);
+        memset(as->label_offsets + n, -1, 8 * sizeof(size_t));
+        as->max_num_labels = n + 8;
+    }
+    return emit->gen_next_label++;
+}
+
+STATIC mp_uint_t emit_native_gen_new_resume_label(emit_t *emit) {
+    if (emit->gen_resume_len >= emit->gen_resume_alloc) {
+        emit->gen_resume = m_renew(mp_uint_t, emit->gen_resume, emit->gen_resume_alloc, emit->gen_resume_alloc + 4);
+        emit->gen_resume_alloc += 4;
+    }
+    mp_uint_t label = emit_native_gen_new_label(emit);
+    emit->gen_resume[emit->gen_resume_len++] = label;
+    return label;
+}
+
+// Copy one word of the state between the C-stack frame and the heap, where
+// REG_TEMP1 points to word *base of the heap code_state.
+STATIC void emit_native_gen_sync_word(emit_t *emit, bool to_heap, mp_uint_t i, mp_uint_t *base) {
+    mp_uint_t idx = STATE_START + i;
+    if (idx - *base >= GEN_STATE_WINDOW) {
+        ASM_MOV_IMM_TO_REG(emit->as, (idx - *base) * ASM_WORD_SIZE, REG_TEMP2);
+        ASM_ADD_REG_REG(emit->as, REG_TEMP1, REG_TEMP2);
+        *base = idx;
+    }
+
+    // some locals are cached in registers
+    int reg = REG_TEMP0;
+    mp_uint_t local_num = emit->n_state - 1 - i;
+    if (local_num < emit->scope->num_locals && emit->local_reg[local_num] != LOCAL_REG_NONE) {
+        reg = emit->local_reg[local_num];
+    }
+
+    if (to_heap) {
+        if (reg == REG_TEMP0) {
+            ASM_MOV_LOCAL_TO_REG(emit->as, idx, REG_TEMP0);
+        }
+        ASM_STORE_REG_REG_OFFSET(emit->as, reg, REG_TEMP1, idx - *base);
+    } else {
+        ASM_LOAD_REG_REG_OFFSET(emit->as, reg, REG_TEMP1, idx - *base);
+        if (reg == REG_TEMP0) {
+            ASM_MOV_REG_TO_LOCAL(emit->as, REG_TEMP0, idx);
+        }
+    }
+}
+
+// Copy all locals, and the bottom n_stack entries of the value stack, between
+// the C-stack frame and the heap-allocated code_state.
+STATIC void emit_native_gen_sync_state(emit_t *emit, bool to_heap, mp_uint_t n_stack) {
+    mp_uint_t base = 0;
+    ASM_MOV_LOCAL_TO_REG(emit->as, LOCAL_IDX_GEN_STATE, REG_TEMP1);
+    for (mp_uint_t i = 0; i < n_stack; i++) {
+        emit_native_gen_sync_word(emit, to_heap, i, &base);
+    }
+    for (int i = emit->n_state - emit->scope->num_locals; i < emit->n_state; i++) {
+        emit_native_gen_sync_word(emit, to_heap, i, &base);
+    }
+}
+
+// Set code_state->sp to point to the given stack entry in the heap.
+STATIC void emit_native_gen_set_sp(emit_t *emit, mp_uint_t stack_pos) {
+    ASM_MOV_LOCAL_TO_REG(emit->as, LOCAL_IDX_GEN_STATE, REG_TEMP1);
+    ASM_MOV_IMM_TO_REG(emit->as, (STATE_START + stack_pos) * ASM_WORD_SIZE, REG_TEMP0);
+    ASM_ADD_REG_REG(emit->as, REG_TEMP0, REG_TEMP1);
+    ASM_STORE_REG_REG_OFFSET(emit->as, REG_TEMP0, REG_TEMP1, offsetof(mp_code_state_t, sp) / sizeof(uintptr_t));
+}
+
+// Pop the active exception handlers, which live in this C-stack frame, and
+// return to mp_obj_gen_resume.
+STATIC void emit_native_gen_exit(emit_t *emit, mp_vm_return_kind_t kind) {
+    for (mp_uint_t i = 0; i <= emit->exc_stack_size; i++) {
+        emit_native_call_ind(emit, MP_F_NLR_POP);
+    }
+    ASM_MOV_IMM_TO_REG(emit->as, kind, REG_RET);
+    ASM_EXIT(emit->as);
+}
+
+// Yield the value in the given stack entry, which must be the top of the
+// (settled) stack, and emit the code that resumes execution after the yield.
+// On resumption the entry holds the value sent in.
+STATIC void emit_native_gen_yield(emit_t *emit, mp_uint_t stack_pos) {
+    mp_uint_t label = emit_native_gen_new_resume_label(emit);
+
+    // save the state and the resume point in the heap
+    emit_native_gen_sync_state(emit, true, stack_pos + 1);
+    emit_native_gen_set_sp(emit, stack_pos);
+    ASM_MOV_IMM_TO_REG(emit->as, label, REG_TEMP0);
+    ASM_STORE_REG_REG_OFFSET(emit->as, REG_TEMP0, REG_TEMP1, offsetof(mp_code_state_t, ip) / sizeof(uintptr_t));
+    emit_native_gen_exit(emit, MP_VM_RETURN_YIELD);
+
+    // restore the state, and re-push the exception handlers into the new frame
+    mp_asm_base_label_assign(&emit->as->base, label);
+    emit_native_gen_sync_state(emit, false, stack_pos + 1);
+    for (mp_uint_t i = 0; i < emit->exc_stack_size; i++) {
+        exc_stack_entry_t *e = &emit->exc_stack[i];
+        ASM_MOV_LOCAL_ADDR_TO_REG(emit->as, e->local_idx, REG_ARG_1);
+        emit_native_call_ind(emit, MP_F_NLR_PUSH);
+        ASM_JUMP_IF_REG_NONZERO(emit->as, REG_RET, e->label);
+    }
+}
+
+STATIC void emit_native_push_exc_stack(emit_t *emit, mp_uint_t label) {
+    if (emit->exc_stack_size >= emit->exc_stack_alloc) {
+        emit->exc_stack = m_renew(exc_stack_entry_t, emit->exc_stack, emit->exc_stack_alloc, emit->exc_stack_alloc + 4);
+        emit->exc_stack_alloc += 4;
+    }
+    exc_stack_entry_t *e = &emit->exc_stack[emit->exc_stack_size++];
+    e->label = label;
+    e->local_idx = emit->stack_start + emit->stack_size;
+}
+
+STATIC void emit_native_pop_exc_stack(emit_t *emit) {
+    assert(emit->exc_stack_size > 0);
+    emit->exc_stack_size -= 1;
+}
+
+// Record a use of a local in the stack-size pass.
+STATIC void emit_native_note_local_use(emit_t *emit, mp_uint_t local_num) {
+    if (emit->pass != MP_PASS_STACK_SIZE) {
+        return;
+    }
+    if (emit->local_use_len >= emit->local_use_alloc) {
+        emit->local_use = m_renew(local_use_t, emit->local_use, emit->local_use_alloc, emit->local_use_alloc + 32);
+        emit->local_use_alloc += 32;
+    }
+    local_use_t *u = &emit->local_use[emit->local_use_len++];
+    u->local_num = local_num;
+    u->weight = 1;
+}
+
+// Record a jump in the stack-size pass.  A backward jump closes a loop, so
+// all uses of locals since the target label are weighted more heavily.
+STATIC void emit_native_note_jump(emit_t *emit, mp_uint_t label) {
+    if (emit->pass != MP_PASS_STACK_SIZE || label >= emit->gen_label_base) {
+        return;
+    }
+    mp_uint_t pos = emit->label_use_pos[label];
+    if (pos == (mp_uint_t)-1) {
+        // forward jump
+        return;
+    }
+    for (mp_uint_t i = pos; i < emit->local_use_len; i++) {
+        mp_uint_t w = emit->local_use[i].weight * LOCAL_USE_LOOP_FACTOR;
+        emit->local_use[i].weight = MIN(w, LOCAL_USE_WEIGHT_MAX);
+    }
+    // another jump back to the same label (a continue) is in the same loop
+    emit->label_use_pos[label] = emit->local_use_len;
+}
+
+// Decide where each local lives.  Before the stack-size pass, when nothing is
+// known about the uses, the first locals get registers.  Otherwise the locals
+// are ranked by their uses weighted by loop depth: the highest ranked get the
+// registers and the rest get frame slots in rank order, the most used being
+// the cheapest to address.  Locals are kept out of registers when there is an
+// exception handler, because nlr restores the registers from when the handler
+// was set up, losing any later assignments.
+STATIC void emit_native_alloc_locals(emit_t *emit, bool use_weights) {
+    mp_uint_t num_locals = emit->scope->num_locals;
+    emit->n_local_slots = 0;
+    if (num_locals == 0) {
+        return;
+    }
+    mp_uint_t *weight = m_new0(mp_uint_t, num_locals);
+    uint16_t *order = m_new(uint16_t, num_locals);
+
+    if (use_weights) {
+        for (mp_uint_t i = 0; i < emit->local_use_len; i++) {
+            weight[emit->local_use[i].local_num] += emit->local_use[i].weight;
+        }
+    }
+
+    // stable sort by decreasing weight
+    for (mp_uint_t i = 0; i < num_locals; i++) {
+        mp_uint_t j = i;
+        for (; j > 0 && weight[order[j - 1]] < weight[i]; j--) {
+            order[j] = order[j - 1];
+        }
+        order[j] = i;
+    }
+
+    mp_uint_t n_reg = 0;
+    if (emit->scope->exc_stack_size == 0) {
+        n_reg = MIN(num_locals, REG_LOCAL_NUM);
+        if (use_weights) {
+            // unused locals don't need a register
+            while (n_reg > 0 && weight[order[n_reg - 1]] == 0) {
+                n_reg -= 1;
+            }
+        }
+    }
+    emit->n_local_slots = num_locals - n_reg;
+
+    for (mp_uint_t rank = 0; rank < num_locals; rank++) {
+        mp_uint_t l = order[rank];
+        if (rank < n_reg) {
+            emit->local_reg[l] = reg_local_table[rank];
+            emit->local_slot[l] = 0;
+        } else {
+            emit->local_reg[l] = LOCAL_REG_NONE;
+            #if N_X64 || N_X86
+            // slots are addressed down from the frame pointer, so the last is the nearest
+            emit->local_slot[l] = num_locals - 1 - rank;
+            #else
+            emit->local_slot[l] = rank - n_reg;
+            #endif
+        }
+    }
+
+    m_del(uint16_t, order, num_locals);
+    m_del(mp_uint_t, weight, num_locals);
+}
 
 STATIC void emit_native_start_pass(emit_t *emit, pass_kind_t pass, scope_t *scope) {
     DEBUG_printf("start_pass(pass=%u, scope=%p)\n", pass, scope);
@@ -290,15 +702,37 @@ STATIC void emit_native_start_pass(emit_t *emit, pass_kind_t pass, scope_t *scop
     emit->pass = pass;
     emit->stack_start = 0;
     emit->stack_size = 0;
+    emit->exc_stack_size = 0;
     emit->last_emit_was_return_value = false;
     emit->scope = scope;
+    emit->is_generator = !emit->do_viper_types && (scope->scope_flags & MP_SCOPE_FLAG_GENERATOR);
+    emit->gen_next_label = emit->gen_label_base;
+    emit->gen_resume_len = 0;
+    #if N_PERSISTENT
+    emit->reloc_len = 0;
+    #endif
 
-    // allocate memory for keeping track of the types of locals
+    // allocate memory for keeping track of the types and homes of locals
     if (emit->local_vtype_alloc < scope->num_locals) {
         emit->local_vtype = m_renew(vtype_kind_t, emit->local_vtype, emit->local_vtype_alloc, scope->num_locals);
+        emit->local_reg = m_renew(int8_t, emit->local_reg, emit->local_vtype_alloc, scope->num_locals);
+        emit->local_slot = m_renew(uint16_t, emit->local_slot, emit->local_vtype_alloc, scope->num_locals);
         emit->local_vtype_alloc = scope->num_locals;
     }
 
+    // the stack-size pass records the uses of locals, from which the homes
+    // of the locals are chosen for the following passes
+    if (pass == MP_PASS_STACK_SIZE) {
+        if (emit->label_use_pos == NULL) {
+            emit->label_use_pos = m_new(mp_uint_t, emit->gen_label_base);
+        }
+        memset(emit->label_use_pos, -1, emit->gen_label_base * sizeof(mp_uint_t));
+        emit->local_use_len = 0;
+        emit_native_alloc_locals(emit, false);
+    } else if (pass == MP_PASS_CODE_SIZE) {
+        emit_native_alloc_locals(emit, true);
+    }
+
     // allocate memory for keeping track of the objects on the stack
     // XXX don't know stack size on entry, and it should be maximum over all scopes
     // XXX this is such a big hack and really needs to be fixed
@@ -348,10 +782,7 @@ STATIC void emit_native_start_pass(emit_t *emit, pass_kind_t pass, scope_t *scop
         // entry to function
         int num_locals = 0;
         if (pass > MP_PASS_SCOPE) {
-            num_locals = scope->num_locals - REG_LOCAL_NUM;
-            if (num_locals < 0) {
-                num_locals = 0;
-            }
+            num_locals = emit->n_local_slots;
             emit->stack_start = num_locals;
             num_locals += scope->stack_size;
         }
@@ -366,32 +797,75 @@ STATIC void emit_native_start_pass(emit_t *emit, pass_kind_t pass, scope_t *scop
 
         #if N_X86
         for (int i = 0; i < scope->num_pos_args; i++) {
-            if (i == 0) {
-                asm_x86_mov_arg_to_r32(emit->as, i, REG_LOCAL_1);
-            } else if (i == 1) {
-                asm_x86_mov_arg_to_r32(emit->as, i, REG_LOCAL_2);
-            } else if (i == 2) {
-                asm_x86_mov_arg_to_r32(emit->as, i, REG_LOCAL_3);
+            if (emit->local_reg[i] != LOCAL_REG_NONE) {
+                asm_x86_mov_arg_to_r32(emit->as, i, emit->local_reg[i]);
             } else {
                 asm_x86_mov_arg_to_r32(emit->as, i, REG_TEMP0);
-                asm_x86_mov_r32_to_local(emit->as, REG_TEMP0, i - REG_LOCAL_NUM);
+                asm_x86_mov_r32_to_local(emit->as, REG_TEMP0, emit->local_slot[i]);
             }
         }
         #else
+        static const byte reg_arg_table[4] = {REG_ARG_1, REG_ARG_2, REG_ARG_3, REG_ARG_4};
         for (int i = 0; i < scope->num_pos_args; i++) {
-            if (i == 0) {
-                ASM_MOV_REG_REG(emit->as, REG_LOCAL_1, REG_ARG_1);
-            } else if (i == 1) {
-                ASM_MOV_REG_REG(emit->as, REG_LOCAL_2, REG_ARG_2);
-            } else if (i == 2) {
-                ASM_MOV_REG_REG(emit->as, REG_LOCAL_3, REG_ARG_3);
+            // max 4 args is checked above
+            if (emit->local_reg[i] != LOCAL_REG_NONE) {
+                ASM_MOV_REG_REG(emit->as, emit->local_reg[i], reg_arg_table[i]);
             } else {
-                assert(i == 3); // should be true; max 4 args is checked above
-                ASM_MOV_REG_TO_LOCAL(emit->as, REG_ARG_4, i - REG_LOCAL_NUM);
+                ASM_MOV_REG_TO_LOCAL(emit->as, reg_arg_table[i], emit->local_slot[i]);
             }
         }
         #endif
 
+    } else if (emit->is_generator) {
+        // The function is entered with a pointer to the heap-allocated code_state
+        // of the generator instance (already set up by gen_wrap_call) and the
+        // value to throw in, and returns a mp_vm_return_kind_t.
+        emit->n_state = scope->num_locals + scope->stack_size;
+        emit->stack_start = STATE_START;
+        emit_native_gen_new_label(emit); // GEN_LABEL_DISPATCH
+        emit_native_gen_new_label(emit); // GEN_LABEL_START
+        emit_native_gen_new_label(emit); // GEN_LABEL_EXC
+
+        // gen_wrap_call needs to find the prelude, so its offset comes first
+        mp_asm_base_data(&emit->as->base, ASM_WORD_SIZE, emit->prelude_offset);
+
+        ASM_ENTRY(emit->as, LOCAL_IDX_GEN_NLR(emit) + NLR_BUF_WORDS);
+
+        #if N_THUMB
+        asm_thumb_mov_reg_i32(emit->as, ASM_THUMB_REG_R7, (mp_uint_t)mp_fun_table);
+        #elif N_ARM
+        asm_arm_mov_reg_i32(emit->as, ASM_ARM_REG_R7, (mp_uint_t)mp_fun_table);
+        #endif
+
+        #if N_X86
+        asm_x86_mov_arg_to_r32(emit->as, 0, REG_ARG_1);
+        asm_x86_mov_arg_to_r32(emit->as, 1, REG_ARG_2);
+        #endif
+        ASM_MOV_REG_TO_LOCAL(emit->as, REG_ARG_1, LOCAL_IDX_GEN_STATE);
+        ASM_MOV_REG_TO_LOCAL(emit->as, REG_ARG_2, LOCAL_IDX_GEN_THROW);
+
+        // catch all exceptions, to hand them back to mp_obj_gen_resume
+        ASM_MOV_LOCAL_ADDR_TO_REG(emit->as, LOCAL_IDX_GEN_NLR(emit), REG_ARG_1);
+        emit_native_call_ind(emit, MP_F_NLR_PUSH);
+        ASM_JUMP_IF_REG_NONZERO(emit->as, REG_RET, GEN_LABEL_EXC(emit));
+
+        // jump to the resume point, the dispatch code for which is emitted at the end
+        ASM_JUMP(emit->as, GEN_LABEL_DISPATCH(emit));
+
+        // first time in: load the arguments, and raise the thrown value if any
+        mp_asm_base_label_assign(&emit->as->base, GEN_LABEL_START(emit));
+        emit_native_gen_sync_state(emit, false, 0);
+        ASM_MOV_LOCAL_TO_REG(emit->as, LOCAL_IDX_GEN_THROW, REG_ARG_1);
+        emit_native_call_ind(emit, MP_F_NATIVE_RAISE);
+
+        // set the type of closed over variables
+        for (mp_uint_t i = 0; i < scope->id_info_len; i++) {
+            id_info_t *id = &scope->id_info[i];
+            if (id->kind == ID_INFO_KIND_CELL) {
+                emit->local_vtype[id->local_num] = VTYPE_PYOBJ;
+            }
+        }
+
     } else {
         // work out size of state (locals plus stack)
         emit->n_state = scope->num_locals + scope->stack_size;
@@ -431,17 +905,13 @@ STATIC void emit_native_start_pass(emit_t *emit, pass_kind_t pass, scope_t *scop
         #elif N_ARM
         asm_arm_bl_ind(emit->as, mp_fun_table[MP_F_SETUP_CODE_STATE], MP_F_SETUP_CODE_STATE, ASM_ARM_REG_R4);
         #else
-        ASM_CALL_IND(emit->as, mp_fun_table[MP_F_SETUP_CODE_STATE], MP_F_SETUP_CODE_STATE);
+        emit_native_call_ind(emit, MP_F_SETUP_CODE_STATE);
         #endif
 
         // cache some locals in registers
-        if (scope->num_locals > 0) {
-            ASM_MOV_LOCAL_TO_REG(emit->as, STATE_START + emit->n_state - 1 - 0, REG_LOCAL_1);
-            if (scope->num_locals > 1) {
-                ASM_MOV_LOCAL_TO_REG(emit->as, STATE_START + emit->n_state - 1 - 1, REG_LOCAL_2);
-                if (scope->num_locals > 2) {
-                    ASM_MOV_LOCAL_TO_REG(emit->as, STATE_START + emit->n_state - 1 - 2, REG_LOCAL_3);
-                }
+        for (mp_uint_t i = 0; i < scope->num_locals; i++) {
+            if (emit->local_reg[i] != LOCAL_REG_NONE) {
+                ASM_MOV_LOCAL_TO_REG(emit->as, STATE_START + emit->n_state - 1 - i, emit->local_reg[i]);
             }
         }
 
@@ -461,6 +931,29 @@ STATIC void emit_native_end_pass(emit_t *emit) {
         ASM_EXIT(emit->as);
     }
 
+    if (emit->is_generator) {
+        // dispatch to the point where execution is to resume, which is given
+        // by code_state->ip: a resume label, or else (on the first call) the start
+        mp_asm_base_label_assign(&emit->as->base, GEN_LABEL_DISPATCH(emit));
+        ASM_MOV_LOCAL_TO_REG(emit->as, LOCAL_IDX_GEN_STATE, REG_TEMP1);
+        ASM_LOAD_REG_REG_OFFSET(emit->as, REG_TEMP0, REG_TEMP1, offsetof(mp_code_state_t, ip) / sizeof(uintptr_t));
+        for (mp_uint_t i = 0; i < emit->gen_resume_len; i++) {
+            ASM_MOV_IMM_TO_REG(emit->as, emit->gen_resume[i], REG_TEMP1);
+            ASM_JUMP_IF_REG_EQ(emit->as, REG_TEMP0, REG_TEMP1, emit->gen_resume[i]);
+        }
+        ASM_JUMP(emit->as, GEN_LABEL_START(emit));
+
+        // an exception escaped: store it where mp_obj_gen_resume expects it
+        mp_asm_base_label_assign(&emit->as->base, GEN_LABEL_EXC(emit));
+        ASM_MOV_LOCAL_TO_REG(emit->as, LOCAL_IDX_GEN_STATE, REG_TEMP1);
+        ASM_MOV_IMM_TO_REG(emit->as, (STATE_START + emit->n_state - 1) * ASM_WORD_SIZE, REG_TEMP2);
+        ASM_ADD_REG_REG(emit->as, REG_TEMP1, REG_TEMP2);
+        ASM_MOV_LOCAL_TO_REG(emit->as, LOCAL_IDX_GEN_NLR(emit) + offsetof(nlr_buf_t, ret_val) / sizeof(uintptr_t), REG_TEMP0);
+        ASM_STORE_REG_REG(emit->as, REG_TEMP0, REG_TEMP1);
+        ASM_MOV_IMM_TO_REG(emit->as, MP_VM_RETURN_EXCEPTION, REG_RET);
+        ASM_EXIT(emit->as);
+    }
+
     if (!emit->do_viper_types) {
         emit->prelude_offset = mp_asm_base_get_code_pos(&emit->as->base);
         mp_asm_base_data(&emit->as->base, 1, 0x80 | ((emit->n_state >> 7) & 0x7f));
@@ -507,6 +1000,9 @@ STATIC void emit_native_end_pass(emit_t *emit) {
                 }
             }
             mp_asm_base_data(&emit->as->base, ASM_WORD_SIZE, (mp_uint_t)MP_OBJ_NEW_QSTR(qst));
+            #if N_PERSISTENT
+            emit_native_add_reloc(emit, MP_NATIVE_RELOC_QSTR_OBJ, qst);
+            #endif
         }
 
     }
@@ -527,9 +1023,19 @@ STATIC void emit_native_end_pass(emit_t *emit) {
             type_sig |= (emit->local_vtype[i] & 0xf) << (i * 4 + 4);
         }
 
+        #if N_PERSISTENT
+        mp_native_reloc_t *relocs = m_new(mp_native_reloc_t, emit->reloc_len);
+        memcpy(relocs, emit->relocs, emit->reloc_len * sizeof(mp_native_reloc_t));
+        #endif
+
         mp_emit_glue_assign_native(emit->scope->raw_code,
             emit->do_viper_types ? MP_CODE_NATIVE_VIPER : MP_CODE_NATIVE_PY,
             f, f_len, (mp_uint_t*)((byte*)f + emit->const_table_offset),
+            #if N_PERSISTENT
+            emit->prelude_offset, relocs, emit->reloc_len,
+            #elif MICROPY_PERSISTENT_CODE_SAVE
+            emit->prelude_offset, NULL, 0,
+            #endif
             emit->scope->num_pos_args, emit->scope->scope_flags, type_sig);
     }
 }
@@ -635,7 +1141,11 @@ STATIC void need_stack_settled(emit_t *emit) {
         if (si->kind == STACK_IMM) {
             DEBUG_printf("    imm(" INT_FMT ") to local(%u)\n", si->data.u_imm, emit->stack_start + i);
             si->kind = STACK_VALUE;
-            ASM_MOV_IMM_TO_LOCAL_USING(emit->as, si->data.u_imm, emit->stack_start + i, REG_TEMP0);
+            if (si->vtype == VTYPE_PYOBJ) {
+                emit_native_mov_local_const(emit, emit->stack_start + i, (mp_obj_t)si->data.u_imm, REG_TEMP0);
+            } else {
+                ASM_MOV_IMM_TO_LOCAL_USING(emit->as, si->data.u_imm, emit->stack_start + i, REG_TEMP0);
+            }
         }
     }
 }
@@ -657,7 +1167,11 @@ STATIC void emit_access_stack(emit_t *emit, int pos, vtype_kind_t *vtype, int re
             break;
 
         case STACK_IMM:
-            ASM_MOV_IMM_TO_REG(emit->as, si->data.u_imm, reg_dest);
+            if (si->vtype == VTYPE_PYOBJ) {
+                emit_native_mov_reg_const(emit, reg_dest, (mp_obj_t)si->data.u_imm);
+            } else {
+                ASM_MOV_IMM_TO_REG(emit->as, si->data.u_imm, reg_dest);
+            }
             break;
     }
 }
@@ -758,36 +1272,33 @@ STATIC void emit_post_push_reg_reg_reg_reg(emit_t *emit, vtype_kind_t vtypea, in
 
 STATIC void emit_call(emit_t *emit, mp_fun_kind_t fun_kind) {
     need_reg_all(emit);
-    ASM_CALL_IND(emit->as, mp_fun_table[fun_kind], fun_kind);
+    emit_native_call_ind(emit, fun_kind);
 }
 
 STATIC void emit_call_with_imm_arg(emit_t *emit, mp_fun_kind_t fun_kind, mp_int_t arg_val, int arg_reg) {
     need_reg_all(emit);
     ASM_MOV_IMM_TO_REG(emit->as, arg_val, arg_reg);
-    ASM_CALL_IND(emit->as, mp_fun_table[fun_kind], fun_kind);
+    emit_native_call_ind(emit, fun_kind);
 }
 
-// the first arg is stored in the code aligned on a mp_uint_t boundary
-STATIC void emit_call_with_imm_arg_aligned(emit_t *emit, mp_fun_kind_t fun_kind, mp_int_t arg_val, int arg_reg) {
+STATIC void emit_call_with_qstr_arg(emit_t *emit, mp_fun_kind_t fun_kind, qstr qst, int arg_reg) {
     need_reg_all(emit);
-    ASM_MOV_ALIGNED_IMM_TO_REG(emit->as, arg_val, arg_reg);
-    ASM_CALL_IND(emit->as, mp_fun_table[fun_kind], fun_kind);
+    emit_native_mov_reg_reloc(emit, arg_reg, MP_NATIVE_RELOC_QSTR, qst, false);
+    emit_native_call_ind(emit, fun_kind);
 }
 
-STATIC void emit_call_with_2_imm_args(emit_t *emit, mp_fun_kind_t fun_kind, mp_int_t arg_val1, int arg_reg1, mp_int_t arg_val2, int arg_reg2) {
+// the raw code is stored in the code aligned on a mp_uint_t boundary
+STATIC void emit_call_with_raw_code_arg(emit_t *emit, mp_fun_kind_t fun_kind, mp_raw_code_t *rc, int arg_reg) {
     need_reg_all(emit);
-    ASM_MOV_IMM_TO_REG(emit->as, arg_val1, arg_reg1);
-    ASM_MOV_IMM_TO_REG(emit->as, arg_val2, arg_reg2);
-    ASM_CALL_IND(emit->as, mp_fun_table[fun_kind], fun_kind);
+    emit_native_mov_reg_reloc(emit, arg_reg, MP_NATIVE_RELOC_RAW_CODE, (mp_uint_t)rc, true);
+    emit_native_call_ind(emit, fun_kind);
 }
 
-// the first arg is stored in the code aligned on a mp_uint_t boundary
-STATIC void emit_call_with_3_imm_args_and_first_aligned(emit_t *emit, mp_fun_kind_t fun_kind, mp_int_t arg_val1, int arg_reg1, mp_int_t arg_val2, int arg_reg2, mp_int_t arg_val3, int arg_reg3) {
+STATIC void emit_call_with_2_imm_args(emit_t *emit, mp_fun_kind_t fun_kind, mp_int_t arg_val1, int arg_reg1, mp_int_t arg_val2, int arg_reg2) {
     need_reg_all(emit);
-    ASM_MOV_ALIGNED_IMM_TO_REG(emit->as, arg_val1, arg_reg1);
+    ASM_MOV_IMM_TO_REG(emit->as, arg_val1, arg_reg1);
     ASM_MOV_IMM_TO_REG(emit->as, arg_val2, arg_reg2);
-    ASM_MOV_IMM_TO_REG(emit->as, arg_val3, arg_reg3);
-    ASM_CALL_IND(emit->as, mp_fun_table[fun_kind], fun_kind);
+    emit_native_call_ind(emit, fun_kind);
 }
 
 // vtype of all n_pop objects is VTYPE_PYOBJ
@@ -806,13 +1317,13 @@ STATIC void emit_get_stack_pointer_to_reg_for_pop(emit_t *emit, mp_uint_t reg_de
             si->kind = STACK_VALUE;
             switch (si->vtype) {
                 case VTYPE_PYOBJ:
-                    ASM_MOV_IMM_TO_LOCAL_USING(emit->as, si->data.u_imm, emit->stack_start + emit->stack_size - 1 - i, reg_dest);
+                    emit_native_mov_local_const(emit, emit->stack_start + emit->stack_size - 1 - i, (mp_obj_t)si->data.u_imm, reg_dest);
                     break;
                 case VTYPE_BOOL:
                     if (si->data.u_imm == 0) {
-                        ASM_MOV_IMM_TO_LOCAL_USING(emit->as, (mp_uint_t)mp_const_false, emit->stack_start + emit->stack_size - 1 - i, reg_dest);
+                        emit_native_mov_local_const(emit, emit->stack_start + emit->stack_size - 1 - i, mp_const_false, reg_dest);
                     } else {
-                        ASM_MOV_IMM_TO_LOCAL_USING(emit->as, (mp_uint_t)mp_const_true, emit->stack_start + emit->stack_size - 1 - i, reg_dest);
+                        emit_native_mov_local_const(emit, emit->stack_start + emit->stack_size - 1 - i, mp_const_true, reg_dest);
                     }
                     si->vtype = VTYPE_PYOBJ;
                     break;
@@ -866,6 +1377,9 @@ STATIC void emit_native_label_assign(emit_t *emit, mp_uint_t l) {
     // need to commit stack because we can jump here from elsewhere
     need_stack_settled(emit);
     mp_asm_base_label_assign(&emit->as->base, l);
+    if (emit->pass == MP_PASS_STACK_SIZE && l < emit->gen_label_base) {
+        emit->label_use_pos[l] = emit->local_use_len;
+    }
     emit_post(emit);
 }
 
@@ -879,7 +1393,7 @@ STATIC void emit_native_import_name(emit_t *emit, qstr qst) {
         stack_info_t *top = peek_stack(emit, 0);
         if (top->vtype == VTYPE_PTR_NONE) {
             emit_pre_pop_discard(emit);
-            ASM_MOV_IMM_TO_REG(emit->as, (mp_uint_t)mp_const_none, REG_ARG_2);
+            emit_native_mov_reg_const(emit, REG_ARG_2, mp_const_none);
         } else {
             vtype_kind_t vtype_fromlist;
             emit_pre_pop_reg(emit, &vtype_fromlist, REG_ARG_2);
@@ -900,7 +1414,7 @@ STATIC void emit_native_import_name(emit_t *emit, qstr qst) {
         assert(vtype_level == VTYPE_PYOBJ);
     }
 
-    emit_call_with_imm_arg(emit, MP_F_IMPORT_NAME, qst, REG_ARG_1); // arg1 = import name
+    emit_call_with_qstr_arg(emit, MP_F_IMPORT_NAME, qst, REG_ARG_1); // arg1 = import name
     emit_post_push_reg(emit, VTYPE_PYOBJ, REG_RET);
 }
 
@@ -910,7 +1424,7 @@ STATIC void emit_native_import_from(emit_t *emit, qstr qst) {
     vtype_kind_t vtype_module;
     emit_access_stack(emit, 1, &vtype_module, REG_ARG_1); // arg1 = module
     assert(vtype_module == VTYPE_PYOBJ);
-    emit_call_with_imm_arg(emit, MP_F_IMPORT_FROM, qst, REG_ARG_2); // arg2 = import name
+    emit_call_with_qstr_arg(emit, MP_F_IMPORT_FROM, qst, REG_ARG_2); // arg2 = import name
     emit_post_push_reg(emit, VTYPE_PYOBJ, REG_RET);
 }
 
@@ -979,7 +1493,7 @@ STATIC void emit_native_load_const_str(emit_t *emit, qstr qst) {
 STATIC void emit_native_load_const_obj(emit_t *emit, mp_obj_t obj) {
     emit_native_pre(emit);
     need_reg_single(emit, REG_RET, 0);
-    ASM_MOV_ALIGNED_IMM_TO_REG(emit->as, (mp_uint_t)obj, REG_RET);
+    emit_native_mov_reg_reloc(emit, REG_RET, MP_NATIVE_RELOC_OBJ, (mp_uint_t)obj, true);
     emit_post_push_reg(emit, VTYPE_PYOBJ, REG_RET);
 }
 
@@ -995,16 +1509,13 @@ STATIC void emit_native_load_fast(emit_t *emit, qstr qst, mp_uint_t local_num) {
         EMIT_NATIVE_VIPER_TYPE_ERROR(emit, "local '%q' used before type known", qst);
     }
     emit_native_pre(emit);
-    if (local_num == 0) {
-        emit_post_push_reg(emit, vtype, REG_LOCAL_1);
-    } else if (local_num == 1) {
-        emit_post_push_reg(emit, vtype, REG_LOCAL_2);
-    } else if (local_num == 2) {
-        emit_post_push_reg(emit, vtype, REG_LOCAL_3);
+    emit_native_note_local_use(emit, local_num);
+    if (emit->local_reg[local_num] != LOCAL_REG_NONE) {
+        emit_post_push_reg(emit, vtype, emit->local_reg[local_num]);
     } else {
         need_reg_single(emit, REG_TEMP0, 0);
         if (emit->do_viper_types) {
-            ASM_MOV_LOCAL_TO_REG(emit->as, local_num - REG_LOCAL_NUM, REG_TEMP0);
+            ASM_MOV_LOCAL_TO_REG(emit->as, emit->local_slot[local_num], REG_TEMP0);
         } else {
             ASM_MOV_LOCAL_TO_REG(emit->as, STATE_START + emit->n_state - 1 - local_num, REG_TEMP0);
         }
@@ -1027,7 +1538,7 @@ STATIC void emit_native_load_deref(emit_t *emit, qstr qst, mp_uint_t local_num)
 STATIC void emit_native_load_name(emit_t *emit, qstr qst) {
     DEBUG_printf("load_name(%s)\n", qstr_str(qst));
     emit_native_pre(emit);
-    emit_call_with_imm_arg(emit, MP_F_LOAD_NAME, qst, REG_ARG_1);
+    emit_call_with_qstr_arg(emit, MP_F_LOAD_NAME, qst, REG_ARG_1);
     emit_post_push_reg(emit, VTYPE_PYOBJ, REG_RET);
 }
 
@@ -1047,8 +1558,16 @@ STATIC void emit_native_load_global(emit_t *emit, qstr qst) {
         emit_post_push_imm(emit, VTYPE_BUILTIN_CAST, VTYPE_PTR16);
     } else if (emit->do_viper_types && qst == MP_QSTR_ptr32) {
         emit_post_push_imm(emit, VTYPE_BUILTIN_CAST, VTYPE_PTR32);
+    #if N_FLOAT
+    } else if (emit->do_viper_types && qst == MP_QSTR_float) {
+        emit_post_push_imm(emit, VTYPE_BUILTIN_CAST, VTYPE_FLOAT);
+    } else if (emit->do_viper_types && qst == MP_QSTR_ptrf) {
+        emit_post_push_imm(emit, VTYPE_BUILTIN_CAST, VTYPE_PTRF);
+    } else if (emit->do_viper_types && qst == MP_QSTR_ptrd) {
+        emit_post_push_imm(emit, VTYPE_BUILTIN_CAST, VTYPE_PTRD);
+    #endif
     } else {
-        emit_call_with_imm_arg(emit, MP_F_LOAD_GLOBAL, qst, REG_ARG_1);
+        emit_call_with_qstr_arg(emit, MP_F_LOAD_GLOBAL, qst, REG_ARG_1);
         emit_post_push_reg(emit, VTYPE_PYOBJ, REG_RET);
     }
 }
@@ -1061,7 +1580,7 @@ STATIC void emit_native_load_attr(emit_t *emit, qstr qst) {
     vtype_kind_t vtype_base;
     emit_pre_pop_reg(emit, &vtype_base, REG_ARG_1); // arg1 = base
     assert(vtype_base == VTYPE_PYOBJ);
-    emit_call_with_imm_arg(emit, MP_F_LOAD_ATTR, qst, REG_ARG_2); // arg2 = attribute name
+    emit_call_with_qstr_arg(emit, MP_F_LOAD_ATTR, qst, REG_ARG_2); // arg2 = attribute name
     emit_post_push_reg(emit, VTYPE_PYOBJ, REG_RET);
 }
 
@@ -1070,7 +1589,7 @@ STATIC void emit_native_load_method(emit_t *emit, qstr qst) {
     emit_pre_pop_reg(emit, &vtype_base, REG_ARG_1); // arg1 = base
     assert(vtype_base == VTYPE_PYOBJ);
     emit_get_stack_pointer_to_reg_for_push(emit, REG_ARG_3, 2); // arg3 = dest ptr
-    emit_call_with_imm_arg(emit, MP_F_LOAD_METHOD, qst, REG_ARG_2); // arg2 = method name
+    emit_call_with_qstr_arg(emit, MP_F_LOAD_METHOD, qst, REG_ARG_2); // arg2 = method name
 }
 
 STATIC void emit_native_load_build_class(emit_t *emit) {
@@ -1079,6 +1598,77 @@ STATIC void emit_native_load_build_class(emit_t *emit) {
     emit_post_push_reg(emit, VTYPE_PYOBJ, REG_RET);
 }
 
+#if N_FLOAT
+// For an immediate index into a ptrf/ptrd return the byte displacement of the
+// element from *reg_base, or if that is out of range use reg_temp to hold the
+// element's address and return 0
+STATIC mp_int_t emit_native_float_disp(emit_t *emit, vtype_kind_t vtype_base, int *reg_base, int reg_temp, mp_int_t index_value) {
+    int shift = vtype_base == VTYPE_PTRD ? 3 : 2;
+    if (-0x10000000 <= index_value && index_value < 0x10000000) {
+        return index_value << shift;
+    }
+    ASM_MOV_IMM_TO_REG(emit->as, (mp_uint_t)index_value << shift, reg_temp);
+    ASM_ADD_REG_REG(emit->as, reg_temp, *reg_base);
+    *reg_base = reg_temp;
+    return 0;
+}
+
+// Add the byte offset of element reg_index of a ptrf/ptrd to reg_base,
+// using REG_RET as a temporary
+STATIC void emit_native_float_index(emit_t *emit, vtype_kind_t vtype_base, int reg_base, int reg_index) {
+    need_reg_single(emit, REG_RET, 0);
+    if (reg_index != REG_RET) {
+        ASM_MOV_REG_REG(emit->as, REG_RET, reg_index);
+    }
+    ASM_ADD_REG_REG(emit->as, REG_RET, REG_RET); // 2*index
+    ASM_ADD_REG_REG(emit->as, REG_RET, REG_RET); // 4*index
+    if (vtype_base == VTYPE_PTRD) {
+        ASM_ADD_REG_REG(emit->as, REG_RET, REG_RET); // 8*index
+    }
+    ASM_ADD_REG_REG(emit->as, reg_base, REG_RET);
+}
+
+// Load an element of a ptrf/ptrd into REG_RET as a float
+STATIC void emit_native_load_float(emit_t *emit, vtype_kind_t vtype_base, int reg_base, mp_int_t disp) {
+    need_reg_single(emit, REG_RET, 0);
+    if (vtype_base == VTYPE_PTRF) {
+        asm_x64_cvtss2sd_mem32_to_xmm(emit->as, reg_base, disp, ASM_X64_REG_XMM0);
+        asm_x64_movq_xmm_to_r64(emit->as, REG_RET, ASM_X64_REG_XMM0);
+    } else {
+        asm_x64_mov_mem64_to_r64(emit->as, reg_base, disp, REG_RET);
+    }
+}
+
+// Convert a float in reg_value to the element format of a ptrf/ptrd, in XMM0
+STATIC void emit_native_float_to_element(emit_t *emit, vtype_kind_t vtype_base, int reg_value) {
+    asm_x64_movq_r64_to_xmm(emit->as, ASM_X64_REG_XMM0, reg_value);
+    if (vtype_base == VTYPE_PTRF) {
+        asm_x64_cvtsd2ss_xmm_xmm(emit->as, ASM_X64_REG_XMM0, ASM_X64_REG_XMM0);
+    }
+}
+
+// Store the element in XMM0 to a ptrf/ptrd
+STATIC void emit_native_store_float(emit_t *emit, vtype_kind_t vtype_base, int reg_base, mp_int_t disp) {
+    if (vtype_base == VTYPE_PTRF) {
+        asm_x64_movss_xmm_to_mem32(emit->as, ASM_X64_REG_XMM0, reg_base, disp);
+    } else {
+        asm_x64_movsd_xmm_to_mem64(emit->as, ASM_X64_REG_XMM0, reg_base, disp);
+    }
+}
+#endif
+
+// Whether a value of type vtype_value can be stored through a viper pointer
+STATIC bool emit_native_viper_can_store(vtype_kind_t vtype_base, vtype_kind_t vtype_value) {
+    #if N_FLOAT
+    if (vtype_base == VTYPE_PTRF || vtype_base == VTYPE_PTRD) {
+        return vtype_value == VTYPE_FLOAT;
+    }
+    #else
+    (void)vtype_base;
+    #endif
+    return vtype_value == VTYPE_BOOL || vtype_value == VTYPE_INT || vtype_value == VTYPE_UINT;
+}
+
 STATIC void emit_native_load_subscr(emit_t *emit) {
     DEBUG_printf("load_subscr\n");
     // need to compile: base[index]
@@ -1114,6 +1704,8 @@ STATIC void emit_native_load_subscr(emit_t *emit) {
             int reg_base = REG_ARG_1;
             int reg_index = REG_ARG_2;
             emit_pre_pop_reg_flexible(emit, &vtype_base, &reg_base, reg_index, reg_index);
+            // the loaded value goes in REG_RET, which may hold a value lower down the stack
+            need_reg_single(emit, REG_RET, 0);
             switch (vtype_base) {
                 case VTYPE_PTR8: {
                     // pointer to 8-bit memory
@@ -1167,6 +1759,15 @@ STATIC void emit_native_load_subscr(emit_t *emit) {
                     ASM_LOAD32_REG_REG(emit->as, REG_RET, reg_base); // load from (base+4*index)
                     break;
                 }
+                #if N_FLOAT
+                case VTYPE_PTRF:
+                case VTYPE_PTRD: {
+                    // pointer to single or double precision floats
+                    mp_int_t disp = emit_native_float_disp(emit, vtype_base, &reg_base, reg_index, index_value);
+                    emit_native_load_float(emit, vtype_base, reg_base, disp);
+                    break;
+                }
+                #endif
                 default:
                     EMIT_NATIVE_VIPER_TYPE_ERROR(emit,
                         "can't load from '%q'", vtype_to_qstr(vtype_base));
@@ -1177,6 +1778,7 @@ STATIC void emit_native_load_subscr(emit_t *emit) {
             int reg_index = REG_ARG_2;
             emit_pre_pop_reg_flexible(emit, &vtype_index, &reg_index, REG_ARG_1, REG_ARG_1);
             emit_pre_pop_reg(emit, &vtype_base, REG_ARG_1);
+            need_reg_single(emit, REG_RET, 0);
             if (vtype_index != VTYPE_INT && vtype_index != VTYPE_UINT) {
                 EMIT_NATIVE_VIPER_TYPE_ERROR(emit,
                     "can't load with '%q' index", vtype_to_qstr(vtype_index));
@@ -1205,27 +1807,39 @@ STATIC void emit_native_load_subscr(emit_t *emit) {
                     ASM_LOAD32_REG_REG(emit->as, REG_RET, REG_ARG_1); // load from (base+4*index)
                     break;
                 }
+                #if N_FLOAT
+                case VTYPE_PTRF:
+                case VTYPE_PTRD: {
+                    // pointer to single or double precision floats
+                    emit_native_float_index(emit, vtype_base, REG_ARG_1, reg_index);
+                    emit_native_load_float(emit, vtype_base, REG_ARG_1, 0);
+                    break;
+                }
+                #endif
                 default:
                     EMIT_NATIVE_VIPER_TYPE_ERROR(emit,
                         "can't load from '%q'", vtype_to_qstr(vtype_base));
             }
         }
+        #if N_FLOAT
+        if (vtype_base == VTYPE_PTRF || vtype_base == VTYPE_PTRD) {
+            emit_post_push_reg(emit, VTYPE_FLOAT, REG_RET);
+            return;
+        }
+        #endif
         emit_post_push_reg(emit, VTYPE_INT, REG_RET);
     }
 }
 
 STATIC void emit_native_store_fast(emit_t *emit, qstr qst, mp_uint_t local_num) {
     vtype_kind_t vtype;
-    if (local_num == 0) {
-        emit_pre_pop_reg(emit, &vtype, REG_LOCAL_1);
-    } else if (local_num == 1) {
-        emit_pre_pop_reg(emit, &vtype, REG_LOCAL_2);
-    } else if (local_num == 2) {
-        emit_pre_pop_reg(emit, &vtype, REG_LOCAL_3);
+    emit_native_note_local_use(emit, local_num);
+    if (emit->local_reg[local_num] != LOCAL_REG_NONE) {
+        emit_pre_pop_reg(emit, &vtype, emit->local_reg[local_num]);
     } else {
         emit_pre_pop_reg(emit, &vtype, REG_TEMP0);
         if (emit->do_viper_types) {
-            ASM_MOV_REG_TO_LOCAL(emit->as, REG_TEMP0, local_num - REG_LOCAL_NUM);
+            ASM_MOV_REG_TO_LOCAL(emit->as, REG_TEMP0, emit->local_slot[local_num]);
         } else {
             ASM_MOV_REG_TO_LOCAL(emit->as, REG_TEMP0, STATE_START + emit->n_state - 1 - local_num);
         }
@@ -1263,7 +1877,7 @@ STATIC void emit_native_store_name(emit_t *emit, qstr qst) {
     vtype_kind_t vtype;
     emit_pre_pop_reg(emit, &vtype, REG_ARG_2);
     assert(vtype == VTYPE_PYOBJ);
-    emit_call_with_imm_arg(emit, MP_F_STORE_NAME, qst, REG_ARG_1); // arg1 = name
+    emit_call_with_qstr_arg(emit, MP_F_STORE_NAME, qst, REG_ARG_1); // arg1 = name
     emit_post(emit);
 }
 
@@ -1276,7 +1890,7 @@ STATIC void emit_native_store_global(emit_t *emit, qstr qst) {
         emit_call_with_imm_arg(emit, MP_F_CONVERT_NATIVE_TO_OBJ, vtype, REG_ARG_2); // arg2 = type
         ASM_MOV_REG_REG(emit->as, REG_ARG_2, REG_RET);
     }
-    emit_call_with_imm_arg(emit, MP_F_STORE_GLOBAL, qst, REG_ARG_1); // arg1 = name
+    emit_call_with_qstr_arg(emit, MP_F_STORE_GLOBAL, qst, REG_ARG_1); // arg1 = name
     emit_post(emit);
 }
 
@@ -1285,7 +1899,7 @@ STATIC void emit_native_store_attr(emit_t *emit, qstr qst) {
     emit_pre_pop_reg_reg(emit, &vtype_base, REG_ARG_1, &vtype_val, REG_ARG_3); // arg1 = base, arg3 = value
     assert(vtype_base == VTYPE_PYOBJ);
     assert(vtype_val == VTYPE_PYOBJ);
-    emit_call_with_imm_arg(emit, MP_F_STORE_ATTR, qst, REG_ARG_2); // arg2 = attribute name
+    emit_call_with_qstr_arg(emit, MP_F_STORE_ATTR, qst, REG_ARG_2); // arg2 = attribute name
     emit_post(emit);
 }
 
@@ -1330,7 +1944,7 @@ STATIC void emit_native_store_subscr(emit_t *emit) {
             #else
             emit_pre_pop_reg_flexible(emit, &vtype_value, &reg_value, reg_base, reg_index);
             #endif
-            if (vtype_value != VTYPE_BOOL && vtype_value != VTYPE_INT && vtype_value != VTYPE_UINT) {
+            if (!emit_native_viper_can_store(vtype_base, vtype_value)) {
                 EMIT_NATIVE_VIPER_TYPE_ERROR(emit,
                     "can't store '%q'", vtype_to_qstr(vtype_value));
             }
@@ -1399,6 +2013,16 @@ STATIC void emit_native_store_subscr(emit_t *emit) {
                     ASM_STORE32_REG_REG(emit->as, reg_value, reg_base); // store value to (base+4*index)
                     break;
                 }
+                #if N_FLOAT
+                case VTYPE_PTRF:
+                case VTYPE_PTRD: {
+                    // pointer to single or double precision floats
+                    emit_native_float_to_element(emit, vtype_base, reg_value);
+                    mp_int_t disp = emit_native_float_disp(emit, vtype_base, &reg_base, reg_index, index_value);
+                    emit_native_store_float(emit, vtype_base, reg_base, disp);
+                    break;
+                }
+                #endif
                 default:
                     EMIT_NATIVE_VIPER_TYPE_ERROR(emit,
                         "can't store to '%q'", vtype_to_qstr(vtype_base));
@@ -1420,7 +2044,7 @@ STATIC void emit_native_store_subscr(emit_t *emit) {
             #else
             emit_pre_pop_reg_flexible(emit, &vtype_value, &reg_value, REG_ARG_1, reg_index);
             #endif
-            if (vtype_value != VTYPE_BOOL && vtype_value != VTYPE_INT && vtype_value != VTYPE_UINT) {
+            if (!emit_native_viper_can_store(vtype_base, vtype_value)) {
                 EMIT_NATIVE_VIPER_TYPE_ERROR(emit,
                     "can't store '%q'", vtype_to_qstr(vtype_value));
             }
@@ -1460,6 +2084,17 @@ STATIC void emit_native_store_subscr(emit_t *emit) {
                     ASM_STORE32_REG_REG(emit->as, reg_value, REG_ARG_1); // store value to (base+4*index)
                     break;
                 }
+                #if N_FLOAT
+                case VTYPE_PTRF:
+                case VTYPE_PTRD: {
+                    // pointer to single or double precision floats
+                    // (the value is converted first so that its register is free)
+                    emit_native_float_to_element(emit, vtype_base, reg_value);
+                    emit_native_float_index(emit, vtype_base, REG_ARG_1, reg_index);
+                    emit_native_store_float(emit, vtype_base, REG_ARG_1, 0);
+                    break;
+                }
+                #endif
                 default:
                     EMIT_NATIVE_VIPER_TYPE_ERROR(emit,
                         "can't store to '%q'", vtype_to_qstr(vtype_base));
@@ -1486,13 +2121,13 @@ STATIC void emit_native_delete_deref(emit_t *emit, qstr qst, mp_uint_t local_num
 
 STATIC void emit_native_delete_name(emit_t *emit, qstr qst) {
     emit_native_pre(emit);
-    emit_call_with_imm_arg(emit, MP_F_DELETE_NAME, qst, REG_ARG_1);
+    emit_call_with_qstr_arg(emit, MP_F_DELETE_NAME, qst, REG_ARG_1);
     emit_post(emit);
 }
 
 STATIC void emit_native_delete_global(emit_t *emit, qstr qst) {
     emit_native_pre(emit);
-    emit_call_with_imm_arg(emit, MP_F_DELETE_GLOBAL, qst, REG_ARG_1);
+    emit_call_with_qstr_arg(emit, MP_F_DELETE_GLOBAL, qst, REG_ARG_1);
     emit_post(emit);
 }
 
@@ -1500,7 +2135,9 @@ STATIC void emit_native_delete_attr(emit_t *emit, qstr qst) {
     vtype_kind_t vtype_base;
     emit_pre_pop_reg(emit, &vtype_base, REG_ARG_1); // arg1 = base
     assert(vtype_base == VTYPE_PYOBJ);
-    emit_call_with_2_imm_args(emit, MP_F_STORE_ATTR, qst, REG_ARG_2, (mp_uint_t)MP_OBJ_NULL, REG_ARG_3); // arg2 = attribute name, arg3 = value (null for delete)
+    need_reg_all(emit);
+    ASM_MOV_IMM_TO_REG(emit->as, (mp_uint_t)MP_OBJ_NULL, REG_ARG_3); // arg3 = value (null for delete)
+    emit_call_with_qstr_arg(emit, MP_F_STORE_ATTR, qst, REG_ARG_2); // arg2 = attribute name
     emit_post(emit);
 }
 
@@ -1551,6 +2188,7 @@ STATIC void emit_native_jump(emit_t *emit, mp_uint_t label) {
     emit_native_pre(emit);
     // need to commit stack because we are jumping elsewhere
     need_stack_settled(emit);
+    emit_native_note_jump(emit, label);
     ASM_JUMP(emit->as, label);
     emit_post(emit);
 }
@@ -1585,6 +2223,7 @@ STATIC void emit_native_jump_helper(emit_t *emit, bool pop) {
 STATIC void emit_native_pop_jump_if(emit_t *emit, bool cond, mp_uint_t label) {
     DEBUG_printf("pop_jump_if(cond=%u, label=" UINT_FMT ")\n", cond, label);
     emit_native_jump_helper(emit, true);
+    emit_native_note_jump(emit, label);
     if (cond) {
         ASM_JUMP_IF_REG_NONZERO(emit->as, REG_RET, label);
     } else {
@@ -1596,6 +2235,7 @@ STATIC void emit_native_pop_jump_if(emit_t *emit, bool cond, mp_uint_t label) {
 STATIC void emit_native_jump_if_or_pop(emit_t *emit, bool cond, mp_uint_t label) {
     DEBUG_printf("jump_if_or_pop(cond=%u, label=" UINT_FMT ")\n", cond, label);
     emit_native_jump_helper(emit, false);
+    emit_native_note_jump(emit, label);
     if (cond) {
         ASM_JUMP_IF_REG_NONZERO(emit->as, REG_RET, label);
     } else {
@@ -1624,7 +2264,7 @@ STATIC void emit_native_setup_with(emit_t *emit, mp_uint_t label) {
     emit_access_stack(emit, 1, &vtype, REG_ARG_1); // arg1 = ctx_mgr
     assert(vtype == VTYPE_PYOBJ);
     emit_get_stack_pointer_to_reg_for_push(emit, REG_ARG_3, 2); // arg3 = dest ptr
-    emit_call_with_imm_arg(emit, MP_F_LOAD_METHOD, MP_QSTR___exit__, REG_ARG_2);
+    emit_call_with_qstr_arg(emit, MP_F_LOAD_METHOD, MP_QSTR___exit__, REG_ARG_2);
     // stack: (..., ctx_mgr, __exit__, self)
 
     emit_pre_pop_reg(emit, &vtype, REG_ARG_3); // self
@@ -1637,7 +2277,7 @@ STATIC void emit_native_setup_with(emit_t *emit, mp_uint_t label) {
 
     // get __enter__ method
     emit_get_stack_pointer_to_reg_for_push(emit, REG_ARG_3, 2); // arg3 = dest ptr
-    emit_call_with_imm_arg(emit, MP_F_LOAD_METHOD, MP_QSTR___enter__, REG_ARG_2); // arg2 = method name
+    emit_call_with_qstr_arg(emit, MP_F_LOAD_METHOD, MP_QSTR___enter__, REG_ARG_2); // arg2 = method name
     // stack: (..., __exit__, self, __enter__, self)
 
     // call __enter__ method
@@ -1648,11 +2288,12 @@ STATIC void emit_native_setup_with(emit_t *emit, mp_uint_t label) {
 
     // need to commit stack because we may jump elsewhere
     need_stack_settled(emit);
-    emit_get_stack_pointer_to_reg_for_push(emit, REG_ARG_1, sizeof(nlr_buf_t) / sizeof(mp_uint_t)); // arg1 = pointer to nlr buf
+    emit_native_push_exc_stack(emit, label);
+    emit_get_stack_pointer_to_reg_for_push(emit, REG_ARG_1, NLR_BUF_WORDS); // arg1 = pointer to nlr buf
     emit_call(emit, MP_F_NLR_PUSH);
     ASM_JUMP_IF_REG_NONZERO(emit->as, REG_RET, label);
 
-    emit_access_stack(emit, sizeof(nlr_buf_t) / sizeof(mp_uint_t) + 1, &vtype, REG_RET); // access return value of __enter__
+    emit_access_stack(emit, NLR_BUF_WORDS + 1, &vtype, REG_RET); // access return value of __enter__
     emit_post_push_reg(emit, VTYPE_PYOBJ, REG_RET); // push return value of __enter__
     // stack: (..., __exit__, self, as_value, nlr_buf, as_value)
 }
@@ -1663,7 +2304,8 @@ STATIC void emit_native_with_cleanup(emit_t *emit, mp_uint_t label) {
     // stack: (..., __exit__, self, as_value, nlr_buf)
     emit_native_pre(emit);
     emit_call(emit, MP_F_NLR_POP);
-    adjust_stack(emit, -(mp_int_t)(sizeof(nlr_buf_t) / sizeof(mp_uint_t)) - 1);
+    emit_native_pop_exc_stack(emit);
+    adjust_stack(emit, -(mp_int_t)NLR_BUF_WORDS - 1);
     // stack: (..., __exit__, self)
 
     // call __exit__
@@ -1730,7 +2372,8 @@ STATIC void emit_native_setup_except(emit_t *emit, mp_uint_t label) {
     emit_native_pre(emit);
     // need to commit stack because we may jump elsewhere
     need_stack_settled(emit);
-    emit_get_stack_pointer_to_reg_for_push(emit, REG_ARG_1, sizeof(nlr_buf_t) / sizeof(mp_uint_t)); // arg1 = pointer to nlr buf
+    emit_native_push_exc_stack(emit, label);
+    emit_get_stack_pointer_to_reg_for_push(emit, REG_ARG_1, NLR_BUF_WORDS); // arg1 = pointer to nlr buf
     emit_call(emit, MP_F_NLR_PUSH);
     ASM_JUMP_IF_REG_NONZERO(emit->as, REG_RET, label);
     emit_post(emit);
@@ -1791,7 +2434,8 @@ STATIC void emit_native_for_iter_end(emit_t *emit) {
 STATIC void emit_native_pop_block(emit_t *emit) {
     emit_native_pre(emit);
     emit_call(emit, MP_F_NLR_POP);
-    adjust_stack(emit, -(mp_int_t)(sizeof(nlr_buf_t) / sizeof(mp_uint_t)) + 1);
+    emit_native_pop_exc_stack(emit);
+    adjust_stack(emit, -(mp_int_t)NLR_BUF_WORDS + 1);
     emit_post(emit);
 }
 
@@ -1812,10 +2456,102 @@ STATIC void emit_native_unary_op(emit_t *emit, mp_unary_op_t op) {
     }
 }
 
+#if N_FLOAT
+// Whether a value can be an operand of a float binary op; ints are converted
+// and objects are unboxed, raising TypeError at runtime if not a number
+STATIC bool emit_native_is_float_operand(vtype_kind_t vtype) {
+    return vtype == VTYPE_FLOAT || vtype == VTYPE_INT || vtype == VTYPE_UINT || vtype == VTYPE_PYOBJ;
+}
+
+// Unbox the object on top of the stack to a float
+STATIC void emit_native_unbox_float(emit_t *emit) {
+    vtype_kind_t vtype;
+    emit_pre_pop_reg(emit, &vtype, REG_ARG_1);
+    emit_call_with_imm_arg(emit, MP_F_CONVERT_OBJ_TO_NATIVE, VTYPE_FLOAT, REG_ARG_2); // arg2 = type
+    emit_post_push_reg(emit, VTYPE_FLOAT, REG_RET);
+}
+
+// Move a float or int operand to an SSE register, as a double
+STATIC void emit_native_mov_xmm_float(emit_t *emit, int dest_xmm, vtype_kind_t vtype, int src_reg) {
+    if (vtype == VTYPE_FLOAT) {
+        asm_x64_movq_r64_to_xmm(emit->as, dest_xmm, src_reg);
+    } else {
+        asm_x64_cvtsi2sd_r64_to_xmm(emit->as, dest_xmm, src_reg);
+    }
+}
+
+STATIC void emit_native_binary_op_float(emit_t *emit, mp_binary_op_t op) {
+    if (peek_vtype(emit, 0) == VTYPE_PYOBJ) {
+        emit_native_unbox_float(emit);
+    }
+    if (peek_vtype(emit, 1) == VTYPE_PYOBJ) {
+        emit_native_rot_two(emit);
+        emit_native_unbox_float(emit);
+        emit_native_rot_two(emit);
+    }
+    vtype_kind_t vtype_lhs, vtype_rhs;
+    emit_pre_pop_reg_reg(emit, &vtype_rhs, REG_ARG_3, &vtype_lhs, REG_ARG_2);
+    emit_native_mov_xmm_float(emit, ASM_X64_REG_XMM0, vtype_lhs, REG_ARG_2);
+    emit_native_mov_xmm_float(emit, ASM_X64_REG_XMM1, vtype_rhs, REG_ARG_3);
+    if (op == MP_BINARY_OP_ADD || op == MP_BINARY_OP_INPLACE_ADD) {
+        asm_x64_addsd_xmm_xmm(emit->as, ASM_X64_REG_XMM0, ASM_X64_REG_XMM1);
+    } else if (op == MP_BINARY_OP_SUBTRACT || op == MP_BINARY_OP_INPLACE_SUBTRACT) {
+        asm_x64_subsd_xmm_xmm(emit->as, ASM_X64_REG_XMM0, ASM_X64_REG_XMM1);
+    } else if (op == MP_BINARY_OP_MULTIPLY || op == MP_BINARY_OP_INPLACE_MULTIPLY) {
+        asm_x64_mulsd_xmm_xmm(emit->as, ASM_X64_REG_XMM0, ASM_X64_REG_XMM1);
+    } else if (op == MP_BINARY_OP_TRUE_DIVIDE || op == MP_BINARY_OP_INPLACE_TRUE_DIVIDE) {
+        // division by zero gives an infinity or nan, as for C doubles
+        asm_x64_divsd_xmm_xmm(emit->as, ASM_X64_REG_XMM0, ASM_X64_REG_XMM1);
+    } else if (MP_BINARY_OP_LESS <= op && op <= MP_BINARY_OP_NOT_EQUAL) {
+        // ucomisd compares like unsigned ints, so less-than comparisons swap
+        // the operands and use "above"; an unordered (nan) comparison sets all
+        // of ZF, PF and CF so is false for everything except not-equal
+        need_reg_single(emit, REG_RET, 0);
+        asm_x64_xor_r64_r64(emit->as, REG_RET, REG_RET);
+        if (op == MP_BINARY_OP_EQUAL || op == MP_BINARY_OP_NOT_EQUAL) {
+            need_reg_single(emit, ASM_X64_REG_RCX, 0);
+            asm_x64_xor_r64_r64(emit->as, ASM_X64_REG_RCX, ASM_X64_REG_RCX);
+            asm_x64_ucomisd_xmm_with_xmm(emit->as, ASM_X64_REG_XMM0, ASM_X64_REG_XMM1);
+            if (op == MP_BINARY_OP_EQUAL) {
+                asm_x64_setcc_r8(emit->as, ASM_X64_CC_JE, REG_RET);
+                asm_x64_setcc_r8(emit->as, ASM_X64_CC_JNP, ASM_X64_REG_RCX);
+                asm_x64_and_r64_r64(emit->as, REG_RET, ASM_X64_REG_RCX);
+            } else {
+                asm_x64_setcc_r8(emit->as, ASM_X64_CC_JNE, REG_RET);
+                asm_x64_setcc_r8(emit->as, ASM_X64_CC_JP, ASM_X64_REG_RCX);
+                asm_x64_or_r64_r64(emit->as, REG_RET, ASM_X64_REG_RCX);
+            }
+        } else if (op == MP_BINARY_OP_LESS || op == MP_BINARY_OP_LESS_EQUAL) {
+            asm_x64_ucomisd_xmm_with_xmm(emit->as, ASM_X64_REG_XMM1, ASM_X64_REG_XMM0);
+            asm_x64_setcc_r8(emit->as, op == MP_BINARY_OP_LESS ? ASM_X64_CC_JA : ASM_X64_CC_JAE, REG_RET);
+        } else {
+            asm_x64_ucomisd_xmm_with_xmm(emit->as, ASM_X64_REG_XMM0, ASM_X64_REG_XMM1);
+            asm_x64_setcc_r8(emit->as, op == MP_BINARY_OP_MORE ? ASM_X64_CC_JA : ASM_X64_CC_JAE, REG_RET);
+        }
+        emit_post_push_reg(emit, VTYPE_BOOL, REG_RET);
+        return;
+    } else {
+        adjust_stack(emit, 1);
+        EMIT_NATIVE_VIPER_TYPE_ERROR(emit,
+            "binary op %q not implemented", mp_binary_op_method_name[op]);
+        return;
+    }
+    asm_x64_movq_xmm_to_r64(emit->as, REG_ARG_2, ASM_X64_REG_XMM0);
+    emit_post_push_reg(emit, VTYPE_FLOAT, REG_ARG_2);
+}
+#endif
+
 STATIC void emit_native_binary_op(emit_t *emit, mp_binary_op_t op) {
     DEBUG_printf("binary_op(" UINT_FMT ")\n", op);
     vtype_kind_t vtype_lhs = peek_vtype(emit, 1);
     vtype_kind_t vtype_rhs = peek_vtype(emit, 0);
+    #if N_FLOAT
+    if ((vtype_lhs == VTYPE_FLOAT || vtype_rhs == VTYPE_FLOAT)
+        && emit_native_is_float_operand(vtype_lhs) && emit_native_is_float_operand(vtype_rhs)) {
+        emit_native_binary_op_float(emit, op);
+        return;
+    }
+    #endif
     if (vtype_lhs == VTYPE_INT && vtype_rhs == VTYPE_INT) {
         #if N_X64 || N_X86
         // special cases for x86 and shifting
@@ -2024,7 +2760,9 @@ STATIC void emit_native_build_slice(emit_t *emit, mp_uint_t n_args) {
         emit_pre_pop_reg_reg(emit, &vtype_stop, REG_ARG_2, &vtype_start, REG_ARG_1); // arg1 = start, arg2 = stop
         assert(vtype_start == VTYPE_PYOBJ);
         assert(vtype_stop == VTYPE_PYOBJ);
-        emit_call_with_imm_arg(emit, MP_F_NEW_SLICE, (mp_uint_t)mp_const_none, REG_ARG_3); // arg3 = step
+        need_reg_all(emit);
+        emit_native_mov_reg_const(emit, REG_ARG_3, mp_const_none); // arg3 = step
+        emit_call(emit, MP_F_NEW_SLICE);
         emit_post_push_reg(emit, VTYPE_PYOBJ, REG_RET);
     } else {
         assert(n_args == 3);
@@ -2090,13 +2828,16 @@ STATIC void emit_native_make_function(emit_t *emit, scope_t *scope, mp_uint_t n_
     // call runtime, with type info for args, or don't support dict/default params, or only support Python objects for them
     emit_native_pre(emit);
     if (n_pos_defaults == 0 && n_kw_defaults == 0) {
-        emit_call_with_3_imm_args_and_first_aligned(emit, MP_F_MAKE_FUNCTION_FROM_RAW_CODE, (mp_uint_t)scope->raw_code, REG_ARG_1, (mp_uint_t)MP_OBJ_NULL, REG_ARG_2, (mp_uint_t)MP_OBJ_NULL, REG_ARG_3);
+        need_reg_all(emit);
+        ASM_MOV_IMM_TO_REG(emit->as, (mp_uint_t)MP_OBJ_NULL, REG_ARG_2);
+        ASM_MOV_IMM_TO_REG(emit->as, (mp_uint_t)MP_OBJ_NULL, REG_ARG_3);
+        emit_call_with_raw_code_arg(emit, MP_F_MAKE_FUNCTION_FROM_RAW_CODE, scope->raw_code, REG_ARG_1);
     } else {
         vtype_kind_t vtype_def_tuple, vtype_def_dict;
         emit_pre_pop_reg_reg(emit, &vtype_def_dict, REG_ARG_3, &vtype_def_tuple, REG_ARG_2);
         assert(vtype_def_tuple == VTYPE_PYOBJ);
         assert(vtype_def_dict == VTYPE_PYOBJ);
-        emit_call_with_imm_arg_aligned(emit, MP_F_MAKE_FUNCTION_FROM_RAW_CODE, (mp_uint_t)scope->raw_code, REG_ARG_1);
+        emit_call_with_raw_code_arg(emit, MP_F_MAKE_FUNCTION_FROM_RAW_CODE, scope->raw_code, REG_ARG_1);
     }
     emit_post_push_reg(emit, VTYPE_PYOBJ, REG_RET);
 }
@@ -2110,11 +2851,34 @@ STATIC void emit_native_make_closure(emit_t *emit, scope_t *scope, mp_uint_t n_c
         emit_get_stack_pointer_to_reg_for_pop(emit, REG_ARG_3, n_closed_over + 2);
         ASM_MOV_IMM_TO_REG(emit->as, 0x100 | n_closed_over, REG_ARG_2);
     }
-    ASM_MOV_ALIGNED_IMM_TO_REG(emit->as, (mp_uint_t)scope->raw_code, REG_ARG_1);
-    ASM_CALL_IND(emit->as, mp_fun_table[MP_F_MAKE_CLOSURE_FROM_RAW_CODE], MP_F_MAKE_CLOSURE_FROM_RAW_CODE);
+    emit_native_mov_reg_reloc(emit, REG_ARG_1, MP_NATIVE_RELOC_RAW_CODE, (mp_uint_t)scope->raw_code, true);
+    emit_native_call_ind(emit, MP_F_MAKE_CLOSURE_FROM_RAW_CODE);
     emit_post_push_reg(emit, VTYPE_PYOBJ, REG_RET);
 }
 
+#if N_FLOAT
+// Cast the native value on top of the stack when it or the cast is a float;
+// float to int truncates towards zero, like int() of a float object
+STATIC void emit_native_cast_float(emit_t *emit, vtype_kind_t vtype_cast) {
+    vtype_kind_t vtype;
+    emit_pre_pop_reg(emit, &vtype, REG_RET);
+    emit_pre_pop_discard(emit);
+    if (vtype == vtype_cast) {
+        // nothing to do
+    } else if (vtype_cast == VTYPE_FLOAT && (vtype == VTYPE_BOOL || vtype == VTYPE_INT || vtype == VTYPE_UINT)) {
+        asm_x64_cvtsi2sd_r64_to_xmm(emit->as, ASM_X64_REG_XMM0, REG_RET);
+        asm_x64_movq_xmm_to_r64(emit->as, REG_RET, ASM_X64_REG_XMM0);
+    } else if (vtype == VTYPE_FLOAT && (vtype_cast == VTYPE_INT || vtype_cast == VTYPE_UINT)) {
+        asm_x64_movq_r64_to_xmm(emit->as, ASM_X64_REG_XMM0, REG_RET);
+        asm_x64_cvttsd2si_xmm_to_r64(emit->as, REG_RET, ASM_X64_REG_XMM0);
+    } else {
+        EMIT_NATIVE_VIPER_TYPE_ERROR(emit,
+            "can't cast '%q' to '%q'", vtype_to_qstr(vtype), vtype_to_qstr(vtype_cast));
+    }
+    emit_post_push_reg(emit, vtype_cast, REG_RET);
+}
+#endif
+
 STATIC void emit_native_call_function(emit_t *emit, mp_uint_t n_positional, mp_uint_t n_keyword, mp_uint_t star_flags) {
     DEBUG_printf("call_function(n_pos=" UINT_FMT ", n_kw=" UINT_FMT ", star_flags=" UINT_FMT ")\n", n_positional, n_keyword, star_flags);
 
@@ -2145,10 +2909,25 @@ STATIC void emit_native_call_function(emit_t *emit, mp_uint_t n_positional, mp_u
             case VTYPE_PTR8:
             case VTYPE_PTR16:
             case VTYPE_PTR32:
+            #if N_FLOAT
+            case VTYPE_PTRF:
+            case VTYPE_PTRD:
+            #endif
             case VTYPE_PTR_NONE:
+                #if N_FLOAT
+                if (vtype_cast == VTYPE_FLOAT) {
+                    emit_native_cast_float(emit, vtype_cast);
+                    break;
+                }
+                #endif
                 emit_fold_stack_top(emit, REG_ARG_1);
                 emit_post_top_set_vtype(emit, vtype_cast);
                 break;
+            #if N_FLOAT
+            case VTYPE_FLOAT:
+                emit_native_cast_float(emit, vtype_cast);
+                break;
+            #endif
             default:
                 // this can happen when casting a cast: int(int)
                 mp_not_implemented("casting");
@@ -2189,7 +2968,7 @@ STATIC void emit_native_return_value(emit_t *emit) {
         if (peek_vtype(emit, 0) == VTYPE_PTR_NONE) {
             emit_pre_pop_discard(emit);
             if (emit->return_vtype == VTYPE_PYOBJ) {
-                ASM_MOV_IMM_TO_REG(emit->as, (mp_uint_t)mp_const_none, REG_RET);
+                emit_native_mov_reg_const(emit, REG_RET, mp_const_none);
             } else {
                 ASM_MOV_IMM_TO_REG(emit->as, 0, REG_RET);
             }
@@ -2202,6 +2981,17 @@ STATIC void emit_native_return_value(emit_t *emit) {
                     vtype_to_qstr(emit->return_vtype), vtype_to_qstr(vtype));
             }
         }
+    } else if (emit->is_generator) {
+        // put the return value in the first stack entry and point sp to it
+        vtype_kind_t vtype;
+        emit_pre_pop_reg(emit, &vtype, REG_TEMP0);
+        assert(vtype == VTYPE_PYOBJ);
+        ASM_MOV_LOCAL_TO_REG(emit->as, LOCAL_IDX_GEN_STATE, REG_TEMP1);
+        ASM_STORE_REG_REG_OFFSET(emit->as, REG_TEMP0, REG_TEMP1, STATE_START);
+        emit_native_gen_set_sp(emit, 0);
+        emit->last_emit_was_return_value = true;
+        emit_native_gen_exit(emit, MP_VM_RETURN_NORMAL);
+        return;
     } else {
         vtype_kind_t vtype;
         emit_pre_pop_reg(emit, &vtype, REG_RET);
@@ -2223,14 +3013,60 @@ STATIC void emit_native_raise_varargs(emit_t *emit, mp_uint_t n_args) {
 }
 
 STATIC void emit_native_yield_value(emit_t *emit) {
-    // not supported (for now)
-    (void)emit;
-    mp_not_implemented("native yield");
+    if (!emit->is_generator) {
+        // viper functions can't be generators (for now)
+        mp_not_implemented("native yield");
+    }
+    emit_native_pre(emit);
+    need_stack_settled(emit);
+    emit_native_gen_yield(emit, emit->stack_size - 1);
+    // the sent value is now on top of the stack, unless a value was thrown in
+    ASM_MOV_LOCAL_TO_REG(emit->as, LOCAL_IDX_GEN_THROW, REG_ARG_1);
+    emit_call(emit, MP_F_NATIVE_RAISE);
+    emit_post(emit);
 }
+
 STATIC void emit_native_yield_from(emit_t *emit) {
-    // not supported (for now)
-    (void)emit;
-    mp_not_implemented("native yield from");
+    if (!emit->is_generator) {
+        // viper functions can't be generators (for now)
+        mp_not_implemented("native yield from");
+    }
+
+    // stack: (..., iter, send_value)
+    emit_native_pre(emit);
+    need_stack_settled(emit);
+    mp_uint_t send_idx = emit->stack_start + emit->stack_size - 1;
+    mp_uint_t label_loop = emit_native_gen_new_label(emit);
+    mp_uint_t label_done = emit_native_gen_new_label(emit);
+
+    // The entry above send_value holds the value to throw into iter (or
+    // MP_OBJ_NULL), and receives what iter yields or returns.  It is not
+    // tracked as part of the stack, but room must be reserved for it.
+    adjust_stack(emit, 1);
+    adjust_stack(emit, -1);
+    ASM_MOV_IMM_TO_LOCAL_USING(emit->as, (mp_uint_t)MP_OBJ_NULL, send_idx + 1, REG_TEMP0);
+
+    mp_asm_base_label_assign(&emit->as->base, label_loop);
+    ASM_MOV_LOCAL_TO_REG(emit->as, send_idx - 1, REG_ARG_1);
+    ASM_MOV_LOCAL_TO_REG(emit->as, send_idx, REG_ARG_2);
+    ASM_MOV_LOCAL_ADDR_TO_REG(emit->as, send_idx + 1, REG_ARG_3);
+    emit_call(emit, MP_F_NATIVE_YIELD_FROM);
+    ASM_JUMP_IF_REG_ZERO(emit->as, REG_RET, label_done);
+
+    // iter yielded a value, so yield it to our caller, then loop to pass on
+    // whatever is sent or thrown in
+    ASM_MOV_LOCAL_TO_REG(emit->as, send_idx + 1, REG_TEMP0);
+    ASM_MOV_REG_TO_LOCAL(emit->as, REG_TEMP0, send_idx);
+    emit_native_gen_yield(emit, emit->stack_size - 1);
+    ASM_MOV_LOCAL_TO_REG(emit->as, LOCAL_IDX_GEN_THROW, REG_TEMP0);
+    ASM_MOV_REG_TO_LOCAL(emit->as, REG_TEMP0, send_idx + 1);
+    ASM_JUMP(emit->as, label_loop);
+
+    // iter finished, so replace (iter, send_value) with its return value
+    mp_asm_base_label_assign(&emit->as->base, label_done);
+    ASM_MOV_LOCAL_TO_REG(emit->as, send_idx + 1, REG_RET);
+    adjust_stack(emit, -2);
+    emit_post_push_reg(emit, VTYPE_PYOBJ, REG_RET);
 }
 
 STATIC void emit_native_start_except_handler(emit_t *emit) {
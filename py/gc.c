@@ -33,6 +33,10 @@
 #include "py/obj.h"
 #include "py/runtime.h"
 
+#if MICROPY_GC_INCREMENTAL
+#include "py/mphal.h"
+#endif
+
 #if MICROPY_ENABLE_GC
 
 #if 0 // print debugging info
@@ -72,26 +76,218 @@
 #define ATB_3_IS_FREE(a) (((a) & ATB_MASK_3) == 0)
 
 #define BLOCK_SHIFT(block) (2 * ((block) & (BLOCKS_PER_ATB - 1)))
-#define ATB_GET_KIND(block) ((MP_STATE_MEM(gc_alloc_table_start)[(block) / BLOCKS_PER_ATB] >> BLOCK_SHIFT(block)) & 3)
-#define ATB_ANY_TO_FREE(block) do { MP_STATE_MEM(gc_alloc_table_start)[(block) / BLOCKS_PER_ATB] &= (~(AT_MARK << BLOCK_SHIFT(block))); } while (0)
-#define ATB_FREE_TO_HEAD(block) do { MP_STATE_MEM(gc_alloc_table_start)[(block) / BLOCKS_PER_ATB] |= (AT_HEAD << BLOCK_SHIFT(block)); } while (0)
-#define ATB_FREE_TO_TAIL(block) do { MP_STATE_MEM(gc_alloc_table_start)[(block) / BLOCKS_PER_ATB] |= (AT_TAIL << BLOCK_SHIFT(block)); } while (0)
-#define ATB_HEAD_TO_MARK(block) do { MP_STATE_MEM(gc_alloc_table_start)[(block) / BLOCKS_PER_ATB] |= (AT_MARK << BLOCK_SHIFT(block)); } while (0)
-#define ATB_MARK_TO_HEAD(block) do { MP_STATE_MEM(gc_alloc_table_start)[(block) / BLOCKS_PER_ATB] &= (~(AT_TAIL << BLOCK_SHIFT(block))); } while (0)
-
-#define BLOCK_FROM_PTR(ptr) (((byte*)(ptr) - MP_STATE_MEM(gc_pool_start)) / BYTES_PER_BLOCK)
-#define PTR_FROM_BLOCK(block) (((block) * BYTES_PER_BLOCK + (uintptr_t)MP_STATE_MEM(gc_pool_start)))
+#define ATB_GET_KIND(area, block) (((area)->gc_alloc_table_start[(block) / BLOCKS_PER_ATB] >> BLOCK_SHIFT(block)) & 3)
+#define ATB_ANY_TO_FREE(area, block) do { (area)->gc_alloc_table_start[(block) / BLOCKS_PER_ATB] &= (~(AT_MARK << BLOCK_SHIFT(block))); } while (0)
+#define ATB_FREE_TO_HEAD(area, block) do { (area)->gc_alloc_table_start[(block) / BLOCKS_PER_ATB] |= (AT_HEAD << BLOCK_SHIFT(block)); } while (0)
+#define ATB_FREE_TO_TAIL(area, block) do { (area)->gc_alloc_table_start[(block) / BLOCKS_PER_ATB] |= (AT_TAIL << BLOCK_SHIFT(block)); } while (0)
+#define ATB_HEAD_TO_MARK(area, block) do { (area)->gc_alloc_table_start[(block) / BLOCKS_PER_ATB] |= (AT_MARK << BLOCK_SHIFT(block)); } while (0)
+#define ATB_MARK_TO_HEAD(area, block) do { (area)->gc_alloc_table_start[(block) / BLOCKS_PER_ATB] &= (~(AT_TAIL << BLOCK_SHIFT(block))); } while (0)
+
+#define BLOCK_FROM_PTR(area, ptr) (((byte*)(ptr) - (area)->gc_pool_start) / BYTES_PER_BLOCK)
+#define PTR_FROM_BLOCK(area, block) (((block) * BYTES_PER_BLOCK + (uintptr_t)(area)->gc_pool_start))
 #define ATB_FROM_BLOCK(bl) ((bl) / BLOCKS_PER_ATB)
 
+// number of blocks in the pool of an area
+#define NUM_BLOCKS(area) ((area)->gc_alloc_table_byte_len * BLOCKS_PER_ATB)
+
+#if MICROPY_GC_SPLIT_HEAP
+#define NEXT_AREA(area) ((area)->next)
+#else
+#define NEXT_AREA(area) (NULL)
+#endif
+
 #if MICROPY_ENABLE_FINALISER
 // FTB = finaliser table byte
 // if set, then the corresponding block may have a finaliser
 
 #define BLOCKS_PER_FTB (8)
 
-#define FTB_GET(block) ((MP_STATE_MEM(gc_finaliser_table_start)[(block) / BLOCKS_PER_FTB] >> ((block) & 7)) & 1)
-#define FTB_SET(block) do { MP_STATE_MEM(gc_finaliser_table_start)[(block) / BLOCKS_PER_FTB] |= (1 << ((block) & 7)); } while (0)
-#define FTB_CLEAR(block) do { MP_STATE_MEM(gc_finaliser_table_start)[(block) / BLOCKS_PER_FTB] &= (~(1 << ((block) & 7))); } while (0)
+#define FTB_GET(area, block) (((area)->gc_finaliser_table_start[(block) / BLOCKS_PER_FTB] >> ((block) & 7)) & 1)
+#define FTB_SET(area, block) do { (area)->gc_finaliser_table_start[(block) / BLOCKS_PER_FTB] |= (1 << ((block) & 7)); } while (0)
+#define FTB_CLEAR(area, block) do { (area)->gc_finaliser_table_start[(block) / BLOCKS_PER_FTB] &= (~(1 << ((block) & 7))); } while (0)
+#endif
+
+#if MICROPY_GC_LEAF
+// LTB = leaf table byte
+// if set, then the corresponding head block holds no pointers to the heap and
+// its chain is not scanned when it is marked
+
+#define BLOCKS_PER_LTB (8)
+
+#define LTB_GET(area, block) (((area)->gc_leaf_table_start[(block) / BLOCKS_PER_LTB] >> ((block) & 7)) & 1)
+#define LTB_SET(area, block) do { (area)->gc_leaf_table_start[(block) / BLOCKS_PER_LTB] |= (1 << ((block) & 7)); } while (0)
+#define LTB_CLEAR(area, block) do { (area)->gc_leaf_table_start[(block) / BLOCKS_PER_LTB] &= (~(1 << ((block) & 7))); } while (0)
+#endif
+
+#if MICROPY_GC_INCREMENTAL
+// DTB = dirty table byte
+// if set, then the corresponding head block was allocated or written to during
+// the mark phase of an incremental collection, and is scanned again before the
+// mark is finished
+
+#define BLOCKS_PER_DTB (8)
+
+#define DTB_SET(area, block) do { (area)->gc_dirty_table_start[(block) / BLOCKS_PER_DTB] |= (1 << ((block) & 7)); } while (0)
+
+// outside of a collection, a marked head is a live block of an incremental one
+#define ATB_KIND_IS_HEAD(kind) ((kind) == AT_HEAD || (kind) == AT_MARK)
+#else
+#define ATB_KIND_IS_HEAD(kind) ((kind) == AT_HEAD)
+#endif
+
+#if MICROPY_GC_FREE_LISTS
+// Free runs of blocks are kept, per heap area, in doubly-linked lists
+// segregated by size.  The first block of a run holds the list node and the
+// last word of the last block of a run holds its length (a boundary tag), so a
+// run can be found from either end when coalescing a newly freed neighbour.
+// Lists 0 to GC_NUM_EXACT_LISTS - 1 hold runs of exactly 1 to
+// GC_NUM_EXACT_LISTS blocks, the remaining lists hold runs in successive
+// power-of-two size ranges, with the last list holding everything bigger.  A
+// bitmap records which lists are non-empty.  The lists are rebuilt from
+// scratch by each sweep and kept up to date by gc_alloc/gc_free/gc_realloc.
+
+#define GC_NUM_EXACT_LISTS (16)
+#define GC_NO_BLOCK ((size_t)-1)
+
+typedef struct _gc_free_run_t {
+    struct _gc_free_run_t *next;
+    struct _gc_free_run_t *prev;
+    size_t n_blocks;
+} gc_free_run_t;
+
+#define RUN_FROM_BLOCK(area, block) ((gc_free_run_t*)PTR_FROM_BLOCK(area, block))
+#define RUN_LEN_FROM_LAST_BLOCK(area, block) (((size_t*)PTR_FROM_BLOCK(area, (block) + 1))[-1])
+
+STATIC size_t gc_free_list_index(size_t n_blocks) {
+    if (n_blocks <= GC_NUM_EXACT_LISTS) {
+        return n_blocks - 1;
+    }
+    size_t idx = GC_NUM_EXACT_LISTS;
+    for (n_blocks = (n_blocks - 1) / GC_NUM_EXACT_LISTS; n_blocks > 1 && idx < MP_GC_NUM_FREE_LISTS - 1; n_blocks >>= 1) {
+        idx += 1;
+    }
+    return idx;
+}
+
+// Add the free run of n_blocks blocks starting at block to the head of its list.
+STATIC void gc_free_list_insert(mp_state_mem_area_t *area, size_t block, size_t n_blocks) {
+    gc_free_run_t *run = RUN_FROM_BLOCK(area, block);
+    size_t idx = gc_free_list_index(n_blocks);
+    gc_free_run_t **list = &area->gc_free_list[idx];
+    area->gc_free_list_bitmap |= (uint32_t)1 << idx;
+    run->next = *list;
+    run->prev = NULL;
+    run->n_blocks = n_blocks;
+    RUN_LEN_FROM_LAST_BLOCK(area, block + n_blocks - 1) = n_blocks;
+    if (*list != NULL) {
+        (*list)->prev = run;
+    }
+    *list = run;
+}
+
+// Add a free run to the tail of its list, for use while the sweep rebuilds
+// the lists; list_tail[] holds the current tails.
+STATIC void gc_free_list_append(mp_state_mem_area_t *area, gc_free_run_t **list_tail, size_t block, size_t n_blocks) {
+    gc_free_run_t *run = RUN_FROM_BLOCK(area, block);
+    size_t idx = gc_free_list_index(n_blocks);
+    run->next = NULL;
+    run->n_blocks = n_blocks;
+    RUN_LEN_FROM_LAST_BLOCK(area, block + n_blocks - 1) = n_blocks;
+    if (area->gc_free_list_bitmap & ((uint32_t)1 << idx)) {
+        run->prev = list_tail[idx];
+        list_tail[idx]->next = run;
+    } else {
+        run->prev = NULL;
+        area->gc_free_list[idx] = run;
+        area->gc_free_list_bitmap |= (uint32_t)1 << idx;
+    }
+    list_tail[idx] = run;
+}
+
+STATIC void gc_free_list_unlink(mp_state_mem_area_t *area, gc_free_run_t *run) {
+    if (run->prev != NULL) {
+        run->prev->next = run->next;
+    } else {
+        size_t idx = gc_free_list_index(run->n_blocks);
+        area->gc_free_list[idx] = run->next;
+        if (run->next == NULL) {
+            area->gc_free_list_bitmap &= ~((uint32_t)1 << idx);
+        }
+    }
+    if (run->next != NULL) {
+        run->next->prev = run->prev;
+    }
+}
+
+// Add a run of newly freed blocks, merging it with free neighbours.
+STATIC void gc_free_list_add(mp_state_mem_area_t *area, size_t block, size_t n_blocks) {
+    size_t end = block + n_blocks;
+    if (end < NUM_BLOCKS(area) && ATB_GET_KIND(area, end) == AT_FREE) {
+        gc_free_run_t *run = RUN_FROM_BLOCK(area, end);
+        gc_free_list_unlink(area, run);
+        n_blocks += run->n_blocks;
+    }
+    if (block > 0 && ATB_GET_KIND(area, block - 1) == AT_FREE) {
+        size_t n_prev = RUN_LEN_FROM_LAST_BLOCK(area, block - 1);
+        block -= n_prev;
+        gc_free_list_unlink(area, RUN_FROM_BLOCK(area, block));
+        n_blocks += n_prev;
+    }
+    gc_free_list_insert(area, block, n_blocks);
+}
+
+// Take n_blocks blocks off the free lists of area, returning the first block
+// (which is still marked free in the ATB) or GC_NO_BLOCK.  Any run in a list
+// above the request's own list is big enough, so the head of the first
+// non-empty one is taken; only the request's own size range (if it is not an
+// exact-size list) is searched, for the best fit.  The blocks are cut from the end of a bigger
+// run, so the rest of the run usually keeps its node and its place in its list
+// (which keeps the lists in the address order the sweep built them in).
+STATIC size_t gc_free_list_take(mp_state_mem_area_t *area, size_t n_blocks) {
+    gc_free_run_t *best = NULL;
+    size_t idx = gc_free_list_index(n_blocks);
+    uint32_t mask = area->gc_free_list_bitmap >> idx;
+    if (idx >= GC_NUM_EXACT_LISTS && (mask & 1)) {
+        for (gc_free_run_t *run = area->gc_free_list[idx]; run != NULL; run = run->next) {
+            if (run->n_blocks >= n_blocks && (best == NULL || run->n_blocks < best->n_blocks)) {
+                best = run;
+                if (run->n_blocks == n_blocks) {
+                    break;
+                }
+            }
+        }
+        if (best == NULL) {
+            mask &= ~1;
+        }
+    }
+    if (best == NULL && (mask & 1)) {
+        best = area->gc_free_list[idx];
+    } else if (best == NULL && mask != 0) {
+        // find the lowest set bit of mask
+        for (size_t shift = 16; shift > 0; shift >>= 1) {
+            if ((mask & (((uint32_t)1 << shift) - 1)) == 0) {
+                mask >>= shift;
+                idx += shift;
+            }
+        }
+        best = area->gc_free_list[idx];
+    }
+    if (best == NULL) {
+        return GC_NO_BLOCK;
+    }
+    size_t block = BLOCK_FROM_PTR(area, best);
+    size_t n_rest = best->n_blocks - n_blocks;
+    if (n_rest == 0) {
+        gc_free_list_unlink(area, best);
+    } else if (gc_free_list_index(n_rest) == idx) {
+        best->n_blocks = n_rest;
+        RUN_LEN_FROM_LAST_BLOCK(area, block + n_rest - 1) = n_rest;
+    } else {
+        gc_free_list_unlink(area, best);
+        gc_free_list_insert(area, block, n_rest);
+    }
+    return block + n_rest;
+}
 #endif
 
 #if MICROPY_PY_THREAD && !MICROPY_PY_THREAD_GIL
@@ -102,49 +298,224 @@
 #define GC_EXIT()
 #endif
 
+// Return the heap area that ptr points to the start of a block in, or NULL.
+STATIC inline mp_state_mem_area_t *gc_get_ptr_area(const void *ptr) {
+    if (((uintptr_t)(ptr) & (BYTES_PER_BLOCK - 1)) != 0) { // must be aligned on a block
+        return NULL;
+    }
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+        if (ptr >= (void*)area->gc_pool_start  // must be above start of pool
+            && ptr < (void*)area->gc_pool_end) { // must be below end of pool
+            return area;
+        }
+    }
+    return NULL;
+}
+
+// The GC stack holds pointers to the blocks still to be scanned; this gives
+// the area of such a block.
+#if MICROPY_GC_SPLIT_HEAP
+#define GC_STACK_AREA(ptr) gc_get_ptr_area(ptr)
+#else
+#define GC_STACK_AREA(ptr) (&MP_STATE_MEM(area))
+#endif
+
+#if MICROPY_GC_STACK_SPILL
+#define GC_STACK_BASE (MP_STATE_MEM(gc_stack_base))
+#define GC_STACK_LIMIT (MP_STATE_MEM(gc_stack_limit))
+#else
+#define GC_STACK_BASE (MP_STATE_MEM(gc_stack))
+#define GC_STACK_LIMIT (&MP_STATE_MEM(gc_stack)[MICROPY_ALLOC_GC_STACK_SIZE])
+#endif
+
+STATIC void gc_reset_stack(void) {
+    MP_STATE_MEM(gc_stack_overflow) = 0;
+    #if MICROPY_GC_STACK_SPILL
+    // any spill area is unmarked, so the sweep frees it
+    MP_STATE_MEM(gc_stack_base) = MP_STATE_MEM(gc_stack);
+    MP_STATE_MEM(gc_stack_limit) = &MP_STATE_MEM(gc_stack)[MICROPY_ALLOC_GC_STACK_SIZE];
+    #endif
+    MP_STATE_MEM(gc_sp) = GC_STACK_BASE;
+}
+
+#if MICROPY_GC_STACK_SPILL
+// Find n_blocks free blocks in area, returning the first one (which is still
+// marked free in the ATB) or -1.
+STATIC size_t gc_find_free_run(mp_state_mem_area_t *area, size_t n_blocks) {
+    #if MICROPY_GC_FREE_LISTS
+    return gc_free_list_take(area, n_blocks);
+    #else
+    size_t block = area->gc_last_free_atb_index * BLOCKS_PER_ATB;
+    for (size_t n_free = 0; n_free < n_blocks; block++) {
+        if (block == NUM_BLOCKS(area)) {
+            return (size_t)-1;
+        }
+        n_free = ATB_GET_KIND(area, block) == AT_FREE ? n_free + 1 : 0;
+    }
+    return block - n_blocks;
+    #endif
+}
+
+// Move the GC stack to a run of free blocks with room for twice as many
+// entries.  The run is made into an unmarked chain, so nothing scans it and
+// the sweep frees it.  Returns false if there is no big enough run.
+STATIC bool gc_grow_stack(void) {
+    size_t n_entries = GC_STACK_LIMIT - GC_STACK_BASE;
+    size_t n_blocks = (2 * n_entries * sizeof(void*) + BYTES_PER_BLOCK - 1) / BYTES_PER_BLOCK;
+    mp_state_mem_area_t *area = &MP_STATE_MEM(area);
+    size_t block;
+    while ((block = gc_find_free_run(area, n_blocks)) == (size_t)-1) {
+        area = NEXT_AREA(area);
+        if (area == NULL) {
+            return false;
+        }
+    }
+    ATB_FREE_TO_HEAD(area, block);
+    for (size_t bl = block + 1; bl < block + n_blocks; bl++) {
+        ATB_FREE_TO_TAIL(area, bl);
+    }
+    void **stack = (void**)PTR_FROM_BLOCK(area, block);
+    memcpy(stack, GC_STACK_BASE, n_entries * sizeof(void*));
+    DEBUG_printf("gc_grow_stack(%p, " UINT_FMT ")\n", stack, n_blocks * BYTES_PER_BLOCK / sizeof(void*));
+    MP_STATE_MEM(gc_stack_base) = stack;
+    MP_STATE_MEM(gc_stack_limit) = stack + n_blocks * BYTES_PER_BLOCK / sizeof(void*);
+    MP_STATE_MEM(gc_sp) = stack + n_entries;
+    return true;
+}
+#endif
+
+// Push a block on the GC stack, growing it if it is full.  If it can't grow
+// then the block is only marked, and a rescan of the heap traces it later.
+STATIC void gc_push_block(mp_state_mem_area_t *area, size_t block) {
+    if (MP_STATE_MEM(gc_sp) == GC_STACK_LIMIT) {
+        MP_STATE_MEM(gc_stack_overflow_count)++;
+        #if MICROPY_GC_STACK_SPILL
+        if (!gc_grow_stack())
+        #endif
+        {
+            MP_STATE_MEM(gc_stack_overflow) = 1;
+            return;
+        }
+    }
+    *MP_STATE_MEM(gc_sp)++ = (void*)PTR_FROM_BLOCK(area, block);
+}
+
+// Lay out the tables and pool of a heap area in the memory from start to end.
 // TODO waste less memory; currently requires that all entries in alloc_table have a corresponding block in pool
-void gc_init(void *start, void *end) {
+STATIC void gc_setup_area(mp_state_mem_area_t *area, void *start, void *end) {
     // align end pointer on block boundary
     end = (void*)((uintptr_t)end & (~(BYTES_PER_BLOCK - 1)));
     DEBUG_printf("Initializing GC heap: %p..%p = " UINT_FMT " bytes\n", start, end, (byte*)end - (byte*)start);
 
-    // calculate parameters for GC (T=total, A=alloc table, F=finaliser table, P=pool; all in bytes):
-    // T = A + F + P
+    // calculate parameters for GC (T=total, A=alloc table, F=finaliser table, L=leaf table, D=dirty table, P=pool; all in bytes):
+    // T = A + F + L + D + P
     //     F = A * BLOCKS_PER_ATB / BLOCKS_PER_FTB
+    //     L = A * BLOCKS_PER_ATB / BLOCKS_PER_LTB
+    //     D = A * BLOCKS_PER_ATB / BLOCKS_PER_DTB
     //     P = A * BLOCKS_PER_ATB * BYTES_PER_BLOCK
-    // => T = A * (1 + BLOCKS_PER_ATB / BLOCKS_PER_FTB + BLOCKS_PER_ATB * BYTES_PER_BLOCK)
+    // => T = A * (1 + BLOCKS_PER_ATB / BLOCKS_PER_FTB + BLOCKS_PER_ATB / BLOCKS_PER_LTB + BLOCKS_PER_ATB / BLOCKS_PER_DTB + BLOCKS_PER_ATB * BYTES_PER_BLOCK)
     size_t total_byte_len = (byte*)end - (byte*)start;
+    size_t table_bits_per_atb = BITS_PER_BYTE;
 #if MICROPY_ENABLE_FINALISER
-    MP_STATE_MEM(gc_alloc_table_byte_len) = total_byte_len * BITS_PER_BYTE / (BITS_PER_BYTE + BITS_PER_BYTE * BLOCKS_PER_ATB / BLOCKS_PER_FTB + BITS_PER_BYTE * BLOCKS_PER_ATB * BYTES_PER_BLOCK);
-#else
-    MP_STATE_MEM(gc_alloc_table_byte_len) = total_byte_len / (1 + BITS_PER_BYTE / 2 * BYTES_PER_BLOCK);
+    table_bits_per_atb += BITS_PER_BYTE * BLOCKS_PER_ATB / BLOCKS_PER_FTB;
+#endif
+#if MICROPY_GC_LEAF
+    table_bits_per_atb += BITS_PER_BYTE * BLOCKS_PER_ATB / BLOCKS_PER_LTB;
+#endif
+#if MICROPY_GC_INCREMENTAL
+    table_bits_per_atb += BITS_PER_BYTE * BLOCKS_PER_ATB / BLOCKS_PER_DTB;
 #endif
+    area->gc_alloc_table_byte_len = total_byte_len * BITS_PER_BYTE / (table_bits_per_atb + BITS_PER_BYTE * BLOCKS_PER_ATB * BYTES_PER_BLOCK);
 
-    MP_STATE_MEM(gc_alloc_table_start) = (byte*)start;
+    area->gc_alloc_table_start = (byte*)start;
+    byte *table_end = area->gc_alloc_table_start + area->gc_alloc_table_byte_len;
 
 #if MICROPY_ENABLE_FINALISER
-    size_t gc_finaliser_table_byte_len = (MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB + BLOCKS_PER_FTB - 1) / BLOCKS_PER_FTB;
-    MP_STATE_MEM(gc_finaliser_table_start) = MP_STATE_MEM(gc_alloc_table_start) + MP_STATE_MEM(gc_alloc_table_byte_len);
+    size_t gc_finaliser_table_byte_len = (area->gc_alloc_table_byte_len * BLOCKS_PER_ATB + BLOCKS_PER_FTB - 1) / BLOCKS_PER_FTB;
+    area->gc_finaliser_table_start = table_end;
+    table_end += gc_finaliser_table_byte_len;
 #endif
 
-    size_t gc_pool_block_len = MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB;
-    MP_STATE_MEM(gc_pool_start) = (byte*)end - gc_pool_block_len * BYTES_PER_BLOCK;
-    MP_STATE_MEM(gc_pool_end) = end;
+#if MICROPY_GC_LEAF
+    size_t gc_leaf_table_byte_len = (area->gc_alloc_table_byte_len * BLOCKS_PER_ATB + BLOCKS_PER_LTB - 1) / BLOCKS_PER_LTB;
+    area->gc_leaf_table_start = table_end;
+    table_end += gc_leaf_table_byte_len;
+#endif
 
-#if MICROPY_ENABLE_FINALISER
-    assert(MP_STATE_MEM(gc_pool_start) >= MP_STATE_MEM(gc_finaliser_table_start) + gc_finaliser_table_byte_len);
+#if MICROPY_GC_INCREMENTAL
+    size_t gc_dirty_table_byte_len = (area->gc_alloc_table_byte_len * BLOCKS_PER_ATB + BLOCKS_PER_DTB - 1) / BLOCKS_PER_DTB;
+    area->gc_dirty_table_start = table_end;
+    table_end += gc_dirty_table_byte_len;
 #endif
 
+    size_t gc_pool_block_len = area->gc_alloc_table_byte_len * BLOCKS_PER_ATB;
+    area->gc_pool_start = (byte*)end - gc_pool_block_len * BYTES_PER_BLOCK;
+    area->gc_pool_end = end;
+
+    assert(area->gc_pool_start >= table_end);
+
     // clear ATBs
-    memset(MP_STATE_MEM(gc_alloc_table_start), 0, MP_STATE_MEM(gc_alloc_table_byte_len));
+    memset(area->gc_alloc_table_start, 0, area->gc_alloc_table_byte_len);
 
 #if MICROPY_ENABLE_FINALISER
     // clear FTBs
-    memset(MP_STATE_MEM(gc_finaliser_table_start), 0, gc_finaliser_table_byte_len);
+    memset(area->gc_finaliser_table_start, 0, gc_finaliser_table_byte_len);
+#endif
+
+#if MICROPY_GC_LEAF
+    // clear LTBs
+    memset(area->gc_leaf_table_start, 0, gc_leaf_table_byte_len);
+#endif
+
+#if MICROPY_GC_INCREMENTAL
+    // clear DTBs
+    memset(area->gc_dirty_table_start, 0, gc_dirty_table_byte_len);
 #endif
 
     // set last free ATB index to start of heap
-    MP_STATE_MEM(gc_last_free_atb_index) = 0;
+    area->gc_last_free_atb_index = 0;
+
+    #if MICROPY_GC_FREE_LISTS
+    // a block must have room for a list node and a boundary tag
+    assert(WORDS_PER_BLOCK >= 4);
+    // the whole pool is one free run
+    memset(area->gc_free_list, 0, sizeof(area->gc_free_list));
+    area->gc_free_list_bitmap = 0;
+    gc_free_list_insert(area, 0, gc_pool_block_len);
+    #endif
+
+    #if MICROPY_GC_SPLIT_HEAP
+    area->next = NULL;
+    #endif
+
+    DEBUG_printf("GC layout:\n");
+    DEBUG_printf("  alloc table at %p, length " UINT_FMT " bytes, " UINT_FMT " blocks\n", area->gc_alloc_table_start, area->gc_alloc_table_byte_len, area->gc_alloc_table_byte_len * BLOCKS_PER_ATB);
+#if MICROPY_ENABLE_FINALISER
+    DEBUG_printf("  finaliser table at %p, length " UINT_FMT " bytes, " UINT_FMT " blocks\n", area->gc_finaliser_table_start, gc_finaliser_table_byte_len, gc_finaliser_table_byte_len * BLOCKS_PER_FTB);
+#endif
+#if MICROPY_GC_LEAF
+    DEBUG_printf("  leaf table at %p, length " UINT_FMT " bytes, " UINT_FMT " blocks\n", area->gc_leaf_table_start, gc_leaf_table_byte_len, gc_leaf_table_byte_len * BLOCKS_PER_LTB);
+#endif
+#if MICROPY_GC_INCREMENTAL
+    DEBUG_printf("  dirty table at %p, length " UINT_FMT " bytes, " UINT_FMT " blocks\n", area->gc_dirty_table_start, gc_dirty_table_byte_len, gc_dirty_table_byte_len * BLOCKS_PER_DTB);
+#endif
+    DEBUG_printf("  pool at %p, length " UINT_FMT " bytes, " UINT_FMT " blocks\n", area->gc_pool_start, gc_pool_block_len * BYTES_PER_BLOCK, gc_pool_block_len);
+}
+
+void gc_init(void *start, void *end) {
+    gc_setup_area(&MP_STATE_MEM(area), start, end);
+
+    #if MICROPY_ENABLE_FINALISER
+    // nothing is waiting to be finalised
+    MP_STATE_MEM(gc_finaliser_queue_len) = 0;
+    MP_STATE_MEM(gc_finaliser_queue_overflow) = false;
+    MP_STATE_MEM(gc_finalisers_running) = false;
+    memset(MP_STATE_VM(gc_finaliser_queue), 0, sizeof(MP_STATE_VM(gc_finaliser_queue)));
+    #endif
+
+    gc_reset_stack();
+    MP_STATE_MEM(gc_stack_overflow_count) = 0;
+    MP_STATE_MEM(gc_stack_rescan_count) = 0;
 
     // unlock the GC
     MP_STATE_MEM(gc_lock_depth) = 0;
@@ -158,18 +529,44 @@ void gc_init(void *start, void *end) {
     MP_STATE_MEM(gc_alloc_amount) = 0;
     #endif
 
+    #if MICROPY_GC_INCREMENTAL
+    // incremental collection is off until enabled by gc.incremental()
+    MP_STATE_MEM(gc_incr_phase) = GC_INCR_PHASE_IDLE;
+    MP_STATE_MEM(gc_incr_enabled) = false;
+    MP_STATE_MEM(gc_incr_lazy_sweep) = false;
+    MP_STATE_MEM(gc_incr_budget) = MICROPY_GC_INCREMENTAL_BUDGET;
+    MP_STATE_MEM(gc_incr_alloc) = 0;
+    MP_STATE_MEM(gc_incr_allocated) = 0;
+    MP_STATE_MEM(gc_incr_trigger) = NUM_BLOCKS(&MP_STATE_MEM(area)) / 2;
+    MP_STATE_MEM(gc_pause_max) = 0;
+    memset(MP_STATE_MEM(gc_pause_hist), 0, sizeof(MP_STATE_MEM(gc_pause_hist)));
+    #endif
+
     #if MICROPY_PY_THREAD
     mp_thread_mutex_init(&MP_STATE_MEM(gc_mutex));
     #endif
+}
 
-    DEBUG_printf("GC layout:\n");
-    DEBUG_printf("  alloc table at %p, length " UINT_FMT " bytes, " UINT_FMT " blocks\n", MP_STATE_MEM(gc_alloc_table_start), MP_STATE_MEM(gc_alloc_table_byte_len), MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB);
-#if MICROPY_ENABLE_FINALISER
-    DEBUG_printf("  finaliser table at %p, length " UINT_FMT " bytes, " UINT_FMT " blocks\n", MP_STATE_MEM(gc_finaliser_table_start), gc_finaliser_table_byte_len, gc_finaliser_table_byte_len * BLOCKS_PER_FTB);
-#endif
-    DEBUG_printf("  pool at %p, length " UINT_FMT " bytes, " UINT_FMT " blocks\n", MP_STATE_MEM(gc_pool_start), gc_pool_block_len * BYTES_PER_BLOCK, gc_pool_block_len);
+#if MICROPY_GC_SPLIT_HEAP
+// Append the memory from start to end to the heap as a new area.  The area
+// descriptor lives at the start of the memory.
+STATIC void gc_add_area(void *start, void *end) {
+    mp_state_mem_area_t *area = (mp_state_mem_area_t*)start;
+    gc_setup_area(area, area + 1, end);
+    mp_state_mem_area_t *prev = &MP_STATE_MEM(area);
+    while (prev->next != NULL) {
+        prev = prev->next;
+    }
+    prev->next = area;
 }
 
+void gc_add(void *start, void *end) {
+    GC_ENTER();
+    gc_add_area(start, end);
+    GC_EXIT();
+}
+#endif
+
 void gc_lock(void) {
     GC_ENTER();
     MP_STATE_MEM(gc_lock_depth)++;
@@ -186,190 +583,706 @@ bool gc_is_locked(void) {
     return MP_STATE_MEM(gc_lock_depth) != 0;
 }
 
-// ptr should be of type void*
-#define VERIFY_PTR(ptr) ( \
-        ((uintptr_t)(ptr) & (BYTES_PER_BLOCK - 1)) == 0      /* must be aligned on a block */ \
-        && ptr >= (void*)MP_STATE_MEM(gc_pool_start)     /* must be above start of pool */ \
-        && ptr < (void*)MP_STATE_MEM(gc_pool_end)        /* must be below end of pool */ \
-    )
+#if MICROPY_GC_LEAF
+#define BLOCK_IS_LEAF(area, block) LTB_GET(area, block)
+#else
+#define BLOCK_IS_LEAF(area, block) (0)
+#endif
 
 // ptr should be of type void*
 #define VERIFY_MARK_AND_PUSH(ptr) \
     do { \
-        if (VERIFY_PTR(ptr)) { \
-            size_t _block = BLOCK_FROM_PTR(ptr); \
-            if (ATB_GET_KIND(_block) == AT_HEAD) { \
+        mp_state_mem_area_t *_area = gc_get_ptr_area(ptr); \
+        if (_area != NULL) { \
+            size_t _block = BLOCK_FROM_PTR(_area, ptr); \
+            if (ATB_GET_KIND(_area, _block) == AT_HEAD) { \
                 /* an unmarked head, mark it, and push it on gc stack */ \
                 DEBUG_printf("gc_mark(%p)\n", ptr); \
-                ATB_HEAD_TO_MARK(_block); \
-                if (MP_STATE_MEM(gc_sp) < &MP_STATE_MEM(gc_stack)[MICROPY_ALLOC_GC_STACK_SIZE]) { \
-                    *MP_STATE_MEM(gc_sp)++ = _block; \
-                } else { \
-                    MP_STATE_MEM(gc_stack_overflow) = 1; \
+                ATB_HEAD_TO_MARK(_area, _block); \
+                if (!BLOCK_IS_LEAF(_area, _block)) { \
+                    gc_push_block(_area, _block); \
                 } \
             } \
         } \
     } while (0)
 
+// check the children of the chain starting at start; returns its size in bytes
+STATIC size_t gc_scan_block(void *start) {
+    mp_state_mem_area_t *area = GC_STACK_AREA(start);
+    size_t block = BLOCK_FROM_PTR(area, start);
+
+    // work out number of consecutive blocks in the chain starting with this one
+    size_t n_blocks = 0;
+    do {
+        n_blocks += 1;
+    } while (ATB_GET_KIND(area, block + n_blocks) == AT_TAIL);
+
+    // check this block's children
+    void **ptrs = (void**)start;
+    for (size_t i = n_blocks * BYTES_PER_BLOCK / sizeof(void*); i > 0; i--, ptrs++) {
+        void *ptr = *ptrs;
+        VERIFY_MARK_AND_PUSH(ptr);
+    }
+    return n_blocks * BYTES_PER_BLOCK;
+}
+
 STATIC void gc_drain_stack(void) {
-    while (MP_STATE_MEM(gc_sp) > MP_STATE_MEM(gc_stack)) {
-        // pop the next block off the stack
-        size_t block = *--MP_STATE_MEM(gc_sp);
-
-        // work out number of consecutive blocks in the chain starting with this one
-        size_t n_blocks = 0;
-        do {
-            n_blocks += 1;
-        } while (ATB_GET_KIND(block + n_blocks) == AT_TAIL);
-
-        // check this block's children
-        void **ptrs = (void**)PTR_FROM_BLOCK(block);
-        for (size_t i = n_blocks * BYTES_PER_BLOCK / sizeof(void*); i > 0; i--, ptrs++) {
-            void *ptr = *ptrs;
-            VERIFY_MARK_AND_PUSH(ptr);
-        }
+    while (MP_STATE_MEM(gc_sp) > GC_STACK_BASE) {
+        // pop the next block off the stack and check its children
+        gc_scan_block(*--MP_STATE_MEM(gc_sp));
     }
 }
 
 STATIC void gc_deal_with_stack_overflow(void) {
     while (MP_STATE_MEM(gc_stack_overflow)) {
         MP_STATE_MEM(gc_stack_overflow) = 0;
-        MP_STATE_MEM(gc_sp) = MP_STATE_MEM(gc_stack);
+        MP_STATE_MEM(gc_sp) = GC_STACK_BASE;
+        MP_STATE_MEM(gc_stack_rescan_count)++;
 
         // scan entire memory looking for blocks which have been marked but not their children
-        for (size_t block = 0; block < MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB; block++) {
-            // trace (again) if mark bit set
-            if (ATB_GET_KIND(block) == AT_MARK) {
-                *MP_STATE_MEM(gc_sp)++ = block;
-                gc_drain_stack();
+        for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+            for (size_t block = 0; block < NUM_BLOCKS(area); block++) {
+                // trace (again) if mark bit set
+                if (ATB_GET_KIND(area, block) == AT_MARK && !BLOCK_IS_LEAF(area, block)) {
+                    *MP_STATE_MEM(gc_sp)++ = (void*)PTR_FROM_BLOCK(area, block);
+                    gc_drain_stack();
+                }
             }
         }
     }
 }
 
+#if MICROPY_ENABLE_FINALISER
+// Called at the end of the mark.  Unreachable objects that have a finaliser
+// are marked again, along with everything they refer to, so that they
+// survive this collection, and are put on the finaliser queue.  Their
+// finalisers are called later by gc_run_finalisers, with the GC unlocked,
+// and they are freed by the first collection after that.  If the queue is
+// full then the remaining objects are only kept, and gc_run_finalisers
+// collects again once it has emptied the queue.
+STATIC void gc_queue_finalisers(void) {
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+        size_t ftb_len = (NUM_BLOCKS(area) + BLOCKS_PER_FTB - 1) / BLOCKS_PER_FTB;
+        for (size_t i = 0; i < ftb_len; i++) {
+            if (area->gc_finaliser_table_start[i] == 0) {
+                continue;
+            }
+            for (size_t block = i * BLOCKS_PER_FTB; block < (i + 1) * BLOCKS_PER_FTB; block++) {
+                if (FTB_GET(area, block) && ATB_GET_KIND(area, block) == AT_HEAD) {
+                    void *ptr = (void*)PTR_FROM_BLOCK(area, block);
+                    VERIFY_MARK_AND_PUSH(ptr);
+                    gc_drain_stack();
+                    if (MP_STATE_MEM(gc_finaliser_queue_len) < MICROPY_ALLOC_GC_FINALISER_QUEUE_SIZE) {
+                        MP_STATE_VM(gc_finaliser_queue)[MP_STATE_MEM(gc_finaliser_queue_len)++] = MP_OBJ_FROM_PTR(ptr);
+                        FTB_CLEAR(area, block);
+                    } else {
+                        MP_STATE_MEM(gc_finaliser_queue_overflow) = true;
+                    }
+                }
+            }
+        }
+    }
+    gc_deal_with_stack_overflow();
+}
+
+void gc_run_finalisers(void) {
+    GC_ENTER();
+    if (MP_STATE_MEM(gc_finalisers_running)) {
+        // the caller is a finaliser, or another thread is already draining
+        // the queue and will see any new entries
+        GC_EXIT();
+        return;
+    }
+    MP_STATE_MEM(gc_finalisers_running) = true;
+    for (;;) {
+        if (MP_STATE_MEM(gc_finaliser_queue_len) == 0) {
+            if (!MP_STATE_MEM(gc_finaliser_queue_overflow) || !MP_STATE_MEM(gc_auto_collect_enabled)) {
+                break;
+            }
+            // some objects didn't fit in the queue, so collect again to
+            // queue them
+            MP_STATE_MEM(gc_finaliser_queue_overflow) = false;
+            GC_EXIT();
+            gc_collect();
+            GC_ENTER();
+            continue;
+        }
+        // take the object off the queue; from here on only this function
+        // refers to it, and it is freed by the next collection after that
+        size_t n = --MP_STATE_MEM(gc_finaliser_queue_len);
+        mp_obj_base_t *obj = MP_OBJ_TO_PTR(MP_STATE_VM(gc_finaliser_queue)[n]);
+        MP_STATE_VM(gc_finaliser_queue)[n] = MP_OBJ_NULL;
+        GC_EXIT();
+        if (obj->type != NULL) {
+            // if the object has a type then see if it has a __del__ method
+            nlr_buf_t nlr;
+            if (nlr_push(&nlr) == 0) {
+                mp_obj_t dest[2];
+                mp_load_method_maybe(MP_OBJ_FROM_PTR(obj), MP_QSTR___del__, dest);
+                if (dest[0] != MP_OBJ_NULL) {
+                    // load_method returned a method
+                    mp_call_method_n_kw(0, 0, dest);
+                }
+                nlr_pop();
+            } else {
+                // an exception in a finaliser has nowhere to go, so print it
+                mp_obj_print_exception(&mp_plat_print, MP_OBJ_FROM_PTR(nlr.ret_val));
+            }
+        }
+        GC_ENTER();
+    }
+    MP_STATE_MEM(gc_finalisers_running) = false;
+    GC_EXIT();
+}
+#endif
+
+#if MICROPY_GC_SPLIT_HEAP_AUTO || MICROPY_GC_INCREMENTAL
+// Return the number of blocks in all areas of the heap.
+STATIC size_t gc_total_blocks(void) {
+    size_t n = 0;
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+        n += NUM_BLOCKS(area);
+    }
+    return n;
+}
+#endif
+
+#if MICROPY_GC_SPLIT_HEAP_AUTO
+// Return the areas, other than the first, that have no blocks in use to the
+// port.  Must only be called when no collection is in progress.
+STATIC void gc_free_empty_areas(void) {
+    mp_state_mem_area_t *prev = &MP_STATE_MEM(area);
+    while (prev->next != NULL) {
+        mp_state_mem_area_t *area = prev->next;
+        size_t i = 0;
+        while (i < area->gc_alloc_table_byte_len && area->gc_alloc_table_start[i] == 0) {
+            i++;
+        }
+        if (i < area->gc_alloc_table_byte_len) {
+            prev = area;
+            continue;
+        }
+        DEBUG_printf("gc_free_empty_areas(%p)\n", area);
+        prev->next = area->next;
+        MP_PLAT_FREE_HEAP(area, (byte*)area->gc_pool_end - (byte*)area);
+    }
+}
+
+// Get a new area from the port with room for an allocation of n_bytes, and add
+// it to the heap.  The area is half the size of the heap so far, if the port
+// can give that much, so that the heap grows in a few steps.  Returns false if
+// the port has no more memory.
+STATIC bool gc_try_add_heap(size_t n_bytes) {
+    // room for the area descriptor, the tables (less than a byte per block),
+    // the pool, and the rounding of the tables to whole bytes
+    size_t n_blocks = (n_bytes + BYTES_PER_BLOCK - 1) / BYTES_PER_BLOCK;
+    size_t min_size = sizeof(mp_state_mem_area_t) + n_blocks * (BYTES_PER_BLOCK + 1) + 2 * BLOCKS_PER_ATB * BYTES_PER_BLOCK;
+    min_size = (min_size + BYTES_PER_BLOCK - 1) & ~(BYTES_PER_BLOCK - 1);
+    size_t size = gc_total_blocks() * BYTES_PER_BLOCK / 2;
+    void *start = NULL;
+    if (size > min_size) {
+        start = MP_PLAT_ALLOC_HEAP(size);
+    }
+    if (start == NULL) {
+        size = min_size;
+        start = MP_PLAT_ALLOC_HEAP(size);
+        if (start == NULL) {
+            return false;
+        }
+    }
+    DEBUG_printf("gc_try_add_heap(" UINT_FMT "): %p, " UINT_FMT " bytes\n", n_bytes, start, size);
+    gc_add_area(start, (byte*)start + size);
+    return true;
+}
+#endif
+
+#if MICROPY_GC_INCREMENTAL
+// Called at the end of each collection, to work out when the next incremental
+// cycle should start: when half of the memory left free has been allocated.
+STATIC void gc_incr_cycle_done(size_t n_live) {
+    MP_STATE_MEM(gc_incr_phase) = GC_INCR_PHASE_IDLE;
+    #if MICROPY_GC_SPLIT_HEAP_AUTO
+    gc_free_empty_areas();
+    #endif
+    MP_STATE_MEM(gc_incr_allocated) = 0;
+    MP_STATE_MEM(gc_incr_trigger) = (gc_total_blocks() - n_live) / 2;
+}
+#endif
+
 STATIC void gc_sweep(void) {
     #if MICROPY_PY_GC_COLLECT_RETVAL
     MP_STATE_MEM(gc_collected) = 0;
     #endif
-    // free unmarked heads and their tails
-    int free_tail = 0;
-    for (size_t block = 0; block < MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB; block++) {
-        switch (ATB_GET_KIND(block)) {
-            case AT_HEAD:
-#if MICROPY_ENABLE_FINALISER
-                if (FTB_GET(block)) {
-                    #if MICROPY_PY_THREAD
-                    // TODO need to think about reentrancy with finaliser code
-                    assert(!"finaliser with threading not implemented");
+    #if MICROPY_GC_INCREMENTAL
+    size_t n_live = 0;
+    #endif
+
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+        size_t n_total = NUM_BLOCKS(area);
+        #if MICROPY_GC_FREE_LISTS
+        // the free lists are rebuilt, in address order, from the free runs
+        // that the sweep leaves
+        gc_free_run_t *list_tail[MP_GC_NUM_FREE_LISTS];
+        memset(area->gc_free_list, 0, sizeof(area->gc_free_list));
+        area->gc_free_list_bitmap = 0;
+        size_t free_run = GC_NO_BLOCK;
+        #endif
+        // free unmarked heads and their tails
+        int free_tail = 0;
+        for (size_t block = 0; block < n_total; block++) {
+            switch (ATB_GET_KIND(area, block)) {
+                case AT_HEAD:
+                    free_tail = 1;
+                    DEBUG_printf("gc_sweep(%x)\n", PTR_FROM_BLOCK(area, block));
+                    #if MICROPY_PY_GC_COLLECT_RETVAL
+                    MP_STATE_MEM(gc_collected)++;
                     #endif
-                    mp_obj_base_t *obj = (mp_obj_base_t*)PTR_FROM_BLOCK(block);
-                    if (obj->type != NULL) {
-                        // if the object has a type then see if it has a __del__ method
-                        mp_obj_t dest[2];
-                        mp_load_method_maybe(MP_OBJ_FROM_PTR(obj), MP_QSTR___del__, dest);
-                        if (dest[0] != MP_OBJ_NULL) {
-                            // load_method returned a method
-                            mp_call_method_n_kw(0, 0, dest);
-                        }
+                    // fall through to free the head
+
+                case AT_TAIL:
+                    if (free_tail) {
+                        ATB_ANY_TO_FREE(area, block);
+                    }
+                    #if MICROPY_GC_INCREMENTAL
+                    else {
+                        n_live++;
                     }
-                    // clear finaliser flag
-                    FTB_CLEAR(block);
+                    #endif
+                    break;
+
+                case AT_MARK:
+                    ATB_MARK_TO_HEAD(area, block);
+                    free_tail = 0;
+                    #if MICROPY_GC_INCREMENTAL
+                    n_live++;
+                    #endif
+                    break;
+            }
+
+            #if MICROPY_GC_FREE_LISTS
+            if (ATB_GET_KIND(area, block) == AT_FREE) {
+                if (free_run == GC_NO_BLOCK) {
+                    free_run = block;
                 }
-#endif
-                free_tail = 1;
-                DEBUG_printf("gc_sweep(%x)\n", PTR_FROM_BLOCK(block));
-                #if MICROPY_PY_GC_COLLECT_RETVAL
-                MP_STATE_MEM(gc_collected)++;
-                #endif
-                // fall through to free the head
+            } else if (free_run != GC_NO_BLOCK) {
+                gc_free_list_append(area, list_tail, free_run, block - free_run);
+                free_run = GC_NO_BLOCK;
+            }
+            #endif
+        }
 
-            case AT_TAIL:
-                if (free_tail) {
-                    ATB_ANY_TO_FREE(block);
+        #if MICROPY_GC_FREE_LISTS
+        if (free_run != GC_NO_BLOCK) {
+            gc_free_list_append(area, list_tail, free_run, n_total - free_run);
+        }
+        #endif
+    }
+
+    #if MICROPY_GC_INCREMENTAL
+    gc_incr_cycle_done(n_live);
+    #elif MICROPY_GC_SPLIT_HEAP_AUTO
+    gc_free_empty_areas();
+    #endif
+}
+
+#if MICROPY_GC_INCREMENTAL
+// An incremental collection goes through these phases:
+//  - MARK: the root pointers in mp_state_ctx are pushed and traced a slice at
+//    a time.  Blocks allocated during this phase are marked straight away, and
+//    they and the blocks passed to gc_write_barrier are recorded in the dirty
+//    table.  When tracing is done the dirty blocks are scanned again (the
+//    pre-clean), then gc_collect() finishes the mark atomically: the port's
+//    roots (stack, registers) are traced, marked blocks they point to are
+//    treated as dirty, and all dirty blocks are scanned once more.
+//  - SWEEP: finalisers are queued as part of finishing the mark, then unmarked
+//    blocks are freed a slice at a time.  Blocks allocated ahead of the sweep
+//    are marked, so the sweep keeps them.
+// Slices are run by gc_alloc, after every budget / 4 bytes allocated, and from
+// the VM loop.  If memory runs out during a cycle the cycle is completed at
+// once.
+
+// number of VM loop checks between slices
+#define GC_INCR_POLL_DIVISOR (1024)
+
+// Clear the i-th byte of the dirty table of area, pushing the marked blocks it
+// records.
+STATIC void gc_incr_clean_dtb(mp_state_mem_area_t *area, size_t i) {
+    byte dtb = area->gc_dirty_table_start[i];
+    area->gc_dirty_table_start[i] = 0;
+    for (size_t block = i * BLOCKS_PER_DTB; dtb != 0; dtb >>= 1, block++) {
+        if ((dtb & 1) && ATB_GET_KIND(area, block) == AT_MARK && !BLOCK_IS_LEAF(area, block)) {
+            gc_push_block(area, block);
+        }
+    }
+}
+
+// Pop and scan blocks until the stack is empty or budget bytes have been
+// scanned; returns what is left of the budget.
+STATIC size_t gc_incr_drain_stack(size_t budget) {
+    while (MP_STATE_MEM(gc_sp) > GC_STACK_BASE) {
+        size_t n = gc_scan_block(*--MP_STATE_MEM(gc_sp));
+        if (n >= budget) {
+            return 0;
+        }
+        budget -= n;
+    }
+    return budget;
+}
+
+// Do a slice of marking; returns true when only the atomic finish is left.
+STATIC bool gc_incr_mark(size_t budget) {
+    void **roots = (void**)(void*)&mp_state_ctx;
+    size_t n_roots = offsetof(mp_state_ctx_t, vm.qstr_last_chunk) / sizeof(void*);
+    for (;;) {
+        budget = gc_incr_drain_stack(budget);
+        if (budget == 0) {
+            return false;
+        }
+        if (MP_STATE_MEM(gc_incr_root) < n_roots) {
+            void *ptr = roots[MP_STATE_MEM(gc_incr_root)++];
+            VERIFY_MARK_AND_PUSH(ptr);
+            budget -= 1;
+        } else if (MP_STATE_MEM(gc_stack_overflow) || MP_STATE_MEM(gc_incr_rescan_area) != NULL) {
+            // the stack overflowed, so trace (again) all marked blocks, as
+            // gc_deal_with_stack_overflow does, but resumable
+            if (MP_STATE_MEM(gc_incr_rescan_area) == NULL) {
+                MP_STATE_MEM(gc_stack_overflow) = 0;
+                MP_STATE_MEM(gc_stack_rescan_count)++;
+                MP_STATE_MEM(gc_incr_rescan_area) = &MP_STATE_MEM(area);
+                MP_STATE_MEM(gc_incr_rescan) = 0;
+            }
+            mp_state_mem_area_t *area = MP_STATE_MEM(gc_incr_rescan_area);
+            size_t block = MP_STATE_MEM(gc_incr_rescan);
+            while (area != NULL && budget > 0) {
+                budget -= 1;
+                if (block == NUM_BLOCKS(area)) {
+                    area = NEXT_AREA(area);
+                    block = 0;
+                    continue;
                 }
-                break;
+                if (ATB_GET_KIND(area, block) == AT_MARK && !BLOCK_IS_LEAF(area, block)) {
+                    gc_push_block(area, block++);
+                    break;
+                }
+                block++;
+            }
+            MP_STATE_MEM(gc_incr_rescan_area) = area;
+            MP_STATE_MEM(gc_incr_rescan) = block;
+        } else if (MP_STATE_MEM(gc_incr_clean_area) != NULL) {
+            mp_state_mem_area_t *area = MP_STATE_MEM(gc_incr_clean_area);
+            gc_incr_clean_dtb(area, MP_STATE_MEM(gc_incr_clean) / BLOCKS_PER_DTB);
+            MP_STATE_MEM(gc_incr_clean) += BLOCKS_PER_DTB;
+            if (MP_STATE_MEM(gc_incr_clean) >= NUM_BLOCKS(area)) {
+                MP_STATE_MEM(gc_incr_clean_area) = NEXT_AREA(area);
+                MP_STATE_MEM(gc_incr_clean) = 0;
+            }
+            budget -= 1;
+        } else {
+            return true;
+        }
+    }
+}
 
-            case AT_MARK:
-                ATB_MARK_TO_HEAD(block);
-                free_tail = 0;
-                break;
+// Sweep chains of blocks until budget blocks have been swept; returns true
+// when the sweep is complete.
+STATIC bool gc_incr_sweep(size_t budget) {
+    mp_state_mem_area_t *area = MP_STATE_MEM(gc_incr_sweep_area);
+    size_t block = MP_STATE_MEM(gc_incr_sweep);
+    #if MICROPY_GC_FREE_LISTS
+    size_t free_run = GC_NO_BLOCK;
+    #endif
+    while (area != NULL && budget > 0) {
+        size_t n_total = NUM_BLOCKS(area);
+        if (block == n_total) {
+            #if MICROPY_GC_FREE_LISTS
+            if (free_run != GC_NO_BLOCK) {
+                gc_free_list_add(area, free_run, block - free_run);
+                free_run = GC_NO_BLOCK;
+            }
+            #endif
+            area = NEXT_AREA(area);
+            block = 0;
+            continue;
+        }
+        size_t kind = ATB_GET_KIND(area, block);
+        size_t n_blocks = 1;
+        if (kind == AT_HEAD || kind == AT_MARK) {
+            while (block + n_blocks < n_total && ATB_GET_KIND(area, block + n_blocks) == AT_TAIL) {
+                n_blocks++;
+            }
+        }
+        if (kind == AT_HEAD) {
+            // unreachable, so free it and its tail
+            DEBUG_printf("gc_sweep(%x)\n", PTR_FROM_BLOCK(area, block));
+            #if MICROPY_PY_GC_COLLECT_RETVAL
+            MP_STATE_MEM(gc_collected)++;
+            #endif
+            for (size_t bl = block; bl < block + n_blocks; bl++) {
+                ATB_ANY_TO_FREE(area, bl);
+            }
+            #if MICROPY_GC_FREE_LISTS
+            if (free_run == GC_NO_BLOCK) {
+                free_run = block;
+            }
+            #else
+            if (block / BLOCKS_PER_ATB < area->gc_last_free_atb_index) {
+                area->gc_last_free_atb_index = block / BLOCKS_PER_ATB;
+            }
+            #endif
+        } else {
+            // a live chain, a free block, or a tail of a chain allocated
+            // across the sweep position
+            if (kind == AT_MARK) {
+                ATB_MARK_TO_HEAD(area, block);
+                MP_STATE_MEM(gc_incr_live) += n_blocks;
+            }
+            #if MICROPY_GC_FREE_LISTS
+            if (free_run != GC_NO_BLOCK) {
+                gc_free_list_add(area, free_run, block - free_run);
+                free_run = GC_NO_BLOCK;
+            }
+            #endif
+        }
+        block += n_blocks;
+        budget -= n_blocks < budget ? n_blocks : budget;
+    }
+    #if MICROPY_GC_FREE_LISTS
+    if (free_run != GC_NO_BLOCK) {
+        gc_free_list_add(area, free_run, block - free_run);
+    }
+    #endif
+    MP_STATE_MEM(gc_incr_sweep_area) = area;
+    MP_STATE_MEM(gc_incr_sweep) = block;
+    return area == NULL;
+}
+
+// Return true if the lazy sweep has not reached the given block yet.
+STATIC bool gc_incr_ahead_of_sweep(mp_state_mem_area_t *area, size_t block) {
+    mp_state_mem_area_t *sweep_area = MP_STATE_MEM(gc_incr_sweep_area);
+    if (sweep_area == NULL) {
+        return false;
+    }
+    if (area == sweep_area) {
+        return block >= MP_STATE_MEM(gc_incr_sweep);
+    }
+    // the areas after the one being swept have not been reached
+    for (mp_state_mem_area_t *a = NEXT_AREA(sweep_area); a != NULL; a = NEXT_AREA(a)) {
+        if (a == area) {
+            return true;
+        }
+    }
+    return false;
+}
+
+STATIC void gc_incr_finish_sweep(void) {
+    gc_incr_sweep((size_t)-1);
+    gc_incr_cycle_done(MP_STATE_MEM(gc_incr_live));
+}
+
+STATIC void gc_pause_record(mp_uint_t start) {
+    mp_uint_t t = mp_hal_ticks_us() - start;
+    if (t > MP_STATE_MEM(gc_pause_max)) {
+        MP_STATE_MEM(gc_pause_max) = t;
+    }
+    // bucket i counts the pauses shorter than 16 << i us
+    size_t i = 0;
+    while (i < MP_GC_NUM_PAUSE_BUCKETS - 1 && t >= ((mp_uint_t)16 << i)) {
+        i++;
+    }
+    MP_STATE_MEM(gc_pause_hist)[i]++;
+}
+
+void gc_incremental_step(void) {
+    GC_ENTER();
+    MP_STATE_MEM(gc_incr_allocated) += MP_STATE_MEM(gc_incr_alloc);
+    MP_STATE_MEM(gc_incr_alloc) = 0;
+    MP_STATE_MEM(gc_incr_poll_count) = GC_INCR_POLL_DIVISOR;
+    if (MP_STATE_MEM(gc_lock_depth) > 0 || !MP_STATE_MEM(gc_auto_collect_enabled) || !MP_STATE_MEM(gc_incr_enabled)) {
+        GC_EXIT();
+        return;
+    }
+    if (MP_STATE_MEM(gc_incr_phase) == GC_INCR_PHASE_IDLE) {
+        if (MP_STATE_MEM(gc_incr_allocated) < MP_STATE_MEM(gc_incr_trigger)) {
+            GC_EXIT();
+            return;
+        }
+        // start a new cycle
+        DEBUG_printf("gc_incremental_step: start cycle\n");
+        #if MICROPY_GC_ALLOC_THRESHOLD
+        MP_STATE_MEM(gc_alloc_amount) = 0;
+        #endif
+        gc_reset_stack();
+        MP_STATE_MEM(gc_incr_root) = 0;
+        MP_STATE_MEM(gc_incr_rescan_area) = NULL;
+        MP_STATE_MEM(gc_incr_clean_area) = &MP_STATE_MEM(area);
+        MP_STATE_MEM(gc_incr_clean) = 0;
+        MP_STATE_MEM(gc_incr_phase) = GC_INCR_PHASE_MARK;
+    }
+    mp_uint_t start = mp_hal_ticks_us();
+    bool finish_mark = false;
+    if (MP_STATE_MEM(gc_incr_phase) == GC_INCR_PHASE_MARK) {
+        finish_mark = gc_incr_mark(MP_STATE_MEM(gc_incr_budget));
+    } else if (gc_incr_sweep(MP_STATE_MEM(gc_incr_budget) / BYTES_PER_WORD)) {
+        // sweeping a block costs about as much as scanning a word
+        gc_incr_cycle_done(MP_STATE_MEM(gc_incr_live));
+    }
+    gc_pause_record(start);
+    GC_EXIT();
+    if (finish_mark) {
+        MP_STATE_MEM(gc_incr_lazy_sweep) = true;
+        gc_collect();
+    }
+}
+
+void gc_write_barrier_slow(const void *ptr) {
+    GC_ENTER();
+    if (MP_STATE_MEM(gc_incr_phase) == GC_INCR_PHASE_MARK) {
+        mp_state_mem_area_t *area = gc_get_ptr_area(ptr);
+        if (area != NULL) {
+            DTB_SET(area, BLOCK_FROM_PTR(area, ptr));
         }
     }
+    GC_EXIT();
 }
+#endif
 
 void gc_collect_start(void) {
     GC_ENTER();
     MP_STATE_MEM(gc_lock_depth)++;
+    #if MICROPY_GC_INCREMENTAL
+    MP_STATE_MEM(gc_pause_start) = mp_hal_ticks_us();
+    if (MP_STATE_MEM(gc_incr_phase) == GC_INCR_PHASE_SWEEP) {
+        gc_incr_finish_sweep();
+    }
+    #endif
     #if MICROPY_GC_ALLOC_THRESHOLD
     MP_STATE_MEM(gc_alloc_amount) = 0;
     #endif
-    MP_STATE_MEM(gc_stack_overflow) = 0;
-    MP_STATE_MEM(gc_sp) = MP_STATE_MEM(gc_stack);
+    #if MICROPY_GC_INCREMENTAL
+    // an incremental mark in progress is finished, not restarted
+    if (MP_STATE_MEM(gc_incr_phase) == GC_INCR_PHASE_IDLE)
+    #endif
+    {
+        gc_reset_stack();
+    }
     // Trace root pointers.  This relies on the root pointers being organised
     // correctly in the mp_state_ctx structure.  We scan nlr_top, dict_locals,
     // dict_globals, then the root pointer section of mp_state_vm.
     void **ptrs = (void**)(void*)&mp_state_ctx;
     gc_collect_root(ptrs, offsetof(mp_state_ctx_t, vm.qstr_last_chunk) / sizeof(void*));
+
+    #if MICROPY_ENABLE_PYSTACK
+    // Trace root pointers from the Python stack of this thread
+    ptrs = (void**)(void*)MP_STATE_THREAD(pystack_start);
+    gc_collect_root(ptrs, (MP_STATE_THREAD(pystack_cur) - MP_STATE_THREAD(pystack_start)) / sizeof(void*));
+    #endif
 }
 
 void gc_collect_root(void **ptrs, size_t len) {
     for (size_t i = 0; i < len; i++) {
         void *ptr = ptrs[i];
+        #if MICROPY_GC_INCREMENTAL
+        if (MP_STATE_MEM(gc_incr_phase) == GC_INCR_PHASE_MARK) {
+            mp_state_mem_area_t *area = gc_get_ptr_area(ptr);
+            if (area != NULL && ATB_GET_KIND(area, BLOCK_FROM_PTR(area, ptr)) == AT_MARK) {
+                // the block may have been written to since it was scanned
+                DTB_SET(area, BLOCK_FROM_PTR(area, ptr));
+            }
+        }
+        #endif
         VERIFY_MARK_AND_PUSH(ptr);
         gc_drain_stack();
     }
 }
 
 void gc_collect_end(void) {
+    #if MICROPY_GC_INCREMENTAL
+    if (MP_STATE_MEM(gc_incr_phase) == GC_INCR_PHASE_MARK) {
+        // finish an incremental mark by scanning all dirty blocks again
+        if (MP_STATE_MEM(gc_incr_rescan_area) != NULL) {
+            // an overflow rescan was not completed
+            MP_STATE_MEM(gc_stack_overflow) = 1;
+        }
+        for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+            size_t dtb_len = (NUM_BLOCKS(area) + BLOCKS_PER_DTB - 1) / BLOCKS_PER_DTB;
+            for (size_t i = 0; i < dtb_len; i++) {
+                if (area->gc_dirty_table_start[i] != 0) {
+                    gc_incr_clean_dtb(area, i);
+                    gc_drain_stack();
+                }
+            }
+        }
+    }
+    #endif
     gc_deal_with_stack_overflow();
+    #if MICROPY_ENABLE_FINALISER
+    gc_queue_finalisers();
+    #endif
+    gc_reset_stack();
+    #if MICROPY_GC_INCREMENTAL
+    if (MP_STATE_MEM(gc_incr_lazy_sweep)) {
+        // the mark was finished by gc_incremental_step, so sweep in slices
+        MP_STATE_MEM(gc_incr_lazy_sweep) = false;
+        MP_STATE_MEM(gc_incr_phase) = GC_INCR_PHASE_SWEEP;
+        MP_STATE_MEM(gc_incr_sweep_area) = &MP_STATE_MEM(area);
+        MP_STATE_MEM(gc_incr_sweep) = 0;
+        MP_STATE_MEM(gc_incr_live) = 0;
+        #if MICROPY_PY_GC_COLLECT_RETVAL
+        MP_STATE_MEM(gc_collected) = 0;
+        #endif
+    } else {
+        MP_STATE_MEM(gc_incr_phase) = GC_INCR_PHASE_IDLE;
+        gc_sweep();
+    }
+    #else
     gc_sweep();
-    MP_STATE_MEM(gc_last_free_atb_index) = 0;
+    #endif
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+        area->gc_last_free_atb_index = 0;
+    }
     MP_STATE_MEM(gc_lock_depth)--;
+    #if MICROPY_GC_INCREMENTAL
+    gc_pause_record(MP_STATE_MEM(gc_pause_start));
+    #endif
     GC_EXIT();
 }
 
-void gc_info(gc_info_t *info) {
-    GC_ENTER();
-    info->total = MP_STATE_MEM(gc_pool_end) - MP_STATE_MEM(gc_pool_start);
-    info->used = 0;
-    info->free = 0;
-    info->max_free = 0;
-    info->num_1block = 0;
-    info->num_2block = 0;
-    info->max_block = 0;
+// Add the usage of area to info.
+STATIC void gc_info_area(mp_state_mem_area_t *area, gc_info_t *info) {
+    info->total += area->gc_pool_end - area->gc_pool_start;
+    size_t used = 0;
+    size_t free = 0;
     bool finish = false;
     for (size_t block = 0, len = 0, len_free = 0; !finish;) {
-        size_t kind = ATB_GET_KIND(block);
+        size_t kind = ATB_GET_KIND(area, block);
         switch (kind) {
             case AT_FREE:
-                info->free += 1;
+                free += 1;
                 len_free += 1;
                 len = 0;
                 break;
 
+            case AT_MARK:
+                // a live head during an incremental collection
             case AT_HEAD:
-                info->used += 1;
+                used += 1;
                 len = 1;
                 break;
 
             case AT_TAIL:
-                info->used += 1;
+                used += 1;
                 len += 1;
                 break;
-
-            case AT_MARK:
-                // shouldn't happen
-                break;
         }
 
         block++;
-        finish = (block == MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB);
+        finish = (block == NUM_BLOCKS(area));
         // Get next block type if possible
         if (!finish) {
-            kind = ATB_GET_KIND(block);
+            kind = ATB_GET_KIND(area, block);
         }
 
-        if (finish || kind == AT_FREE || kind == AT_HEAD) {
+        if (finish || kind == AT_FREE || ATB_KIND_IS_HEAD(kind)) {
             if (len == 1) {
                 info->num_1block += 1;
             } else if (len == 2) {
@@ -378,7 +1291,7 @@ void gc_info(gc_info_t *info) {
             if (len > info->max_block) {
                 info->max_block = len;
             }
-            if (finish || kind == AT_HEAD) {
+            if (finish || ATB_KIND_IS_HEAD(kind)) {
                 if (len_free > info->max_free) {
                     info->max_free = len_free;
                 }
@@ -387,12 +1300,32 @@ void gc_info(gc_info_t *info) {
         }
     }
 
-    info->used *= BYTES_PER_BLOCK;
-    info->free *= BYTES_PER_BLOCK;
+    info->used += used * BYTES_PER_BLOCK;
+    info->free += free * BYTES_PER_BLOCK;
+}
+
+STATIC void gc_info_clear(gc_info_t *info) {
+    info->total = 0;
+    info->used = 0;
+    info->free = 0;
+    info->max_free = 0;
+    info->num_1block = 0;
+    info->num_2block = 0;
+    info->max_block = 0;
+    info->num_stack_overflow = MP_STATE_MEM(gc_stack_overflow_count);
+    info->num_stack_rescan = MP_STATE_MEM(gc_stack_rescan_count);
+}
+
+void gc_info(gc_info_t *info) {
+    GC_ENTER();
+    gc_info_clear(info);
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+        gc_info_area(area, info);
+    }
     GC_EXIT();
 }
 
-void *gc_alloc(size_t n_bytes, bool has_finaliser) {
+void *gc_alloc(size_t n_bytes, unsigned int alloc_flags) {
     size_t n_blocks = ((n_bytes + BYTES_PER_BLOCK - 1) & (~(BYTES_PER_BLOCK - 1))) / BYTES_PER_BLOCK;
     DEBUG_printf("gc_alloc(" UINT_FMT " bytes -> " UINT_FMT " blocks)\n", n_bytes, n_blocks);
 
@@ -409,11 +1342,15 @@ void *gc_alloc(size_t n_bytes, bool has_finaliser) {
         return NULL;
     }
 
+    mp_state_mem_area_t *area;
     size_t i;
     size_t end_block;
     size_t start_block;
     size_t n_free = 0;
     int collected = !MP_STATE_MEM(gc_auto_collect_enabled);
+    #if MICROPY_GC_SPLIT_HEAP_AUTO
+    bool added = false;
+    #endif
 
     #if MICROPY_GC_ALLOC_THRESHOLD
     if (!collected && MP_STATE_MEM(gc_alloc_amount) >= MP_STATE_MEM(gc_alloc_threshold)) {
@@ -423,16 +1360,57 @@ void *gc_alloc(size_t n_bytes, bool has_finaliser) {
     }
     #endif
 
+    #if MICROPY_GC_INCREMENTAL
+    if (!collected && MP_STATE_MEM(gc_incr_enabled)) {
+        MP_STATE_MEM(gc_incr_alloc) += n_blocks;
+        if (MP_STATE_MEM(gc_incr_alloc) >= MP_STATE_MEM(gc_incr_budget) / (4 * BYTES_PER_BLOCK)) {
+            GC_EXIT();
+            gc_incremental_step();
+            GC_ENTER();
+        }
+    }
+    #endif
+
     for (;;) {
 
-        // look for a run of n_blocks available blocks
-        for (i = MP_STATE_MEM(gc_last_free_atb_index); i < MP_STATE_MEM(gc_alloc_table_byte_len); i++) {
-            byte a = MP_STATE_MEM(gc_alloc_table_start)[i];
-            if (ATB_0_IS_FREE(a)) { if (++n_free >= n_blocks) { i = i * BLOCKS_PER_ATB + 0; goto found; } } else { n_free = 0; }
-            if (ATB_1_IS_FREE(a)) { if (++n_free >= n_blocks) { i = i * BLOCKS_PER_ATB + 1; goto found; } } else { n_free = 0; }
-            if (ATB_2_IS_FREE(a)) { if (++n_free >= n_blocks) { i = i * BLOCKS_PER_ATB + 2; goto found; } } else { n_free = 0; }
-            if (ATB_3_IS_FREE(a)) { if (++n_free >= n_blocks) { i = i * BLOCKS_PER_ATB + 3; goto found; } } else { n_free = 0; }
+        for (area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+            #if MICROPY_GC_FREE_LISTS
+            i = gc_free_list_take(area, n_blocks);
+            if (i != GC_NO_BLOCK) {
+                goto found;
+            }
+            #else
+            // look for a run of n_blocks available blocks
+            n_free = 0;
+            for (i = area->gc_last_free_atb_index; i < area->gc_alloc_table_byte_len; i++) {
+                byte a = area->gc_alloc_table_start[i];
+                if (ATB_0_IS_FREE(a)) { if (++n_free >= n_blocks) { i = i * BLOCKS_PER_ATB + 0; goto found; } } else { n_free = 0; }
+                if (ATB_1_IS_FREE(a)) { if (++n_free >= n_blocks) { i = i * BLOCKS_PER_ATB + 1; goto found; } } else { n_free = 0; }
+                if (ATB_2_IS_FREE(a)) { if (++n_free >= n_blocks) { i = i * BLOCKS_PER_ATB + 2; goto found; } } else { n_free = 0; }
+                if (ATB_3_IS_FREE(a)) { if (++n_free >= n_blocks) { i = i * BLOCKS_PER_ATB + 3; goto found; } } else { n_free = 0; }
+            }
+            #endif
+        }
+
+        #if MICROPY_GC_INCREMENTAL
+        if (MP_STATE_MEM(gc_incr_phase) == GC_INCR_PHASE_SWEEP) {
+            // finish the sweep in progress, which may free enough memory
+            mp_uint_t start = mp_hal_ticks_us();
+            gc_incr_finish_sweep();
+            gc_pause_record(start);
+            continue;
         }
+        #endif
+
+        #if MICROPY_GC_SPLIT_HEAP_AUTO
+        if (collected && !added) {
+            // a collection didn't free enough, so grow the heap
+            added = true;
+            if (gc_try_add_heap(n_bytes)) {
+                continue;
+            }
+        }
+        #endif
 
         GC_EXIT();
         // nothing found!
@@ -445,8 +1423,14 @@ void *gc_alloc(size_t n_bytes, bool has_finaliser) {
         GC_ENTER();
     }
 
-    // found, ending at block i inclusive
 found:
+    #if MICROPY_GC_FREE_LISTS
+    // found, starting at block i
+    start_block = i;
+    end_block = i + n_blocks - 1;
+    (void)n_free;
+    #else
+    // found, ending at block i inclusive
     // get starting and end blocks, both inclusive
     end_block = i;
     start_block = i - n_free + 1;
@@ -457,21 +1441,42 @@ found:
     // before this one.  Also, whenever we free or shink a block we must check
     // if this index needs adjusting (see gc_realloc and gc_free).
     if (n_free == 1) {
-        MP_STATE_MEM(gc_last_free_atb_index) = (i + 1) / BLOCKS_PER_ATB;
+        area->gc_last_free_atb_index = (i + 1) / BLOCKS_PER_ATB;
     }
+    #endif
 
     // mark first block as used head
-    ATB_FREE_TO_HEAD(start_block);
+    ATB_FREE_TO_HEAD(area, start_block);
+
+    #if MICROPY_GC_LEAF
+    // the leaf bit is only cleared here, so it must be written for every allocation
+    if (alloc_flags & GC_ALLOC_FLAG_LEAF) {
+        LTB_SET(area, start_block);
+    } else {
+        LTB_CLEAR(area, start_block);
+    }
+    #endif
+
+    #if MICROPY_GC_INCREMENTAL
+    if (MP_STATE_MEM(gc_incr_phase) == GC_INCR_PHASE_MARK) {
+        // allocate marked, and scan the contents before the mark is finished
+        ATB_HEAD_TO_MARK(area, start_block);
+        DTB_SET(area, start_block);
+    } else if (MP_STATE_MEM(gc_incr_phase) == GC_INCR_PHASE_SWEEP && gc_incr_ahead_of_sweep(area, start_block)) {
+        // ahead of the sweep, so mark it for the sweep to keep
+        ATB_HEAD_TO_MARK(area, start_block);
+    }
+    #endif
 
     // mark rest of blocks as used tail
     // TODO for a run of many blocks can make this more efficient
     for (size_t bl = start_block + 1; bl <= end_block; bl++) {
-        ATB_FREE_TO_TAIL(bl);
+        ATB_FREE_TO_TAIL(area, bl);
     }
 
     // get pointer to first block
     // we must create this pointer before unlocking the GC so a collection can find it
-    void *ret_ptr = (void*)(MP_STATE_MEM(gc_pool_start) + start_block * BYTES_PER_BLOCK);
+    void *ret_ptr = (void*)PTR_FROM_BLOCK(area, start_block);
     DEBUG_printf("gc_alloc(%p)\n", ret_ptr);
 
     #if MICROPY_GC_ALLOC_THRESHOLD
@@ -493,16 +1498,14 @@ found:
     #endif
 
     #if MICROPY_ENABLE_FINALISER
-    if (has_finaliser) {
+    if (alloc_flags & GC_ALLOC_FLAG_HAS_FINALISER) {
         // clear type pointer in case it is never set
         ((mp_obj_base_t*)ret_ptr)->type = NULL;
         // set mp_obj flag only if it has a finaliser
         GC_ENTER();
-        FTB_SET(start_block);
+        FTB_SET(area, start_block);
         GC_EXIT();
     }
-    #else
-    (void)has_finaliser;
     #endif
 
     #if EXTENSIVE_HEAP_PROFILING
@@ -534,22 +1537,32 @@ void gc_free(void *ptr) {
 
     DEBUG_printf("gc_free(%p)\n", ptr);
 
-    if (VERIFY_PTR(ptr)) {
-        size_t block = BLOCK_FROM_PTR(ptr);
-        if (ATB_GET_KIND(block) == AT_HEAD) {
+    mp_state_mem_area_t *area = gc_get_ptr_area(ptr);
+    if (area != NULL) {
+        size_t block = BLOCK_FROM_PTR(area, ptr);
+        if (ATB_KIND_IS_HEAD(ATB_GET_KIND(area, block))) {
             #if MICROPY_ENABLE_FINALISER
-            FTB_CLEAR(block);
+            FTB_CLEAR(area, block);
             #endif
             // set the last_free pointer to this block if it's earlier in the heap
-            if (block / BLOCKS_PER_ATB < MP_STATE_MEM(gc_last_free_atb_index)) {
-                MP_STATE_MEM(gc_last_free_atb_index) = block / BLOCKS_PER_ATB;
+            if (block / BLOCKS_PER_ATB < area->gc_last_free_atb_index) {
+                area->gc_last_free_atb_index = block / BLOCKS_PER_ATB;
             }
 
             // free head and all of its tail blocks
+            #if MICROPY_GC_FREE_LISTS
+            size_t n_blocks = 0;
+            do {
+                ATB_ANY_TO_FREE(area, block + n_blocks);
+                n_blocks += 1;
+            } while (ATB_GET_KIND(area, block + n_blocks) == AT_TAIL);
+            gc_free_list_add(area, block, n_blocks);
+            #else
             do {
-                ATB_ANY_TO_FREE(block);
+                ATB_ANY_TO_FREE(area, block);
                 block += 1;
-            } while (ATB_GET_KIND(block) == AT_TAIL);
+            } while (ATB_GET_KIND(area, block) == AT_TAIL);
+            #endif
 
             GC_EXIT();
 
@@ -570,14 +1583,15 @@ void gc_free(void *ptr) {
 
 size_t gc_nbytes(const void *ptr) {
     GC_ENTER();
-    if (VERIFY_PTR(ptr)) {
-        size_t block = BLOCK_FROM_PTR(ptr);
-        if (ATB_GET_KIND(block) == AT_HEAD) {
+    mp_state_mem_area_t *area = gc_get_ptr_area(ptr);
+    if (area != NULL) {
+        size_t block = BLOCK_FROM_PTR(area, ptr);
+        if (ATB_KIND_IS_HEAD(ATB_GET_KIND(area, block))) {
             // work out number of consecutive blocks in the chain starting with this on
             size_t n_blocks = 0;
             do {
                 n_blocks += 1;
-            } while (ATB_GET_KIND(block + n_blocks) == AT_TAIL);
+            } while (ATB_GET_KIND(area, block + n_blocks) == AT_TAIL);
             GC_EXIT();
             return n_blocks * BYTES_PER_BLOCK;
         }
@@ -588,6 +1602,15 @@ size_t gc_nbytes(const void *ptr) {
     return 0;
 }
 
+bool gc_is_heap_ptr(const void *ptr) {
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+        if (ptr >= (void*)area->gc_pool_start && ptr < (void*)area->gc_pool_end) {
+            return true;
+        }
+    }
+    return false;
+}
+
 #if 0
 // old, simple realloc that didn't expand memory in place
 void *gc_realloc(void *ptr, mp_uint_t n_bytes) {
@@ -620,7 +1643,7 @@ void *gc_realloc(void *ptr, mp_uint_t n_bytes) {
 void *gc_realloc(void *ptr_in, size_t n_bytes, bool allow_move) {
     // check for pure allocation
     if (ptr_in == NULL) {
-        return gc_alloc(n_bytes, false);
+        return gc_alloc(n_bytes, 0);
     }
 
     // check for pure free
@@ -631,18 +1654,20 @@ void *gc_realloc(void *ptr_in, size_t n_bytes, bool allow_move) {
 
     void *ptr = ptr_in;
 
+    GC_ENTER();
+
     // sanity check the ptr
-    if (!VERIFY_PTR(ptr)) {
+    mp_state_mem_area_t *area = gc_get_ptr_area(ptr);
+    if (area == NULL) {
+        GC_EXIT();
         return NULL;
     }
 
     // get first block
-    size_t block = BLOCK_FROM_PTR(ptr);
-
-    GC_ENTER();
+    size_t block = BLOCK_FROM_PTR(area, ptr);
 
     // sanity check the ptr is pointing to the head of a block
-    if (ATB_GET_KIND(block) != AT_HEAD) {
+    if (!ATB_KIND_IS_HEAD(ATB_GET_KIND(area, block))) {
         GC_EXIT();
         return NULL;
     }
@@ -663,9 +1688,9 @@ void *gc_realloc(void *ptr_in, size_t n_bytes, bool allow_move) {
     // efficiently shrink it (see below for shrinking code).
     size_t n_free   = 0;
     size_t n_blocks = 1; // counting HEAD block
-    size_t max_block = MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB;
+    size_t max_block = NUM_BLOCKS(area);
     for (size_t bl = block + n_blocks; bl < max_block; bl++) {
-        byte block_type = ATB_GET_KIND(bl);
+        byte block_type = ATB_GET_KIND(area, bl);
         if (block_type == AT_TAIL) {
             n_blocks++;
             continue;
@@ -691,12 +1716,15 @@ void *gc_realloc(void *ptr_in, size_t n_bytes, bool allow_move) {
     if (new_blocks < n_blocks) {
         // free unneeded tail blocks
         for (size_t bl = block + new_blocks, count = n_blocks - new_blocks; count > 0; bl++, count--) {
-            ATB_ANY_TO_FREE(bl);
+            ATB_ANY_TO_FREE(area, bl);
         }
+        #if MICROPY_GC_FREE_LISTS
+        gc_free_list_add(area, block + new_blocks, n_blocks - new_blocks);
+        #endif
 
         // set the last_free pointer to end of this block if it's earlier in the heap
-        if ((block + new_blocks) / BLOCKS_PER_ATB < MP_STATE_MEM(gc_last_free_atb_index)) {
-            MP_STATE_MEM(gc_last_free_atb_index) = (block + new_blocks) / BLOCKS_PER_ATB;
+        if ((block + new_blocks) / BLOCKS_PER_ATB < area->gc_last_free_atb_index) {
+            area->gc_last_free_atb_index = (block + new_blocks) / BLOCKS_PER_ATB;
         }
 
         GC_EXIT();
@@ -710,11 +1738,28 @@ void *gc_realloc(void *ptr_in, size_t n_bytes, bool allow_move) {
 
     // check if we can expand in place
     if (new_blocks <= n_blocks + n_free) {
+        #if MICROPY_GC_FREE_LISTS
+        // the following free run starts right after this chunk; take what we
+        // need from its front
+        gc_free_run_t *run = RUN_FROM_BLOCK(area, block + n_blocks);
+        size_t run_len = run->n_blocks;
+        gc_free_list_unlink(area, run);
+        if (run_len > new_blocks - n_blocks) {
+            gc_free_list_insert(area, block + new_blocks, run_len - (new_blocks - n_blocks));
+        }
+        #endif
         // mark few more blocks as used tail
         for (size_t bl = block + n_blocks; bl < block + new_blocks; bl++) {
-            assert(ATB_GET_KIND(bl) == AT_FREE);
-            ATB_FREE_TO_TAIL(bl);
+            assert(ATB_GET_KIND(area, bl) == AT_FREE);
+            ATB_FREE_TO_TAIL(area, bl);
+        }
+
+        #if MICROPY_GC_INCREMENTAL
+        if (MP_STATE_MEM(gc_incr_phase) == GC_INCR_PHASE_MARK) {
+            // the new part will be written to
+            DTB_SET(area, block);
         }
+        #endif
 
         GC_EXIT();
 
@@ -733,10 +1778,17 @@ void *gc_realloc(void *ptr_in, size_t n_bytes, bool allow_move) {
         return ptr_in;
     }
 
+    // the new chain keeps the finaliser and leaf state of this one
+    unsigned int alloc_flags = 0;
     #if MICROPY_ENABLE_FINALISER
-    bool ftb_state = FTB_GET(block);
-    #else
-    bool ftb_state = false;
+    if (FTB_GET(area, block)) {
+        alloc_flags |= GC_ALLOC_FLAG_HAS_FINALISER;
+    }
+    #endif
+    #if MICROPY_GC_LEAF
+    if (LTB_GET(area, block)) {
+        alloc_flags |= GC_ALLOC_FLAG_LEAF;
+    }
     #endif
 
     GC_EXIT();
@@ -747,7 +1799,7 @@ void *gc_realloc(void *ptr_in, size_t n_bytes, bool allow_move) {
     }
 
     // can't resize inplace; try to find a new contiguous chain
-    void *ptr_out = gc_alloc(n_bytes, ftb_state);
+    void *ptr_out = gc_alloc(n_bytes, alloc_flags);
 
     // check that the alloc succeeded
     if (ptr_out == NULL) {
@@ -768,30 +1820,45 @@ void gc_dump_info(void) {
         (uint)info.total, (uint)info.used, (uint)info.free);
     mp_printf(&mp_plat_print, " No. of 1-blocks: %u, 2-blocks: %u, max blk sz: %u, max free sz: %u\n",
            (uint)info.num_1block, (uint)info.num_2block, (uint)info.max_block, (uint)info.max_free);
+    mp_printf(&mp_plat_print, " Mark stack overflows: %u, rescans: %u\n",
+           (uint)info.num_stack_overflow, (uint)info.num_stack_rescan);
+    #if MICROPY_GC_SPLIT_HEAP
+    GC_ENTER();
+    if (MP_STATE_MEM(area).next != NULL) {
+        // the heap has grown, so also give the usage of each area
+        size_t n = 0;
+        for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+            gc_info_clear(&info);
+            gc_info_area(area, &info);
+            mp_printf(&mp_plat_print, " Area %u: total: %u, used: %u, free: %u, max free sz: %u\n",
+                (uint)n++, (uint)info.total, (uint)info.used, (uint)info.free, (uint)info.max_free);
+        }
+    }
+    GC_EXIT();
+    #endif
 }
 
-void gc_dump_alloc_table(void) {
-    GC_ENTER();
+STATIC void gc_dump_area_alloc_table(mp_state_mem_area_t *area) {
     static const size_t DUMP_BYTES_PER_LINE = 64;
     #if !EXTENSIVE_HEAP_PROFILING
     // When comparing heap output we don't want to print the starting
     // pointer of the heap because it changes from run to run.
-    mp_printf(&mp_plat_print, "GC memory layout; from %p:", MP_STATE_MEM(gc_pool_start));
+    mp_printf(&mp_plat_print, "GC memory layout; from %p:", area->gc_pool_start);
     #endif
-    for (size_t bl = 0; bl < MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB; bl++) {
+    for (size_t bl = 0; bl < NUM_BLOCKS(area); bl++) {
         if (bl % DUMP_BYTES_PER_LINE == 0) {
             // a new line of blocks
             {
                 // check if this line contains only free blocks
                 size_t bl2 = bl;
-                while (bl2 < MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB && ATB_GET_KIND(bl2) == AT_FREE) {
+                while (bl2 < NUM_BLOCKS(area) && ATB_GET_KIND(area, bl2) == AT_FREE) {
                     bl2++;
                 }
                 if (bl2 - bl >= 2 * DUMP_BYTES_PER_LINE) {
                     // there are at least 2 lines containing only free blocks, so abbreviate their printing
                     mp_printf(&mp_plat_print, "\n       (%u lines all free)", (uint)(bl2 - bl) / DUMP_BYTES_PER_LINE);
                     bl = bl2 & (~(DUMP_BYTES_PER_LINE - 1));
-                    if (bl >= MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB) {
+                    if (bl >= NUM_BLOCKS(area)) {
                         // got to end of heap
                         break;
                     }
@@ -803,7 +1870,7 @@ void gc_dump_alloc_table(void) {
             mp_printf(&mp_plat_print, "\n%05x: ", (uint)((bl * BYTES_PER_BLOCK) & (uint32_t)0xfffff));
         }
         int c = ' ';
-        switch (ATB_GET_KIND(bl)) {
+        switch (ATB_GET_KIND(area, bl)) {
             case AT_FREE: c = '.'; break;
             /* this prints out if the object is reachable from BSS or STACK (for unix only)
             case AT_HEAD: {
@@ -833,7 +1900,7 @@ void gc_dump_alloc_table(void) {
             */
             /* this prints the uPy object type of the head block */
             case AT_HEAD: {
-                void **ptr = (void**)(MP_STATE_MEM(gc_pool_start) + bl * BYTES_PER_BLOCK);
+                void **ptr = (void**)PTR_FROM_BLOCK(area, bl);
                 if (*ptr == &mp_type_tuple) { c = 'T'; }
                 else if (*ptr == &mp_type_list) { c = 'L'; }
                 else if (*ptr == &mp_type_dict) { c = 'D'; }
@@ -877,6 +1944,13 @@ void gc_dump_alloc_table(void) {
         mp_printf(&mp_plat_print, "%c", c);
     }
     mp_print_str(&mp_plat_print, "\n");
+}
+
+void gc_dump_alloc_table(void) {
+    GC_ENTER();
+    for (mp_state_mem_area_t *area = &MP_STATE_MEM(area); area != NULL; area = NEXT_AREA(area)) {
+        gc_dump_area_alloc_table(area);
+    }
     GC_EXIT();
 }
 
@@ -33,6 +33,11 @@
 
 void gc_init(void *start, void *end);
 
+#if MICROPY_GC_SPLIT_HEAP
+// Add the memory from start to end to the heap, as a new area.
+void gc_add(void *start, void *end);
+#endif
+
 // These lock/unlock functions can be nested.
 // They can be used to prevent the GC from allocating/freeing.
 void gc_lock(void);
@@ -45,11 +50,46 @@ void gc_collect_start(void);
 void gc_collect_root(void **ptrs, size_t len);
 void gc_collect_end(void);
 
-void *gc_alloc(size_t n_bytes, bool has_finaliser);
+// Flags for gc_alloc
+#define GC_ALLOC_FLAG_HAS_FINALISER (1) // call __del__ when the block is freed
+#define GC_ALLOC_FLAG_LEAF (2) // the block holds no pointers to the heap
+
+void *gc_alloc(size_t n_bytes, unsigned int alloc_flags);
 void gc_free(void *ptr); // does not call finaliser
 size_t gc_nbytes(const void *ptr);
+bool gc_is_heap_ptr(const void *ptr); // whether ptr points into the heap
 void *gc_realloc(void *ptr, size_t n_bytes, bool allow_move);
 
+#if MICROPY_ENABLE_FINALISER
+// Call the finalisers of the objects queued by previous collections.  This
+// runs Python code so must be called with the GC unlocked, from a point
+// where the VM may be reentered.
+void gc_run_finalisers(void);
+#endif
+
+#if MICROPY_GC_INCREMENTAL
+// Phases of an incremental collection
+#define GC_INCR_PHASE_IDLE (0)
+#define GC_INCR_PHASE_MARK (1)
+#define GC_INCR_PHASE_SWEEP (2)
+
+// Do one slice of incremental collection work, if a cycle is due or running.
+void gc_incremental_step(void);
+
+// Must be called after storing a heap pointer into the heap block at ptr
+// (with no allocation in between), so an incremental mark that has already
+// scanned the block scans it again.  Callers need py/mpstate.h.
+void gc_write_barrier_slow(const void *ptr);
+#define gc_write_barrier(ptr) \
+    do { \
+        if (MP_STATE_MEM(gc_incr_phase) == GC_INCR_PHASE_MARK) { \
+            gc_write_barrier_slow(ptr); \
+        } \
+    } while (0)
+#else
+#define gc_write_barrier(ptr) (void)0
+#endif
+
 typedef struct _gc_info_t {
     size_t total;
     size_t used;
@@ -58,6 +98,8 @@ typedef struct _gc_info_t {
     size_t num_1block;
     size_t num_2block;
     size_t max_block;
+    size_t num_stack_overflow;
+    size_t num_stack_rescan;
 } gc_info_t;
 
 void gc_info(gc_info_t *info);
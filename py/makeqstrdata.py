@@ -59,6 +59,13 @@ def compute_hash(qstr, bytes_hash):
     # Make sure that valid hash is never zero, zero means "hash not computed"
     return (hash & ((1 << (8 * bytes_hash)) - 1)) or 1
 
+# this must match qstr_compute_index_hash in qstr.c
+def compute_index_hash(qstr):
+    hash = 5381
+    for b in qstr:
+        hash = ((hash * 33) ^ b) & 0xffffffff
+    return hash
+
 def qstr_escape(qst):
     def esc_char(m):
         c = ord(m.group(0))
@@ -150,6 +157,29 @@ def print_qstr_data(qcfgs, qstrs):
         qbytes = make_bytes(cfg_bytes_len, cfg_bytes_hash, qstr)
         print('QDEF(MP_QSTR_%s, %s)' % (ident, qbytes))
 
+    print_qstr_index(qstrs)
+
+def print_qstr_index(qstrs):
+    # build an open-addressed (linear probing) hash index over the static
+    # pool; slots hold qstr ids and 0 (MP_QSTR_NULL) marks an empty slot
+    n = len(qstrs)
+    assert n < 0x10000
+    size = 16
+    while size < 2 * n:
+        size *= 2
+    table = [0] * size
+    for order, ident, qstr in sorted(qstrs.values(), key=lambda x: x[0]):
+        h = compute_index_hash(bytes_cons(qstr, 'utf8')) & (size - 1)
+        while table[h] != 0:
+            h = (h + 1) & (size - 1)
+        table[h] = order + 1 # +1 to account for MP_QSTR_NULL
+
+    print('')
+    print('#ifdef QINDEX')
+    for i in range(0, size, 16):
+        print(' '.join('QINDEX(%d)' % q for q in table[i:i + 16]))
+    print('#endif')
+
 def do_work(infiles):
     qcfgs, qstrs = parse_input_headers(infiles)
     print_qstr_data(qcfgs, qstrs)
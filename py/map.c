@@ -33,6 +33,7 @@
 #include "py/misc.h"
 #include "py/runtime0.h"
 #include "py/runtime.h"
+#include "py/gc.h"
 
 // Fixed empty map. Useful when need to call kw-receiving functions
 // without any keywords from C, etc.
@@ -70,6 +71,14 @@ STATIC size_t get_hash_alloc_greater_or_equal_to(size_t x) {
 /******************************************************************************/
 /* map                                                                        */
 
+#if MICROPY_OPT_LOAD_GLOBAL_CACHE
+// Give the map a version that no map has had before, so that a cached slot of
+// it can't be confused with a slot of a map reusing its memory.
+#define MAP_NEW_VERSION(map) ((map)->version = ++MP_STATE_VM(map_version))
+#else
+#define MAP_NEW_VERSION(map) (void)0
+#endif
+
 void mp_map_init(mp_map_t *map, size_t n) {
     if (n == 0) {
         map->alloc = 0;
@@ -82,6 +91,7 @@ void mp_map_init(mp_map_t *map, size_t n) {
     map->all_keys_are_qstrs = 1;
     map->is_fixed = 0;
     map->is_ordered = 0;
+    MAP_NEW_VERSION(map);
 }
 
 void mp_map_init_fixed_table(mp_map_t *map, size_t n, const mp_obj_t *table) {
@@ -91,6 +101,7 @@ void mp_map_init_fixed_table(mp_map_t *map, size_t n, const mp_obj_t *table) {
     map->is_fixed = 1;
     map->is_ordered = 1;
     map->table = (mp_map_elem_t*)table;
+    MAP_NEW_VERSION(map);
 }
 
 mp_map_t *mp_map_new(size_t n) {
@@ -105,6 +116,7 @@ void mp_map_deinit(mp_map_t *map) {
         m_del(mp_map_elem_t, map->table, map->alloc);
     }
     map->used = map->alloc = 0;
+    MAP_NEW_VERSION(map);
 }
 
 void mp_map_free(mp_map_t *map) {
@@ -121,6 +133,7 @@ void mp_map_clear(mp_map_t *map) {
     map->all_keys_are_qstrs = 1;
     map->is_fixed = 0;
     map->table = NULL;
+    MAP_NEW_VERSION(map);
 }
 
 STATIC void mp_map_rehash(mp_map_t *map) {
@@ -133,6 +146,7 @@ STATIC void mp_map_rehash(mp_map_t *map) {
     map->used = 0;
     map->all_keys_are_qstrs = 1;
     map->table = new_table;
+    MAP_NEW_VERSION(map);
     for (size_t i = 0; i < old_alloc; i++) {
         if (old_table[i].key != MP_OBJ_NULL && old_table[i].key != MP_OBJ_SENTINEL) {
             mp_map_lookup(map, old_table[i].key, MP_MAP_LOOKUP_ADD_IF_NOT_FOUND)->value = old_table[i].value;
@@ -186,6 +200,10 @@ mp_map_elem_t *mp_map_lookup(mp_map_t *map, mp_obj_t index, mp_map_lookup_kind_t
                     elem = &map->table[map->used];
                     elem->key = MP_OBJ_NULL;
                     elem->value = value;
+                    MAP_NEW_VERSION(map);
+                } else if (lookup_kind == MP_MAP_LOOKUP_ADD_IF_NOT_FOUND) {
+                    // the caller will store a new value
+                    gc_write_barrier(map->table);
                 }
                 return elem;
             }
@@ -201,9 +219,11 @@ mp_map_elem_t *mp_map_lookup(mp_map_t *map, mp_obj_t index, mp_map_lookup_kind_t
         }
         mp_map_elem_t *elem = map->table + map->used++;
         elem->key = index;
+        MAP_NEW_VERSION(map);
         if (!MP_OBJ_IS_QSTR(index)) {
             map->all_keys_are_qstrs = 0;
         }
+        gc_write_barrier(map->table);
         return elem;
     }
 
@@ -239,9 +259,11 @@ mp_map_elem_t *mp_map_lookup(mp_map_t *map, mp_obj_t index, mp_map_lookup_kind_t
                 }
                 avail_slot->key = index;
                 avail_slot->value = MP_OBJ_NULL;
+                MAP_NEW_VERSION(map);
                 if (!MP_OBJ_IS_QSTR(index)) {
                     map->all_keys_are_qstrs = 0;
                 }
+                gc_write_barrier(map->table);
                 return avail_slot;
             } else {
                 return NULL;
@@ -263,7 +285,11 @@ mp_map_elem_t *mp_map_lookup(mp_map_t *map, mp_obj_t index, mp_map_lookup_kind_t
                 } else {
                     slot->key = MP_OBJ_SENTINEL;
                 }
+                MAP_NEW_VERSION(map);
                 // keep slot->value so that caller can access it if needed
+            } else if (lookup_kind == MP_MAP_LOOKUP_ADD_IF_NOT_FOUND) {
+                // the caller will store a new value
+                gc_write_barrier(map->table);
             }
             return slot;
         }
@@ -279,9 +305,11 @@ mp_map_elem_t *mp_map_lookup(mp_map_t *map, mp_obj_t index, mp_map_lookup_kind_t
                     map->used++;
                     avail_slot->key = index;
                     avail_slot->value = MP_OBJ_NULL;
+                    MAP_NEW_VERSION(map);
                     if (!MP_OBJ_IS_QSTR(index)) {
                         map->all_keys_are_qstrs = 0;
                     }
+                    gc_write_barrier(map->table);
                     return avail_slot;
                 } else {
                     // not enough room in table, rehash it
@@ -346,6 +374,7 @@ mp_obj_t mp_set_lookup(mp_set_t *set, mp_obj_t index, mp_map_lookup_kind_t looku
                 }
                 set->used++;
                 *avail_slot = index;
+                gc_write_barrier(set->table);
                 return index;
             } else {
                 return MP_OBJ_NULL;
@@ -380,6 +409,7 @@ mp_obj_t mp_set_lookup(mp_set_t *set, mp_obj_t index, mp_map_lookup_kind_t looku
                     // there was an available slot, so use that
                     set->used++;
                     *avail_slot = index;
+                    gc_write_barrier(set->table);
                     return index;
                 } else {
                     // not enough room in table, rehash it
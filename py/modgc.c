@@ -24,9 +24,12 @@
  * THE SOFTWARE.
  */
 
+#include <string.h>
+
 #include "py/mpstate.h"
 #include "py/obj.h"
 #include "py/gc.h"
+#include "py/runtime.h"
 
 #if MICROPY_PY_GC && MICROPY_ENABLE_GC
 
@@ -37,10 +40,15 @@
 STATIC mp_obj_t py_gc_collect(void) {
     gc_collect();
 #if MICROPY_PY_GC_COLLECT_RETVAL
-    return MP_OBJ_NEW_SMALL_INT(MP_STATE_MEM(gc_collected));
+    mp_obj_t ret = MP_OBJ_NEW_SMALL_INT(MP_STATE_MEM(gc_collected));
 #else
-    return mp_const_none;
+    mp_obj_t ret = mp_const_none;
+#endif
+#if MICROPY_ENABLE_FINALISER
+    // finalise what this collection found unreachable before returning
+    gc_run_finalisers();
 #endif
+    return ret;
 }
 MP_DEFINE_CONST_FUN_OBJ_0(gc_collect_obj, py_gc_collect);
 
@@ -102,6 +110,55 @@ STATIC mp_obj_t gc_threshold(size_t n_args, const mp_obj_t *args) {
 MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(gc_threshold_obj, 0, 1, gc_threshold);
 #endif
 
+#if MICROPY_GC_INCREMENTAL
+/// \function incremental([enable[, budget]])
+/// Query or set whether the collector runs incrementally, and the number of
+/// bytes of heap that one slice of incremental collection may scan.
+STATIC mp_obj_t gc_incremental(size_t n_args, const mp_obj_t *args) {
+    if (n_args == 0) {
+        return mp_obj_new_bool(MP_STATE_MEM(gc_incr_enabled));
+    }
+    if (n_args == 2) {
+        mp_int_t budget = mp_obj_get_int(args[1]);
+        if (budget < 256) {
+            mp_raise_ValueError("budget too small");
+        }
+        MP_STATE_MEM(gc_incr_budget) = budget;
+    }
+    bool enable = mp_obj_is_true(args[0]);
+    if (!enable && MP_STATE_MEM(gc_incr_phase) != GC_INCR_PHASE_IDLE) {
+        // complete the cycle in progress
+        gc_collect();
+    }
+    MP_STATE_MEM(gc_incr_enabled) = enable;
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(gc_incremental_obj, 0, 2, gc_incremental);
+
+/// \function pauses([reset])
+/// Return a tuple (max, hist) describing the pauses caused by the collector:
+/// the longest pause in microseconds, and a tuple whose i-th entry is the
+/// number of pauses shorter than 16 << i microseconds but not counted in an
+/// earlier entry (the last entry counts all longer pauses).
+STATIC mp_obj_t gc_pauses(size_t n_args, const mp_obj_t *args) {
+    mp_obj_t hist[MP_GC_NUM_PAUSE_BUCKETS];
+    for (size_t i = 0; i < MP_GC_NUM_PAUSE_BUCKETS; i++) {
+        hist[i] = mp_obj_new_int_from_uint(MP_STATE_MEM(gc_pause_hist)[i]);
+    }
+    mp_obj_t items[2] = {
+        mp_obj_new_int_from_uint(MP_STATE_MEM(gc_pause_max)),
+        mp_obj_new_tuple(MP_GC_NUM_PAUSE_BUCKETS, hist),
+    };
+    mp_obj_t ret = mp_obj_new_tuple(2, items);
+    if (n_args == 1 && mp_obj_is_true(args[0])) {
+        MP_STATE_MEM(gc_pause_max) = 0;
+        memset(MP_STATE_MEM(gc_pause_hist), 0, sizeof(MP_STATE_MEM(gc_pause_hist)));
+    }
+    return ret;
+}
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(gc_pauses_obj, 0, 1, gc_pauses);
+#endif
+
 STATIC const mp_rom_map_elem_t mp_module_gc_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR_gc) },
     { MP_ROM_QSTR(MP_QSTR_collect), MP_ROM_PTR(&gc_collect_obj) },
@@ -113,6 +170,10 @@ STATIC const mp_rom_map_elem_t mp_module_gc_globals_table[] = {
     #if MICROPY_GC_ALLOC_THRESHOLD
     { MP_ROM_QSTR(MP_QSTR_threshold), MP_ROM_PTR(&gc_threshold_obj) },
     #endif
+    #if MICROPY_GC_INCREMENTAL
+    { MP_ROM_QSTR(MP_QSTR_incremental), MP_ROM_PTR(&gc_incremental_obj) },
+    { MP_ROM_QSTR(MP_QSTR_pauses), MP_ROM_PTR(&gc_pauses_obj) },
+    #endif
 };
 
 STATIC MP_DEFINE_CONST_DICT(mp_module_gc_globals, mp_module_gc_globals_table);
@@ -31,6 +31,8 @@
 #include "py/stackctrl.h"
 #include "py/runtime.h"
 #include "py/gc.h"
+#include "py/vmprofile.h"
+#include "py/objfun.h"
 
 // Various builtins specific to MicroPython runtime,
 // living in micropython module
@@ -45,6 +47,67 @@ STATIC mp_obj_t mp_micropython_opt_level(size_t n_args, const mp_obj_t *args) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mp_micropython_opt_level_obj, 0, 1, mp_micropython_opt_level);
 
+#if MICROPY_COMP_BC_PEEPHOLE
+STATIC mp_obj_t mp_micropython_opt_peephole(size_t n_args, const mp_obj_t *args) {
+    if (n_args == 0) {
+        return mp_obj_new_bool(MP_STATE_VM(mp_bc_peephole));
+    } else {
+        MP_STATE_VM(mp_bc_peephole) = mp_obj_is_true(args[0]);
+        return mp_const_none;
+    }
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mp_micropython_opt_peephole_obj, 0, 1, mp_micropython_opt_peephole);
+#endif
+
+#if MICROPY_TIERING
+STATIC mp_obj_t mp_micropython_opt_tier(size_t n_args, const mp_obj_t *args) {
+    if (n_args == 0) {
+        return mp_obj_new_int_from_uint(MP_STATE_VM(tier_threshold));
+    } else {
+        mp_int_t threshold = mp_obj_get_int(args[0]);
+        if (threshold < 0) {
+            mp_raise_ValueError(NULL);
+        }
+        MP_STATE_VM(tier_threshold) = threshold;
+        return mp_const_none;
+    }
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mp_micropython_opt_tier_obj, 0, 1, mp_micropython_opt_tier);
+
+// With no args returns the number of functions promoted to native code and
+// rejected for it; given a function returns its count, and True if it was
+// promoted, None if it was rejected or False if neither yet.
+STATIC mp_obj_t mp_micropython_tier_info(size_t n_args, const mp_obj_t *args) {
+    mp_obj_t items[2];
+    if (n_args == 0) {
+        items[0] = mp_obj_new_int_from_uint(MP_STATE_VM(tier_promoted));
+        items[1] = mp_obj_new_int_from_uint(MP_STATE_VM(tier_rejected));
+    } else {
+        if (!MP_OBJ_IS_TYPE(args[0], &mp_type_fun_bc)) {
+            mp_raise_TypeError(NULL);
+        }
+        mp_obj_fun_bc_t *fun = MP_OBJ_TO_PTR(args[0]);
+        items[0] = mp_obj_new_int_from_uint(fun->tier_count);
+        if (fun->tier_native == MP_OBJ_NULL) {
+            items[1] = mp_const_false;
+        } else if (fun->tier_native == MP_OBJ_SENTINEL) {
+            items[1] = mp_const_none;
+        } else {
+            items[1] = mp_const_true;
+        }
+    }
+    return mp_obj_new_tuple(2, items);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mp_micropython_tier_info_obj, 0, 1, mp_micropython_tier_info);
+#endif
+
+#if MICROPY_VM_PROFILE
+STATIC mp_obj_t mp_micropython_vm_profile(size_t n_args, const mp_obj_t *args) {
+    return mp_vm_profile_get(n_args > 0 && mp_obj_is_true(args[0]));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mp_micropython_vm_profile_obj, 0, 1, mp_micropython_vm_profile);
+#endif
+
 #if MICROPY_PY_MICROPYTHON_MEM_INFO
 
 #if MICROPY_MEM_STATS
@@ -143,6 +206,16 @@ STATIC const mp_rom_map_elem_t mp_module_micropython_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR_micropython) },
     { MP_ROM_QSTR(MP_QSTR_const), MP_ROM_PTR(&mp_identity_obj) },
     { MP_ROM_QSTR(MP_QSTR_opt_level), MP_ROM_PTR(&mp_micropython_opt_level_obj) },
+    #if MICROPY_COMP_BC_PEEPHOLE
+    { MP_ROM_QSTR(MP_QSTR_opt_peephole), MP_ROM_PTR(&mp_micropython_opt_peephole_obj) },
+    #endif
+    #if MICROPY_TIERING
+    { MP_ROM_QSTR(MP_QSTR_opt_tier), MP_ROM_PTR(&mp_micropython_opt_tier_obj) },
+    { MP_ROM_QSTR(MP_QSTR_tier_info), MP_ROM_PTR(&mp_micropython_tier_info_obj) },
+    #endif
+    #if MICROPY_VM_PROFILE
+    { MP_ROM_QSTR(MP_QSTR_vm_profile), MP_ROM_PTR(&mp_micropython_vm_profile_obj) },
+    #endif
 #if MICROPY_PY_MICROPYTHON_MEM_INFO
 #if MICROPY_MEM_STATS
     { MP_ROM_QSTR(MP_QSTR_mem_total), MP_ROM_PTR(&mp_micropython_mem_total_obj) },
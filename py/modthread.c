@@ -29,6 +29,8 @@
 
 #include "py/runtime.h"
 #include "py/stackctrl.h"
+#include "py/pystack.h"
+#include "py/vmprofile.h"
 
 #if MICROPY_PY_THREAD
 
@@ -143,9 +145,15 @@ STATIC mp_obj_t mod_thread_stack_size(size_t n_args, const mp_obj_t *args) {
 STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_thread_stack_size_obj, 0, 1, mod_thread_stack_size);
 
 typedef struct _thread_entry_args_t {
+    // the state of the new thread; with the inline caches it is too big to go
+    // on the stack of the thread, so it is on the heap, kept alive by th_args
+    mp_state_thread_t *ts;
     mp_obj_dict_t *dict_locals;
     mp_obj_dict_t *dict_globals;
     size_t stack_size;
+    #if MICROPY_ENABLE_PYSTACK
+    uint8_t *pystack;
+    #endif
     mp_obj_t fun;
     size_t n_args;
     size_t n_kw;
@@ -157,12 +165,32 @@ STATIC void *thread_entry(void *args_in) {
 
     thread_entry_args_t *args = (thread_entry_args_t*)args_in;
 
-    mp_state_thread_t ts;
-    mp_thread_set_state(&ts);
+    mp_state_thread_t *ts = args->ts;
+    mp_thread_set_state(ts);
 
     mp_stack_set_top(&ts + 1); // need to include ts in root-pointer scan
     mp_stack_set_limit(args->stack_size);
 
+    #if MICROPY_ENABLE_PYSTACK
+    mp_pystack_init(args->pystack, args->pystack + MICROPY_PY_THREAD_PYSTACK_SIZE);
+    #endif
+
+    #if MICROPY_OPT_ATTR_INLINE_CACHE
+    memset(ts->attr_cache, 0, sizeof(ts->attr_cache));
+    #endif
+    #if MICROPY_OPT_LOAD_GLOBAL_CACHE
+    memset(ts->global_cache, 0, sizeof(ts->global_cache));
+    #endif
+    #if MICROPY_OPT_KW_CALL_CACHE
+    memset(ts->kw_cache, 0, sizeof(ts->kw_cache));
+    #endif
+    #if MICROPY_VM_PROFILE
+    mp_vm_profile_init_thread();
+    #endif
+    #if MICROPY_VM_SAMPLING
+    ts->current_code_state = NULL;
+    #endif
+
     // set locals and globals from the calling context
     mp_locals_set(args->dict_locals);
     mp_globals_set(args->dict_globals);
@@ -176,7 +204,7 @@ STATIC void *thread_entry(void *args_in) {
     //  mp_pending_exception? (root pointer)
     //  cur_exception (root pointer)
 
-    DEBUG_printf("[thread] start ts=%p args=%p stack=%p\n", &ts, &args, MP_STATE_THREAD(stack_top));
+    DEBUG_printf("[thread] start ts=%p args=%p stack=%p\n", ts, &args, MP_STATE_THREAD(stack_top));
 
     nlr_buf_t nlr;
     if (nlr_push(&nlr) == 0) {
@@ -197,7 +225,17 @@ STATIC void *thread_entry(void *args_in) {
         }
     }
 
-    DEBUG_printf("[thread] finish ts=%p\n", &ts);
+    DEBUG_printf("[thread] finish ts=%p\n", ts);
+
+    #if MICROPY_ENABLE_PYSTACK
+    // args stays reachable after the thread finishes, so drop its Python stack
+    m_del(uint8_t, args->pystack, MICROPY_PY_THREAD_PYSTACK_SIZE);
+    args->pystack = NULL;
+    #endif
+
+    // likewise let the state, and the objects its caches refer to, be freed;
+    // nothing uses the state from here on
+    args->ts = NULL;
 
     // signal that we are finished
     mp_thread_finish();
@@ -252,6 +290,13 @@ STATIC mp_obj_t mod_thread_start_new_thread(size_t n_args, const mp_obj_t *args)
     // set the stack size to use
     th_args->stack_size = thread_stack_size;
 
+    th_args->ts = m_new_obj(mp_state_thread_t);
+
+    #if MICROPY_ENABLE_PYSTACK
+    // the Python stack is on the heap, kept alive by th_args while the thread runs
+    th_args->pystack = m_new(uint8_t, MICROPY_PY_THREAD_PYSTACK_SIZE);
+    #endif
+
     // set the function for thread entry
     th_args->fun = args[0];
 
@@ -107,6 +107,12 @@
 #define MICROPY_ALLOC_GC_STACK_SIZE (64)
 #endif
 
+// Number of unreachable objects with finalisers that a collection can queue
+// to be finalised (minimum is 1); any others are kept for the next collection
+#ifndef MICROPY_ALLOC_GC_FINALISER_QUEUE_SIZE
+#define MICROPY_ALLOC_GC_FINALISER_QUEUE_SIZE (16)
+#endif
+
 // Be conservative and always clear to zero newly (re)allocated memory in the GC.
 // This helps eliminate stray pointers that hold on to memory that's no longer
 // used.  It decreases performance due to unnecessary memory clearing.
@@ -117,6 +123,54 @@
 #define MICROPY_GC_CONSERVATIVE_CLEAR (MICROPY_ENABLE_GC)
 #endif
 
+// Keep free heap blocks in size-segregated free lists built during the sweep,
+// so that gc_alloc does not need to scan the allocation table for free space.
+// Requires MICROPY_BYTES_PER_GC_BLOCK to be at least 4 words.
+#ifndef MICROPY_GC_FREE_LISTS
+#define MICROPY_GC_FREE_LISTS (0)
+#endif
+
+// Whether the GC keeps a table of "leaf" blocks, which hold no pointers to the
+// heap and so are not scanned when marked (see m_new_leaf); used for the data
+// of str, bytes, bytearray, array and vstr
+#ifndef MICROPY_GC_LEAF
+#define MICROPY_GC_LEAF (0)
+#endif
+
+// When the GC stack overflows, move it to a bigger area carved from free heap
+// blocks (freed again by the sweep), instead of rescanning the whole heap for
+// marked blocks; the rescan is still done if no free area is big enough
+#ifndef MICROPY_GC_STACK_SPILL
+#define MICROPY_GC_STACK_SPILL (0)
+#endif
+
+// Allow the heap to be made of several areas, each with its own tables; areas
+// after the first one are added with gc_add()
+#ifndef MICROPY_GC_SPLIT_HEAP
+#define MICROPY_GC_SPLIT_HEAP (0)
+#endif
+
+// Grow the heap when a collection doesn't free enough memory for an
+// allocation, by getting a new area from MP_PLAT_ALLOC_HEAP, and give areas
+// that become empty back with MP_PLAT_FREE_HEAP (requires MICROPY_GC_SPLIT_HEAP)
+#ifndef MICROPY_GC_SPLIT_HEAP_AUTO
+#define MICROPY_GC_SPLIT_HEAP_AUTO (0)
+#endif
+
+// Support an incremental collection mode (enabled at run time with
+// gc.incremental()), in which marking and sweeping are done in bounded slices
+// interleaved with allocation and with the VM loop, instead of all at once.
+// Requires the port to provide mp_hal_ticks_us, which is used to record pause
+// times.
+#ifndef MICROPY_GC_INCREMENTAL
+#define MICROPY_GC_INCREMENTAL (0)
+#endif
+
+// Default number of bytes of heap scanned by one incremental collection slice
+#ifndef MICROPY_GC_INCREMENTAL_BUDGET
+#define MICROPY_GC_INCREMENTAL_BUDGET (16384)
+#endif
+
 // Support automatic GC when reaching allocation threshold,
 // configurable by gc.threshold().
 #ifndef MICROPY_GC_ALLOC_THRESHOLD
@@ -131,6 +185,13 @@
 #define MICROPY_ALLOC_QSTR_CHUNK_INIT (128)
 #endif
 
+// Number of slots to allocate initially for the hash index of dynamically
+// interned strings (only used if MICROPY_QSTR_HASH_INDEX is enabled).
+// Must be a power of 2.
+#ifndef MICROPY_ALLOC_QSTR_INDEX_INIT
+#define MICROPY_ALLOC_QSTR_INDEX_INIT (64)
+#endif
+
 // Initial amount for lexer indentation level
 #ifndef MICROPY_ALLOC_LEXER_INDENT_INIT
 #define MICROPY_ALLOC_LEXER_INDENT_INIT (10)
@@ -211,6 +272,31 @@
 #define MICROPY_QSTR_BYTES_IN_HASH (2)
 #endif
 
+// Whether to look up qstrs using hash indices instead of scanning all pools.
+// The index for the static pool is generated at build time (costs 2 bytes of
+// ROM per slot) and the index for dynamically interned qstrs is kept on the
+// heap, so lookup does not depend on the number of interned strings.
+#ifndef MICROPY_QSTR_HASH_INDEX
+#define MICROPY_QSTR_HASH_INDEX (0)
+#endif
+
+// Whether to allocate the states of bytecode functions from a per-thread
+// Python stack (see py/pystack.h) instead of the C stack or the heap.  The
+// port must give each thread a stack with mp_pystack_init.
+#ifndef MICROPY_ENABLE_PYSTACK
+#define MICROPY_ENABLE_PYSTACK (0)
+#endif
+
+// Number of bytes that allocations from the Python stack are aligned to
+#ifndef MICROPY_PYSTACK_ALIGN
+#define MICROPY_PYSTACK_ALIGN (8)
+#endif
+
+// Size in bytes of the Python stack of each thread started by _thread
+#ifndef MICROPY_PY_THREAD_PYSTACK_SIZE
+#define MICROPY_PY_THREAD_PYSTACK_SIZE (4096)
+#endif
+
 // Avoid using C stack when making Python function calls. C stack still
 // may be used if there's no free heap.
 #ifndef MICROPY_STACKLESS
@@ -353,6 +439,14 @@
 #define MICROPY_COMP_TRIPLE_TUPLE_ASSIGN (0)
 #endif
 
+// Whether the bytecode emitter supports a peephole pass which threads jumps,
+// drops unreachable code and fuses common instruction pairs into
+// superinstructions.  If enabled the pass is on by default and can be
+// switched at runtime with micropython.opt_peephole().
+#ifndef MICROPY_COMP_BC_PEEPHOLE
+#define MICROPY_COMP_BC_PEEPHOLE (0)
+#endif
+
 /*****************************************************************************/
 /* Internal debugging stuff                                                  */
 
@@ -368,6 +462,49 @@
 #define MICROPY_DEBUG_PRINTERS (0)
 #endif
 
+// Whether to instrument the VM to count the opcodes it executes, the ticks
+// spent in each and the calls of each bytecode function, for
+// micropython.vm_profile().  Time is given to the opcode that was last
+// dispatched, so it includes any C code that the opcode calls.  Calls made
+// inline by the stackless VM are not counted per function.
+#ifndef MICROPY_VM_PROFILE
+#define MICROPY_VM_PROFILE (0)
+#endif
+
+// Whether the VM profile also counts pairs of consecutive opcodes (this uses
+// 256KiB of RAM)
+#ifndef MICROPY_VM_PROFILE_PAIRS
+#define MICROPY_VM_PROFILE_PAIRS (MICROPY_VM_PROFILE)
+#endif
+
+// Maximum number of bytecode functions whose calls the VM profile counts
+#ifndef MICROPY_VM_PROFILE_NUM_FUNS
+#define MICROPY_VM_PROFILE_NUM_FUNS (1024)
+#endif
+
+// Clock that the VM profile measures time with
+#ifndef MICROPY_VM_PROFILE_TICKS
+#define MICROPY_VM_PROFILE_TICKS() mp_hal_ticks_cpu()
+#endif
+
+// Whether the VM can sample the Python call stack for a statistical profile.
+// A port requests a sample by setting MP_STATE_VM(vm_sample_pending), eg from
+// a timer signal, and the VM takes it at its next pending-exception check.
+#ifndef MICROPY_VM_SAMPLING
+#define MICROPY_VM_SAMPLING (0)
+#endif
+
+// Size in words of the ring buffer that samples are recorded into before
+// they are aggregated; a sample of n frames takes 1 + 3 * n words
+#ifndef MICROPY_VM_SAMPLING_RING_SIZE
+#define MICROPY_VM_SAMPLING_RING_SIZE (4096)
+#endif
+
+// Maximum number of frames recorded per sample; outer frames are dropped
+#ifndef MICROPY_VM_SAMPLING_MAX_DEPTH
+#define MICROPY_VM_SAMPLING_MAX_DEPTH (64)
+#endif
+
 /*****************************************************************************/
 /* Optimisations                                                             */
 
@@ -384,6 +521,94 @@
 #define MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE (0)
 #endif
 
+// Whether to cache the result of class and type attribute lookups done by
+// LOAD_ATTR and LOAD_METHOD, per call site, keyed on the type of the object.
+// Entries are invalidated whenever a class is created or a class attribute is
+// stored or deleted.  Uses MICROPY_OPT_ATTR_INLINE_CACHE_SIZE entries (of 6
+// words) per thread, and saves walking the class hierarchy on a hit.
+#ifndef MICROPY_OPT_ATTR_INLINE_CACHE
+#define MICROPY_OPT_ATTR_INLINE_CACHE (0)
+#endif
+
+// Number of entries in the attribute inline cache; must be a power of 2
+#ifndef MICROPY_OPT_ATTR_INLINE_CACHE_SIZE
+#define MICROPY_OPT_ATTR_INLINE_CACHE_SIZE (64)
+#endif
+
+// Whether to cache the result of global and builtin name lookups done by
+// LOAD_GLOBAL and LOAD_NAME, per call site.  Each map carries a version that
+// changes when a key is added or removed, and an entry is valid while the
+// versions of the globals and the builtins override dict are unchanged.  Adds
+// a word to each map, and uses MICROPY_OPT_LOAD_GLOBAL_CACHE_SIZE entries (of
+// 5 words) per thread.
+#ifndef MICROPY_OPT_LOAD_GLOBAL_CACHE
+#define MICROPY_OPT_LOAD_GLOBAL_CACHE (0)
+#endif
+
+// Number of entries in the global name cache; must be a power of 2
+#ifndef MICROPY_OPT_LOAD_GLOBAL_CACHE_SIZE
+#define MICROPY_OPT_LOAD_GLOBAL_CACHE_SIZE (64)
+#endif
+
+// Whether to cache, per callee and sequence of keyword names, the argument
+// slot that each keyword arg of a call goes to.  Used when setting up the
+// state of a bytecode function and by mp_arg_parse_all for builtins, so that
+// repeated keyword calls don't search the argument names.  Uses
+// MICROPY_OPT_KW_CALL_CACHE_SIZE entries per thread.
+#ifndef MICROPY_OPT_KW_CALL_CACHE
+#define MICROPY_OPT_KW_CALL_CACHE (0)
+#endif
+
+// Number of entries in the keyword call cache; must be a power of 2
+#ifndef MICROPY_OPT_KW_CALL_CACHE_SIZE
+#define MICROPY_OPT_KW_CALL_CACHE_SIZE (32)
+#endif
+
+// Maximum number of keyword args of a call that can be cached
+#ifndef MICROPY_OPT_KW_CALL_CACHE_MAX_KW
+#define MICROPY_OPT_KW_CALL_CACHE_MAX_KW (4)
+#endif
+
+// Whether calls with *args or **kwargs avoid allocating the combined arg
+// array: a tuple forwarded as the only args, as in f(*args), passes its items
+// as they are, and arrays of up to MICROPY_OPT_CALL_VAR_STACK_ARGS entries are
+// built on the C stack.
+#ifndef MICROPY_OPT_CALL_VAR_FORWARD
+#define MICROPY_OPT_CALL_VAR_FORWARD (0)
+#endif
+
+// Number of entries (self, positional args, and 2 per keyword arg) of the arg
+// array of a *args/**kwargs call that is built on the C stack
+#ifndef MICROPY_OPT_CALL_VAR_STACK_ARGS
+#define MICROPY_OPT_CALL_VAR_STACK_ARGS (8)
+#endif
+
+// Whether the VM rewrites BINARY_OP, LOAD_SUBSCR and STORE_SUBSCR opcodes in
+// bytecode that is in the heap into forms specialised for the types of the
+// operands they see (small ints, floats, strs, lists and dicts).  Frozen
+// bytecode is left alone.  Requires MICROPY_OPT_COMPUTED_GOTO and
+// MICROPY_ENABLE_GC.
+#ifndef MICROPY_OPT_QUICKEN
+#define MICROPY_OPT_QUICKEN (0)
+#endif
+
+// Whether a call to a bytecode function that the compiler marked as taking
+// only positional args (MP_SCOPE_FLAG_SIMPLE_ARGS), with exactly that many
+// positional args, copies them straight into the new state instead of going
+// through the generic argument parsing of mp_setup_code_state.
+#ifndef MICROPY_OPT_SIMPLE_ARGS_CALL
+#define MICROPY_OPT_SIMPLE_ARGS_CALL (0)
+#endif
+
+// Whether bytecode functions count their calls and backward jumps, and once
+// the count reaches micropython.opt_tier() (0, the default, disables it) are
+// translated to native code, which is then run by later calls.  Functions the
+// native emitter can't run the same as the VM stay as bytecode.  Requires a
+// native emitter.
+#ifndef MICROPY_TIERING
+#define MICROPY_TIERING (0)
+#endif
+
 // Whether to use fast versions of bitwise operations (and, or, xor) when the
 // arguments are both positive.  Increases Thumb2 code size by about 250 bytes.
 #ifndef MICROPY_OPT_MPZ_BITWISE
@@ -548,6 +773,11 @@ typedef double mp_float_t;
 #define MICROPY_PY_BUILTINS_COMPLEX (MICROPY_PY_BUILTINS_FLOAT)
 #endif
 
+// Convenience definition for whether the viper emitter supports the float,
+// ptrf and ptrd types; a float is held unboxed as the bit pattern of a double
+// in a machine word and the arithmetic uses SSE2, so this is x64 only
+#define MICROPY_EMIT_NATIVE_FLOAT (MICROPY_EMIT_X64 && MICROPY_FLOAT_IMPL == MICROPY_FLOAT_IMPL_DOUBLE)
+
 // Enable features which improve CPython compatibility
 // but may lead to more code size/memory usage.
 // TODO: Originally intended as generic category to not
@@ -993,10 +1223,27 @@ typedef double mp_float_t;
 #define MICROPY_PY_UJSON (0)
 #endif
 
+// Size of the buffer used by ujson to read from streams (on the C stack for
+// load(), on the heap for iterload())
+#ifndef MICROPY_PY_UJSON_READ_BUF_SIZE
+#define MICROPY_PY_UJSON_READ_BUF_SIZE (64)
+#endif
+
 #ifndef MICROPY_PY_URE
 #define MICROPY_PY_URE (0)
 #endif
 
+// Whether ure includes the Pike VM engine, which runs in time linear in the
+// subject length; it is then used for patterns with repetition/alternation
+#ifndef MICROPY_PY_URE_PIKEVM
+#define MICROPY_PY_URE_PIKEVM (0)
+#endif
+
+// Number of compiled patterns cached by ure.compile/match/search (0 to disable)
+#ifndef MICROPY_PY_URE_CACHE_SIZE
+#define MICROPY_PY_URE_CACHE_SIZE (0)
+#endif
+
 #ifndef MICROPY_PY_UHEAPQ
 #define MICROPY_PY_UHEAPQ (0)
 #endif
@@ -1174,6 +1421,18 @@ typedef double mp_float_t;
 #define MP_PLAT_FREE_EXEC(ptr, size) m_del(byte, ptr, size)
 #endif
 
+// Used by MICROPY_GC_SPLIT_HEAP_AUTO to get memory for a new heap area, and to
+// return it.  The memory must be aligned to a GC block, and size is always a
+// multiple of the block size.  MP_PLAT_ALLOC_HEAP returns NULL if the port has
+// no memory to give.
+#ifndef MP_PLAT_ALLOC_HEAP
+#define MP_PLAT_ALLOC_HEAP(size) (NULL)
+#endif
+
+#ifndef MP_PLAT_FREE_HEAP
+#define MP_PLAT_FREE_HEAP(ptr, size) (void)0
+#endif
+
 // This macro is used to do all output (except when MICROPY_PY_IO is defined)
 #ifndef MP_PLAT_PRINT_STRN
 #define MP_PLAT_PRINT_STRN(str, len) mp_hal_stdout_tx_strn_cooked(str, len)
@@ -46,6 +46,9 @@ typedef struct mp_dynamic_compiler_t {
     uint8_t small_int_bits; // must be <= host small_int_bits
     bool opt_cache_map_lookup_in_bytecode;
     bool py_builtins_str_unicode;
+    uint8_t native_arch; // MP_NATIVE_ARCH_NONE if native code can't be emitted
+    uint8_t native_code_state_words; // size of mp_code_state_t on the target
+    uint8_t native_nlr_buf_words; // size of nlr_buf_t on the target
 } mp_dynamic_compiler_t;
 extern mp_dynamic_compiler_t mp_dynamic_compiler;
 #endif
@@ -60,12 +63,74 @@ typedef struct _mp_sched_item_t {
     mp_obj_t arg;
 } mp_sched_item_t;
 
-// This structure hold information about the memory allocation system.
-typedef struct _mp_state_mem_t {
-    #if MICROPY_MEM_STATS
-    size_t total_bytes_allocated;
-    size_t current_bytes_allocated;
-    size_t peak_bytes_allocated;
+#if MICROPY_OPT_ATTR_INLINE_CACHE
+// An entry of the attribute inline cache: the result of loading attr from an
+// object of the given type (or from the given class, if is_type).  self is
+// MP_OBJ_SENTINEL when the object itself is bound to value.
+typedef struct _mp_attr_cache_entry_t {
+    const void *key;
+    size_t epoch;
+    qstr attr;
+    mp_obj_t value;
+    mp_obj_t self;
+    bool is_type;
+} mp_attr_cache_entry_t;
+#endif
+
+#if MICROPY_OPT_LOAD_GLOBAL_CACHE
+// An entry of the global name cache: the slot that the name qst loaded at
+// site was found in, when the globals map and the builtins override dict had
+// the given versions.  The name is checked too, because bytecode can be freed
+// and new bytecode that loads another name allocated at the same site.
+typedef struct _mp_global_cache_entry_t {
+    const byte *site;
+    qstr qst;
+    const mp_map_t *globals;
+    size_t version;
+    size_t builtins_version;
+    mp_map_elem_t *elem;
+} mp_global_cache_entry_t;
+#endif
+
+#if MICROPY_VM_PROFILE
+// The counts of the VM profile for an opcode and for a bytecode function.
+typedef struct _mp_vm_profile_op_t {
+    uint64_t count;
+    uint64_t ticks;
+} mp_vm_profile_op_t;
+
+typedef struct _mp_vm_profile_fun_t {
+    const byte *bytecode;
+    mp_uint_t depth; // number of active calls
+    mp_uint_t start; // when the outermost active call started
+    uint64_t calls;
+    uint64_t ticks; // total time, not counting recursive calls twice
+} mp_vm_profile_fun_t;
+#endif
+
+#if MICROPY_OPT_KW_CALL_CACHE
+// An entry of the keyword call cache: the slot of callee (a bytecode function
+// or an mp_arg_t table) that each of the keyword names of a call with n_args
+// positional args went to, or 0xff if it matched no slot.
+typedef struct _mp_kw_cache_entry_t {
+    const void *callee;
+    mp_obj_t names[MICROPY_OPT_KW_CALL_CACHE_MAX_KW];
+    uint8_t n_args;
+    uint8_t n_kw;
+    uint8_t slots[MICROPY_OPT_KW_CALL_CACHE_MAX_KW];
+} mp_kw_cache_entry_t;
+#endif
+
+// Number of size-segregated free lists used by the GC
+#define MP_GC_NUM_FREE_LISTS (32)
+
+// Number of buckets in the histogram of GC pause times
+#define MP_GC_NUM_PAUSE_BUCKETS (12)
+
+// This structure holds the tables and pool of one area of the GC heap.
+typedef struct _mp_state_mem_area_t {
+    #if MICROPY_GC_SPLIT_HEAP
+    struct _mp_state_mem_area_t *next;
     #endif
 
     byte *gc_alloc_table_start;
@@ -73,12 +138,45 @@ typedef struct _mp_state_mem_t {
     #if MICROPY_ENABLE_FINALISER
     byte *gc_finaliser_table_start;
     #endif
+    #if MICROPY_GC_LEAF
+    byte *gc_leaf_table_start;
+    #endif
+    #if MICROPY_GC_INCREMENTAL
+    byte *gc_dirty_table_start;
+    #endif
     byte *gc_pool_start;
     byte *gc_pool_end;
 
+    size_t gc_last_free_atb_index;
+
+    #if MICROPY_GC_FREE_LISTS
+    struct _gc_free_run_t *gc_free_list[MP_GC_NUM_FREE_LISTS];
+    uint32_t gc_free_list_bitmap;
+    #endif
+} mp_state_mem_area_t;
+
+// This structure hold information about the memory allocation system.
+typedef struct _mp_state_mem_t {
+    #if MICROPY_MEM_STATS
+    size_t total_bytes_allocated;
+    size_t current_bytes_allocated;
+    size_t peak_bytes_allocated;
+    #endif
+
+    // the first area of the heap, which further areas are linked to
+    mp_state_mem_area_t area;
+
     int gc_stack_overflow;
-    size_t gc_stack[MICROPY_ALLOC_GC_STACK_SIZE];
-    size_t *gc_sp;
+    void *gc_stack[MICROPY_ALLOC_GC_STACK_SIZE];
+    void **gc_sp;
+    #if MICROPY_GC_STACK_SPILL
+    // the stack in use, which is gc_stack or an area of free heap
+    void **gc_stack_base;
+    void **gc_stack_limit;
+    #endif
+    // number of times the stack filled up, and of full-heap rescans done
+    size_t gc_stack_overflow_count;
+    size_t gc_stack_rescan_count;
     uint16_t gc_lock_depth;
 
     // This variable controls auto garbage collection.  If set to 0 then the
@@ -91,12 +189,40 @@ typedef struct _mp_state_mem_t {
     size_t gc_alloc_threshold;
     #endif
 
-    size_t gc_last_free_atb_index;
+    #if MICROPY_ENABLE_FINALISER
+    uint16_t gc_finaliser_queue_len;
+    bool gc_finaliser_queue_overflow;
+    bool gc_finalisers_running;
+    #endif
 
     #if MICROPY_PY_GC_COLLECT_RETVAL
     size_t gc_collected;
     #endif
 
+    #if MICROPY_GC_INCREMENTAL
+    uint8_t gc_incr_phase;
+    bool gc_incr_enabled;
+    bool gc_incr_lazy_sweep;
+    uint16_t gc_incr_poll_count;
+    size_t gc_incr_budget;
+    size_t gc_incr_alloc;       // blocks allocated since the last slice
+    size_t gc_incr_allocated;   // blocks allocated since the last cycle
+    size_t gc_incr_trigger;     // start a cycle after this many blocks
+    size_t gc_incr_live;        // blocks found live by the current sweep
+    size_t gc_incr_root;        // next root pointer to push
+    // positions of the overflow rescan, the dirty block pre-clean and the
+    // lazy sweep; the area is NULL when there is none or it is done
+    mp_state_mem_area_t *gc_incr_rescan_area;
+    size_t gc_incr_rescan;
+    mp_state_mem_area_t *gc_incr_clean_area;
+    size_t gc_incr_clean;
+    mp_state_mem_area_t *gc_incr_sweep_area;
+    size_t gc_incr_sweep;
+    mp_uint_t gc_pause_start;
+    mp_uint_t gc_pause_max;
+    size_t gc_pause_hist[MP_GC_NUM_PAUSE_BUCKETS];
+    #endif
+
     #if MICROPY_PY_THREAD
     // This is a global mutex used to make the GC thread-safe.
     mp_thread_mutex_t gc_mutex;
@@ -114,6 +240,11 @@ typedef struct _mp_state_vm_t {
 
     qstr_pool_t *last_pool;
 
+    #if MICROPY_QSTR_HASH_INDEX
+    // hash index over the qstrs in the dynamically allocated pools
+    qstr *qstr_index;
+    #endif
+
     // non-heap memory for creating an exception if we can't allocate RAM
     mp_obj_exception_t mp_emergency_exception_obj;
 
@@ -176,11 +307,33 @@ typedef struct _mp_state_vm_t {
     mp_obj_t lwip_slip_stream;
     #endif
 
+    #if MICROPY_PY_URE && MICROPY_PY_URE_CACHE_SIZE
+    // (pattern, compiled regex) pairs, most recently used first
+    mp_obj_t ure_cache[MICROPY_PY_URE_CACHE_SIZE][2];
+    #endif
+
+    #if MICROPY_ENABLE_FINALISER
+    // unreachable objects whose finalisers are still to be called
+    mp_obj_t gc_finaliser_queue[MICROPY_ALLOC_GC_FINALISER_QUEUE_SIZE];
+    #endif
+
     #if MICROPY_VFS
     struct _mp_vfs_mount_t *vfs_cur;
     struct _mp_vfs_mount_t *vfs_mount_table;
     #endif
 
+    #if MICROPY_VM_PROFILE
+    // functions are keyed by their bytecode, which must be kept alive so it
+    // isn't reused by another function
+    mp_vm_profile_fun_t vm_profile_funs[MICROPY_VM_PROFILE_NUM_FUNS];
+    #endif
+
+    #if MICROPY_VM_SAMPLING
+    // dict of the sampled stacks, mapping each to its count, or MP_OBJ_NULL
+    // if sampling hasn't been started
+    mp_obj_t vm_sample_stacks;
+    #endif
+
     //
     // END ROOT POINTER SECTION
     ////////////////////////////////////////////////////////////
@@ -191,6 +344,12 @@ typedef struct _mp_state_vm_t {
     size_t qstr_last_alloc;
     size_t qstr_last_used;
 
+    #if MICROPY_QSTR_HASH_INDEX
+    // number of slots in, and number of qstrs stored in, qstr_index
+    size_t qstr_index_alloc;
+    size_t qstr_index_used;
+    #endif
+
     #if MICROPY_PY_THREAD
     // This is a global mutex used to make qstr interning thread-safe.
     mp_thread_mutex_t qstr_mutex;
@@ -198,6 +357,31 @@ typedef struct _mp_state_vm_t {
 
     mp_uint_t mp_optimise_value;
 
+    #if MICROPY_COMP_BC_PEEPHOLE
+    // whether the bytecode emitter runs its peephole pass
+    bool mp_bc_peephole;
+    #endif
+
+    #if MICROPY_TIERING
+    // count at which a bytecode function is promoted to native code (0 for
+    // never), and the number of functions that were and weren't promoted
+    mp_uint_t tier_threshold;
+    mp_uint_t tier_promoted;
+    mp_uint_t tier_rejected;
+    #endif
+
+    #if MICROPY_OPT_ATTR_INLINE_CACHE
+    // incremented when a class is created or a class attribute changes, to
+    // invalidate the attribute inline caches
+    size_t attr_cache_epoch;
+    #endif
+
+    #if MICROPY_OPT_LOAD_GLOBAL_CACHE
+    // source of the versions of maps; a new version is taken from here each
+    // time a map changes so that no two maps share a version
+    size_t map_version;
+    #endif
+
     // size of the emergency exception buf, if it's dynamically allocated
     #if MICROPY_ENABLE_EMERGENCY_EXCEPTION_BUF && MICROPY_EMERGENCY_EXCEPTION_BUF_SIZE == 0
     mp_int_t mp_emergency_exception_buf_size;
@@ -207,6 +391,29 @@ typedef struct _mp_state_vm_t {
     // This is a global mutex used to make the VM/runtime thread-safe.
     mp_thread_mutex_t gil_mutex;
     #endif
+
+    #if MICROPY_VM_PROFILE
+    mp_vm_profile_op_t vm_profile_ops[256];
+    #if MICROPY_VM_PROFILE_PAIRS
+    uint32_t vm_profile_pairs[256][256];
+    #endif
+    #endif
+
+    #if MICROPY_VM_SAMPLING
+    // set, eg by a signal handler, to have the VM take a sample; the first
+    // thread to see it takes the sample, of its own stack
+    volatile bool vm_sample_pending;
+    // samples waiting to be aggregated, in words written from head and read
+    // from tail, which only ever increase
+    size_t vm_sample_head;
+    size_t vm_sample_tail;
+    size_t vm_sample_dropped;
+    uint32_t vm_sample_ring[MICROPY_VM_SAMPLING_RING_SIZE];
+    #if MICROPY_PY_THREAD
+    // guards the ring and the dict of stacks, which all threads add to
+    mp_thread_mutex_t vm_sample_mutex;
+    #endif
+    #endif
 } mp_state_vm_t;
 
 // This structure holds state that is specific to a given thread.
@@ -224,6 +431,35 @@ typedef struct _mp_state_thread_t {
     #if MICROPY_STACK_CHECK
     size_t stack_limit;
     #endif
+
+    #if MICROPY_ENABLE_PYSTACK
+    uint8_t *pystack_start;
+    uint8_t *pystack_end;
+    uint8_t *pystack_cur;
+    #endif
+
+    #if MICROPY_OPT_ATTR_INLINE_CACHE
+    mp_attr_cache_entry_t attr_cache[MICROPY_OPT_ATTR_INLINE_CACHE_SIZE];
+    #endif
+
+    #if MICROPY_OPT_LOAD_GLOBAL_CACHE
+    mp_global_cache_entry_t global_cache[MICROPY_OPT_LOAD_GLOBAL_CACHE_SIZE];
+    #endif
+
+    #if MICROPY_OPT_KW_CALL_CACHE
+    mp_kw_cache_entry_t kw_cache[MICROPY_OPT_KW_CALL_CACHE_SIZE];
+    #endif
+
+    #if MICROPY_VM_PROFILE
+    // the opcode this thread last dispatched, or MP_VM_PROFILE_NO_OP, and when
+    mp_uint_t vm_profile_last_op;
+    mp_uint_t vm_profile_last_ticks;
+    #endif
+
+    #if MICROPY_VM_SAMPLING
+    // the innermost code state being run by the VM, linked to the outer ones
+    struct _mp_code_state_t *current_code_state;
+    #endif
 } mp_state_thread_t;
 
 // This structure combines the above 3 structures.
@@ -32,6 +32,7 @@ void nlr_setjmp_jump(void *val) {
     nlr_buf_t *buf = MP_STATE_THREAD(nlr_top);
     MP_STATE_THREAD(nlr_top) = buf->prev;
     buf->ret_val = val;
+    MP_NLR_RESTORE_PYSTACK(buf);
     longjmp(buf->jmpbuf, 1);
 }
 
@@ -359,6 +359,9 @@ typedef struct _mp_map_t {
     size_t used : (8 * sizeof(size_t) - 3);
     size_t alloc;
     mp_map_elem_t *table;
+    #if MICROPY_OPT_LOAD_GLOBAL_CACHE
+    size_t version; // changes when a key is added or removed, or table moves
+    #endif
 } mp_map_t;
 
 // mp_set_lookup requires these constants to have the values they do
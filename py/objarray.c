@@ -35,6 +35,7 @@
 #include "py/binary.h"
 #include "py/objstr.h"
 #include "py/objarray.h"
+#include "py/gc.h"
 
 #if MICROPY_PY_ARRAY || MICROPY_PY_BUILTINS_BYTEARRAY || MICROPY_PY_BUILTINS_MEMORYVIEW
 
@@ -59,6 +60,21 @@
 #define TYPECODE_MASK (~(size_t)0)
 #endif
 
+// Items of these typecodes may point to the heap; items of all other typecodes
+// are a leaf allocation, which the GC does not scan.
+#define TYPECODE_MAY_HOLD_POINTERS(typecode) ((typecode) == 'O' || (typecode) == 'P' || (typecode) == 'S')
+
+#if MICROPY_PY_BUILTINS_BYTEARRAY || MICROPY_PY_ARRAY || MICROPY_PY_ARRAY_SLICE_ASSIGN
+// Resize the items of the array, keeping them a leaf allocation if they
+// started out empty.
+STATIC byte *array_renew_items(mp_obj_array_t *o, size_t old_num_bytes, size_t new_num_bytes) {
+    if (o->items == NULL && !TYPECODE_MAY_HOLD_POINTERS(o->typecode)) {
+        return m_new_leaf(byte, new_num_bytes);
+    }
+    return m_renew(byte, o->items, old_num_bytes, new_num_bytes);
+}
+#endif
+
 STATIC mp_obj_t array_iterator_new(mp_obj_t array_in, mp_obj_iter_buf_t *iter_buf);
 STATIC mp_obj_t array_append(mp_obj_t self_in, mp_obj_t arg);
 STATIC mp_obj_t array_extend(mp_obj_t self_in, mp_obj_t arg_in);
@@ -105,7 +121,11 @@ STATIC mp_obj_array_t *array_new(char typecode, size_t n) {
     o->typecode = typecode;
     o->free = 0;
     o->len = n;
-    o->items = m_new(byte, typecode_size * o->len);
+    if (TYPECODE_MAY_HOLD_POINTERS(typecode)) {
+        o->items = m_new(byte, typecode_size * o->len);
+    } else {
+        o->items = m_new_leaf(byte, typecode_size * o->len);
+    }
     return o;
 }
 #endif
@@ -320,10 +340,13 @@ STATIC mp_obj_t array_append(mp_obj_t self_in, mp_obj_t arg) {
         size_t item_sz = mp_binary_get_size('@', self->typecode, NULL);
         // TODO: alloc policy
         self->free = 8;
-        self->items = m_renew(byte, self->items, item_sz * self->len, item_sz * (self->len + self->free));
+        self->items = array_renew_items(self, item_sz * self->len, item_sz * (self->len + self->free));
         mp_seq_clear(self->items, self->len + 1, self->len + self->free, item_sz);
     }
     mp_binary_set_val_array(self->typecode, self->items, self->len, arg);
+    if (TYPECODE_MAY_HOLD_POINTERS(self->typecode)) {
+        gc_write_barrier(self->items);
+    }
     // only update length/free if set succeeded
     self->len++;
     self->free--;
@@ -349,7 +372,7 @@ STATIC mp_obj_t array_extend(mp_obj_t self_in, mp_obj_t arg_in) {
     // make sure we have enough room to extend
     // TODO: alloc policy; at the moment we go conservative
     if (self->free < len) {
-        self->items = m_renew(byte, self->items, (self->len + self->free) * sz, (self->len + len) * sz);
+        self->items = array_renew_items(self, (self->len + self->free) * sz, (self->len + len) * sz);
         self->free = 0;
     } else {
         self->free -= len;
@@ -430,7 +453,7 @@ STATIC mp_obj_t array_subscr(mp_obj_t self_in, mp_obj_t index_in, mp_obj_t value
                 if (len_adj > 0) {
                     if (len_adj > o->free) {
                         // TODO: alloc policy; at the moment we go conservative
-                        o->items = m_renew(byte, o->items, (o->len + o->free) * item_sz, (o->len + len_adj) * item_sz);
+                        o->items = array_renew_items(o, (o->len + o->free) * item_sz, (o->len + len_adj) * item_sz);
                         o->free = 0;
                         dest_items = o->items;
                     }
@@ -486,6 +509,9 @@ STATIC mp_obj_t array_subscr(mp_obj_t self_in, mp_obj_t index_in, mp_obj_t value
             } else {
                 // store
                 mp_binary_set_val_array(o->typecode & TYPECODE_MASK, o->items, index, value);
+                if (TYPECODE_MAY_HOLD_POINTERS(o->typecode & TYPECODE_MASK)) {
+                    gc_write_barrier(o->items);
+                }
                 return mp_const_none;
             }
         }
@@ -350,6 +350,9 @@ STATIC mp_obj_t dict_popitem(mp_obj_t self_in) {
     mp_obj_t items[] = {next->key, next->value};
     next->key = MP_OBJ_SENTINEL; // must mark key as sentinel to indicate that it was deleted
     next->value = MP_OBJ_NULL;
+    #if MICROPY_OPT_LOAD_GLOBAL_CACHE
+    self->map.version = ++MP_STATE_VM(map_version);
+    #endif
     mp_obj_t tuple = mp_obj_new_tuple(2, items);
 
     return tuple;
@@ -35,6 +35,9 @@
 #include "py/runtime.h"
 #include "py/bc.h"
 #include "py/stackctrl.h"
+#include "py/pystack.h"
+#include "py/vmprofile.h"
+#include "py/tier.h"
 
 #if 0 // print debugging info
 #define DEBUG_PRINT (1)
@@ -149,10 +152,6 @@ qstr mp_obj_code_get_name(const byte *code_info) {
     #endif
 }
 
-#if MICROPY_EMIT_NATIVE
-STATIC const mp_obj_type_t mp_type_fun_native;
-#endif
-
 qstr mp_obj_fun_get_name(mp_const_obj_t fun_in) {
     const mp_obj_fun_bc_t *fun = MP_OBJ_TO_PTR(fun_in);
     #if MICROPY_EMIT_NATIVE
@@ -215,14 +214,26 @@ mp_code_state_t *mp_obj_fun_bc_prepare_codestate(mp_obj_t self_in, size_t n_args
     // allocate state for locals and stack
     size_t state_size = n_state * sizeof(mp_obj_t) + n_exc_stack * sizeof(mp_exc_stack_t);
     mp_code_state_t *code_state;
+    #if MICROPY_ENABLE_PYSTACK
+    code_state = mp_pystack_alloc(sizeof(mp_code_state_t) + state_size);
+    #else
     code_state = m_new_obj_var_maybe(mp_code_state_t, byte, state_size);
     if (!code_state) {
         return NULL;
     }
+    #endif
 
     code_state->fun_bc = self;
-    code_state->ip = 0;
-    mp_setup_code_state(code_state, n_args, n_kw, args);
+    #if MICROPY_OPT_SIMPLE_ARGS_CALL
+    // ip points to scope_flags, followed by n_pos_args
+    if (n_kw == 0 && (ip[0] & MP_SCOPE_FLAG_SIMPLE_ARGS) != 0 && n_args == ip[1]) {
+        mp_setup_code_state_simple(code_state, n_args, args);
+    } else
+    #endif
+    {
+        code_state->ip = 0;
+        mp_setup_code_state(code_state, n_args, n_kw, args);
+    }
 
     // execute the byte code with the correct globals context
     code_state->old_globals = mp_globals_get();
@@ -232,6 +243,10 @@ mp_code_state_t *mp_obj_fun_bc_prepare_codestate(mp_obj_t self_in, size_t n_args
 }
 #endif
 
+#if MICROPY_TIERING
+STATIC mp_obj_t fun_native_call(mp_obj_t self_in, size_t n_args, size_t n_kw, const mp_obj_t *args);
+#endif
+
 STATIC mp_obj_t fun_bc_call(mp_obj_t self_in, size_t n_args, size_t n_kw, const mp_obj_t *args) {
     MP_STACK_CHECK();
 
@@ -243,6 +258,12 @@ STATIC mp_obj_t fun_bc_call(mp_obj_t self_in, size_t n_args, size_t n_kw, const
     mp_obj_fun_bc_t *self = MP_OBJ_TO_PTR(self_in);
     DEBUG_printf("Func n_def_args: %d\n", self->n_def_args);
 
+    #if MICROPY_TIERING
+    if (mp_tier_count_call(self)) {
+        return fun_native_call(self->tier_native, n_args, n_kw, args);
+    }
+    #endif
+
     // get start of bytecode
     const byte *ip = self->bytecode;
 
@@ -256,6 +277,9 @@ STATIC mp_obj_t fun_bc_call(mp_obj_t self_in, size_t n_args, size_t n_kw, const
 
     // allocate state for locals and stack
     size_t state_size = n_state * sizeof(mp_obj_t) + n_exc_stack * sizeof(mp_exc_stack_t);
+    #if MICROPY_ENABLE_PYSTACK
+    mp_code_state_t *code_state = mp_pystack_alloc(sizeof(mp_code_state_t) + state_size);
+    #else
     mp_code_state_t *code_state = NULL;
     if (state_size > VM_MAX_STATE_ON_STACK) {
         code_state = m_new_obj_var_maybe(mp_code_state_t, byte, state_size);
@@ -264,15 +288,30 @@ STATIC mp_obj_t fun_bc_call(mp_obj_t self_in, size_t n_args, size_t n_kw, const
         code_state = alloca(sizeof(mp_code_state_t) + state_size);
         state_size = 0; // indicate that we allocated using alloca
     }
+    #endif
 
     code_state->fun_bc = self;
-    code_state->ip = 0;
-    mp_setup_code_state(code_state, n_args, n_kw, args);
+    #if MICROPY_OPT_SIMPLE_ARGS_CALL
+    // ip points to scope_flags, followed by n_pos_args
+    if (n_kw == 0 && (ip[0] & MP_SCOPE_FLAG_SIMPLE_ARGS) != 0 && n_args == ip[1]) {
+        mp_setup_code_state_simple(code_state, n_args, args);
+    } else
+    #endif
+    {
+        code_state->ip = 0;
+        mp_setup_code_state(code_state, n_args, n_kw, args);
+    }
 
     // execute the byte code with the correct globals context
     code_state->old_globals = mp_globals_get();
     mp_globals_set(self->globals);
+    #if MICROPY_VM_PROFILE
+    mp_vm_profile_fun_t *prof = mp_vm_profile_fun_enter(self->bytecode);
+    #endif
     mp_vm_return_kind_t vm_return_kind = mp_execute_bytecode(code_state, MP_OBJ_NULL);
+    #if MICROPY_VM_PROFILE
+    mp_vm_profile_fun_exit(prof);
+    #endif
     mp_globals_set(code_state->old_globals);
 
 #if VM_DETECT_STACK_OVERFLOW
@@ -312,10 +351,14 @@ STATIC mp_obj_t fun_bc_call(mp_obj_t self_in, size_t n_args, size_t n_kw, const
         result = code_state->state[n_state - 1];
     }
 
+    #if MICROPY_ENABLE_PYSTACK
+    mp_pystack_free(code_state);
+    #else
     // free the state if it was allocated on the heap
     if (state_size != 0) {
         m_del_var(mp_code_state_t, byte, state_size, code_state);
     }
+    #endif
 
     if (vm_return_kind == MP_VM_RETURN_NORMAL) {
         return result;
@@ -366,6 +409,10 @@ mp_obj_t mp_obj_new_fun_bc(mp_obj_t def_args_in, mp_obj_t def_kw_args, const byt
     o->globals = mp_globals_get();
     o->bytecode = code;
     o->const_table = const_table;
+    #if MICROPY_TIERING
+    o->tier_count = 0;
+    o->tier_native = MP_OBJ_NULL;
+    #endif
     if (def_args != NULL) {
         memcpy(o->extra_args, def_args->items, n_def_args * sizeof(mp_obj_t));
     }
@@ -380,14 +427,34 @@ mp_obj_t mp_obj_new_fun_bc(mp_obj_t def_args_in, mp_obj_t def_kw_args, const byt
 
 #if MICROPY_EMIT_NATIVE
 
+// Native and viper code doesn't switch to the globals of its function, so
+// that's done here if needed, eg when the function was imported from a module.
+STATIC mp_obj_t fun_call_with_globals(mp_obj_dict_t *globals, mp_call_fun_t fun, mp_obj_t self_in, size_t n_args, size_t n_kw, const mp_obj_t *args) {
+    mp_obj_dict_t *old_globals = mp_globals_get();
+    if (old_globals == globals) {
+        return fun(self_in, n_args, n_kw, args);
+    }
+    mp_globals_set(globals);
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        mp_obj_t ret = fun(self_in, n_args, n_kw, args);
+        nlr_pop();
+        mp_globals_set(old_globals);
+        return ret;
+    } else {
+        mp_globals_set(old_globals);
+        nlr_jump(nlr.ret_val);
+    }
+}
+
 STATIC mp_obj_t fun_native_call(mp_obj_t self_in, size_t n_args, size_t n_kw, const mp_obj_t *args) {
     MP_STACK_CHECK();
     mp_obj_fun_bc_t *self = self_in;
     mp_call_fun_t fun = MICROPY_MAKE_POINTER_CALLABLE((void*)self->bytecode);
-    return fun(self_in, n_args, n_kw, args);
+    return fun_call_with_globals(self->globals, fun, self_in, n_args, n_kw, args);
 }
 
-STATIC const mp_obj_type_t mp_type_fun_native = {
+const mp_obj_type_t mp_type_fun_native = {
     { &mp_type_type },
     .name = MP_QSTR_function,
     .call = fun_native_call,
@@ -412,6 +479,7 @@ typedef struct _mp_obj_fun_viper_t {
     size_t n_args;
     void *fun_data; // GC must be able to trace this pointer
     mp_uint_t type_sig;
+    mp_obj_dict_t *globals;
 } mp_obj_fun_viper_t;
 
 typedef mp_uint_t (*viper_fun_0_t)(void);
@@ -420,11 +488,9 @@ typedef mp_uint_t (*viper_fun_2_t)(mp_uint_t, mp_uint_t);
 typedef mp_uint_t (*viper_fun_3_t)(mp_uint_t, mp_uint_t, mp_uint_t);
 typedef mp_uint_t (*viper_fun_4_t)(mp_uint_t, mp_uint_t, mp_uint_t, mp_uint_t);
 
-STATIC mp_obj_t fun_viper_call(mp_obj_t self_in, size_t n_args, size_t n_kw, const mp_obj_t *args) {
+STATIC mp_obj_t fun_viper_call_body(mp_obj_t self_in, size_t n_args, size_t n_kw, const mp_obj_t *args) {
+    (void)n_kw;
     mp_obj_fun_viper_t *self = self_in;
-
-    mp_arg_check_num(n_args, n_kw, self->n_args, self->n_args, false);
-
     void *fun = MICROPY_MAKE_POINTER_CALLABLE(self->fun_data);
 
     mp_uint_t ret;
@@ -450,6 +516,14 @@ STATIC mp_obj_t fun_viper_call(mp_obj_t self_in, size_t n_args, size_t n_kw, con
     return mp_convert_native_to_obj(ret, self->type_sig);
 }
 
+STATIC mp_obj_t fun_viper_call(mp_obj_t self_in, size_t n_args, size_t n_kw, const mp_obj_t *args) {
+    mp_obj_fun_viper_t *self = self_in;
+
+    mp_arg_check_num(n_args, n_kw, self->n_args, self->n_args, false);
+
+    return fun_call_with_globals(self->globals, fun_viper_call_body, self_in, n_args, n_kw, args);
+}
+
 STATIC const mp_obj_type_t mp_type_fun_viper = {
     { &mp_type_type },
     .name = MP_QSTR_function,
@@ -463,6 +537,7 @@ mp_obj_t mp_obj_new_fun_viper(size_t n_args, void *fun_data, mp_uint_t type_sig)
     o->n_args = n_args;
     o->fun_data = fun_data;
     o->type_sig = type_sig;
+    o->globals = mp_globals_get();
     return o;
 }
 
@@ -33,6 +33,10 @@ typedef struct _mp_obj_fun_bc_t {
     mp_obj_dict_t *globals;         // the context within which this function was defined
     const byte *bytecode;           // bytecode for the function
     const mp_uint_t *const_table;   // constant table
+    #if MICROPY_TIERING
+    mp_uint_t tier_count;           // calls plus backward jumps, while bytecode
+    mp_obj_t tier_native;           // native version, or MP_OBJ_SENTINEL if none can be made
+    #endif
     // the following extra_args array is allocated space to take (in order):
     //  - values of positional default args (if any)
     //  - a single slot for default kw args dict (if it has them)
@@ -41,4 +45,8 @@ typedef struct _mp_obj_fun_bc_t {
     mp_obj_t extra_args[];
 } mp_obj_fun_bc_t;
 
+#if MICROPY_EMIT_NATIVE
+extern const mp_obj_type_t mp_type_fun_native;
+#endif
+
 #endif // __MICROPY_INCLUDED_PY_OBJFUN_H__
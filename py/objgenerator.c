@@ -34,6 +34,7 @@
 #include "py/bc.h"
 #include "py/objgenerator.h"
 #include "py/objfun.h"
+#include "py/gc.h"
 
 /******************************************************************************/
 /* generator wrapper                                                          */
@@ -49,13 +50,33 @@ typedef struct _mp_obj_gen_instance_t {
     mp_code_state_t code_state;
 } mp_obj_gen_instance_t;
 
+#if MICROPY_EMIT_NATIVE
+// The code of a native generator is preceded by the offset to its prelude, and
+// is called with the generator's code_state and the value to throw in (if any).
+typedef mp_vm_return_kind_t (*mp_fun_native_gen_t)(mp_code_state_t *code_state, mp_obj_t throw_value);
+#endif
+
+STATIC const byte *gen_get_prelude(const mp_obj_fun_bc_t *fun) {
+    #if MICROPY_EMIT_NATIVE
+    if (fun->base.type == &mp_type_fun_native) {
+        return fun->bytecode + *(const uintptr_t*)fun->bytecode;
+    }
+    #endif
+    return fun->bytecode;
+}
+
 STATIC mp_obj_t gen_wrap_call(mp_obj_t self_in, size_t n_args, size_t n_kw, const mp_obj_t *args) {
     mp_obj_gen_wrap_t *self = MP_OBJ_TO_PTR(self_in);
     mp_obj_fun_bc_t *self_fun = (mp_obj_fun_bc_t*)self->fun;
+    #if MICROPY_EMIT_NATIVE
+    assert(self_fun->base.type == &mp_type_fun_bc || self_fun->base.type == &mp_type_fun_native);
+    #else
     assert(self_fun->base.type == &mp_type_fun_bc);
+    #endif
 
-    // get start of bytecode
-    const byte *ip = self_fun->bytecode;
+    // get start of bytecode prelude
+    const byte *prelude = gen_get_prelude(self_fun);
+    const byte *ip = prelude;
 
     // bytecode prelude: get state size and exception stack size
     mp_uint_t n_state = mp_decode_uint(&ip);
@@ -68,7 +89,7 @@ STATIC mp_obj_t gen_wrap_call(mp_obj_t self_in, size_t n_args, size_t n_kw, cons
 
     o->globals = self_fun->globals;
     o->code_state.fun_bc = self_fun;
-    o->code_state.ip = 0;
+    o->code_state.ip = (const byte*)(prelude - self_fun->bytecode);
     mp_setup_code_state(&o->code_state, n_args, n_kw, args);
     return MP_OBJ_FROM_PTR(o);
 }
@@ -112,8 +133,19 @@ mp_vm_return_kind_t mp_obj_gen_resume(mp_obj_t self_in, mp_obj_t send_value, mp_
     }
     mp_obj_dict_t *old_globals = mp_globals_get();
     mp_globals_set(self->globals);
-    mp_vm_return_kind_t ret_kind = mp_execute_bytecode(&self->code_state, throw_value);
+    mp_vm_return_kind_t ret_kind;
+    #if MICROPY_EMIT_NATIVE
+    if (self->code_state.fun_bc->base.type == &mp_type_fun_native) {
+        mp_fun_native_gen_t fun = MICROPY_MAKE_POINTER_CALLABLE((void*)(self->code_state.fun_bc->bytecode + sizeof(uintptr_t)));
+        ret_kind = fun(&self->code_state, throw_value);
+    } else
+    #endif
+    {
+        ret_kind = mp_execute_bytecode(&self->code_state, throw_value);
+    }
     mp_globals_set(old_globals);
+    // the VM wrote to the generator's state
+    gc_write_barrier(self);
 
     switch (ret_kind) {
         case MP_VM_RETURN_NORMAL:
@@ -135,7 +167,7 @@ mp_vm_return_kind_t mp_obj_gen_resume(mp_obj_t self_in, mp_obj_t send_value, mp_
             break;
 
         case MP_VM_RETURN_EXCEPTION: {
-            size_t n_state = mp_decode_uint_value(self->code_state.fun_bc->bytecode);
+            size_t n_state = mp_decode_uint_value(gen_get_prelude(self->code_state.fun_bc));
             self->code_state.ip = 0;
             *ret_val = self->code_state.state[n_state - 1];
             break;
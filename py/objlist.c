@@ -29,9 +29,11 @@
 
 #include "py/nlr.h"
 #include "py/objlist.h"
+#include "py/objstr.h"
 #include "py/runtime0.h"
 #include "py/runtime.h"
 #include "py/stackctrl.h"
+#include "py/gc.h"
 
 STATIC mp_obj_t mp_obj_new_list_iterator(mp_obj_t list, size_t cur, mp_obj_iter_buf_t *iter_buf);
 STATIC mp_obj_list_t *list_new(size_t n);
@@ -209,9 +211,11 @@ STATIC mp_obj_t list_subscr(mp_obj_t self_in, mp_obj_t index, mp_obj_t value) {
                 }
                 mp_seq_replace_slice_grow_inplace(self->items, self->len,
                     slice_out.start, slice_out.stop, value_items, value_len, len_adj, sizeof(*self->items));
+                gc_write_barrier(self->items);
             } else {
                 mp_seq_replace_slice_no_grow(self->items, self->len,
                     slice_out.start, slice_out.stop, value_items, value_len, sizeof(*self->items));
+                gc_write_barrier(self->items);
                 // Clear "freed" elements at the end of list
                 mp_seq_clear(self->items, self->len + len_adj, self->len, sizeof(*self->items));
                 // TODO: apply allocation policy re: alloc_size
@@ -238,6 +242,7 @@ mp_obj_t mp_obj_list_append(mp_obj_t self_in, mp_obj_t arg) {
         mp_seq_clear(self->items, self->len + 1, self->alloc, sizeof(*self->items));
     }
     self->items[self->len++] = arg;
+    gc_write_barrier(self->items);
     return mp_const_none; // return None, as per CPython
 }
 
@@ -256,6 +261,7 @@ STATIC mp_obj_t list_extend(mp_obj_t self_in, mp_obj_t arg_in) {
 
         memcpy(self->items + self->len, arg->items, sizeof(mp_obj_t) * arg->len);
         self->len += arg->len;
+        gc_write_barrier(self->items);
     } else {
         list_extend_from_iter(self_in, arg_in);
     }
@@ -281,35 +287,577 @@ STATIC mp_obj_t list_pop(size_t n_args, const mp_obj_t *args) {
     return ret;
 }
 
-STATIC void mp_quicksort(mp_obj_t *head, mp_obj_t *tail, mp_obj_t key_fn, mp_obj_t binop_less_result) {
-    MP_STACK_CHECK();
-    while (head < tail) {
-        mp_obj_t *h = head - 1;
-        mp_obj_t *t = tail;
-        mp_obj_t v = key_fn == MP_OBJ_NULL ? tail[0] : mp_call_function_1(key_fn, tail[0]); // get pivot using key_fn
+// list.sort and sorted() use a stable, run-adaptive merge sort in the style of
+// timsort.  The sort works on a private copy of the items so that the list is
+// left untouched if a comparison raises.  If a key function is given then it
+// is called exactly once per item, and (key, item) pairs are sorted together.
+
+#define SORT_MIN_MERGE (64)
+#define SORT_MIN_GALLOP (7)
+// enough pending runs for 2**64 items, given the run-length invariants
+#define SORT_MAX_RUNS (85)
+
+// which comparison to use, chosen by looking at the keys before sorting
+enum {
+    SORT_CMP_GENERIC,
+    SORT_CMP_SMALL_INT,
+    #if MICROPY_PY_BUILTINS_FLOAT
+    SORT_CMP_FLOAT,
+    #endif
+    SORT_CMP_STR,
+};
+
+typedef struct _sort_run_t {
+    mp_obj_t *base;
+    size_t len;
+} sort_run_t;
+
+typedef struct _sort_state_t {
+    size_t w; // words per element: 1 for plain items, 2 for (key, item) pairs
+    uint8_t cmp;
+    bool reverse;
+    size_t min_gallop;
+    mp_obj_t *tmp;
+    size_t tmp_alloc; // in elements
+    size_t n_runs;
+    sort_run_t runs[SORT_MAX_RUNS];
+} sort_state_t;
+
+// pointer to the i'th element, and copying of n elements
+#define SORT_ELEM(p, i) ((p) + (i) * st->w)
+#define SORT_COPY(dest, src, n) memcpy((dest), (src), (n) * st->w * sizeof(mp_obj_t))
+#define SORT_MOVE(dest, src, n) memmove((dest), (src), (n) * st->w * sizeof(mp_obj_t))
+
+// returns a < b for two keys, taking the direction of the sort into account
+STATIC bool sort_lt(sort_state_t *st, mp_obj_t a, mp_obj_t b) {
+    if (st->reverse) {
+        mp_obj_t t = a;
+        a = b;
+        b = t;
+    }
+    switch (st->cmp) {
+        case SORT_CMP_SMALL_INT:
+            return MP_OBJ_SMALL_INT_VALUE(a) < MP_OBJ_SMALL_INT_VALUE(b);
+        #if MICROPY_PY_BUILTINS_FLOAT
+        case SORT_CMP_FLOAT:
+            return mp_obj_float_get(a) < mp_obj_float_get(b);
+        #endif
+        case SORT_CMP_STR: {
+            GET_STR_DATA_LEN(a, a_data, a_len);
+            GET_STR_DATA_LEN(b, b_data, b_len);
+            return mp_seq_cmp_bytes(MP_BINARY_OP_LESS, a_data, a_len, b_data, b_len);
+        }
+        default:
+            return mp_obj_is_true(mp_binary_op(MP_BINARY_OP_LESS, a, b));
+    }
+}
+
+STATIC uint8_t sort_choose_cmp(const mp_obj_t *elems, size_t n, size_t w) {
+    mp_obj_t k = elems[0];
+    uint8_t cmp;
+    if (MP_OBJ_IS_SMALL_INT(k)) {
+        cmp = SORT_CMP_SMALL_INT;
+    #if MICROPY_PY_BUILTINS_FLOAT
+    } else if (mp_obj_is_float(k)) {
+        cmp = SORT_CMP_FLOAT;
+    #endif
+    } else if (MP_OBJ_IS_STR(k)) {
+        cmp = SORT_CMP_STR;
+    } else {
+        return SORT_CMP_GENERIC;
+    }
+    for (size_t i = 1; i < n; i++) {
+        k = elems[i * w];
+        if ((cmp == SORT_CMP_SMALL_INT && !MP_OBJ_IS_SMALL_INT(k))
+            #if MICROPY_PY_BUILTINS_FLOAT
+            || (cmp == SORT_CMP_FLOAT && !mp_obj_is_float(k))
+            #endif
+            || (cmp == SORT_CMP_STR && !MP_OBJ_IS_STR(k))) {
+            return SORT_CMP_GENERIC;
+        }
+    }
+    return cmp;
+}
+
+STATIC void sort_reverse_slice(sort_state_t *st, mp_obj_t *lo, mp_obj_t *hi) {
+    // hi is inclusive
+    while (lo < hi) {
+        for (size_t i = 0; i < st->w; i++) {
+            mp_obj_t t = lo[i];
+            lo[i] = hi[i];
+            hi[i] = t;
+        }
+        lo += st->w;
+        hi -= st->w;
+    }
+}
+
+// sort elements [0, n) given that [0, start) is already sorted
+STATIC void sort_binary_insertion(sort_state_t *st, mp_obj_t *a, size_t n, size_t start) {
+    mp_obj_t pivot[2];
+    for (size_t i = start; i < n; i++) {
+        SORT_COPY(pivot, SORT_ELEM(a, i), 1);
+        size_t l = 0;
+        size_t r = i;
+        while (l < r) {
+            size_t m = l + ((r - l) >> 1);
+            if (sort_lt(st, pivot[0], SORT_ELEM(a, m)[0])) {
+                r = m;
+            } else {
+                l = m + 1;
+            }
+        }
+        SORT_MOVE(SORT_ELEM(a, l + 1), SORT_ELEM(a, l), i - l);
+        SORT_COPY(SORT_ELEM(a, l), pivot, 1);
+    }
+}
+
+// return the length of the run starting at a, reversing it if it is
+// strictly descending (strictness keeps the sort stable)
+STATIC size_t sort_count_run(sort_state_t *st, mp_obj_t *a, size_t n) {
+    if (n == 1) {
+        return 1;
+    }
+    size_t i = 2;
+    if (sort_lt(st, SORT_ELEM(a, 1)[0], a[0])) {
+        while (i < n && sort_lt(st, SORT_ELEM(a, i)[0], SORT_ELEM(a, i - 1)[0])) {
+            i++;
+        }
+        sort_reverse_slice(st, a, SORT_ELEM(a, i - 1));
+    } else {
+        while (i < n && !sort_lt(st, SORT_ELEM(a, i)[0], SORT_ELEM(a, i - 1)[0])) {
+            i++;
+        }
+    }
+    return i;
+}
+
+// locate the position at which to insert key into sorted a[0, n), to the
+// left of any equal elements; hint is where to start looking
+STATIC size_t sort_gallop_left(sort_state_t *st, mp_obj_t key, mp_obj_t *a, mp_int_t n, mp_int_t hint) {
+    mp_int_t last_ofs = 0;
+    mp_int_t ofs = 1;
+    if (sort_lt(st, SORT_ELEM(a, hint)[0], key)) {
+        // a[hint] < key, so gallop right until a[hint + last_ofs] < key <= a[hint + ofs]
+        mp_int_t max_ofs = n - hint;
+        while (ofs < max_ofs && sort_lt(st, SORT_ELEM(a, hint + ofs)[0], key)) {
+            last_ofs = ofs;
+            ofs = (ofs << 1) + 1;
+        }
+        if (ofs > max_ofs) {
+            ofs = max_ofs;
+        }
+        last_ofs += hint;
+        ofs += hint;
+    } else {
+        // key <= a[hint], so gallop left until a[hint - ofs] < key <= a[hint - last_ofs]
+        mp_int_t max_ofs = hint + 1;
+        while (ofs < max_ofs && !sort_lt(st, SORT_ELEM(a, hint - ofs)[0], key)) {
+            last_ofs = ofs;
+            ofs = (ofs << 1) + 1;
+        }
+        if (ofs > max_ofs) {
+            ofs = max_ofs;
+        }
+        mp_int_t k = last_ofs;
+        last_ofs = hint - ofs;
+        ofs = hint - k;
+    }
+    // now a[last_ofs] < key <= a[ofs], so binary search in between
+    last_ofs += 1;
+    while (last_ofs < ofs) {
+        mp_int_t m = last_ofs + ((ofs - last_ofs) >> 1);
+        if (sort_lt(st, SORT_ELEM(a, m)[0], key)) {
+            last_ofs = m + 1;
+        } else {
+            ofs = m;
+        }
+    }
+    return ofs;
+}
+
+// like sort_gallop_left but finds the position to the right of any equal elements
+STATIC size_t sort_gallop_right(sort_state_t *st, mp_obj_t key, mp_obj_t *a, mp_int_t n, mp_int_t hint) {
+    mp_int_t last_ofs = 0;
+    mp_int_t ofs = 1;
+    if (sort_lt(st, key, SORT_ELEM(a, hint)[0])) {
+        // key < a[hint], so gallop left until a[hint - ofs] <= key < a[hint - last_ofs]
+        mp_int_t max_ofs = hint + 1;
+        while (ofs < max_ofs && sort_lt(st, key, SORT_ELEM(a, hint - ofs)[0])) {
+            last_ofs = ofs;
+            ofs = (ofs << 1) + 1;
+        }
+        if (ofs > max_ofs) {
+            ofs = max_ofs;
+        }
+        mp_int_t k = last_ofs;
+        last_ofs = hint - ofs;
+        ofs = hint - k;
+    } else {
+        // a[hint] <= key, so gallop right until a[hint + last_ofs] <= key < a[hint + ofs]
+        mp_int_t max_ofs = n - hint;
+        while (ofs < max_ofs && !sort_lt(st, key, SORT_ELEM(a, hint + ofs)[0])) {
+            last_ofs = ofs;
+            ofs = (ofs << 1) + 1;
+        }
+        if (ofs > max_ofs) {
+            ofs = max_ofs;
+        }
+        last_ofs += hint;
+        ofs += hint;
+    }
+    // now a[last_ofs] <= key < a[ofs], so binary search in between
+    last_ofs += 1;
+    while (last_ofs < ofs) {
+        mp_int_t m = last_ofs + ((ofs - last_ofs) >> 1);
+        if (sort_lt(st, key, SORT_ELEM(a, m)[0])) {
+            ofs = m;
+        } else {
+            last_ofs = m + 1;
+        }
+    }
+    return ofs;
+}
+
+STATIC void sort_ensure_tmp(sort_state_t *st, size_t n) {
+    if (st->tmp_alloc < n) {
+        st->tmp = m_renew(mp_obj_t, st->tmp, st->tmp_alloc * st->w, n * st->w);
+        st->tmp_alloc = n;
+    }
+}
+
+// merge the adjacent runs a and b in place, where na <= nb
+STATIC void sort_merge_lo(sort_state_t *st, mp_obj_t *a, size_t na, mp_obj_t *b, size_t nb) {
+    sort_ensure_tmp(st, na);
+    mp_obj_t *dest = a;
+    SORT_COPY(st->tmp, a, na);
+    a = st->tmp;
+
+    SORT_COPY(dest, b, 1);
+    dest = SORT_ELEM(dest, 1);
+    b = SORT_ELEM(b, 1);
+    if (--nb == 0) {
+        goto succeed;
+    }
+    if (na == 1) {
+        goto copy_b;
+    }
+
+    size_t min_gallop = st->min_gallop;
+    for (;;) {
+        size_t a_count = 0; // number of times in a row that run a won
+        size_t b_count = 0; // number of times in a row that run b won
+
+        // do the straightforward merge until one run appears to win consistently
+        for (;;) {
+            if (sort_lt(st, b[0], a[0])) {
+                SORT_COPY(dest, b, 1);
+                dest = SORT_ELEM(dest, 1);
+                b = SORT_ELEM(b, 1);
+                ++b_count;
+                a_count = 0;
+                if (--nb == 0) {
+                    goto succeed;
+                }
+                if (b_count >= min_gallop) {
+                    break;
+                }
+            } else {
+                SORT_COPY(dest, a, 1);
+                dest = SORT_ELEM(dest, 1);
+                a = SORT_ELEM(a, 1);
+                ++a_count;
+                b_count = 0;
+                if (--na == 1) {
+                    goto copy_b;
+                }
+                if (a_count >= min_gallop) {
+                    break;
+                }
+            }
+        }
+
+        // switch to galloping until neither run appears to be winning consistently
+        ++min_gallop;
+        do {
+            min_gallop -= min_gallop > 1;
+            st->min_gallop = min_gallop;
+            size_t k = sort_gallop_right(st, b[0], a, na, 0);
+            a_count = k;
+            if (k) {
+                SORT_COPY(dest, a, k);
+                dest = SORT_ELEM(dest, k);
+                a = SORT_ELEM(a, k);
+                na -= k;
+                if (na == 1) {
+                    goto copy_b;
+                }
+                // na == 0 is only possible if the comparison is inconsistent
+                if (na == 0) {
+                    goto succeed;
+                }
+            }
+            SORT_COPY(dest, b, 1);
+            dest = SORT_ELEM(dest, 1);
+            b = SORT_ELEM(b, 1);
+            if (--nb == 0) {
+                goto succeed;
+            }
+
+            k = sort_gallop_left(st, a[0], b, nb, 0);
+            b_count = k;
+            if (k) {
+                SORT_MOVE(dest, b, k);
+                dest = SORT_ELEM(dest, k);
+                b = SORT_ELEM(b, k);
+                nb -= k;
+                if (nb == 0) {
+                    goto succeed;
+                }
+            }
+            SORT_COPY(dest, a, 1);
+            dest = SORT_ELEM(dest, 1);
+            a = SORT_ELEM(a, 1);
+            if (--na == 1) {
+                goto copy_b;
+            }
+        } while (a_count >= SORT_MIN_GALLOP || b_count >= SORT_MIN_GALLOP);
+        ++min_gallop; // penalise leaving galloping mode
+        st->min_gallop = min_gallop;
+    }
+
+succeed:
+    if (na) {
+        SORT_COPY(dest, a, na);
+    }
+    return;
+
+copy_b:
+    // the last element of a belongs at the end of the merge
+    SORT_MOVE(dest, b, nb);
+    SORT_COPY(SORT_ELEM(dest, nb), a, 1);
+}
+
+// merge the adjacent runs a and b in place, where na >= nb
+STATIC void sort_merge_hi(sort_state_t *st, mp_obj_t *a, size_t na, mp_obj_t *b, size_t nb) {
+    sort_ensure_tmp(st, nb);
+    mp_obj_t *dest = SORT_ELEM(b, nb - 1);
+    SORT_COPY(st->tmp, b, nb);
+    mp_obj_t *base_a = a;
+    mp_obj_t *base_b = st->tmp;
+    b = SORT_ELEM(st->tmp, nb - 1);
+    a = SORT_ELEM(a, na - 1);
+
+    SORT_COPY(dest, a, 1);
+    dest = SORT_ELEM(dest, -1);
+    a = SORT_ELEM(a, -1);
+    if (--na == 0) {
+        goto succeed;
+    }
+    if (nb == 1) {
+        goto copy_a;
+    }
+
+    size_t min_gallop = st->min_gallop;
+    for (;;) {
+        size_t a_count = 0;
+        size_t b_count = 0;
+
         for (;;) {
-            do ++h; while (h < t && mp_binary_op(MP_BINARY_OP_LESS, key_fn == MP_OBJ_NULL ? h[0] : mp_call_function_1(key_fn, h[0]), v) == binop_less_result);
-            do --t; while (h < t && mp_binary_op(MP_BINARY_OP_LESS, v, key_fn == MP_OBJ_NULL ? t[0] : mp_call_function_1(key_fn, t[0])) == binop_less_result);
-            if (h >= t) break;
-            mp_obj_t x = h[0];
-            h[0] = t[0];
-            t[0] = x;
-        }
-        mp_obj_t x = h[0];
-        h[0] = tail[0];
-        tail[0] = x;
-        // do the smaller recursive call first, to keep stack within O(log(N))
-        if (t - head < tail - h - 1) {
-            mp_quicksort(head, t, key_fn, binop_less_result);
-            head = h + 1;
+            if (sort_lt(st, b[0], a[0])) {
+                SORT_COPY(dest, a, 1);
+                dest = SORT_ELEM(dest, -1);
+                a = SORT_ELEM(a, -1);
+                ++a_count;
+                b_count = 0;
+                if (--na == 0) {
+                    goto succeed;
+                }
+                if (a_count >= min_gallop) {
+                    break;
+                }
+            } else {
+                SORT_COPY(dest, b, 1);
+                dest = SORT_ELEM(dest, -1);
+                b = SORT_ELEM(b, -1);
+                ++b_count;
+                a_count = 0;
+                if (--nb == 1) {
+                    goto copy_a;
+                }
+                if (b_count >= min_gallop) {
+                    break;
+                }
+            }
+        }
+
+        ++min_gallop;
+        do {
+            min_gallop -= min_gallop > 1;
+            st->min_gallop = min_gallop;
+            size_t k = na - sort_gallop_right(st, b[0], base_a, na, na - 1);
+            a_count = k;
+            if (k) {
+                dest = SORT_ELEM(dest, -(mp_int_t)k);
+                a = SORT_ELEM(a, -(mp_int_t)k);
+                SORT_MOVE(SORT_ELEM(dest, 1), SORT_ELEM(a, 1), k);
+                na -= k;
+                if (na == 0) {
+                    goto succeed;
+                }
+            }
+            SORT_COPY(dest, b, 1);
+            dest = SORT_ELEM(dest, -1);
+            b = SORT_ELEM(b, -1);
+            if (--nb == 1) {
+                goto copy_a;
+            }
+
+            k = nb - sort_gallop_left(st, a[0], base_b, nb, nb - 1);
+            b_count = k;
+            if (k) {
+                dest = SORT_ELEM(dest, -(mp_int_t)k);
+                b = SORT_ELEM(b, -(mp_int_t)k);
+                SORT_COPY(SORT_ELEM(dest, 1), SORT_ELEM(b, 1), k);
+                nb -= k;
+                if (nb == 1) {
+                    goto copy_a;
+                }
+                // nb == 0 is only possible if the comparison is inconsistent
+                if (nb == 0) {
+                    goto succeed;
+                }
+            }
+            SORT_COPY(dest, a, 1);
+            dest = SORT_ELEM(dest, -1);
+            a = SORT_ELEM(a, -1);
+            if (--na == 0) {
+                goto succeed;
+            }
+        } while (a_count >= SORT_MIN_GALLOP || b_count >= SORT_MIN_GALLOP);
+        ++min_gallop;
+        st->min_gallop = min_gallop;
+    }
+
+succeed:
+    if (nb) {
+        SORT_COPY(SORT_ELEM(dest, -(mp_int_t)(nb - 1)), base_b, nb);
+    }
+    return;
+
+copy_a:
+    // the first element of b belongs at the start of the merge
+    dest = SORT_ELEM(dest, -(mp_int_t)na);
+    a = SORT_ELEM(a, -(mp_int_t)na);
+    SORT_MOVE(SORT_ELEM(dest, 1), SORT_ELEM(a, 1), na);
+    SORT_COPY(dest, b, 1);
+}
+
+// merge the pending runs i and i + 1
+STATIC void sort_merge_at(sort_state_t *st, size_t i) {
+    mp_obj_t *a = st->runs[i].base;
+    size_t na = st->runs[i].len;
+    mp_obj_t *b = st->runs[i + 1].base;
+    size_t nb = st->runs[i + 1].len;
+
+    st->runs[i].len = na + nb;
+    if (i == st->n_runs - 3) {
+        st->runs[i + 1] = st->runs[i + 2];
+    }
+    --st->n_runs;
+
+    // elements of a that are already in place can be ignored
+    size_t k = sort_gallop_right(st, b[0], a, na, 0);
+    a = SORT_ELEM(a, k);
+    na -= k;
+    if (na == 0) {
+        return;
+    }
+
+    // likewise for elements at the end of b
+    nb = sort_gallop_left(st, SORT_ELEM(a, na - 1)[0], b, nb, nb - 1);
+    if (nb == 0) {
+        return;
+    }
+
+    if (na <= nb) {
+        sort_merge_lo(st, a, na, b, nb);
+    } else {
+        sort_merge_hi(st, a, na, b, nb);
+    }
+}
+
+// merge pending runs until the run-length invariants hold again
+STATIC void sort_merge_collapse(sort_state_t *st) {
+    sort_run_t *p = st->runs;
+    while (st->n_runs > 1) {
+        size_t n = st->n_runs - 2;
+        if ((n > 0 && p[n - 1].len <= p[n].len + p[n + 1].len)
+            || (n > 1 && p[n - 2].len <= p[n - 1].len + p[n].len)) {
+            if (p[n - 1].len < p[n + 1].len) {
+                --n;
+            }
+            sort_merge_at(st, n);
+        } else if (p[n].len <= p[n + 1].len) {
+            sort_merge_at(st, n);
         } else {
-            mp_quicksort(h + 1, tail, key_fn, binop_less_result);
-            tail = t;
+            break;
         }
     }
 }
 
-// TODO Python defines sort to be stable but ours is not
+STATIC size_t sort_min_run(size_t n) {
+    size_t r = 0;
+    while (n >= SORT_MIN_MERGE) {
+        r |= n & 1;
+        n >>= 1;
+    }
+    return n + r;
+}
+
+// stably sort n elements, each w words wide and keyed on their first word
+STATIC void mp_timsort(mp_obj_t *elems, size_t n, size_t w, bool reverse) {
+    sort_state_t st_mem;
+    sort_state_t *st = &st_mem;
+    st->w = w;
+    st->cmp = sort_choose_cmp(elems, n, w);
+    st->reverse = reverse;
+    st->min_gallop = SORT_MIN_GALLOP;
+    st->tmp = NULL;
+    st->tmp_alloc = 0;
+    st->n_runs = 0;
+
+    size_t min_run = sort_min_run(n);
+    mp_obj_t *lo = elems;
+    size_t n_remaining = n;
+    do {
+        size_t run = sort_count_run(st, lo, n_remaining);
+        if (run < min_run) {
+            // extend a short run to min_run elements
+            size_t force = n_remaining < min_run ? n_remaining : min_run;
+            sort_binary_insertion(st, lo, force, run);
+            run = force;
+        }
+        st->runs[st->n_runs].base = lo;
+        st->runs[st->n_runs].len = run;
+        ++st->n_runs;
+        sort_merge_collapse(st);
+        lo = SORT_ELEM(lo, run);
+        n_remaining -= run;
+    } while (n_remaining);
+
+    // merge all remaining runs
+    while (st->n_runs > 1) {
+        size_t i = st->n_runs - 2;
+        if (i > 0 && st->runs[i - 1].len < st->runs[i + 1].len) {
+            --i;
+        }
+        sort_merge_at(st, i);
+    }
+
+    m_del(mp_obj_t, st->tmp, st->tmp_alloc * w);
+}
+
 mp_obj_t mp_obj_list_sort(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
     static const mp_arg_t allowed_args[] = {
         { MP_QSTR_key, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_rom_obj = MP_ROM_PTR(&mp_const_none_obj)} },
@@ -326,10 +874,31 @@ mp_obj_t mp_obj_list_sort(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_
     mp_check_self(MP_OBJ_IS_TYPE(pos_args[0], &mp_type_list));
     mp_obj_list_t *self = MP_OBJ_TO_PTR(pos_args[0]);
 
-    if (self->len > 1) {
-        mp_quicksort(self->items, self->items + self->len - 1,
-                     args.key.u_obj == mp_const_none ? MP_OBJ_NULL : args.key.u_obj,
-                     args.reverse.u_bool ? mp_const_false : mp_const_true);
+    size_t n = self->len;
+    if (n > 1) {
+        // sort a copy of the items, as (key, item) pairs if there is a key function
+        size_t w = args.key.u_obj == mp_const_none ? 1 : 2;
+        mp_obj_t *elems = m_new(mp_obj_t, n * w);
+        for (size_t i = 0; i < n; i++) {
+            elems[i * w + w - 1] = self->items[i];
+        }
+        if (w == 2) {
+            for (size_t i = 0; i < n; i++) {
+                elems[i * 2] = mp_call_function_1(args.key.u_obj, elems[i * 2 + 1]);
+            }
+        }
+
+        mp_timsort(elems, n, w, args.reverse.u_bool);
+
+        if (self->len != n) {
+            m_del(mp_obj_t, elems, n * w);
+            mp_raise_ValueError("list modified during sort");
+        }
+        for (size_t i = 0; i < n; i++) {
+            self->items[i] = elems[i * w + w - 1];
+        }
+        gc_write_barrier(self->items);
+        m_del(mp_obj_t, elems, n * w);
     }
 
     return mp_const_none;
@@ -492,6 +1061,7 @@ void mp_obj_list_store(mp_obj_t self_in, mp_obj_t index, mp_obj_t value) {
     mp_obj_list_t *self = MP_OBJ_TO_PTR(self_in);
     size_t i = mp_get_index(self->base.type, self->len, index, false);
     self->items[i] = value;
+    gc_write_barrier(self->items);
 }
 
 /******************************************************************************/
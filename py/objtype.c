@@ -193,6 +193,48 @@ STATIC void mp_obj_class_lookup(struct class_lookup_data  *lookup, const mp_obj_
     }
 }
 
+#if MICROPY_OPT_ATTR_INLINE_CACHE
+// Search the locals dicts of type and its bases for attr, in the same order as
+// mp_obj_class_lookup, and return the member as stored in the dict.  Returns
+// MP_OBJ_NULL if it's not found, and MP_OBJ_SENTINEL if, for a lookup on an
+// instance, a native base is reached first (whose load_attr depends on the
+// instance), so that the result can't be cached.
+mp_obj_t mp_obj_class_lookup_member(const mp_obj_type_t *type, qstr attr, bool is_type) {
+    for (;;) {
+        if (type->locals_dict != NULL) {
+            mp_map_elem_t *elem = mp_map_lookup(&type->locals_dict->map, MP_OBJ_NEW_QSTR(attr), MP_MAP_LOOKUP);
+            if (elem != NULL) {
+                return elem->value;
+            }
+        }
+
+        if (!is_type && mp_obj_is_native_type(type) && type != &mp_type_object) {
+            return MP_OBJ_SENTINEL;
+        }
+
+        if (type->bases_tuple == NULL || type->bases_tuple->len == 0) {
+            return MP_OBJ_NULL;
+        }
+        size_t len = type->bases_tuple->len;
+        mp_obj_t *items = type->bases_tuple->items;
+        for (size_t i = 0; i < len - 1; i++) {
+            const mp_obj_type_t *bt = MP_OBJ_TO_PTR(items[i]);
+            if (bt == &mp_type_object) {
+                continue;
+            }
+            mp_obj_t member = mp_obj_class_lookup_member(bt, attr, is_type);
+            if (member != MP_OBJ_NULL) {
+                return member;
+            }
+        }
+        type = MP_OBJ_TO_PTR(items[len - 1]);
+        if (type == &mp_type_object) {
+            return MP_OBJ_NULL;
+        }
+    }
+}
+#endif
+
 STATIC void instance_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind) {
     mp_obj_instance_t *self = MP_OBJ_TO_PTR(self_in);
     qstr meth = (kind == PRINT_STR) ? MP_QSTR___str__ : MP_QSTR___repr__;
@@ -823,6 +865,20 @@ STATIC mp_obj_t type_make_new(const mp_obj_type_t *type_in, size_t n_args, size_
             // args[0] = name
             // args[1] = bases tuple
             // args[2] = locals dict
+            #if MICROPY_OPT_ATTR_INLINE_CACHE
+            if (MP_OBJ_IS_TYPE(args[2], &mp_type_dict)) {
+                // the class gets its own copy of the dict, as in CPython, so
+                // that the caller can't change it behind the inline caches
+                mp_map_t *map = mp_obj_dict_get_map(args[2]);
+                mp_obj_t locals_dict = mp_obj_new_dict(map->used);
+                for (size_t i = 0; i < map->alloc; i++) {
+                    if (MP_MAP_SLOT_IS_FILLED(map, i)) {
+                        mp_obj_dict_store(locals_dict, map->table[i].key, map->table[i].value);
+                    }
+                }
+                return mp_obj_new_type(mp_obj_str_get_qstr(args[0]), args[1], locals_dict);
+            }
+            #endif
             return mp_obj_new_type(mp_obj_str_get_qstr(args[0]), args[1], args[2]);
 
         default:
@@ -885,6 +941,9 @@ STATIC void type_attr(mp_obj_t self_in, qstr attr, mp_obj_t *dest) {
                 // note that locals_map may be in ROM, so remove will fail in that case
                 if (elem != NULL) {
                     dest[0] = MP_OBJ_NULL; // indicate success
+                    #if MICROPY_OPT_ATTR_INLINE_CACHE
+                    MP_STATE_VM(attr_cache_epoch)++;
+                    #endif
                 }
             } else {
                 // store attribute
@@ -893,6 +952,9 @@ STATIC void type_attr(mp_obj_t self_in, qstr attr, mp_obj_t *dest) {
                 if (elem != NULL) {
                     elem->value = dest[1];
                     dest[0] = MP_OBJ_NULL; // indicate success
+                    #if MICROPY_OPT_ATTR_INLINE_CACHE
+                    MP_STATE_VM(attr_cache_epoch)++;
+                    #endif
                 }
             }
         }
@@ -972,6 +1034,11 @@ mp_obj_t mp_obj_new_type(qstr name, mp_obj_t bases_tuple, mp_obj_t locals_dict)
         }
     }
 
+    #if MICROPY_OPT_ATTR_INLINE_CACHE
+    // the new class may be at the address of a freed one that is in a cache
+    MP_STATE_VM(attr_cache_epoch)++;
+    #endif
+
     return MP_OBJ_FROM_PTR(o);
 }
 
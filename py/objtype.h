@@ -40,6 +40,11 @@ typedef struct _mp_obj_instance_t {
 // this needs to be exposed for MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE to work
 void mp_obj_instance_attr(mp_obj_t self_in, qstr attr, mp_obj_t *dest);
 
+#if MICROPY_OPT_ATTR_INLINE_CACHE
+// this needs to be exposed for the attribute inline cache in runtime.c
+mp_obj_t mp_obj_class_lookup_member(const mp_obj_type_t *type, qstr attr, bool is_type);
+#endif
+
 // these need to be exposed so mp_obj_is_callable can work correctly
 bool mp_obj_instance_is_callable(mp_obj_t self_in);
 mp_obj_t mp_obj_instance_call(mp_obj_t self_in, size_t n_args, size_t n_kw, const mp_obj_t *args);
@@ -33,13 +33,14 @@
 #include "py/emitglue.h"
 #include "py/persistentcode.h"
 #include "py/bc.h"
+#include "py/runtime0.h"
 
 #if MICROPY_PERSISTENT_CODE_LOAD || MICROPY_PERSISTENT_CODE_SAVE
 
 #include "py/smallint.h"
 
 // The current version of .mpy files
-#define MPY_VERSION (1)
+#define MPY_VERSION (3)
 
 // The feature flags byte encodes the compile-time config options that
 // affect the generate bytecode.
@@ -53,6 +54,20 @@
     | ((MICROPY_PY_BUILTINS_STR_UNICODE_DYNAMIC) << 1) \
     )
 
+// The upper bits of the feature flags byte hold the architecture of any
+// native code in the file, or MP_NATIVE_ARCH_NONE if it only has bytecode.
+#define MPY_FEATURE_ENCODE_ARCH(arch) ((arch) << 2)
+#define MPY_FEATURE_DECODE_ARCH(feat) ((feat) >> 2)
+#define MPY_FEATURE_DECODE_FLAGS(feat) ((feat) & 3)
+
+// The architecture of the native code that this build can save and load;
+// native code is made relocatable only by the x64 emitter
+#if MICROPY_EMIT_X64
+#define MPY_FEATURE_ARCH (MP_NATIVE_ARCH_X64)
+#else
+#define MPY_FEATURE_ARCH (MP_NATIVE_ARCH_NONE)
+#endif
+
 #if MICROPY_PERSISTENT_CODE_LOAD || (MICROPY_PERSISTENT_CODE_SAVE && !MICROPY_DYNAMIC_COMPILER)
 // The bytecode will depend on the number of bits in a small-int, and
 // this function computes that (could make it a fixed constant, but it
@@ -136,6 +151,12 @@ STATIC mp_obj_t load_obj(mp_reader_t *reader) {
     byte obj_type = read_byte(reader);
     if (obj_type == 'e') {
         return MP_OBJ_FROM_PTR(&mp_const_ellipsis_obj);
+    } else if (obj_type == 'N') {
+        return mp_const_none;
+    } else if (obj_type == 'F') {
+        return mp_const_false;
+    } else if (obj_type == 'T') {
+        return mp_const_true;
     } else {
         size_t len = read_uint(reader);
         vstr_t vstr;
@@ -165,9 +186,97 @@ STATIC void load_bytecode_qstrs(mp_reader_t *reader, byte *ip, byte *ip_top) {
     }
 }
 
+#if MPY_FEATURE_ARCH != MP_NATIVE_ARCH_NONE
+
+STATIC mp_raw_code_t *load_raw_code(mp_reader_t *reader);
+
+STATIC mp_raw_code_t *load_raw_code_native(mp_reader_t *reader, mp_raw_code_kind_t kind, size_t fun_data_len) {
+    // load the machine code into executable memory
+    void *fun_data;
+    size_t fun_alloc;
+    MP_PLAT_ALLOC_EXEC(fun_data_len, &fun_data, &fun_alloc);
+    read_bytes(reader, fun_data, fun_data_len);
+
+    mp_uint_t prelude_offset = 0;
+    mp_uint_t *const_table = NULL;
+    mp_uint_t type_sig = 0;
+    if (kind == MP_CODE_NATIVE_PY) {
+        // link the qstrs of the prelude; the argument names follow it
+        prelude_offset = read_uint(reader);
+        const byte *ip = (byte*)fun_data + prelude_offset;
+        const byte *ip2;
+        bytecode_prelude_t prelude;
+        extract_prelude(&ip, &ip2, &prelude);
+        qstr simple_name = load_qstr(reader);
+        qstr source_file = load_qstr(reader);
+        ((byte*)ip2)[0] = simple_name; ((byte*)ip2)[1] = simple_name >> 8;
+        ((byte*)ip2)[2] = source_file; ((byte*)ip2)[3] = source_file >> 8;
+        const_table = MP_ALIGN(ip, sizeof(mp_uint_t));
+    } else {
+        type_sig = read_uint(reader);
+    }
+    mp_uint_t scope_flags = read_uint(reader);
+    mp_uint_t n_pos_args = read_uint(reader);
+
+    // patch the runtime-dependent values into the machine code
+    size_t n_reloc = read_uint(reader);
+    for (size_t i = 0; i < n_reloc; ++i) {
+        size_t offset = read_uint(reader);
+        byte reloc_kind = read_byte(reader);
+        mp_uint_t value;
+        if (reloc_kind == MP_NATIVE_RELOC_QSTR) {
+            value = load_qstr(reader);
+        } else if (reloc_kind == MP_NATIVE_RELOC_QSTR_OBJ) {
+            value = (mp_uint_t)MP_OBJ_NEW_QSTR(load_qstr(reader));
+        } else if (reloc_kind == MP_NATIVE_RELOC_OBJ) {
+            value = (mp_uint_t)load_obj(reader);
+        } else if (reloc_kind == MP_NATIVE_RELOC_FUN_TABLE) {
+            size_t idx = read_uint(reader);
+            if (idx >= MP_F_NUMBER_OF) {
+                mp_raise_ValueError("incompatible .mpy file");
+            }
+            value = (mp_uint_t)mp_fun_table[idx];
+        } else {
+            assert(reloc_kind == MP_NATIVE_RELOC_RAW_CODE);
+            value = (mp_uint_t)(uintptr_t)load_raw_code(reader);
+        }
+        if (offset + sizeof(mp_uint_t) > fun_data_len) {
+            mp_raise_ValueError("incompatible .mpy file");
+        }
+        memcpy((byte*)fun_data + offset, &value, sizeof(mp_uint_t));
+    }
+
+    #if defined(MP_PLAT_COMMIT_EXEC)
+    fun_data = MP_PLAT_COMMIT_EXEC(fun_data, fun_data_len);
+    #endif
+
+    // create raw_code and return it
+    mp_raw_code_t *rc = mp_emit_glue_new_raw_code();
+    mp_emit_glue_assign_native(rc, kind, fun_data, fun_data_len, const_table,
+        #if MICROPY_PERSISTENT_CODE_SAVE
+        prelude_offset, NULL, 0,
+        #endif
+        n_pos_args, scope_flags, type_sig);
+    return rc;
+}
+
+#endif
+
 STATIC mp_raw_code_t *load_raw_code(mp_reader_t *reader) {
+    // the kind of code is in the low bits of its length
+    size_t kind_len = read_uint(reader);
+    mp_raw_code_kind_t kind = MP_CODE_BYTECODE + (kind_len & 3);
+    if (kind != MP_CODE_BYTECODE) {
+        #if MPY_FEATURE_ARCH != MP_NATIVE_ARCH_NONE
+        if (kind != MP_CODE_NATIVE_ASM) {
+            return load_raw_code_native(reader, kind, kind_len >> 2);
+        }
+        #endif
+        mp_raise_ValueError("incompatible .mpy file");
+    }
+
     // load bytecode
-    size_t bc_len = read_uint(reader);
+    size_t bc_len = kind_len >> 2;
     byte *bytecode = m_new(byte, bc_len);
     read_bytes(reader, bytecode, bc_len);
 
@@ -214,10 +323,21 @@ mp_raw_code_t *mp_raw_code_load(mp_reader_t *reader) {
     read_bytes(reader, header, sizeof(header));
     if (header[0] != 'M'
         || header[1] != MPY_VERSION
-        || header[2] != MPY_FEATURE_FLAGS
+        || MPY_FEATURE_DECODE_FLAGS(header[2]) != MPY_FEATURE_FLAGS
         || header[3] > mp_small_int_bits()) {
         mp_raise_ValueError("incompatible .mpy file");
     }
+    if (MPY_FEATURE_DECODE_ARCH(header[2]) != MP_NATIVE_ARCH_NONE) {
+        // native code must be for this architecture, and must agree on the
+        // layout of the structures that it accesses directly
+        byte layout[2];
+        read_bytes(reader, layout, sizeof(layout));
+        if (MPY_FEATURE_DECODE_ARCH(header[2]) != MPY_FEATURE_ARCH
+            || layout[0] != sizeof(mp_code_state_t) / sizeof(mp_uint_t)
+            || layout[1] != sizeof(nlr_buf_t) / sizeof(mp_uint_t)) {
+            mp_raise_ValueError("incompatible .mpy arch");
+        }
+    }
     mp_raw_code_t *rc = load_raw_code(reader);
     reader->close(reader->data);
     return rc;
@@ -280,6 +400,10 @@ STATIC void save_obj(mp_print_t *print, mp_obj_t o) {
     } else if (MP_OBJ_TO_PTR(o) == &mp_const_ellipsis_obj) {
         byte obj_type = 'e';
         mp_print_bytes(print, &obj_type, 1);
+    } else if (o == mp_const_none || o == mp_const_false || o == mp_const_true) {
+        // these only appear in native code
+        byte obj_type = o == mp_const_none ? 'N' : o == mp_const_false ? 'F' : 'T';
+        mp_print_bytes(print, &obj_type, 1);
     } else {
         // we save numbers using a simplistic text representation
         // TODO could be improved
@@ -315,13 +439,66 @@ STATIC void save_bytecode_qstrs(mp_print_t *print, const byte *ip, const byte *i
     }
 }
 
+#if MPY_FEATURE_ARCH != MP_NATIVE_ARCH_NONE
+
+STATIC void save_raw_code(mp_print_t *print, mp_raw_code_t *rc);
+
+STATIC void save_raw_code_native(mp_print_t *print, mp_raw_code_t *rc) {
+    // save machine code
+    const byte *fun_data = rc->data.u_native.fun_data;
+    mp_print_uint(print, (rc->data.u_native.fun_data_len << 2) | (rc->kind - MP_CODE_BYTECODE));
+    mp_print_bytes(print, fun_data, rc->data.u_native.fun_data_len);
+
+    if (rc->kind == MP_CODE_NATIVE_PY) {
+        // save prelude offset and qstrs
+        const byte *ip = fun_data + rc->data.u_native.prelude_offset;
+        const byte *ip2;
+        bytecode_prelude_t prelude;
+        extract_prelude(&ip, &ip2, &prelude);
+        mp_print_uint(print, rc->data.u_native.prelude_offset);
+        save_qstr(print, ip2[0] | (ip2[1] << 8)); // simple_name
+        save_qstr(print, ip2[2] | (ip2[3] << 8)); // source_file
+    } else {
+        mp_print_uint(print, rc->data.u_native.type_sig);
+    }
+    mp_print_uint(print, rc->scope_flags);
+    mp_print_uint(print, rc->n_pos_args);
+
+    // save the values that the loader must patch in, with any nested code
+    mp_print_uint(print, rc->data.u_native.n_reloc);
+    for (mp_uint_t i = 0; i < rc->data.u_native.n_reloc; ++i) {
+        const mp_native_reloc_t *r = &rc->data.u_native.relocs[i];
+        byte kind = r->kind;
+        mp_print_uint(print, r->offset);
+        mp_print_bytes(print, &kind, 1);
+        if (kind == MP_NATIVE_RELOC_QSTR || kind == MP_NATIVE_RELOC_QSTR_OBJ) {
+            save_qstr(print, r->value);
+        } else if (kind == MP_NATIVE_RELOC_OBJ) {
+            save_obj(print, (mp_obj_t)r->value);
+        } else if (kind == MP_NATIVE_RELOC_FUN_TABLE) {
+            mp_print_uint(print, r->value);
+        } else {
+            assert(kind == MP_NATIVE_RELOC_RAW_CODE);
+            save_raw_code(print, (mp_raw_code_t*)(uintptr_t)r->value);
+        }
+    }
+}
+
+#endif
+
 STATIC void save_raw_code(mp_print_t *print, mp_raw_code_t *rc) {
     if (rc->kind != MP_CODE_BYTECODE) {
-        mp_raise_ValueError("can only save bytecode");
+        #if MPY_FEATURE_ARCH != MP_NATIVE_ARCH_NONE
+        if (rc->kind != MP_CODE_NATIVE_ASM) {
+            save_raw_code_native(print, rc);
+            return;
+        }
+        #endif
+        mp_raise_ValueError("can only save bytecode and native code");
     }
 
     // save bytecode
-    mp_print_uint(print, rc->data.u_byte.bc_len);
+    mp_print_uint(print, rc->data.u_byte.bc_len << 2);
     mp_print_bytes(print, rc->data.u_byte.bytecode, rc->data.u_byte.bc_len);
 
     // extract prelude
@@ -351,20 +528,55 @@ STATIC void save_raw_code(mp_print_t *print, mp_raw_code_t *rc) {
     }
 }
 
+// whether the raw code, or any code nested in it, is native code
+STATIC bool raw_code_has_native(mp_raw_code_t *rc) {
+    if (rc->kind != MP_CODE_BYTECODE) {
+        return true;
+    }
+    const byte *ip = rc->data.u_byte.bytecode;
+    const byte *ip2;
+    bytecode_prelude_t prelude;
+    extract_prelude(&ip, &ip2, &prelude);
+    const mp_uint_t *ct = rc->data.u_byte.const_table
+        + prelude.n_pos_args + prelude.n_kwonly_args + rc->data.u_byte.n_obj;
+    for (uint i = 0; i < rc->data.u_byte.n_raw_code; ++i) {
+        if (raw_code_has_native((mp_raw_code_t*)(uintptr_t)ct[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
 void mp_raw_code_save(mp_raw_code_t *rc, mp_print_t *print) {
     // header contains:
     //  byte  'M'
     //  byte  version
-    //  byte  feature flags
+    //  byte  feature flags, and arch of native code
     //  byte  number of bits in a small int
-    byte header[4] = {'M', MPY_VERSION, MPY_FEATURE_FLAGS_DYNAMIC,
+    // and, if there is native code:
+    //  byte  number of words in mp_code_state_t
+    //  byte  number of words in nlr_buf_t
+    byte header[6] = {'M', MPY_VERSION, MPY_FEATURE_FLAGS_DYNAMIC,
         #if MICROPY_DYNAMIC_COMPILER
         mp_dynamic_compiler.small_int_bits,
         #else
         mp_small_int_bits(),
         #endif
     };
-    mp_print_bytes(print, header, sizeof(header));
+    size_t header_len = 4;
+    if (raw_code_has_native(rc)) {
+        #if MICROPY_DYNAMIC_COMPILER
+        header[2] |= MPY_FEATURE_ENCODE_ARCH(mp_dynamic_compiler.native_arch);
+        header[4] = mp_dynamic_compiler.native_code_state_words;
+        header[5] = mp_dynamic_compiler.native_nlr_buf_words;
+        #else
+        header[2] |= MPY_FEATURE_ENCODE_ARCH(MPY_FEATURE_ARCH);
+        header[4] = sizeof(mp_code_state_t) / sizeof(mp_uint_t);
+        header[5] = sizeof(nlr_buf_t) / sizeof(mp_uint_t);
+        #endif
+        header_len = 6;
+    }
+    mp_print_bytes(print, header, header_len);
 
     save_raw_code(print, rc);
 }
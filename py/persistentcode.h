@@ -30,6 +30,14 @@
 #include "py/reader.h"
 #include "py/emitglue.h"
 
+// Architectures of native code that can be stored in an .mpy file
+#define MP_NATIVE_ARCH_NONE (0)
+#define MP_NATIVE_ARCH_X86 (1)
+#define MP_NATIVE_ARCH_X64 (2)
+#define MP_NATIVE_ARCH_ARM (3)
+#define MP_NATIVE_ARCH_THUMB (4)
+#define MP_NATIVE_ARCH_XTENSA (5)
+
 mp_raw_code_t *mp_raw_code_load(mp_reader_t *reader);
 mp_raw_code_t *mp_raw_code_load_mem(const byte *buf, size_t len);
 mp_raw_code_t *mp_raw_code_load_file(const char *filename);
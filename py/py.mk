@@ -108,6 +108,7 @@ PY_O_BASENAME = \
 	nlrsetjmp.o \
 	malloc.o \
 	gc.o \
+	pystack.o \
 	qstr.o \
 	vstr.o \
 	mpprint.o \
@@ -204,6 +205,9 @@ PY_O_BASENAME = \
 	moduerrno.o \
 	modthread.o \
 	vm.o \
+	vmprofile.o \
+	vmsample.o \
+	tier.o \
 	bc.o \
 	showbc.o \
 	repl.o \
@@ -32,8 +32,8 @@
 #include "py/qstr.h"
 #include "py/gc.h"
 
-// NOTE: we are using linear arrays to store and search for qstr's (unique strings, interned strings)
-// ultimately we will replace this with a static hash table of some kind
+// NOTE: we are using linear arrays to store qstr's (unique strings, interned strings)
+// and, unless MICROPY_QSTR_HASH_INDEX is enabled, also to search for them
 // also probably need to include the length in the string data, to allow null bytes in the string
 
 #if 0 // print debugging info
@@ -95,6 +95,18 @@ mp_uint_t qstr_compute_hash(const byte *data, size_t len) {
     return hash;
 }
 
+#if MICROPY_QSTR_HASH_INDEX
+// this must match the equivalent function in makeqstrdata.py
+// the low bits of this hash equal those computed by qstr_compute_hash
+STATIC uint32_t qstr_compute_index_hash(const byte *data, size_t len) {
+    uint32_t hash = 5381;
+    for (const byte *top = data + len; data < top; data++) {
+        hash = ((hash << 5) + hash) ^ (*data);
+    }
+    return hash;
+}
+#endif
+
 const qstr_pool_t mp_qstr_const_pool = {
     NULL,               // no previous pool
     0,                  // no previous pool
@@ -109,6 +121,19 @@ const qstr_pool_t mp_qstr_const_pool = {
     },
 };
 
+#if MICROPY_QSTR_HASH_INDEX && !defined(NO_QSTR)
+// Open-addressed hash index over mp_qstr_const_pool, generated by makeqstrdata.py.
+// Each slot holds a qstr id, with MP_QSTR_NULL marking an empty slot.
+STATIC const uint16_t mp_qstr_const_index[] = {
+#define QDEF(id, str)
+#define QINDEX(q) q,
+#include "genhdr/qstrdefs.generated.h"
+#undef QINDEX
+#undef QDEF
+};
+#define QSTR_CONST_INDEX_MASK (MP_ARRAY_SIZE(mp_qstr_const_index) - 1)
+#endif
+
 #ifdef MICROPY_QSTR_EXTRA_POOL
 extern const qstr_pool_t MICROPY_QSTR_EXTRA_POOL;
 #define CONST_POOL MICROPY_QSTR_EXTRA_POOL
@@ -120,6 +145,12 @@ void qstr_init(void) {
     MP_STATE_VM(last_pool) = (qstr_pool_t*)&CONST_POOL; // we won't modify the const_pool since it has no allocated room left
     MP_STATE_VM(qstr_last_chunk) = NULL;
 
+    #if MICROPY_QSTR_HASH_INDEX
+    MP_STATE_VM(qstr_index) = NULL;
+    MP_STATE_VM(qstr_index_alloc) = 0;
+    MP_STATE_VM(qstr_index_used) = 0;
+    #endif
+
     #if MICROPY_PY_THREAD
     mp_thread_mutex_init(&MP_STATE_VM(qstr_mutex));
     #endif
@@ -137,10 +168,62 @@ STATIC const byte *find_qstr(qstr q) {
     return 0;
 }
 
+#if MICROPY_QSTR_HASH_INDEX
+
+STATIC bool qstr_data_equal(const byte *qd, mp_uint_t hash, const char *str, size_t str_len) {
+    return Q_GET_HASH(qd) == hash && Q_GET_LENGTH(qd) == str_len && memcmp(Q_GET_DATA(qd), str, str_len) == 0;
+}
+
+// insert q into the dynamic index; there must be a free slot
+STATIC void qstr_index_insert(qstr *index, size_t alloc, qstr q, uint32_t index_hash) {
+    size_t pos = index_hash & (alloc - 1);
+    while (index[pos] != MP_QSTR_NULL) {
+        pos = (pos + 1) & (alloc - 1);
+    }
+    index[pos] = q;
+}
+
+// make room in the dynamic index for one more qstr
+// qstr_mutex must be taken while in this function
+STATIC void qstr_index_reserve(void) {
+    // keep the load factor of the dynamic index at or below 1/2
+    if (2 * (MP_STATE_VM(qstr_index_used) + 1) > MP_STATE_VM(qstr_index_alloc)) {
+        size_t new_alloc = MP_STATE_VM(qstr_index_alloc) == 0 ? MICROPY_ALLOC_QSTR_INDEX_INIT : MP_STATE_VM(qstr_index_alloc) * 2;
+        qstr *new_index = m_new_maybe(qstr, new_alloc);
+        if (new_index == NULL) {
+            QSTR_EXIT();
+            m_malloc_fail(new_alloc * sizeof(qstr));
+        }
+        memset(new_index, 0, new_alloc * sizeof(qstr));
+        qstr *old_index = MP_STATE_VM(qstr_index);
+        for (size_t i = 0; i < MP_STATE_VM(qstr_index_alloc); i++) {
+            if (old_index[i] != MP_QSTR_NULL) {
+                const byte *qd = find_qstr(old_index[i]);
+                qstr_index_insert(new_index, new_alloc, old_index[i], qstr_compute_index_hash(Q_GET_DATA(qd), Q_GET_LENGTH(qd)));
+            }
+        }
+        m_del(qstr, old_index, MP_STATE_VM(qstr_index_alloc));
+        MP_STATE_VM(qstr_index) = new_index;
+        MP_STATE_VM(qstr_index_alloc) = new_alloc;
+    }
+}
+
+STATIC void qstr_index_add(qstr q, const byte *q_ptr) {
+    qstr_index_insert(MP_STATE_VM(qstr_index), MP_STATE_VM(qstr_index_alloc), q, qstr_compute_index_hash(Q_GET_DATA(q_ptr), Q_GET_LENGTH(q_ptr)));
+    MP_STATE_VM(qstr_index_used) += 1;
+}
+
+#endif
+
 // qstr_mutex must be taken while in this function
 STATIC qstr qstr_add(const byte *q_ptr) {
     DEBUG_printf("QSTR: add hash=%d len=%d data=%.*s\n", Q_GET_HASH(q_ptr), Q_GET_LENGTH(q_ptr), Q_GET_LENGTH(q_ptr), Q_GET_DATA(q_ptr));
 
+    #if MICROPY_QSTR_HASH_INDEX
+    // do this first so that failing to grow the index leaves the pools untouched
+    qstr_index_reserve();
+    #endif
+
     // make sure we have room in the pool for a new qstr
     if (MP_STATE_VM(last_pool)->len >= MP_STATE_VM(last_pool)->alloc) {
         qstr_pool_t *pool = m_new_obj_var_maybe(qstr_pool_t, const char*, MP_STATE_VM(last_pool)->alloc * 2);
@@ -159,11 +242,73 @@ STATIC qstr qstr_add(const byte *q_ptr) {
     // add the new qstr
     MP_STATE_VM(last_pool)->qstrs[MP_STATE_VM(last_pool)->len++] = q_ptr;
 
-    // return id for the newly-added qstr
-    return MP_STATE_VM(last_pool)->total_prev_len + MP_STATE_VM(last_pool)->len - 1;
+    // id for the newly-added qstr
+    qstr q = MP_STATE_VM(last_pool)->total_prev_len + MP_STATE_VM(last_pool)->len - 1;
+
+    #if MICROPY_QSTR_HASH_INDEX
+    qstr_index_add(q, q_ptr);
+    #endif
+
+    return q;
 }
 
-qstr qstr_find_strn(const char *str, size_t str_len) {
+// The caller must hold the qstr lock, because interning a new qstr can
+// reallocate the index of the dynamically allocated pools.
+
+#if MICROPY_QSTR_HASH_INDEX
+
+STATIC qstr qstr_find_strn_locked(const char *str, size_t str_len) {
+    // work out hash of str; the qstr hash is the low bits of the index hash
+    uint32_t index_hash = qstr_compute_index_hash((const byte*)str, str_len);
+    mp_uint_t str_hash = index_hash & Q_HASH_MASK;
+    if (str_hash == 0) {
+        str_hash++;
+    }
+
+    #ifndef NO_QSTR
+    // search the index of the static pool
+    for (size_t pos = index_hash & QSTR_CONST_INDEX_MASK;; pos = (pos + 1) & QSTR_CONST_INDEX_MASK) {
+        qstr q = mp_qstr_const_index[pos];
+        if (q == MP_QSTR_NULL) {
+            break;
+        }
+        if (qstr_data_equal(mp_qstr_const_pool.qstrs[q], str_hash, str, str_len)) {
+            return q;
+        }
+    }
+    #endif
+
+    // search any extra const pools, which are not indexed
+    for (const qstr_pool_t *pool = &CONST_POOL; pool != &mp_qstr_const_pool; pool = pool->prev) {
+        for (const byte *const *q = pool->qstrs, *const *q_top = pool->qstrs + pool->len; q < q_top; q++) {
+            if (qstr_data_equal(*q, str_hash, str, str_len)) {
+                return pool->total_prev_len + (q - pool->qstrs);
+            }
+        }
+    }
+
+    // search the index of the dynamically allocated pools
+    size_t alloc = MP_STATE_VM(qstr_index_alloc);
+    if (alloc != 0) {
+        qstr *index = MP_STATE_VM(qstr_index);
+        for (size_t pos = index_hash & (alloc - 1);; pos = (pos + 1) & (alloc - 1)) {
+            qstr q = index[pos];
+            if (q == MP_QSTR_NULL) {
+                break;
+            }
+            if (qstr_data_equal(find_qstr(q), str_hash, str, str_len)) {
+                return q;
+            }
+        }
+    }
+
+    // not found; return null qstr
+    return 0;
+}
+
+#else
+
+STATIC qstr qstr_find_strn_locked(const char *str, size_t str_len) {
     // work out hash of str
     mp_uint_t str_hash = qstr_compute_hash((const byte*)str, str_len);
 
@@ -180,6 +325,15 @@ qstr qstr_find_strn(const char *str, size_t str_len) {
     return 0;
 }
 
+#endif
+
+qstr qstr_find_strn(const char *str, size_t str_len) {
+    QSTR_ENTER();
+    qstr q = qstr_find_strn_locked(str, str_len);
+    QSTR_EXIT();
+    return q;
+}
+
 qstr qstr_from_str(const char *str) {
     return qstr_from_strn(str, strlen(str));
 }
@@ -187,7 +341,7 @@ qstr qstr_from_str(const char *str) {
 qstr qstr_from_strn(const char *str, size_t len) {
     assert(len < (1 << (8 * MICROPY_QSTR_BYTES_IN_LEN)));
     QSTR_ENTER();
-    qstr q = qstr_find_strn(str, len);
+    qstr q = qstr_find_strn_locked(str, len);
     if (q == 0) {
         // qstr does not exist in interned pool so need to add it
 
@@ -252,7 +406,7 @@ byte *qstr_build_start(size_t len, byte **q_ptr) {
 
 qstr qstr_build_end(byte *q_ptr) {
     QSTR_ENTER();
-    qstr q = qstr_find_strn((const char*)Q_GET_DATA(q_ptr), Q_GET_LENGTH(q_ptr));
+    qstr q = qstr_find_strn_locked((const char*)Q_GET_DATA(q_ptr), Q_GET_LENGTH(q_ptr));
     if (q == 0) {
         size_t len = Q_GET_LENGTH(q_ptr);
         mp_uint_t hash = qstr_compute_hash(Q_GET_DATA(q_ptr), len);
@@ -37,12 +37,14 @@
 #include "py/objlist.h"
 #include "py/objmodule.h"
 #include "py/objgenerator.h"
+#include "py/objtype.h"
 #include "py/smallint.h"
 #include "py/runtime0.h"
 #include "py/runtime.h"
 #include "py/builtin.h"
 #include "py/stackctrl.h"
 #include "py/gc.h"
+#include "py/vmprofile.h"
 
 #if 0 // print debugging info
 #define DEBUG_PRINT (1)
@@ -89,6 +91,16 @@ void mp_init(void) {
     // optimization disabled by default
     MP_STATE_VM(mp_optimise_value) = 0;
 
+    #if MICROPY_COMP_BC_PEEPHOLE
+    MP_STATE_VM(mp_bc_peephole) = true;
+    #endif
+
+    #if MICROPY_TIERING
+    MP_STATE_VM(tier_threshold) = 0;
+    MP_STATE_VM(tier_promoted) = 0;
+    MP_STATE_VM(tier_rejected) = 0;
+    #endif
+
     // init global module dict
     mp_obj_dict_init(&MP_STATE_VM(mp_loaded_modules_dict), 3);
 
@@ -96,6 +108,31 @@ void mp_init(void) {
     mp_obj_dict_init(&MP_STATE_VM(dict_main), 1);
     mp_obj_dict_store(MP_OBJ_FROM_PTR(&MP_STATE_VM(dict_main)), MP_OBJ_NEW_QSTR(MP_QSTR___name__), MP_OBJ_NEW_QSTR(MP_QSTR___main__));
 
+    #if MICROPY_OPT_ATTR_INLINE_CACHE
+    // entries left from before a soft reset refer to freed classes
+    memset(MP_STATE_THREAD(attr_cache), 0, sizeof(MP_STATE_THREAD(attr_cache)));
+    #endif
+
+    #if MICROPY_OPT_LOAD_GLOBAL_CACHE
+    memset(MP_STATE_THREAD(global_cache), 0, sizeof(MP_STATE_THREAD(global_cache)));
+    #endif
+
+    #if MICROPY_OPT_KW_CALL_CACHE
+    memset(MP_STATE_THREAD(kw_cache), 0, sizeof(MP_STATE_THREAD(kw_cache)));
+    #endif
+
+    #if MICROPY_VM_PROFILE
+    // functions left from before a soft reset have been freed
+    memset(MP_STATE_VM(vm_profile_funs), 0, sizeof(MP_STATE_VM(vm_profile_funs)));
+    mp_vm_profile_init_thread();
+    #endif
+
+    #if MICROPY_VM_SAMPLING
+    MP_STATE_VM(vm_sample_stacks) = MP_OBJ_NULL;
+    MP_STATE_VM(vm_sample_pending) = false;
+    MP_STATE_THREAD(current_code_state) = NULL;
+    #endif
+
     // locals = globals for outer module (see Objects/frameobject.c/PyFrame_New())
     mp_locals_set(&MP_STATE_VM(dict_main));
     mp_globals_set(&MP_STATE_VM(dict_main));
@@ -116,6 +153,11 @@ void mp_init(void) {
     MP_STATE_VM(vfs_mount_table) = NULL;
     #endif
 
+    #if MICROPY_PY_URE && MICROPY_PY_URE_CACHE_SIZE
+    // start with no cached regexes
+    memset(MP_STATE_VM(ure_cache), 0, sizeof(MP_STATE_VM(ure_cache)));
+    #endif
+
     #if MICROPY_PY_THREAD_GIL
     mp_thread_mutex_init(&MP_STATE_VM(gil_mutex));
     #endif
@@ -146,9 +188,9 @@ mp_obj_t mp_load_name(qstr qst) {
     return mp_load_global(qst);
 }
 
-mp_obj_t mp_load_global(qstr qst) {
+// Returns the slot holding the global or builtin named qst, else raises.
+STATIC mp_map_elem_t *mp_load_global_elem(qstr qst) {
     // logic: search globals, builtins
-    DEBUG_OP_printf("load global %s\n", qstr_str(qst));
     mp_map_elem_t *elem = mp_map_lookup(&mp_globals_get()->map, MP_OBJ_NEW_QSTR(qst), MP_MAP_LOOKUP);
     if (elem == NULL) {
         #if MICROPY_CAN_OVERRIDE_BUILTINS
@@ -156,7 +198,7 @@ mp_obj_t mp_load_global(qstr qst) {
             // lookup in additional dynamic table of builtins first
             elem = mp_map_lookup(&MP_STATE_VM(mp_module_builtins_override_dict)->map, MP_OBJ_NEW_QSTR(qst), MP_MAP_LOOKUP);
             if (elem != NULL) {
-                return elem->value;
+                return elem;
             }
         }
         #endif
@@ -170,9 +212,110 @@ mp_obj_t mp_load_global(qstr qst) {
             }
         }
     }
+    return elem;
+}
+
+mp_obj_t mp_load_global(qstr qst) {
+    DEBUG_OP_printf("load global %s\n", qstr_str(qst));
+    return mp_load_global_elem(qst)->value;
+}
+
+#if MICROPY_OPT_LOAD_GLOBAL_CACHE
+// The global name cache holds the slot that a LOAD_GLOBAL or LOAD_NAME call
+// site found its name in, which may be in the globals, the builtins override
+// dict or the builtins table.  The value is always read from the slot, so
+// storing to an existing name needs no invalidation.  Adding or removing a key,
+// or growing the table, gives the map a new version, and the entry is only used
+// while the versions of the globals and the override dict are those recorded.
+
+STATIC size_t global_cache_builtins_version(void) {
+    #if MICROPY_CAN_OVERRIDE_BUILTINS
+    if (MP_STATE_VM(mp_module_builtins_override_dict) != NULL) {
+        return MP_STATE_VM(mp_module_builtins_override_dict)->map.version;
+    }
+    #endif
+    return 0;
+}
+
+mp_obj_t mp_load_global_cached(qstr qst, const byte *site) {
+    uintptr_t h = (uintptr_t)site;
+    mp_global_cache_entry_t *entry = &MP_STATE_THREAD(global_cache)[(h ^ (h >> 6)) & (MICROPY_OPT_LOAD_GLOBAL_CACHE_SIZE - 1)];
+    const mp_map_t *globals = &mp_globals_get()->map;
+    size_t builtins_version = global_cache_builtins_version();
+    if (entry->site == site && entry->qst == qst && entry->globals == globals && entry->version == globals->version
+        && entry->builtins_version == builtins_version) {
+        return entry->elem->value;
+    }
+    DEBUG_OP_printf("load global %s\n", qstr_str(qst));
+    mp_map_elem_t *elem = mp_load_global_elem(qst);
+    entry->site = site;
+    entry->qst = qst;
+    entry->globals = globals;
+    entry->version = globals->version;
+    entry->builtins_version = builtins_version;
+    entry->elem = elem;
     return elem->value;
 }
 
+mp_obj_t mp_load_name_cached(qstr qst, const byte *site) {
+    DEBUG_OP_printf("load name %s\n", qstr_str(qst));
+    if (mp_locals_get() != mp_globals_get()) {
+        mp_map_elem_t *elem = mp_map_lookup(&mp_locals_get()->map, MP_OBJ_NEW_QSTR(qst), MP_MAP_LOOKUP);
+        if (elem != NULL) {
+            return elem->value;
+        }
+    }
+    return mp_load_global_cached(qst, site);
+}
+#endif
+
+#if MICROPY_OPT_KW_CALL_CACHE
+// The keyword call cache maps a callee, the number of positional args and the
+// keyword names of a call, in order, to the slot of the callee that each
+// keyword arg goes to.  The keyword args are given as n_kw (name, value) pairs
+// at kw.  The entries are traced by
+// the GC, so a callee stays alive, and can't be replaced by another at the
+// same address, while it has an entry.
+
+STATIC mp_kw_cache_entry_t *kw_cache_entry(const void *callee, size_t n_args, size_t n_kw, const mp_obj_t *kw) {
+    uintptr_t h = (uintptr_t)callee + n_args;
+    for (size_t i = 0; i < n_kw; i++) {
+        h = h * 33 + (uintptr_t)kw[2 * i];
+    }
+    return &MP_STATE_THREAD(kw_cache)[(h ^ (h >> 7)) & (MICROPY_OPT_KW_CALL_CACHE_SIZE - 1)];
+}
+
+const uint8_t *mp_kw_cache_lookup(const void *callee, size_t n_args, size_t n_kw, const mp_obj_t *kw) {
+    if (n_args >= 0xff || n_kw > MICROPY_OPT_KW_CALL_CACHE_MAX_KW) {
+        return NULL;
+    }
+    mp_kw_cache_entry_t *entry = kw_cache_entry(callee, n_args, n_kw, kw);
+    if (entry->callee != callee || entry->n_args != n_args || entry->n_kw != n_kw) {
+        return NULL;
+    }
+    for (size_t i = 0; i < n_kw; i++) {
+        if (entry->names[i] != kw[2 * i]) {
+            return NULL;
+        }
+    }
+    return entry->slots;
+}
+
+void mp_kw_cache_store(const void *callee, size_t n_args, size_t n_kw, const mp_obj_t *kw, const uint8_t *slots) {
+    if (n_args >= 0xff || n_kw > MICROPY_OPT_KW_CALL_CACHE_MAX_KW) {
+        return;
+    }
+    mp_kw_cache_entry_t *entry = kw_cache_entry(callee, n_args, n_kw, kw);
+    entry->callee = callee;
+    entry->n_args = n_args;
+    entry->n_kw = n_kw;
+    for (size_t i = 0; i < n_kw; i++) {
+        entry->names[i] = kw[2 * i];
+        entry->slots[i] = slots[i];
+    }
+}
+#endif
+
 mp_obj_t mp_load_build_class(void) {
     DEBUG_OP_printf("load_build_class\n");
     #if MICROPY_CAN_OVERRIDE_BUILTINS
@@ -616,6 +759,19 @@ mp_obj_t mp_call_method_n_kw(size_t n_args, size_t n_kw, const mp_obj_t *args) {
     return mp_call_function_n_kw(args[0], n_args + adjust, n_kw, args + 2 - adjust);
 }
 
+// Allocate the array of args for mp_call_prepare_args_n_kw_var, on the C stack
+// in out_args if it is small enough.
+STATIC mp_obj_t *call_args_alloc(mp_call_args_t *out_args, size_t n) {
+    #if MICROPY_OPT_CALL_VAR_FORWARD
+    if (n <= MICROPY_OPT_CALL_VAR_STACK_ARGS) {
+        return out_args->stack_args;
+    }
+    #else
+    (void)out_args;
+    #endif
+    return m_new(mp_obj_t, n);
+}
+
 // This function only needs to be exposed externally when in stackless mode.
 #if !MICROPY_STACKLESS
 STATIC
@@ -648,6 +804,25 @@ void mp_call_prepare_args_n_kw_var(bool have_self, size_t n_args_n_kw, const mp_
         kw_dict_len = mp_obj_dict_len(kw_dict);
     }
 
+    #if MICROPY_OPT_CALL_VAR_FORWARD
+    // A tuple that is all of the args, as in f(*args) or f(*args, **{}), is
+    // passed as it is: its items can't change while the call is in progress,
+    // and the caller keeps a reference to it for that long.
+    if (self == MP_OBJ_NULL && n_args == 0 && n_kw == 0 && kw_dict_len == 0
+        && (kw_dict == MP_OBJ_NULL || MP_OBJ_IS_TYPE(kw_dict, &mp_type_dict))
+        && pos_seq != MP_OBJ_NULL && MP_OBJ_IS_TYPE(pos_seq, &mp_type_tuple)) {
+        size_t len;
+        mp_obj_t *items;
+        mp_obj_tuple_get(pos_seq, &len, &items);
+        out_args->fun = fun;
+        out_args->args = items;
+        out_args->n_args = len;
+        out_args->n_kw = 0;
+        out_args->n_alloc = 0;
+        return;
+    }
+    #endif
+
     // Extract the pos_seq sequence to the new args array.
     // Note that it can be arbitrary iterator.
     if (pos_seq == MP_OBJ_NULL) {
@@ -655,7 +830,7 @@ void mp_call_prepare_args_n_kw_var(bool have_self, size_t n_args_n_kw, const mp_
 
         // allocate memory for the new array of args
         args2_alloc = 1 + n_args + 2 * (n_kw + kw_dict_len);
-        args2 = m_new(mp_obj_t, args2_alloc);
+        args2 = call_args_alloc(out_args, args2_alloc);
 
         // copy the self
         if (self != MP_OBJ_NULL) {
@@ -676,7 +851,7 @@ void mp_call_prepare_args_n_kw_var(bool have_self, size_t n_args_n_kw, const mp_
 
         // allocate memory for the new array of args
         args2_alloc = 1 + n_args + len + 2 * (n_kw + kw_dict_len);
-        args2 = m_new(mp_obj_t, args2_alloc);
+        args2 = call_args_alloc(out_args, args2_alloc);
 
         // copy the self
         if (self != MP_OBJ_NULL) {
@@ -747,6 +922,15 @@ void mp_call_prepare_args_n_kw_var(bool have_self, size_t n_args_n_kw, const mp_
         // - call keys() to get an iterable of all keys in the mapping
         // - call __getitem__ for each key to get the corresponding value
 
+        #if MICROPY_OPT_CALL_VAR_FORWARD
+        // the args array may need to grow, so it must be on the heap
+        if (args2 == out_args->stack_args) {
+            args2_alloc = MICROPY_OPT_CALL_VAR_STACK_ARGS;
+            args2 = m_new(mp_obj_t, args2_alloc);
+            mp_seq_copy(args2, out_args->stack_args, args2_len, mp_obj_t);
+        }
+        #endif
+
         // get the keys iterable
         mp_obj_t dest[3];
         mp_load_method(kw_dict, MP_QSTR_keys, dest);
@@ -785,6 +969,11 @@ void mp_call_prepare_args_n_kw_var(bool have_self, size_t n_args_n_kw, const mp_
     out_args->n_args = pos_args_len;
     out_args->n_kw = (args2_len - pos_args_len) / 2;
     out_args->n_alloc = args2_alloc;
+    #if MICROPY_OPT_CALL_VAR_FORWARD
+    if (args2 == out_args->stack_args) {
+        out_args->n_alloc = 0;
+    }
+    #endif
 }
 
 mp_obj_t mp_call_method_n_kw_var(bool have_self, size_t n_args_n_kw, const mp_obj_t *args) {
@@ -792,7 +981,9 @@ mp_obj_t mp_call_method_n_kw_var(bool have_self, size_t n_args_n_kw, const mp_ob
     mp_call_prepare_args_n_kw_var(have_self, n_args_n_kw, args, &out_args);
 
     mp_obj_t res = mp_call_function_n_kw(out_args.fun, out_args.n_args, out_args.n_kw, out_args.args);
-    m_del(mp_obj_t, out_args.args, out_args.n_alloc);
+    if (out_args.n_alloc != 0) {
+        m_del(mp_obj_t, out_args.args, out_args.n_alloc);
+    }
 
     return res;
 }
@@ -1071,6 +1262,116 @@ void mp_load_method(mp_obj_t base, qstr attr, mp_obj_t *dest) {
     }
 }
 
+#if MICROPY_OPT_ATTR_INLINE_CACHE
+// The attribute inline cache holds the results of attribute lookups that are
+// found in the dict of a class or native type, for the LOAD_ATTR and
+// LOAD_METHOD opcodes.  Each call site uses the entry selected by its address.
+// The entries are valid while attr_cache_epoch doesn't change: a class dict
+// can't change without a new epoch, so neither can the member found, and the
+// type that a key points to can't be freed and replaced by a new class.
+
+STATIC mp_attr_cache_entry_t *attr_cache_entry(const byte *site) {
+    uintptr_t h = (uintptr_t)site;
+    return &MP_STATE_THREAD(attr_cache)[(h ^ (h >> 6)) & (MICROPY_OPT_ATTR_INLINE_CACHE_SIZE - 1)];
+}
+
+STATIC bool attr_cache_load(mp_attr_cache_entry_t *entry, mp_obj_t base, qstr attr, mp_obj_t *dest) {
+    mp_obj_type_t *type = mp_obj_get_type(base);
+    bool is_type = type == &mp_type_type;
+    if (entry->key != (is_type ? MP_OBJ_TO_PTR(base) : type) || entry->attr != attr
+        || entry->is_type != is_type || entry->epoch != MP_STATE_VM(attr_cache_epoch)) {
+        return false;
+    }
+    if (type->attr == mp_obj_instance_attr) {
+        // a member of the instance hides the class attribute
+        mp_obj_instance_t *self = MP_OBJ_TO_PTR(base);
+        mp_map_elem_t *elem = mp_map_lookup(&self->members, MP_OBJ_NEW_QSTR(attr), MP_MAP_LOOKUP);
+        if (elem != NULL) {
+            dest[0] = elem->value;
+            dest[1] = MP_OBJ_NULL;
+            return true;
+        }
+    }
+    dest[0] = entry->value;
+    dest[1] = entry->self == MP_OBJ_SENTINEL ? base : entry->self;
+    return true;
+}
+
+// Store the result of a lookup in the cache, if it came from a class dict and
+// so doesn't depend on anything but the type.
+STATIC void attr_cache_store(mp_attr_cache_entry_t *entry, mp_obj_t base, qstr attr, const mp_obj_t *dest) {
+    // these names are special-cased before or instead of the class lookup
+    if (attr == MP_QSTR___class__ || attr == MP_QSTR___next__ || attr == MP_QSTR___dict__ || attr == MP_QSTR___name__) {
+        return;
+    }
+    mp_obj_type_t *type = mp_obj_get_type(base);
+    bool is_type = type == &mp_type_type;
+    mp_obj_t member;
+    if (is_type) {
+        member = mp_obj_class_lookup_member(MP_OBJ_TO_PTR(base), attr, true);
+    } else if (type->attr == mp_obj_instance_attr) {
+        mp_obj_instance_t *self = MP_OBJ_TO_PTR(base);
+        if (mp_map_lookup(&self->members, MP_OBJ_NEW_QSTR(attr), MP_MAP_LOOKUP) != NULL) {
+            return;
+        }
+        member = mp_obj_class_lookup_member(type, attr, false);
+    } else if (type->attr == NULL && type->locals_dict != NULL) {
+        mp_map_elem_t *elem = mp_map_lookup(&type->locals_dict->map, MP_OBJ_NEW_QSTR(attr), MP_MAP_LOOKUP);
+        member = elem != NULL ? elem->value : MP_OBJ_NULL;
+    } else {
+        return;
+    }
+    if (member == MP_OBJ_NULL || member == MP_OBJ_SENTINEL) {
+        return;
+    }
+    #if MICROPY_PY_BUILTINS_PROPERTY
+    if (MP_OBJ_IS_TYPE(member, &mp_type_property)) {
+        // the getter is called on each load
+        return;
+    }
+    #endif
+    #if MICROPY_PY_DESCRIPTORS
+    if (mp_obj_is_instance_type(mp_obj_get_type(member))) {
+        // it may have a __get__ method, which is called on each load
+        return;
+    }
+    #endif
+    if (dest[0] != member && !MP_OBJ_IS_TYPE(member, &mp_type_staticmethod)
+        && !MP_OBJ_IS_TYPE(member, &mp_type_classmethod)) {
+        // the member was wrapped in a new object
+        return;
+    }
+    entry->key = is_type ? MP_OBJ_TO_PTR(base) : type;
+    entry->epoch = MP_STATE_VM(attr_cache_epoch);
+    entry->attr = attr;
+    entry->value = dest[0];
+    entry->self = dest[1] == base ? MP_OBJ_SENTINEL : dest[1];
+    entry->is_type = is_type;
+}
+
+mp_obj_t mp_load_attr_cached(mp_obj_t base, qstr attr, const byte *site) {
+    mp_attr_cache_entry_t *entry = attr_cache_entry(site);
+    mp_obj_t dest[2];
+    if (!attr_cache_load(entry, base, attr, dest)) {
+        mp_load_method(base, attr, dest);
+        attr_cache_store(entry, base, attr, dest);
+    }
+    if (dest[1] == MP_OBJ_NULL) {
+        return dest[0];
+    } else {
+        return mp_obj_new_bound_meth(dest[0], dest[1]);
+    }
+}
+
+void mp_load_method_cached(mp_obj_t base, qstr attr, mp_obj_t *dest, const byte *site) {
+    mp_attr_cache_entry_t *entry = attr_cache_entry(site);
+    if (!attr_cache_load(entry, base, attr, dest)) {
+        mp_load_method(base, attr, dest);
+        attr_cache_store(entry, base, attr, dest);
+    }
+}
+#endif
+
 void mp_store_attr(mp_obj_t base, qstr attr, mp_obj_t value) {
     DEBUG_OP_printf("store attr %p.%s <- %p\n", base, qstr_str(attr), value);
     mp_obj_type_t *type = mp_obj_get_type(base);
@@ -90,6 +90,14 @@ static inline void mp_globals_set(mp_obj_dict_t *d) { MP_STATE_THREAD(dict_globa
 
 mp_obj_t mp_load_name(qstr qst);
 mp_obj_t mp_load_global(qstr qst);
+#if MICROPY_OPT_LOAD_GLOBAL_CACHE
+mp_obj_t mp_load_global_cached(qstr qst, const byte *site);
+mp_obj_t mp_load_name_cached(qstr qst, const byte *site);
+#endif
+#if MICROPY_OPT_KW_CALL_CACHE
+const uint8_t *mp_kw_cache_lookup(const void *callee, size_t n_args, size_t n_kw, const mp_obj_t *kw);
+void mp_kw_cache_store(const void *callee, size_t n_args, size_t n_kw, const mp_obj_t *kw, const uint8_t *slots);
+#endif
 mp_obj_t mp_load_build_class(void);
 void mp_store_name(qstr qst, mp_obj_t obj);
 void mp_store_global(qstr qst, mp_obj_t obj);
@@ -112,8 +120,11 @@ void mp_call_function_2_protected(mp_obj_t fun, mp_obj_t arg1, mp_obj_t arg2);
 
 typedef struct _mp_call_args_t {
     mp_obj_t fun;
-    size_t n_args, n_kw, n_alloc;
+    size_t n_args, n_kw, n_alloc; // n_alloc is 0 if args is not on the heap
     mp_obj_t *args;
+    #if MICROPY_OPT_CALL_VAR_FORWARD
+    mp_obj_t stack_args[MICROPY_OPT_CALL_VAR_STACK_ARGS];
+    #endif
 } mp_call_args_t;
 
 #if MICROPY_STACKLESS
@@ -131,6 +142,10 @@ mp_obj_t mp_load_attr(mp_obj_t base, qstr attr);
 void mp_convert_member_lookup(mp_obj_t obj, const mp_obj_type_t *type, mp_obj_t member, mp_obj_t *dest);
 void mp_load_method(mp_obj_t base, qstr attr, mp_obj_t *dest);
 void mp_load_method_maybe(mp_obj_t base, qstr attr, mp_obj_t *dest);
+#if MICROPY_OPT_ATTR_INLINE_CACHE
+mp_obj_t mp_load_attr_cached(mp_obj_t base, qstr attr, const byte *site);
+void mp_load_method_cached(mp_obj_t base, qstr attr, mp_obj_t *dest, const byte *site);
+#endif
 void mp_store_attr(mp_obj_t base, qstr attr, mp_obj_t val);
 
 mp_obj_t mp_getiter(mp_obj_t o, mp_obj_iter_buf_t *iter_buf);
@@ -305,6 +305,21 @@ const byte *mp_bytecode_print_str(const byte *ip) {
             printf("DELETE_GLOBAL %s", qstr_str(qst));
             break;
 
+        case MP_BC_LOAD_FAST_LOAD_FAST:
+            unum = *ip++;
+            printf("LOAD_FAST_LOAD_FAST " UINT_FMT " " UINT_FMT, unum & 0x0f, unum >> 4);
+            break;
+
+        case MP_BC_STORE_FAST_LOAD_FAST:
+            unum = *ip++;
+            printf("STORE_FAST_LOAD_FAST " UINT_FMT " " UINT_FMT, unum & 0x0f, unum >> 4);
+            break;
+
+        case MP_BC_LOAD_FAST_LOAD_CONST_SMALL_INT:
+            unum = *ip++;
+            printf("LOAD_FAST_LOAD_CONST_SMALL_INT " UINT_FMT " " UINT_FMT, unum & 0x0f, unum >> 4);
+            break;
+
         case MP_BC_DUP_TOP:
             printf("DUP_TOP");
             break;
@@ -0,0 +1,797 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Damien P. George
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "py/emit.h"
+#include "py/emitglue.h"
+#include "py/bc0.h"
+#include "py/bc.h"
+#include "py/runtime.h"
+#include "py/gc.h"
+#include "py/tier.h"
+
+#if MICROPY_TIERING
+
+// A hot function is promoted by translating its bytecode, which is all that
+// is kept of it after compilation, into calls to the native emitter.  The
+// translation is only done for code that the native emitter handles the same
+// way as the VM: there must be no exception handlers or generator code, and
+// every local that is loaded must be bound on all paths to the load, because
+// native code doesn't check for unbound locals.  Anything else leaves the
+// function as bytecode.
+
+#if MICROPY_EMIT_X64
+#define NATIVE_EMITTER(f) emit_native_x64_##f
+#elif MICROPY_EMIT_X86
+#define NATIVE_EMITTER(f) emit_native_x86_##f
+#elif MICROPY_EMIT_THUMB
+#define NATIVE_EMITTER(f) emit_native_thumb_##f
+#elif MICROPY_EMIT_ARM
+#define NATIVE_EMITTER(f) emit_native_arm_##f
+#elif MICROPY_EMIT_XTENSA
+#define NATIVE_EMITTER(f) emit_native_xtensa_##f
+#else
+#error MICROPY_TIERING requires a native emitter
+#endif
+
+// the emitter is only called when emitting, not when analysing the code, so
+// the arguments mustn't have side effects
+#define EMIT(fun) (t->emit == NULL ? (void)0 : t->emit_method_table->fun(t->emit))
+#define EMIT_ARG(fun, ...) (t->emit == NULL ? (void)0 : t->emit_method_table->fun(t->emit, __VA_ARGS__))
+
+#define BOUND_BITS (sizeof(mp_uint_t) * 8)
+
+// result of translating an opcode
+enum {
+    TIER_OP_NEXT,       // execution continues with the next opcode
+    TIER_OP_END,        // execution doesn't reach the next opcode
+    TIER_OP_FAIL,       // the opcode can't be translated
+};
+
+// A jump target, with the state on entry to it: the depth of the stack, and
+// the set of locals that are bound on every path to it
+typedef struct _tier_label_t {
+    size_t offset;
+    mp_int_t depth;
+    mp_uint_t *bound;
+} tier_label_t;
+
+typedef struct _tier_t {
+    const byte *code;               // the bytecode proper, after the prelude
+    const byte *cells;              // locals converted to cells, 255 terminated
+    const mp_uint_t *const_table;
+    size_t n_state;
+    size_t n_words;                 // number of words in a set of bound locals
+    size_t n_args;                  // the locals that are bound on entry
+    size_t n_locals;                // highest local used, plus 1
+    mp_int_t max_depth;
+    size_t n_label;
+    size_t alloc_label;
+    size_t next_label;              // index of the next label in the walk
+    tier_label_t *label;            // sorted by offset
+    bool changed;                   // a label was added or its state narrowed
+    mp_int_t depth;                 // the state at the current opcode
+    mp_uint_t *bound;
+    scope_t child;                  // for passing raw code of nested functions
+    emit_t *emit;                   // NULL while analysing
+    const emit_method_table_t *emit_method_table;
+} tier_t;
+
+STATIC void tier_push(tier_t *t, mp_int_t n) {
+    t->depth += n;
+    if (t->depth > t->max_depth) {
+        t->max_depth = t->depth;
+    }
+}
+
+STATIC bool tier_is_cell(tier_t *t, size_t local_num) {
+    for (const byte *c = t->cells; *c != 255; c++) {
+        if (*c == local_num) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Returns the index of the label at offset, after merging the current state
+// into it, or -1 if the stack depth there doesn't match.  While analysing,
+// the label is added if it's not known yet.
+STATIC mp_int_t tier_edge(tier_t *t, size_t offset, mp_int_t depth) {
+    size_t lo = 0;
+    size_t hi = t->n_label;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (t->label[mid].offset < offset) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    tier_label_t *l = &t->label[lo];
+    if (lo < t->n_label && l->offset == offset) {
+        if (l->depth != depth) {
+            return -1;
+        }
+        for (size_t i = 0; i < t->n_words; i++) {
+            mp_uint_t bound = l->bound[i] & t->bound[i];
+            if (bound != l->bound[i]) {
+                l->bound[i] = bound;
+                t->changed = true;
+            }
+        }
+        return lo;
+    }
+    assert(t->emit == NULL);
+    mp_uint_t *bound = m_new(mp_uint_t, t->n_words);
+    memcpy(bound, t->bound, t->n_words * sizeof(mp_uint_t));
+    if (t->n_label == t->alloc_label) {
+        t->label = m_renew(tier_label_t, t->label, t->alloc_label, t->alloc_label + 8);
+        t->alloc_label += 8;
+    }
+    l = &t->label[lo];
+    memmove(l + 1, l, (t->n_label - lo) * sizeof(tier_label_t));
+    t->n_label += 1;
+    if (lo < t->next_label) {
+        t->next_label += 1;
+    }
+    l->offset = offset;
+    l->depth = depth;
+    l->bound = bound;
+    t->changed = true;
+    return lo;
+}
+
+STATIC bool tier_load_fast(tier_t *t, size_t local_num) {
+    if (local_num >= t->n_state || !(t->bound[local_num / BOUND_BITS] & ((mp_uint_t)1 << (local_num % BOUND_BITS)))) {
+        return false;
+    }
+    EMIT_ARG(load_id.fast, MP_QSTR_, local_num);
+    tier_push(t, 1);
+    return true;
+}
+
+STATIC bool tier_store(tier_t *t, size_t local_num, bool deref) {
+    if (local_num >= t->n_state) {
+        return false;
+    }
+    if (local_num >= t->n_locals) {
+        t->n_locals = local_num + 1;
+    }
+    t->bound[local_num / BOUND_BITS] |= (mp_uint_t)1 << (local_num % BOUND_BITS);
+    if (deref) {
+        EMIT_ARG(store_id.deref, MP_QSTR_, local_num);
+    } else {
+        EMIT_ARG(store_id.fast, MP_QSTR_, local_num);
+    }
+    t->depth -= 1;
+    return true;
+}
+
+STATIC qstr tier_decode_qstr(const byte **ip) {
+    #if MICROPY_PERSISTENT_CODE
+    qstr qst = (*ip)[0] | (*ip)[1] << 8;
+    *ip += 2;
+    return qst;
+    #else
+    return mp_decode_uint(ip);
+    #endif
+}
+
+STATIC mp_uint_t tier_decode_ptr(tier_t *t, const byte **ip) {
+    #if MICROPY_PERSISTENT_CODE
+    return t->const_table[mp_decode_uint(ip)];
+    #else
+    (void)t;
+    *ip = (const byte*)MP_ALIGN(*ip, sizeof(void*));
+    mp_uint_t ptr = *(const mp_uint_t*)*ip;
+    *ip += sizeof(void*);
+    return ptr;
+    #endif
+}
+
+STATIC mp_int_t tier_decode_label(const byte **ip) {
+    mp_int_t lab = ((*ip)[0] | ((*ip)[1] << 8)) - 0x8000;
+    *ip += 2;
+    return lab;
+}
+
+// Checks, and translates if emitting, the opcode at *ip, advancing past it.
+STATIC int tier_op(tier_t *t, const byte **ip_in) {
+    const byte *ip = *ip_in;
+    byte op = *ip++;
+    #if MICROPY_OPT_QUICKEN
+    op = mp_bc_unquicken(op);
+    #endif
+    switch (op) {
+        case MP_BC_LOAD_CONST_FALSE:
+            EMIT_ARG(load_const_tok, MP_TOKEN_KW_FALSE);
+            tier_push(t, 1);
+            break;
+        case MP_BC_LOAD_CONST_NONE:
+            EMIT_ARG(load_const_tok, MP_TOKEN_KW_NONE);
+            tier_push(t, 1);
+            break;
+        case MP_BC_LOAD_CONST_TRUE:
+            EMIT_ARG(load_const_tok, MP_TOKEN_KW_TRUE);
+            tier_push(t, 1);
+            break;
+        case MP_BC_LOAD_CONST_SMALL_INT: {
+            mp_int_t num = 0;
+            if ((ip[0] & 0x40) != 0) {
+                num--;
+            }
+            do {
+                num = (num << 7) | (*ip & 0x7f);
+            } while ((*ip++ & 0x80) != 0);
+            EMIT_ARG(load_const_small_int, num);
+            tier_push(t, 1);
+            break;
+        }
+        case MP_BC_LOAD_CONST_STRING: {
+            qstr qst = tier_decode_qstr(&ip);
+            EMIT_ARG(load_const_str, qst);
+            tier_push(t, 1);
+            break;
+        }
+        case MP_BC_LOAD_CONST_OBJ: {
+            mp_obj_t obj = (mp_obj_t)tier_decode_ptr(t, &ip);
+            EMIT_ARG(load_const_obj, obj);
+            tier_push(t, 1);
+            break;
+        }
+        case MP_BC_LOAD_NULL:
+            EMIT(load_null);
+            tier_push(t, 1);
+            break;
+        case MP_BC_LOAD_FAST_N:
+            if (!tier_load_fast(t, mp_decode_uint(&ip))) {
+                return TIER_OP_FAIL;
+            }
+            break;
+        case MP_BC_LOAD_NAME:
+        case MP_BC_LOAD_GLOBAL: {
+            qstr qst = tier_decode_qstr(&ip);
+            #if MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE
+            ip++;
+            #endif
+            if (op == MP_BC_LOAD_NAME) {
+                EMIT_ARG(load_id.name, qst);
+            } else {
+                EMIT_ARG(load_id.global, qst);
+            }
+            tier_push(t, 1);
+            break;
+        }
+        case MP_BC_LOAD_ATTR: {
+            qstr qst = tier_decode_qstr(&ip);
+            #if MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE
+            ip++;
+            #endif
+            EMIT_ARG(load_attr, qst);
+            break;
+        }
+        case MP_BC_LOAD_METHOD: {
+            qstr qst = tier_decode_qstr(&ip);
+            EMIT_ARG(load_method, qst);
+            tier_push(t, 1);
+            break;
+        }
+        case MP_BC_LOAD_BUILD_CLASS:
+            EMIT(load_build_class);
+            tier_push(t, 1);
+            break;
+        case MP_BC_LOAD_SUBSCR:
+            EMIT(load_subscr);
+            t->depth -= 1;
+            break;
+        case MP_BC_STORE_FAST_N:
+            if (!tier_store(t, mp_decode_uint(&ip), false)) {
+                return TIER_OP_FAIL;
+            }
+            break;
+        case MP_BC_STORE_DEREF:
+            if (!tier_store(t, mp_decode_uint(&ip), true)) {
+                return TIER_OP_FAIL;
+            }
+            break;
+        case MP_BC_STORE_NAME: {
+            qstr qst = tier_decode_qstr(&ip);
+            EMIT_ARG(store_id.name, qst);
+            t->depth -= 1;
+            break;
+        }
+        case MP_BC_STORE_GLOBAL: {
+            qstr qst = tier_decode_qstr(&ip);
+            EMIT_ARG(store_id.global, qst);
+            t->depth -= 1;
+            break;
+        }
+        case MP_BC_STORE_ATTR: {
+            qstr qst = tier_decode_qstr(&ip);
+            #if MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE
+            ip++;
+            #endif
+            EMIT_ARG(store_attr, qst);
+            t->depth -= 2;
+            break;
+        }
+        case MP_BC_STORE_SUBSCR:
+            EMIT(store_subscr);
+            t->depth -= 3;
+            break;
+        case MP_BC_DELETE_NAME: {
+            qstr qst = tier_decode_qstr(&ip);
+            EMIT_ARG(delete_id.name, qst);
+            break;
+        }
+        case MP_BC_DELETE_GLOBAL: {
+            qstr qst = tier_decode_qstr(&ip);
+            EMIT_ARG(delete_id.global, qst);
+            break;
+        }
+        case MP_BC_LOAD_FAST_LOAD_FAST:
+            if (!tier_load_fast(t, ip[0] & 0xf) || !tier_load_fast(t, ip[0] >> 4)) {
+                return TIER_OP_FAIL;
+            }
+            ip++;
+            break;
+        case MP_BC_STORE_FAST_LOAD_FAST:
+            if (!tier_store(t, ip[0] & 0xf, false) || !tier_load_fast(t, ip[0] >> 4)) {
+                return TIER_OP_FAIL;
+            }
+            ip++;
+            break;
+        case MP_BC_LOAD_FAST_LOAD_CONST_SMALL_INT:
+            if (!tier_load_fast(t, ip[0] & 0xf)) {
+                return TIER_OP_FAIL;
+            }
+            EMIT_ARG(load_const_small_int, ip[0] >> 4);
+            tier_push(t, 1);
+            ip++;
+            break;
+        case MP_BC_DUP_TOP:
+            EMIT(dup_top);
+            tier_push(t, 1);
+            break;
+        case MP_BC_DUP_TOP_TWO:
+            EMIT(dup_top_two);
+            tier_push(t, 2);
+            break;
+        case MP_BC_POP_TOP:
+            EMIT(pop_top);
+            t->depth -= 1;
+            break;
+        case MP_BC_ROT_TWO:
+            EMIT(rot_two);
+            break;
+        case MP_BC_ROT_THREE:
+            EMIT(rot_three);
+            break;
+        case MP_BC_JUMP:
+        case MP_BC_POP_JUMP_IF_TRUE:
+        case MP_BC_POP_JUMP_IF_FALSE:
+        case MP_BC_JUMP_IF_TRUE_OR_POP:
+        case MP_BC_JUMP_IF_FALSE_OR_POP: {
+            mp_int_t lab = tier_decode_label(&ip);
+            if (op == MP_BC_POP_JUMP_IF_TRUE || op == MP_BC_POP_JUMP_IF_FALSE) {
+                t->depth -= 1;
+            }
+            mp_int_t l = tier_edge(t, ip + lab - t->code, t->depth);
+            if (l < 0) {
+                return TIER_OP_FAIL;
+            }
+            if (op == MP_BC_JUMP) {
+                EMIT_ARG(jump, l);
+                *ip_in = ip;
+                return TIER_OP_END;
+            } else if (op == MP_BC_POP_JUMP_IF_TRUE || op == MP_BC_POP_JUMP_IF_FALSE) {
+                EMIT_ARG(pop_jump_if, op == MP_BC_POP_JUMP_IF_TRUE, l);
+            } else {
+                EMIT_ARG(jump_if_or_pop, op == MP_BC_JUMP_IF_TRUE_OR_POP, l);
+                t->depth -= 1;
+            }
+            break;
+        }
+        case MP_BC_GET_ITER:
+            EMIT_ARG(get_iter, false);
+            break;
+        case MP_BC_GET_ITER_STACK:
+            EMIT_ARG(get_iter, true);
+            tier_push(t, MP_OBJ_ITER_BUF_NSLOTS - 1);
+            break;
+        case MP_BC_FOR_ITER: {
+            size_t lab = ip[0] | (ip[1] << 8);
+            ip += 2;
+            mp_int_t l = tier_edge(t, ip + lab - t->code, t->depth - MP_OBJ_ITER_BUF_NSLOTS);
+            if (l < 0) {
+                return TIER_OP_FAIL;
+            }
+            EMIT_ARG(for_iter, l);
+            tier_push(t, 1);
+            break;
+        }
+        case MP_BC_BUILD_TUPLE:
+        case MP_BC_BUILD_LIST:
+        #if MICROPY_PY_BUILTINS_SET
+        case MP_BC_BUILD_SET:
+        #endif
+        #if MICROPY_PY_BUILTINS_SLICE
+        case MP_BC_BUILD_SLICE:
+        #endif
+        {
+            mp_uint_t n = mp_decode_uint(&ip);
+            if (op == MP_BC_BUILD_TUPLE) {
+                EMIT_ARG(build_tuple, n);
+            } else if (op == MP_BC_BUILD_LIST) {
+                EMIT_ARG(build_list, n);
+            #if MICROPY_PY_BUILTINS_SET
+            } else if (op == MP_BC_BUILD_SET) {
+                EMIT_ARG(build_set, n);
+            #endif
+            #if MICROPY_PY_BUILTINS_SLICE
+            } else {
+                EMIT_ARG(build_slice, n);
+            #endif
+            }
+            tier_push(t, 1 - (mp_int_t)n);
+            break;
+        }
+        case MP_BC_BUILD_MAP: {
+            mp_uint_t n = mp_decode_uint(&ip);
+            EMIT_ARG(build_map, n);
+            tier_push(t, 1);
+            break;
+        }
+        case MP_BC_STORE_MAP:
+            EMIT(store_map);
+            t->depth -= 2;
+            break;
+        case MP_BC_STORE_COMP: {
+            // the argument holds the kind of collection in the low 2 bits,
+            // and its position relative to the top before popping the item
+            mp_uint_t arg = mp_decode_uint(&ip);
+            if ((arg & 3) == 0) {
+                EMIT_ARG(store_comp, SCOPE_LIST_COMP, arg >> 2);
+                t->depth -= 1;
+            } else if (!MICROPY_PY_BUILTINS_SET || (arg & 3) == 1) {
+                EMIT_ARG(store_comp, SCOPE_DICT_COMP, (arg >> 2) - 1);
+                t->depth -= 2;
+            } else {
+                EMIT_ARG(store_comp, SCOPE_SET_COMP, arg >> 2);
+                t->depth -= 1;
+            }
+            break;
+        }
+        case MP_BC_UNPACK_SEQUENCE: {
+            mp_uint_t n = mp_decode_uint(&ip);
+            EMIT_ARG(unpack_sequence, n);
+            tier_push(t, (mp_int_t)n - 1);
+            break;
+        }
+        case MP_BC_UNPACK_EX: {
+            mp_uint_t arg = mp_decode_uint(&ip);
+            EMIT_ARG(unpack_ex, arg & 0xff, (arg >> 8) & 0xff);
+            tier_push(t, (arg & 0xff) + ((arg >> 8) & 0xff));
+            break;
+        }
+        case MP_BC_RETURN_VALUE:
+            EMIT(return_value);
+            t->depth -= 1;
+            *ip_in = ip;
+            return TIER_OP_END;
+        case MP_BC_RAISE_VARARGS:
+            // re-raising and exception chaining aren't supported natively
+            if (*ip++ != 1) {
+                return TIER_OP_FAIL;
+            }
+            EMIT_ARG(raise_varargs, 1);
+            t->depth -= 1;
+            *ip_in = ip;
+            return TIER_OP_END;
+        case MP_BC_MAKE_FUNCTION:
+        case MP_BC_MAKE_FUNCTION_DEFARGS:
+        case MP_BC_MAKE_CLOSURE:
+        case MP_BC_MAKE_CLOSURE_DEFARGS: {
+            // the emitter only needs the raw code of the nested function, and
+            // whether there are any defaults
+            t->child.raw_code = (mp_raw_code_t*)tier_decode_ptr(t, &ip);
+            mp_uint_t n_def = (op == MP_BC_MAKE_FUNCTION_DEFARGS || op == MP_BC_MAKE_CLOSURE_DEFARGS);
+            if (op == MP_BC_MAKE_FUNCTION || op == MP_BC_MAKE_FUNCTION_DEFARGS) {
+                EMIT_ARG(make_function, &t->child, n_def, 0);
+                tier_push(t, 1 - 2 * n_def);
+            } else {
+                mp_uint_t n_closed_over = *ip++;
+                EMIT_ARG(make_closure, &t->child, n_closed_over, n_def, 0);
+                tier_push(t, 1 - n_closed_over - 2 * n_def);
+            }
+            break;
+        }
+        case MP_BC_CALL_FUNCTION:
+        case MP_BC_CALL_FUNCTION_VAR_KW:
+        case MP_BC_CALL_METHOD:
+        case MP_BC_CALL_METHOD_VAR_KW: {
+            mp_uint_t arg = mp_decode_uint(&ip);
+            mp_uint_t n_pos = arg & 0xff;
+            mp_uint_t n_kw = (arg >> 8) & 0xff;
+            mp_uint_t star_flags = 0;
+            mp_int_t n_pop = n_pos + 2 * n_kw;
+            if (op == MP_BC_CALL_FUNCTION_VAR_KW || op == MP_BC_CALL_METHOD_VAR_KW) {
+                star_flags = MP_EMIT_STAR_FLAG_SINGLE | MP_EMIT_STAR_FLAG_DOUBLE;
+                n_pop += 2;
+            }
+            if (op == MP_BC_CALL_FUNCTION || op == MP_BC_CALL_FUNCTION_VAR_KW) {
+                EMIT_ARG(call_function, n_pos, n_kw, star_flags);
+            } else {
+                EMIT_ARG(call_method, n_pos, n_kw, star_flags);
+                n_pop += 1;
+            }
+            t->depth -= n_pop;
+            break;
+        }
+        case MP_BC_IMPORT_NAME: {
+            qstr qst = tier_decode_qstr(&ip);
+            EMIT_ARG(import_name, qst);
+            t->depth -= 1;
+            break;
+        }
+        case MP_BC_IMPORT_FROM: {
+            qstr qst = tier_decode_qstr(&ip);
+            EMIT_ARG(import_from, qst);
+            tier_push(t, 1);
+            break;
+        }
+        case MP_BC_IMPORT_STAR:
+            EMIT(import_star);
+            t->depth -= 1;
+            break;
+        default:
+            if (op >= MP_BC_LOAD_CONST_SMALL_INT_MULTI && op < MP_BC_LOAD_CONST_SMALL_INT_MULTI + 64) {
+                EMIT_ARG(load_const_small_int, (mp_int_t)op - MP_BC_LOAD_CONST_SMALL_INT_MULTI - 16);
+                tier_push(t, 1);
+            } else if (op >= MP_BC_LOAD_FAST_MULTI && op < MP_BC_LOAD_FAST_MULTI + 16) {
+                if (!tier_load_fast(t, op - MP_BC_LOAD_FAST_MULTI)) {
+                    return TIER_OP_FAIL;
+                }
+            } else if (op >= MP_BC_STORE_FAST_MULTI && op < MP_BC_STORE_FAST_MULTI + 16) {
+                if (!tier_store(t, op - MP_BC_STORE_FAST_MULTI, false)) {
+                    return TIER_OP_FAIL;
+                }
+            } else if (op >= MP_BC_UNARY_OP_MULTI && op < MP_BC_UNARY_OP_MULTI + 7) {
+                EMIT_ARG(unary_op, op - MP_BC_UNARY_OP_MULTI);
+            } else if (op >= MP_BC_BINARY_OP_MULTI && op < MP_BC_BINARY_OP_MULTI + 36) {
+                EMIT_ARG(binary_op, op - MP_BC_BINARY_OP_MULTI);
+                t->depth -= 1;
+            } else {
+                // the opcodes for exception handling, generators, deleting
+                // locals (which must then be checked on every load) and
+                // loading from cells (likewise)
+                return TIER_OP_FAIL;
+            }
+            break;
+    }
+    if (t->depth < 0) {
+        return TIER_OP_FAIL;
+    }
+    *ip_in = ip;
+    return TIER_OP_NEXT;
+}
+
+// Walks the code in order, visiting each opcode that is reachable from the
+// start or from a label found so far.  Returns false if it can't be translated.
+STATIC bool tier_walk(tier_t *t) {
+    const byte *ip = t->code;
+    bool live = true;
+    t->depth = 0;
+    memset(t->bound, 0, t->n_words * sizeof(mp_uint_t));
+    for (size_t i = 0; i < t->n_args; i++) {
+        t->bound[i / BOUND_BITS] |= (mp_uint_t)1 << (i % BOUND_BITS);
+    }
+    t->next_label = 0;
+    for (;;) {
+        size_t offset = ip - t->code;
+        if (t->next_label < t->n_label) {
+            tier_label_t *l = &t->label[t->next_label];
+            if (l->offset < offset) {
+                // a jump into the middle of an opcode
+                return false;
+            }
+            if (l->offset == offset) {
+                if (live) {
+                    if (tier_edge(t, offset, t->depth) < 0) {
+                        return false;
+                    }
+                } else {
+                    // the stack may be of any depth after code that doesn't
+                    // fall through, eg the iterator is popped after a for loop
+                    EMIT_ARG(adjust_stack_size, l->depth - t->depth);
+                }
+                t->depth = l->depth;
+                memcpy(t->bound, l->bound, t->n_words * sizeof(mp_uint_t));
+                EMIT_ARG(label_assign, t->next_label);
+                t->next_label += 1;
+                live = true;
+            }
+        }
+        if (!live) {
+            if (t->next_label == t->n_label) {
+                break;
+            }
+            ip = t->code + t->label[t->next_label].offset;
+            continue;
+        }
+        int ret = tier_op(t, &ip);
+        if (ret == TIER_OP_FAIL) {
+            return false;
+        }
+        live = ret == TIER_OP_NEXT;
+    }
+    if (t->depth != 0) {
+        EMIT_ARG(adjust_stack_size, -t->depth);
+    }
+    return true;
+}
+
+// Returns the native version of fun, or MP_OBJ_NULL if it can't be made.
+STATIC mp_obj_t tier_compile(tier_t *t, mp_obj_fun_bc_t *fun) {
+    scope_t scope;
+    memset(&scope, 0, sizeof(scope));
+    scope.kind = SCOPE_FUNCTION;
+
+    // decode the prelude
+    const byte *ip = fun->bytecode;
+    t->n_state = mp_decode_uint(&ip);
+    size_t n_exc_stack = mp_decode_uint(&ip);
+    scope.scope_flags = *ip++;
+    scope.num_pos_args = *ip++;
+    scope.num_kwonly_args = *ip++;
+    scope.num_def_pos_args = *ip++;
+    const byte *code_info = ip;
+    size_t code_info_size = mp_decode_uint(&ip);
+    #if MICROPY_PERSISTENT_CODE
+    scope.simple_name = ip[0] | (ip[1] << 8);
+    scope.source_file = ip[2] | (ip[3] << 8);
+    #else
+    scope.simple_name = mp_decode_uint(&ip);
+    scope.source_file = mp_decode_uint(&ip);
+    #endif
+    t->cells = code_info + code_info_size;
+    size_t n_cells = 0;
+    while (t->cells[n_cells] != 255) {
+        n_cells += 1;
+    }
+    t->code = t->cells + n_cells + 1;
+    t->const_table = fun->const_table;
+
+    if ((scope.scope_flags & MP_SCOPE_FLAG_GENERATOR) || n_exc_stack != 0) {
+        return MP_OBJ_NULL;
+    }
+
+    t->n_args = scope.num_pos_args + scope.num_kwonly_args;
+    size_t n_named_args = t->n_args;
+    if (scope.scope_flags & MP_SCOPE_FLAG_VARARGS) {
+        t->n_args += 1;
+    }
+    if (scope.scope_flags & MP_SCOPE_FLAG_VARKEYWORDS) {
+        t->n_args += 1;
+    }
+    t->n_locals = t->n_args;
+    t->n_words = (t->n_state + BOUND_BITS - 1) / BOUND_BITS;
+    t->bound = m_new(mp_uint_t, t->n_words);
+
+    // find the labels and the state at each, until they don't change
+    do {
+        t->changed = false;
+        if (!tier_walk(t)) {
+            return MP_OBJ_NULL;
+        }
+    } while (t->changed);
+
+    // the emitter takes the parameters and cells from the identifiers of the
+    // scope, and the names of the parameters are kept in the const table
+    scope.id_info_alloc = t->n_args + n_cells;
+    scope.id_info = m_new0(id_info_t, scope.id_info_alloc);
+    for (size_t i = 0; i < t->n_args; i++) {
+        id_info_t *id = &scope.id_info[scope.id_info_len++];
+        id->kind = tier_is_cell(t, i) ? ID_INFO_KIND_CELL : ID_INFO_KIND_LOCAL;
+        id->flags = ID_FLAG_IS_PARAM;
+        id->local_num = i;
+        id->qst = i < n_named_args ? MP_OBJ_QSTR_VALUE(t->const_table[i]) : MP_QSTR_;
+    }
+    for (size_t i = 0; i < n_cells; i++) {
+        if (t->cells[i] >= t->n_args) {
+            id_info_t *id = &scope.id_info[scope.id_info_len++];
+            id->kind = ID_INFO_KIND_CELL;
+            id->local_num = t->cells[i];
+            id->qst = MP_QSTR_;
+            if (t->cells[i] >= t->n_locals) {
+                t->n_locals = t->cells[i] + 1;
+            }
+        }
+    }
+    scope.num_locals = t->n_locals;
+    scope.stack_size = t->max_depth;
+    scope.raw_code = mp_emit_glue_new_raw_code();
+
+    mp_obj_t error = MP_OBJ_NULL;
+    t->emit = NATIVE_EMITTER(new)(&error, t->n_label);
+    t->emit_method_table = &NATIVE_EMITTER(method_table);
+    EMIT_ARG(set_native_type, MP_EMIT_NATIVE_TYPE_ENABLE, 0, 0);
+    for (int pass = MP_PASS_STACK_SIZE; pass <= MP_PASS_EMIT && error == MP_OBJ_NULL; pass++) {
+        EMIT_ARG(start_pass, pass, &scope);
+        tier_walk(t);
+        EMIT(end_pass);
+    }
+    NATIVE_EMITTER(free)(t->emit);
+    m_del(id_info_t, scope.id_info, scope.id_info_alloc);
+    if (error != MP_OBJ_NULL) {
+        return MP_OBJ_NULL;
+    }
+
+    size_t n_def_args = scope.num_def_pos_args;
+    mp_obj_t def_args = MP_OBJ_NULL;
+    if (n_def_args != 0) {
+        def_args = mp_obj_new_tuple(n_def_args, fun->extra_args);
+    }
+    mp_obj_t def_kw_args = MP_OBJ_NULL;
+    if (scope.scope_flags & MP_SCOPE_FLAG_DEFKWARGS) {
+        def_kw_args = fun->extra_args[n_def_args];
+    }
+    mp_obj_fun_bc_t *native = MP_OBJ_TO_PTR(mp_make_function_from_raw_code(scope.raw_code, def_args, def_kw_args));
+    native->globals = fun->globals;
+    return MP_OBJ_FROM_PTR(native);
+}
+
+// Called when fun is hot, to switch it to running as native code.  If it
+// can't be translated then it's marked so as not to be tried again.
+void mp_tier_promote(mp_obj_fun_bc_t *fun) {
+    // translation needs the heap
+    if (gc_is_locked()) {
+        return;
+    }
+    fun->tier_native = MP_OBJ_SENTINEL;
+    tier_t t;
+    memset(&t, 0, sizeof(t));
+    mp_obj_t native = MP_OBJ_NULL;
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        native = tier_compile(&t, fun);
+        nlr_pop();
+    }
+    for (size_t i = 0; i < t.n_label; i++) {
+        m_del(mp_uint_t, t.label[i].bound, t.n_words);
+    }
+    m_del(tier_label_t, t.label, t.alloc_label);
+    m_del(mp_uint_t, t.bound, t.n_words);
+    if (native == MP_OBJ_NULL) {
+        MP_STATE_VM(tier_rejected) += 1;
+    } else {
+        fun->tier_native = native;
+        MP_STATE_VM(tier_promoted) += 1;
+    }
+}
+
+#endif // MICROPY_TIERING
@@ -0,0 +1,50 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Damien P. George
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __MICROPY_INCLUDED_PY_TIER_H__
+#define __MICROPY_INCLUDED_PY_TIER_H__
+
+#include "py/mpstate.h"
+#include "py/objfun.h"
+
+#if MICROPY_TIERING
+
+void mp_tier_promote(mp_obj_fun_bc_t *fun);
+
+// Count a call to the given function, promoting it once it is hot.  Returns
+// true if the call should go to the native version of the function.
+static inline bool mp_tier_count_call(mp_obj_fun_bc_t *fun) {
+    if (fun->tier_native == MP_OBJ_NULL) {
+        fun->tier_count += 1;
+        if (MP_STATE_VM(tier_threshold) != 0 && fun->tier_count >= MP_STATE_VM(tier_threshold)) {
+            mp_tier_promote(fun);
+        }
+    }
+    return fun->tier_native != MP_OBJ_NULL && fun->tier_native != MP_OBJ_SENTINEL;
+}
+
+#endif // MICROPY_TIERING
+
+#endif // __MICROPY_INCLUDED_PY_TIER_H__
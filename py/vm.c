@@ -33,9 +33,17 @@
 #include "py/nlr.h"
 #include "py/emitglue.h"
 #include "py/objtype.h"
+#include "py/runtime0.h"
 #include "py/runtime.h"
 #include "py/bc0.h"
 #include "py/bc.h"
+#include "py/gc.h"
+#include "py/pystack.h"
+#include "py/smallint.h"
+#include "py/objstr.h"
+#include "py/vmprofile.h"
+#include "py/vmsample.h"
+#include "py/tier.h"
 
 #if 0
 #define TRACE(ip) printf("sp=%d ", (int)(sp - &code_state->state[0] + 1)); mp_bytecode_print2(ip, 1, code_state->fun_bc->const_table);
@@ -43,6 +51,32 @@
 #define TRACE(ip)
 #endif
 
+#if MICROPY_VM_PROFILE
+#define VM_PROFILE_OP(ip) mp_vm_profile_op(*(ip))
+#else
+#define VM_PROFILE_OP(ip)
+#endif
+
+// While sampling, keep MP_STATE_THREAD(current_code_state) pointing to the
+// running code state, for the profiler to walk the call stack from.  This is
+// only done while sampling because getting the thread state can be costly.
+#if MICROPY_VM_SAMPLING
+#define VM_SAMPLING_ENTER() do { \
+    if (MP_STATE_VM(vm_sample_stacks) != MP_OBJ_NULL) { \
+        code_state->prev_state = MP_STATE_THREAD(current_code_state); \
+        MP_STATE_THREAD(current_code_state) = code_state; \
+    } \
+} while (0)
+#define VM_SAMPLING_EXIT() do { \
+    if (MP_STATE_VM(vm_sample_stacks) != MP_OBJ_NULL) { \
+        MP_STATE_THREAD(current_code_state) = code_state->prev_state; \
+    } \
+} while (0)
+#else
+#define VM_SAMPLING_ENTER()
+#define VM_SAMPLING_EXIT()
+#endif
+
 // Value stack grows up (this makes it incompatible with native C stack, but
 // makes sure that arguments to functions are in natural order arg1..argN
 // (Python semantics mandates left-to-right evaluation order, including for
@@ -58,6 +92,111 @@ typedef enum {
     UNWIND_JUMP,
 } mp_unwind_reason_t;
 
+#if MICROPY_OPT_QUICKEN
+#if !MICROPY_OPT_COMPUTED_GOTO || !MICROPY_ENABLE_GC
+#error MICROPY_OPT_QUICKEN requires MICROPY_OPT_COMPUTED_GOTO and MICROPY_ENABLE_GC
+#endif
+
+// The binary ops with a specialised form for each kind of operand; the
+// specialised opcode is the base opcode for the kind plus the index here.
+STATIC const byte quick_small_int_ops[11] = {
+    MP_BINARY_OP_ADD, MP_BINARY_OP_SUBTRACT, MP_BINARY_OP_MULTIPLY,
+    MP_BINARY_OP_INPLACE_ADD, MP_BINARY_OP_INPLACE_SUBTRACT,
+    MP_BINARY_OP_LESS, MP_BINARY_OP_MORE, MP_BINARY_OP_EQUAL,
+    MP_BINARY_OP_LESS_EQUAL, MP_BINARY_OP_MORE_EQUAL, MP_BINARY_OP_NOT_EQUAL,
+};
+STATIC const byte quick_str_ops[2] = {
+    MP_BINARY_OP_ADD, MP_BINARY_OP_INPLACE_ADD,
+};
+#if MICROPY_PY_BUILTINS_FLOAT
+STATIC const byte quick_float_ops[8] = {
+    MP_BINARY_OP_ADD, MP_BINARY_OP_SUBTRACT, MP_BINARY_OP_MULTIPLY, MP_BINARY_OP_TRUE_DIVIDE,
+    MP_BINARY_OP_INPLACE_ADD, MP_BINARY_OP_INPLACE_SUBTRACT, MP_BINARY_OP_INPLACE_MULTIPLY,
+    MP_BINARY_OP_INPLACE_TRUE_DIVIDE,
+};
+#endif
+
+// Replace the opcode at op_ip, unless the bytecode is in ROM
+STATIC void quicken(const byte *op_ip, byte opcode) {
+    if (gc_is_heap_ptr(op_ip)) {
+        *(byte*)op_ip = opcode;
+    }
+}
+
+// Called by a generic BINARY_OP, at op_ip, to specialise it for the kind of
+// its operands
+STATIC void quicken_binary_op(const byte *op_ip, mp_uint_t op, mp_obj_t lhs, mp_obj_t rhs) {
+    const byte *ops;
+    size_t n_ops;
+    byte base;
+    if (MP_OBJ_IS_SMALL_INT(lhs) && MP_OBJ_IS_SMALL_INT(rhs)) {
+        ops = quick_small_int_ops;
+        n_ops = MP_ARRAY_SIZE(quick_small_int_ops);
+        base = MP_BC_QUICK_BINARY_OP_SMALL_INT_MULTI;
+    #if MICROPY_PY_BUILTINS_FLOAT
+    } else if (mp_obj_is_float(lhs) && (mp_obj_is_float(rhs) || MP_OBJ_IS_SMALL_INT(rhs))) {
+        ops = quick_float_ops;
+        n_ops = MP_ARRAY_SIZE(quick_float_ops);
+        base = MP_BC_QUICK_BINARY_OP_FLOAT_MULTI;
+    #endif
+    } else if (MP_OBJ_IS_STR(lhs) && MP_OBJ_IS_STR(rhs)) {
+        ops = quick_str_ops;
+        n_ops = MP_ARRAY_SIZE(quick_str_ops);
+        base = MP_BC_QUICK_BINARY_OP_STR_MULTI;
+    } else {
+        return;
+    }
+    for (size_t i = 0; i < n_ops; i++) {
+        if (ops[i] == op) {
+            quicken(op_ip, base + i);
+            return;
+        }
+    }
+}
+
+#if MICROPY_TIERING
+// Returns the generic form of a specialised opcode, for reading bytecode that
+// may have been quickened
+byte mp_bc_unquicken(byte op) {
+    if (op < MP_BC_QUICK_BINARY_OP_SMALL_INT_MULTI + MP_ARRAY_SIZE(quick_small_int_ops)) {
+        return MP_BC_BINARY_OP_MULTI + quick_small_int_ops[op - MP_BC_QUICK_BINARY_OP_SMALL_INT_MULTI];
+    } else if (op >= MP_BC_QUICK_BINARY_OP_STR_MULTI && op < MP_BC_QUICK_BINARY_OP_STR_MULTI + MP_ARRAY_SIZE(quick_str_ops)) {
+        return MP_BC_BINARY_OP_MULTI + quick_str_ops[op - MP_BC_QUICK_BINARY_OP_STR_MULTI];
+    #if MICROPY_PY_BUILTINS_FLOAT
+    } else if (op >= MP_BC_QUICK_BINARY_OP_FLOAT_MULTI && op < MP_BC_QUICK_BINARY_OP_FLOAT_MULTI + MP_ARRAY_SIZE(quick_float_ops)) {
+        return MP_BC_BINARY_OP_MULTI + quick_float_ops[op - MP_BC_QUICK_BINARY_OP_FLOAT_MULTI];
+    #endif
+    } else if (op == MP_BC_QUICK_LOAD_SUBSCR_LIST || op == MP_BC_QUICK_LOAD_SUBSCR_DICT) {
+        return MP_BC_LOAD_SUBSCR;
+    } else if (op == MP_BC_QUICK_STORE_SUBSCR_LIST) {
+        return MP_BC_STORE_SUBSCR;
+    }
+    return op;
+}
+#endif
+#endif
+
+#if MICROPY_TIERING
+// A backward jump counts towards promoting the function to native code, while
+// it has not been tried yet
+#define TIER_COUNT_JUMP(slab) \
+    if ((mp_int_t)(slab) < 0 && code_state->fun_bc->tier_native == MP_OBJ_NULL) { \
+        code_state->fun_bc->tier_count += 1; \
+    }
+#else
+#define TIER_COUNT_JUMP(slab)
+#endif
+
+#if MICROPY_STACKLESS
+// A call to a bytecode function is run by this invocation of the VM, unless
+// the function has been promoted to native code
+#if MICROPY_TIERING
+#define STACKLESS_CALL(fun) (mp_obj_get_type(fun) == &mp_type_fun_bc && !mp_tier_count_call(MP_OBJ_TO_PTR(fun)))
+#else
+#define STACKLESS_CALL(fun) (mp_obj_get_type(fun) == &mp_type_fun_bc)
+#endif
+#endif
+
 #define DECODE_UINT \
     mp_uint_t unum = 0; \
     do { \
@@ -139,6 +278,7 @@ mp_vm_return_kind_t mp_execute_bytecode(mp_code_state_t *code_state, volatile mp
     #include "py/vmentrytable.h"
     #define DISPATCH() do { \
         TRACE(ip); \
+        VM_PROFILE_OP(ip); \
         MARK_EXC_IP_GLOBAL(); \
         goto *entry_table[*ip++]; \
     } while (0)
@@ -158,6 +298,8 @@ mp_vm_return_kind_t mp_execute_bytecode(mp_code_state_t *code_state, volatile mp
     // loop and the exception handler, leading to very obscure bugs.
     #define RAISE(o) do { nlr_pop(); nlr.ret_val = MP_OBJ_TO_PTR(o); goto exception_handler; } while (0)
 
+    VM_SAMPLING_ENTER();
+
 #if MICROPY_STACKLESS
 run_code_state: ;
 #endif
@@ -206,6 +348,7 @@ dispatch_loop:
                 DISPATCH();
 #else
                 TRACE(ip);
+                VM_PROFILE_OP(ip);
                 MARK_EXC_IP_GLOBAL();
                 switch (*ip++) {
 #endif
@@ -272,7 +415,17 @@ dispatch_loop:
                     goto load_check;
                 }
 
-                #if !MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE
+                #if MICROPY_OPT_LOAD_GLOBAL_CACHE
+                ENTRY(MP_BC_LOAD_NAME): {
+                    MARK_EXC_IP_SELECTIVE();
+                    DECODE_QSTR;
+                    PUSH(mp_load_name_cached(qst, ip));
+                    #if MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE
+                    ip++;
+                    #endif
+                    DISPATCH();
+                }
+                #elif !MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE
                 ENTRY(MP_BC_LOAD_NAME): {
                     MARK_EXC_IP_SELECTIVE();
                     DECODE_QSTR;
@@ -301,7 +454,17 @@ dispatch_loop:
                 }
                 #endif
 
-                #if !MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE
+                #if MICROPY_OPT_LOAD_GLOBAL_CACHE
+                ENTRY(MP_BC_LOAD_GLOBAL): {
+                    MARK_EXC_IP_SELECTIVE();
+                    DECODE_QSTR;
+                    PUSH(mp_load_global_cached(qst, ip));
+                    #if MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE
+                    ip++;
+                    #endif
+                    DISPATCH();
+                }
+                #elif !MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE
                 ENTRY(MP_BC_LOAD_GLOBAL): {
                     MARK_EXC_IP_SELECTIVE();
                     DECODE_QSTR;
@@ -334,7 +497,11 @@ dispatch_loop:
                 ENTRY(MP_BC_LOAD_ATTR): {
                     MARK_EXC_IP_SELECTIVE();
                     DECODE_QSTR;
+                    #if MICROPY_OPT_ATTR_INLINE_CACHE
+                    SET_TOP(mp_load_attr_cached(TOP(), qst, ip));
+                    #else
                     SET_TOP(mp_load_attr(TOP(), qst));
+                    #endif
                     DISPATCH();
                 }
                 #else
@@ -362,7 +529,11 @@ dispatch_loop:
                         DISPATCH();
                     }
                 load_attr_cache_fail:
+                    #if MICROPY_OPT_ATTR_INLINE_CACHE
+                    SET_TOP(mp_load_attr_cached(top, qst, ip));
+                    #else
                     SET_TOP(mp_load_attr(top, qst));
+                    #endif
                     ip++;
                     DISPATCH();
                 }
@@ -371,7 +542,11 @@ dispatch_loop:
                 ENTRY(MP_BC_LOAD_METHOD): {
                     MARK_EXC_IP_SELECTIVE();
                     DECODE_QSTR;
+                    #if MICROPY_OPT_ATTR_INLINE_CACHE
+                    mp_load_method_cached(*sp, qst, sp, ip);
+                    #else
                     mp_load_method(*sp, qst, sp);
+                    #endif
                     sp += 1;
                     DISPATCH();
                 }
@@ -384,6 +559,13 @@ dispatch_loop:
                 ENTRY(MP_BC_LOAD_SUBSCR): {
                     MARK_EXC_IP_SELECTIVE();
                     mp_obj_t index = POP();
+                    #if MICROPY_OPT_QUICKEN
+                    if (MP_OBJ_IS_TYPE(TOP(), &mp_type_list) && MP_OBJ_IS_SMALL_INT(index)) {
+                        quicken(ip - 1, MP_BC_QUICK_LOAD_SUBSCR_LIST);
+                    } else if (MP_OBJ_IS_TYPE(TOP(), &mp_type_dict)) {
+                        quicken(ip - 1, MP_BC_QUICK_LOAD_SUBSCR_DICT);
+                    }
+                    #endif
                     SET_TOP(mp_obj_subscr(TOP(), index, MP_OBJ_SENTINEL));
                     DISPATCH();
                 }
@@ -462,6 +644,11 @@ dispatch_loop:
 
                 ENTRY(MP_BC_STORE_SUBSCR):
                     MARK_EXC_IP_SELECTIVE();
+                    #if MICROPY_OPT_QUICKEN
+                    if (MP_OBJ_IS_TYPE(sp[-1], &mp_type_list) && MP_OBJ_IS_SMALL_INT(sp[0])) {
+                        quicken(ip - 1, MP_BC_QUICK_STORE_SUBSCR_LIST);
+                    }
+                    #endif
                     mp_obj_subscr(sp[-1], sp[0], sp[-2]);
                     sp -= 3;
                     DISPATCH();
@@ -500,6 +687,31 @@ dispatch_loop:
                     DISPATCH();
                 }
 
+                ENTRY(MP_BC_LOAD_FAST_LOAD_FAST): {
+                    obj_shared = fastn[-(*ip & 0x0f)];
+                    if (obj_shared == MP_OBJ_NULL) {
+                        goto local_name_error;
+                    }
+                    PUSH(obj_shared);
+                    obj_shared = fastn[-(*ip++ >> 4)];
+                    goto load_check;
+                }
+
+                ENTRY(MP_BC_STORE_FAST_LOAD_FAST):
+                    fastn[-(*ip & 0x0f)] = POP();
+                    obj_shared = fastn[-(*ip++ >> 4)];
+                    goto load_check;
+
+                ENTRY(MP_BC_LOAD_FAST_LOAD_CONST_SMALL_INT): {
+                    obj_shared = fastn[-(*ip & 0x0f)];
+                    if (obj_shared == MP_OBJ_NULL) {
+                        goto local_name_error;
+                    }
+                    PUSH(obj_shared);
+                    PUSH(MP_OBJ_NEW_SMALL_INT(*ip++ >> 4));
+                    DISPATCH();
+                }
+
                 ENTRY(MP_BC_DUP_TOP): {
                     mp_obj_t top = TOP();
                     PUSH(top);
@@ -533,6 +745,7 @@ dispatch_loop:
 
                 ENTRY(MP_BC_JUMP): {
                     DECODE_SLABEL;
+                    TIER_COUNT_JUMP(slab);
                     ip += slab;
                     DISPATCH_WITH_PEND_EXC_CHECK();
                 }
@@ -540,6 +753,7 @@ dispatch_loop:
                 ENTRY(MP_BC_POP_JUMP_IF_TRUE): {
                     DECODE_SLABEL;
                     if (mp_obj_is_true(POP())) {
+                        TIER_COUNT_JUMP(slab);
                         ip += slab;
                     }
                     DISPATCH_WITH_PEND_EXC_CHECK();
@@ -548,6 +762,7 @@ dispatch_loop:
                 ENTRY(MP_BC_POP_JUMP_IF_FALSE): {
                     DECODE_SLABEL;
                     if (!mp_obj_is_true(POP())) {
+                        TIER_COUNT_JUMP(slab);
                         ip += slab;
                     }
                     DISPATCH_WITH_PEND_EXC_CHECK();
@@ -912,7 +1127,7 @@ unwind_jump:;
                     // (unum >> 8) & 0xff == n_keyword
                     sp -= (unum & 0xff) + ((unum >> 7) & 0x1fe);
                     #if MICROPY_STACKLESS
-                    if (mp_obj_get_type(*sp) == &mp_type_fun_bc) {
+                    if (STACKLESS_CALL(*sp)) {
                         code_state->ip = ip;
                         code_state->sp = sp;
                         code_state->exc_sp = MP_TAGPTR_MAKE(exc_sp, currently_in_except_block);
@@ -920,6 +1135,7 @@ unwind_jump:;
                         if (new_state) {
                             new_state->prev = code_state;
                             code_state = new_state;
+                            VM_SAMPLING_ENTER();
                             nlr_pop();
                             goto run_code_state;
                         }
@@ -944,7 +1160,7 @@ unwind_jump:;
                     // fun arg0 arg1 ... kw0 val0 kw1 val1 ... seq dict <- TOS
                     sp -= (unum & 0xff) + ((unum >> 7) & 0x1fe) + 2;
                     #if MICROPY_STACKLESS
-                    if (mp_obj_get_type(*sp) == &mp_type_fun_bc) {
+                    if (STACKLESS_CALL(*sp)) {
                         code_state->ip = ip;
                         code_state->sp = sp;
                         code_state->exc_sp = MP_TAGPTR_MAKE(exc_sp, currently_in_except_block);
@@ -954,10 +1170,13 @@ unwind_jump:;
 
                         mp_code_state_t *new_state = mp_obj_fun_bc_prepare_codestate(out_args.fun,
                             out_args.n_args, out_args.n_kw, out_args.args);
-                        m_del(mp_obj_t, out_args.args, out_args.n_alloc);
+                        if (out_args.n_alloc != 0) {
+                            m_del(mp_obj_t, out_args.args, out_args.n_alloc);
+                        }
                         if (new_state) {
                             new_state->prev = code_state;
                             code_state = new_state;
+                            VM_SAMPLING_ENTER();
                             nlr_pop();
                             goto run_code_state;
                         }
@@ -979,7 +1198,7 @@ unwind_jump:;
                     // (unum >> 8) & 0xff == n_keyword
                     sp -= (unum & 0xff) + ((unum >> 7) & 0x1fe) + 1;
                     #if MICROPY_STACKLESS
-                    if (mp_obj_get_type(*sp) == &mp_type_fun_bc) {
+                    if (STACKLESS_CALL(*sp)) {
                         code_state->ip = ip;
                         code_state->sp = sp;
                         code_state->exc_sp = MP_TAGPTR_MAKE(exc_sp, currently_in_except_block);
@@ -992,6 +1211,7 @@ unwind_jump:;
                         if (new_state) {
                             new_state->prev = code_state;
                             code_state = new_state;
+                            VM_SAMPLING_ENTER();
                             nlr_pop();
                             goto run_code_state;
                         }
@@ -1015,7 +1235,7 @@ unwind_jump:;
                     // fun self arg0 arg1 ... kw0 val0 kw1 val1 ... seq dict <- TOS
                     sp -= (unum & 0xff) + ((unum >> 7) & 0x1fe) + 3;
                     #if MICROPY_STACKLESS
-                    if (mp_obj_get_type(*sp) == &mp_type_fun_bc) {
+                    if (STACKLESS_CALL(*sp)) {
                         code_state->ip = ip;
                         code_state->sp = sp;
                         code_state->exc_sp = MP_TAGPTR_MAKE(exc_sp, currently_in_except_block);
@@ -1025,10 +1245,13 @@ unwind_jump:;
 
                         mp_code_state_t *new_state = mp_obj_fun_bc_prepare_codestate(out_args.fun,
                             out_args.n_args, out_args.n_kw, out_args.args);
-                        m_del(mp_obj_t, out_args.args, out_args.n_alloc);
+                        if (out_args.n_alloc != 0) {
+                            m_del(mp_obj_t, out_args.args, out_args.n_alloc);
+                        }
                         if (new_state) {
                             new_state->prev = code_state;
                             code_state = new_state;
+                            VM_SAMPLING_ENTER();
                             nlr_pop();
                             goto run_code_state;
                         }
@@ -1087,11 +1310,18 @@ unwind_return:
                     if (code_state->prev != NULL) {
                         mp_obj_t res = *sp;
                         mp_globals_set(code_state->old_globals);
-                        code_state = code_state->prev;
+                        VM_SAMPLING_EXIT();
+                        mp_code_state_t *new_code_state = code_state->prev;
+                        #if MICROPY_ENABLE_PYSTACK
+                        // the state is only referenced by this VM, so can be freed now
+                        mp_pystack_free(code_state);
+                        #endif
+                        code_state = new_code_state;
                         *code_state->sp = res;
                         goto run_code_state;
                     }
                     #endif
+                    VM_SAMPLING_EXIT();
                     return MP_VM_RETURN_NORMAL;
 
                 ENTRY(MP_BC_RAISE_VARARGS): {
@@ -1129,6 +1359,7 @@ yield:
                     code_state->ip = ip;
                     code_state->sp = sp;
                     code_state->exc_sp = MP_TAGPTR_MAKE(exc_sp, currently_in_except_block);
+                    VM_SAMPLING_EXIT();
                     return MP_VM_RETURN_YIELD;
 
                 ENTRY(MP_BC_YIELD_FROM): {
@@ -1228,10 +1459,166 @@ yield:
                     MARK_EXC_IP_SELECTIVE();
                     mp_obj_t rhs = POP();
                     mp_obj_t lhs = TOP();
+                    #if MICROPY_OPT_QUICKEN
+                    mp_uint_t op = ip[-1] - MP_BC_BINARY_OP_MULTI;
+                    quicken_binary_op(ip - 1, op, lhs, rhs);
+                    SET_TOP(mp_binary_op(op, lhs, rhs));
+                    #else
                     SET_TOP(mp_binary_op(ip[-1] - MP_BC_BINARY_OP_MULTI, lhs, rhs));
+                    #endif
                     DISPATCH();
                 }
 
+#if MICROPY_OPT_QUICKEN
+                // The specialised opcodes below fall back to the generic
+                // operation when the result can't be computed directly, and
+                // restore the generic opcode if the operands are of another kind.
+
+                ENTRY(MP_BC_QUICK_BINARY_OP_SMALL_INT_MULTI): {
+                    MARK_EXC_IP_SELECTIVE();
+                    mp_obj_t rhs = POP();
+                    mp_obj_t lhs = TOP();
+                    mp_uint_t op = quick_small_int_ops[ip[-1] - MP_BC_QUICK_BINARY_OP_SMALL_INT_MULTI];
+                    if (MP_OBJ_IS_SMALL_INT(lhs) && MP_OBJ_IS_SMALL_INT(rhs)) {
+                        mp_int_t lhs_val = MP_OBJ_SMALL_INT_VALUE(lhs);
+                        mp_int_t rhs_val = MP_OBJ_SMALL_INT_VALUE(rhs);
+                        switch (op) {
+                            case MP_BINARY_OP_ADD:
+                            case MP_BINARY_OP_INPLACE_ADD:
+                                // can't overflow an mp_int_t, but may not fit a small int
+                                lhs_val += rhs_val;
+                                if (MP_SMALL_INT_FITS(lhs_val)) {
+                                    SET_TOP(MP_OBJ_NEW_SMALL_INT(lhs_val));
+                                    DISPATCH();
+                                }
+                                break;
+                            case MP_BINARY_OP_SUBTRACT:
+                            case MP_BINARY_OP_INPLACE_SUBTRACT:
+                                lhs_val -= rhs_val;
+                                if (MP_SMALL_INT_FITS(lhs_val)) {
+                                    SET_TOP(MP_OBJ_NEW_SMALL_INT(lhs_val));
+                                    DISPATCH();
+                                }
+                                break;
+                            case MP_BINARY_OP_MULTIPLY:
+                                if (!mp_small_int_mul_overflow(lhs_val, rhs_val)) {
+                                    SET_TOP(MP_OBJ_NEW_SMALL_INT(lhs_val * rhs_val));
+                                    DISPATCH();
+                                }
+                                break;
+                            case MP_BINARY_OP_LESS: SET_TOP(mp_obj_new_bool(lhs_val < rhs_val)); DISPATCH();
+                            case MP_BINARY_OP_MORE: SET_TOP(mp_obj_new_bool(lhs_val > rhs_val)); DISPATCH();
+                            case MP_BINARY_OP_EQUAL: SET_TOP(mp_obj_new_bool(lhs_val == rhs_val)); DISPATCH();
+                            case MP_BINARY_OP_LESS_EQUAL: SET_TOP(mp_obj_new_bool(lhs_val <= rhs_val)); DISPATCH();
+                            case MP_BINARY_OP_MORE_EQUAL: SET_TOP(mp_obj_new_bool(lhs_val >= rhs_val)); DISPATCH();
+                            default: SET_TOP(mp_obj_new_bool(lhs_val != rhs_val)); DISPATCH();
+                        }
+                    } else {
+                        *(byte*)(ip - 1) = MP_BC_BINARY_OP_MULTI + op;
+                    }
+                    SET_TOP(mp_binary_op(op, lhs, rhs));
+                    DISPATCH();
+                }
+
+                #if MICROPY_PY_BUILTINS_FLOAT
+                ENTRY(MP_BC_QUICK_BINARY_OP_FLOAT_MULTI): {
+                    MARK_EXC_IP_SELECTIVE();
+                    mp_obj_t rhs = POP();
+                    mp_obj_t lhs = TOP();
+                    mp_uint_t op = quick_float_ops[ip[-1] - MP_BC_QUICK_BINARY_OP_FLOAT_MULTI];
+                    if (mp_obj_is_float(lhs) && (mp_obj_is_float(rhs) || MP_OBJ_IS_SMALL_INT(rhs))) {
+                        mp_float_t lhs_val = mp_obj_float_get(lhs);
+                        mp_float_t rhs_val = MP_OBJ_IS_SMALL_INT(rhs) ? MP_OBJ_SMALL_INT_VALUE(rhs) : mp_obj_float_get(rhs);
+                        switch (op) {
+                            case MP_BINARY_OP_ADD:
+                            case MP_BINARY_OP_INPLACE_ADD: lhs_val += rhs_val; break;
+                            case MP_BINARY_OP_SUBTRACT:
+                            case MP_BINARY_OP_INPLACE_SUBTRACT: lhs_val -= rhs_val; break;
+                            case MP_BINARY_OP_MULTIPLY:
+                            case MP_BINARY_OP_INPLACE_MULTIPLY: lhs_val *= rhs_val; break;
+                            default:
+                                if (rhs_val == 0) {
+                                    // let the runtime raise ZeroDivisionError
+                                    SET_TOP(mp_binary_op(op, lhs, rhs));
+                                    DISPATCH();
+                                }
+                                lhs_val /= rhs_val;
+                                break;
+                        }
+                        SET_TOP(mp_obj_new_float(lhs_val));
+                        DISPATCH();
+                    }
+                    *(byte*)(ip - 1) = MP_BC_BINARY_OP_MULTI + op;
+                    SET_TOP(mp_binary_op(op, lhs, rhs));
+                    DISPATCH();
+                }
+                #endif
+
+                ENTRY(MP_BC_QUICK_BINARY_OP_STR_MULTI): {
+                    MARK_EXC_IP_SELECTIVE();
+                    mp_obj_t rhs = POP();
+                    mp_obj_t lhs = TOP();
+                    mp_uint_t op = quick_str_ops[ip[-1] - MP_BC_QUICK_BINARY_OP_STR_MULTI];
+                    if (MP_OBJ_IS_STR(lhs) && MP_OBJ_IS_STR(rhs)) {
+                        SET_TOP(mp_obj_str_binary_op(op, lhs, rhs));
+                    } else {
+                        *(byte*)(ip - 1) = MP_BC_BINARY_OP_MULTI + op;
+                        SET_TOP(mp_binary_op(op, lhs, rhs));
+                    }
+                    DISPATCH();
+                }
+
+                ENTRY(MP_BC_QUICK_LOAD_SUBSCR_LIST): {
+                    MARK_EXC_IP_SELECTIVE();
+                    mp_obj_t index = POP();
+                    if (MP_OBJ_IS_TYPE(TOP(), &mp_type_list) && MP_OBJ_IS_SMALL_INT(index)) {
+                        size_t len;
+                        mp_obj_t *items;
+                        mp_obj_list_get(TOP(), &len, &items);
+                        mp_int_t i = MP_OBJ_SMALL_INT_VALUE(index);
+                        if (i < 0) {
+                            i += len;
+                        }
+                        if ((mp_uint_t)i < len) {
+                            SET_TOP(items[i]);
+                            DISPATCH();
+                        }
+                    } else {
+                        *(byte*)(ip - 1) = MP_BC_LOAD_SUBSCR;
+                    }
+                    SET_TOP(mp_obj_subscr(TOP(), index, MP_OBJ_SENTINEL));
+                    DISPATCH();
+                }
+
+                ENTRY(MP_BC_QUICK_LOAD_SUBSCR_DICT): {
+                    MARK_EXC_IP_SELECTIVE();
+                    mp_obj_t index = POP();
+                    if (MP_OBJ_IS_TYPE(TOP(), &mp_type_dict)) {
+                        mp_obj_dict_t *dict = MP_OBJ_TO_PTR(TOP());
+                        mp_map_elem_t *elem = mp_map_lookup(&dict->map, index, MP_MAP_LOOKUP);
+                        if (elem != NULL) {
+                            SET_TOP(elem->value);
+                            DISPATCH();
+                        }
+                    } else {
+                        *(byte*)(ip - 1) = MP_BC_LOAD_SUBSCR;
+                    }
+                    SET_TOP(mp_obj_subscr(TOP(), index, MP_OBJ_SENTINEL));
+                    DISPATCH();
+                }
+
+                ENTRY(MP_BC_QUICK_STORE_SUBSCR_LIST):
+                    MARK_EXC_IP_SELECTIVE();
+                    if (MP_OBJ_IS_TYPE(sp[-1], &mp_type_list) && MP_OBJ_IS_SMALL_INT(sp[0])) {
+                        mp_obj_list_store(sp[-1], sp[0], sp[-2]);
+                    } else {
+                        *(byte*)(ip - 1) = MP_BC_STORE_SUBSCR;
+                        mp_obj_subscr(sp[-1], sp[0], sp[-2]);
+                    }
+                    sp -= 3;
+                    DISPATCH();
+#endif
+
                 ENTRY_DEFAULT:
                     MARK_EXC_IP_SELECTIVE();
 #else
@@ -1259,6 +1646,7 @@ yield:
                     mp_obj_t obj = mp_obj_new_exception_msg(&mp_type_NotImplementedError, "byte code not implemented");
                     nlr_pop();
                     fastn[0] = obj;
+                    VM_SAMPLING_EXIT();
                     return MP_VM_RETURN_EXCEPTION;
                 }
 
@@ -1295,6 +1683,32 @@ pending_exception_check:
                 }
                 #endif
 
+                #if MICROPY_VM_SAMPLING
+                if (MP_STATE_VM(vm_sample_pending)) {
+                    mp_vm_sample(ip);
+                }
+                #endif
+
+                #if MICROPY_ENABLE_GC && MICROPY_ENABLE_FINALISER
+                // call the finalisers of objects found unreachable by the
+                // last collection
+                if (MP_STATE_MEM(gc_finaliser_queue_len) != 0
+                    && !MP_STATE_MEM(gc_finalisers_running)) {
+                    MARK_EXC_IP_SELECTIVE();
+                    gc_run_finalisers();
+                }
+                #endif
+
+                #if MICROPY_GC_INCREMENTAL
+                // give a running incremental collection a slice now and
+                // then, so it progresses while the code is not allocating
+                if (MP_STATE_MEM(gc_incr_phase) != GC_INCR_PHASE_IDLE
+                    && --MP_STATE_MEM(gc_incr_poll_count) == 0) {
+                    MARK_EXC_IP_SELECTIVE();
+                    gc_incremental_step();
+                }
+                #endif
+
                 #if MICROPY_PY_THREAD_GIL
                 #if MICROPY_PY_THREAD_GIL_VM_DIVISOR
                 if (--gil_divisor == 0) {
@@ -1373,29 +1787,7 @@ unwind_loop:
                 qstr block_name = mp_decode_uint(&ip);
                 qstr source_file = mp_decode_uint(&ip);
                 #endif
-                size_t source_line = 1;
-                size_t c;
-                while ((c = *ip)) {
-                    size_t b, l;
-                    if ((c & 0x80) == 0) {
-                        // 0b0LLBBBBB encoding
-                        b = c & 0x1f;
-                        l = c >> 5;
-                        ip += 1;
-                    } else {
-                        // 0b1LLLBBBB 0bLLLLLLLL encoding (l's LSB in second byte)
-                        b = c & 0xf;
-                        l = ((c << 4) & 0x700) | ip[1];
-                        ip += 2;
-                    }
-                    if (bc >= b) {
-                        bc -= b;
-                        source_line += l;
-                    } else {
-                        // found source line corresponding to bytecode offset
-                        break;
-                    }
-                }
+                size_t source_line = mp_bytecode_get_source_line(ip, bc);
                 mp_obj_exception_add_traceback(MP_OBJ_FROM_PTR(nlr.ret_val), source_file, source_line, block_name);
             }
 
@@ -1427,7 +1819,14 @@ unwind_loop:
             #if MICROPY_STACKLESS
             } else if (code_state->prev != NULL) {
                 mp_globals_set(code_state->old_globals);
-                code_state = code_state->prev;
+                VM_SAMPLING_EXIT();
+                mp_code_state_t *new_code_state = code_state->prev;
+                #if MICROPY_ENABLE_PYSTACK
+                // the state is only referenced by this VM, so can be freed now
+                mp_pystack_free(code_state);
+                #endif
+                code_state = new_code_state;
+                n_state = mp_decode_uint_value(code_state->fun_bc->bytecode);
                 fastn = &code_state->state[n_state - 1];
                 exc_stack = (mp_exc_stack_t*)(code_state->state + n_state);
                 // variables that are visible to the exception handler (declared volatile)
@@ -1440,6 +1839,7 @@ unwind_loop:
                 // propagate exception to higher level
                 // TODO what to do about ip and sp? they don't really make sense at this point
                 fastn[0] = MP_OBJ_FROM_PTR(nlr.ret_val); // must put exception here because sp is invalid
+                VM_SAMPLING_EXIT();
                 return MP_VM_RETURN_EXCEPTION;
             }
         }
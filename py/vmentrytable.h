@@ -56,6 +56,9 @@ static const void *const entry_table[256] = {
     [MP_BC_DELETE_DEREF] = &&entry_MP_BC_DELETE_DEREF,
     [MP_BC_DELETE_NAME] = &&entry_MP_BC_DELETE_NAME,
     [MP_BC_DELETE_GLOBAL] = &&entry_MP_BC_DELETE_GLOBAL,
+    [MP_BC_LOAD_FAST_LOAD_FAST] = &&entry_MP_BC_LOAD_FAST_LOAD_FAST,
+    [MP_BC_STORE_FAST_LOAD_FAST] = &&entry_MP_BC_STORE_FAST_LOAD_FAST,
+    [MP_BC_LOAD_FAST_LOAD_CONST_SMALL_INT] = &&entry_MP_BC_LOAD_FAST_LOAD_CONST_SMALL_INT,
     [MP_BC_DUP_TOP] = &&entry_MP_BC_DUP_TOP,
     [MP_BC_DUP_TOP_TWO] = &&entry_MP_BC_DUP_TOP_TWO,
     [MP_BC_POP_TOP] = &&entry_MP_BC_POP_TOP,
@@ -110,6 +113,16 @@ static const void *const entry_table[256] = {
     [MP_BC_STORE_FAST_MULTI ... MP_BC_STORE_FAST_MULTI + 15] = &&entry_MP_BC_STORE_FAST_MULTI,
     [MP_BC_UNARY_OP_MULTI ... MP_BC_UNARY_OP_MULTI + 6] = &&entry_MP_BC_UNARY_OP_MULTI,
     [MP_BC_BINARY_OP_MULTI ... MP_BC_BINARY_OP_MULTI + 35] = &&entry_MP_BC_BINARY_OP_MULTI,
+    #if MICROPY_OPT_QUICKEN
+    [MP_BC_QUICK_BINARY_OP_SMALL_INT_MULTI ... MP_BC_QUICK_BINARY_OP_SMALL_INT_MULTI + 10] = &&entry_MP_BC_QUICK_BINARY_OP_SMALL_INT_MULTI,
+    [MP_BC_QUICK_BINARY_OP_STR_MULTI ... MP_BC_QUICK_BINARY_OP_STR_MULTI + 1] = &&entry_MP_BC_QUICK_BINARY_OP_STR_MULTI,
+    [MP_BC_QUICK_LOAD_SUBSCR_LIST] = &&entry_MP_BC_QUICK_LOAD_SUBSCR_LIST,
+    [MP_BC_QUICK_LOAD_SUBSCR_DICT] = &&entry_MP_BC_QUICK_LOAD_SUBSCR_DICT,
+    [MP_BC_QUICK_STORE_SUBSCR_LIST] = &&entry_MP_BC_QUICK_STORE_SUBSCR_LIST,
+    #if MICROPY_PY_BUILTINS_FLOAT
+    [MP_BC_QUICK_BINARY_OP_FLOAT_MULTI ... MP_BC_QUICK_BINARY_OP_FLOAT_MULTI + 7] = &&entry_MP_BC_QUICK_BINARY_OP_FLOAT_MULTI,
+    #endif
+    #endif
 };
 
 #if __clang__
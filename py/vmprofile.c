@@ -0,0 +1,351 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Damien P. George
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "py/runtime.h"
+#include "py/bc.h"
+#include "py/bc0.h"
+#include "py/vmprofile.h"
+
+#if MICROPY_VM_PROFILE
+
+STATIC const char *const opcode_names[256] = {
+    [MP_BC_LOAD_CONST_FALSE] = "LOAD_CONST_FALSE",
+    [MP_BC_LOAD_CONST_NONE] = "LOAD_CONST_NONE",
+    [MP_BC_LOAD_CONST_TRUE] = "LOAD_CONST_TRUE",
+    [MP_BC_LOAD_CONST_SMALL_INT] = "LOAD_CONST_SMALL_INT",
+    [MP_BC_LOAD_CONST_STRING] = "LOAD_CONST_STRING",
+    [MP_BC_LOAD_CONST_OBJ] = "LOAD_CONST_OBJ",
+    [MP_BC_LOAD_NULL] = "LOAD_NULL",
+    [MP_BC_LOAD_FAST_N] = "LOAD_FAST_N",
+    [MP_BC_LOAD_DEREF] = "LOAD_DEREF",
+    [MP_BC_LOAD_NAME] = "LOAD_NAME",
+    [MP_BC_LOAD_GLOBAL] = "LOAD_GLOBAL",
+    [MP_BC_LOAD_ATTR] = "LOAD_ATTR",
+    [MP_BC_LOAD_METHOD] = "LOAD_METHOD",
+    [MP_BC_LOAD_BUILD_CLASS] = "LOAD_BUILD_CLASS",
+    [MP_BC_LOAD_SUBSCR] = "LOAD_SUBSCR",
+    [MP_BC_STORE_FAST_N] = "STORE_FAST_N",
+    [MP_BC_STORE_DEREF] = "STORE_DEREF",
+    [MP_BC_STORE_NAME] = "STORE_NAME",
+    [MP_BC_STORE_GLOBAL] = "STORE_GLOBAL",
+    [MP_BC_STORE_ATTR] = "STORE_ATTR",
+    [MP_BC_STORE_SUBSCR] = "STORE_SUBSCR",
+    [MP_BC_DELETE_FAST] = "DELETE_FAST",
+    [MP_BC_DELETE_DEREF] = "DELETE_DEREF",
+    [MP_BC_DELETE_NAME] = "DELETE_NAME",
+    [MP_BC_DELETE_GLOBAL] = "DELETE_GLOBAL",
+    [MP_BC_LOAD_FAST_LOAD_FAST] = "LOAD_FAST_LOAD_FAST",
+    [MP_BC_STORE_FAST_LOAD_FAST] = "STORE_FAST_LOAD_FAST",
+    [MP_BC_LOAD_FAST_LOAD_CONST_SMALL_INT] = "LOAD_FAST_LOAD_CONST_SMALL_INT",
+    [MP_BC_DUP_TOP] = "DUP_TOP",
+    [MP_BC_DUP_TOP_TWO] = "DUP_TOP_TWO",
+    [MP_BC_POP_TOP] = "POP_TOP",
+    [MP_BC_ROT_TWO] = "ROT_TWO",
+    [MP_BC_ROT_THREE] = "ROT_THREE",
+    [MP_BC_JUMP] = "JUMP",
+    [MP_BC_POP_JUMP_IF_TRUE] = "POP_JUMP_IF_TRUE",
+    [MP_BC_POP_JUMP_IF_FALSE] = "POP_JUMP_IF_FALSE",
+    [MP_BC_JUMP_IF_TRUE_OR_POP] = "JUMP_IF_TRUE_OR_POP",
+    [MP_BC_JUMP_IF_FALSE_OR_POP] = "JUMP_IF_FALSE_OR_POP",
+    [MP_BC_SETUP_WITH] = "SETUP_WITH",
+    [MP_BC_WITH_CLEANUP] = "WITH_CLEANUP",
+    [MP_BC_SETUP_EXCEPT] = "SETUP_EXCEPT",
+    [MP_BC_SETUP_FINALLY] = "SETUP_FINALLY",
+    [MP_BC_END_FINALLY] = "END_FINALLY",
+    [MP_BC_GET_ITER] = "GET_ITER",
+    [MP_BC_FOR_ITER] = "FOR_ITER",
+    [MP_BC_POP_BLOCK] = "POP_BLOCK",
+    [MP_BC_POP_EXCEPT] = "POP_EXCEPT",
+    [MP_BC_UNWIND_JUMP] = "UNWIND_JUMP",
+    [MP_BC_GET_ITER_STACK] = "GET_ITER_STACK",
+    [MP_BC_BUILD_TUPLE] = "BUILD_TUPLE",
+    [MP_BC_BUILD_LIST] = "BUILD_LIST",
+    [MP_BC_BUILD_MAP] = "BUILD_MAP",
+    [MP_BC_STORE_MAP] = "STORE_MAP",
+    [MP_BC_BUILD_SET] = "BUILD_SET",
+    [MP_BC_BUILD_SLICE] = "BUILD_SLICE",
+    [MP_BC_STORE_COMP] = "STORE_COMP",
+    [MP_BC_UNPACK_SEQUENCE] = "UNPACK_SEQUENCE",
+    [MP_BC_UNPACK_EX] = "UNPACK_EX",
+    [MP_BC_RETURN_VALUE] = "RETURN_VALUE",
+    [MP_BC_RAISE_VARARGS] = "RAISE_VARARGS",
+    [MP_BC_YIELD_VALUE] = "YIELD_VALUE",
+    [MP_BC_YIELD_FROM] = "YIELD_FROM",
+    [MP_BC_MAKE_FUNCTION] = "MAKE_FUNCTION",
+    [MP_BC_MAKE_FUNCTION_DEFARGS] = "MAKE_FUNCTION_DEFARGS",
+    [MP_BC_MAKE_CLOSURE] = "MAKE_CLOSURE",
+    [MP_BC_MAKE_CLOSURE_DEFARGS] = "MAKE_CLOSURE_DEFARGS",
+    [MP_BC_CALL_FUNCTION] = "CALL_FUNCTION",
+    [MP_BC_CALL_FUNCTION_VAR_KW] = "CALL_FUNCTION_VAR_KW",
+    [MP_BC_CALL_METHOD] = "CALL_METHOD",
+    [MP_BC_CALL_METHOD_VAR_KW] = "CALL_METHOD_VAR_KW",
+    [MP_BC_IMPORT_NAME] = "IMPORT_NAME",
+    [MP_BC_IMPORT_FROM] = "IMPORT_FROM",
+    [MP_BC_IMPORT_STAR] = "IMPORT_STAR",
+    [MP_BC_QUICK_LOAD_SUBSCR_LIST] = "QUICK_LOAD_SUBSCR_LIST",
+    [MP_BC_QUICK_LOAD_SUBSCR_DICT] = "QUICK_LOAD_SUBSCR_DICT",
+    [MP_BC_QUICK_STORE_SUBSCR_LIST] = "QUICK_STORE_SUBSCR_LIST",
+};
+
+STATIC const struct {
+    byte base;
+    byte n;
+    const char *name;
+} opcode_multi_names[] = {
+    { MP_BC_LOAD_CONST_SMALL_INT_MULTI, 64, "LOAD_CONST_SMALL_INT_MULTI" },
+    { MP_BC_LOAD_FAST_MULTI, 16, "LOAD_FAST_MULTI" },
+    { MP_BC_STORE_FAST_MULTI, 16, "STORE_FAST_MULTI" },
+    { MP_BC_UNARY_OP_MULTI, 7, "UNARY_OP_MULTI" },
+    { MP_BC_BINARY_OP_MULTI, 36, "BINARY_OP_MULTI" },
+    { MP_BC_QUICK_BINARY_OP_SMALL_INT_MULTI, 11, "QUICK_BINARY_OP_SMALL_INT_MULTI" },
+    { MP_BC_QUICK_BINARY_OP_STR_MULTI, 2, "QUICK_BINARY_OP_STR_MULTI" },
+    { MP_BC_QUICK_BINARY_OP_FLOAT_MULTI, 8, "QUICK_BINARY_OP_FLOAT_MULTI" },
+};
+
+// Writes the name of op to buf, with the offset from the base for the
+// opcodes that encode an argument.
+STATIC void opcode_name(char *buf, size_t len, uint op) {
+    if (opcode_names[op] != NULL) {
+        snprintf(buf, len, "%s", opcode_names[op]);
+        return;
+    }
+    for (size_t i = 0; i < MP_ARRAY_SIZE(opcode_multi_names); ++i) {
+        if (op - opcode_multi_names[i].base < opcode_multi_names[i].n) {
+            snprintf(buf, len, "%s+%u", opcode_multi_names[i].name, op - opcode_multi_names[i].base);
+            return;
+        }
+    }
+    snprintf(buf, len, "0x%02x", op);
+}
+
+STATIC mp_obj_t opcode_name_obj(uint op) {
+    char buf[40];
+    opcode_name(buf, sizeof(buf), op);
+    return mp_obj_new_str(buf, strlen(buf), true);
+}
+
+// Gets the name and source file of a bytecode function.
+STATIC void fun_names(const byte *ip, qstr *block_name, qstr *source_file) {
+    mp_decode_uint(&ip); // skip n_state
+    mp_decode_uint(&ip); // skip n_exc_stack
+    ip += 4; // skip scope_params, n_pos_args, n_kwonly_args, n_def_pos_args
+    mp_decode_uint(&ip); // skip code_info_size
+    #if MICROPY_PERSISTENT_CODE
+    *block_name = ip[0] | (ip[1] << 8);
+    *source_file = ip[2] | (ip[3] << 8);
+    #else
+    *block_name = mp_decode_uint(&ip);
+    *source_file = mp_decode_uint(&ip);
+    #endif
+}
+
+void mp_vm_profile_init_thread(void) {
+    MP_STATE_THREAD(vm_profile_last_op) = MP_VM_PROFILE_NO_OP;
+    MP_STATE_THREAD(vm_profile_last_ticks) = 0;
+}
+
+// Returns the counters of the function with the given bytecode, starting the
+// timing of a call to it.  Returns NULL if the table of functions is full.
+mp_vm_profile_fun_t *mp_vm_profile_fun_enter(const byte *bytecode) {
+    mp_vm_profile_fun_t *funs = MP_STATE_VM(vm_profile_funs);
+    size_t i = ((uintptr_t)bytecode >> 3) % MICROPY_VM_PROFILE_NUM_FUNS;
+    for (size_t n = 0; n < MICROPY_VM_PROFILE_NUM_FUNS; ++n) {
+        mp_vm_profile_fun_t *f = &funs[i];
+        if (f->bytecode == NULL) {
+            f->bytecode = bytecode;
+        }
+        if (f->bytecode == bytecode) {
+            f->calls += 1;
+            if (f->depth++ == 0) {
+                f->start = MICROPY_VM_PROFILE_TICKS();
+            }
+            return f;
+        }
+        if (++i == MICROPY_VM_PROFILE_NUM_FUNS) {
+            i = 0;
+        }
+    }
+    return NULL;
+}
+
+void mp_vm_profile_fun_exit(mp_vm_profile_fun_t *f) {
+    if (f != NULL && --f->depth == 0) {
+        f->ticks += MICROPY_VM_PROFILE_TICKS() - f->start;
+    }
+}
+
+STATIC void vm_profile_clear(void) {
+    memset(MP_STATE_VM(vm_profile_ops), 0, sizeof(MP_STATE_VM(vm_profile_ops)));
+    #if MICROPY_VM_PROFILE_PAIRS
+    memset(MP_STATE_VM(vm_profile_pairs), 0, sizeof(MP_STATE_VM(vm_profile_pairs)));
+    #endif
+    // functions that are running keep their entry, and are timed from now
+    mp_uint_t now = MICROPY_VM_PROFILE_TICKS();
+    for (size_t i = 0; i < MICROPY_VM_PROFILE_NUM_FUNS; ++i) {
+        mp_vm_profile_fun_t *f = &MP_STATE_VM(vm_profile_funs)[i];
+        f->calls = 0;
+        f->ticks = 0;
+        f->start = now;
+    }
+}
+
+mp_obj_t mp_vm_profile_get(bool clear) {
+    mp_obj_t ops = mp_obj_new_dict(0);
+    for (uint op = 0; op < 256; ++op) {
+        mp_vm_profile_op_t *p = &MP_STATE_VM(vm_profile_ops)[op];
+        if (p->count != 0) {
+            mp_obj_t t[2] = {mp_obj_new_int_from_ull(p->count), mp_obj_new_int_from_ull(p->ticks)};
+            mp_obj_dict_store(ops, opcode_name_obj(op), mp_obj_new_tuple(2, t));
+        }
+    }
+
+    mp_obj_t pairs = mp_obj_new_dict(0);
+    #if MICROPY_VM_PROFILE_PAIRS
+    for (uint a = 0; a < 256; ++a) {
+        for (uint b = 0; b < 256; ++b) {
+            uint32_t n = MP_STATE_VM(vm_profile_pairs)[a][b];
+            if (n != 0) {
+                mp_obj_t t[2] = {opcode_name_obj(a), opcode_name_obj(b)};
+                mp_obj_dict_store(pairs, mp_obj_new_tuple(2, t), mp_obj_new_int_from_uint(n));
+            }
+        }
+    }
+    #endif
+
+    mp_obj_t funs = mp_obj_new_list(0, NULL);
+    for (size_t i = 0; i < MICROPY_VM_PROFILE_NUM_FUNS; ++i) {
+        mp_vm_profile_fun_t *f = &MP_STATE_VM(vm_profile_funs)[i];
+        if (f->calls != 0) {
+            qstr block_name, source_file;
+            fun_names(f->bytecode, &block_name, &source_file);
+            mp_obj_t t[4] = {
+                MP_OBJ_NEW_QSTR(block_name),
+                MP_OBJ_NEW_QSTR(source_file),
+                mp_obj_new_int_from_ull(f->calls),
+                mp_obj_new_int_from_ull(f->ticks),
+            };
+            mp_obj_list_append(funs, mp_obj_new_tuple(4, t));
+        }
+    }
+
+    if (clear) {
+        vm_profile_clear();
+    }
+
+    mp_obj_t dict = mp_obj_new_dict(3);
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_opcodes), ops);
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_pairs), pairs);
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_functions), funs);
+    return dict;
+}
+
+// mp_printf (and snprintf on some ports) only supports %llu when objects are
+// 64-bit, so the counters are formatted here.
+STATIC void print_u64(const mp_print_t *print, uint64_t n) {
+    char buf[20];
+    char *p = buf + sizeof(buf);
+    do {
+        *--p = '0' + n % 10;
+        n /= 10;
+    } while (n != 0);
+    mp_print_strn(print, p, buf + sizeof(buf) - p, 0, ' ', 0);
+}
+
+// Prints a qstr as a JSON string; names may contain any character, eg those
+// made by exec or taken from a source path
+STATIC void print_json_qstr(const mp_print_t *print, qstr q) {
+    size_t len;
+    const byte *str = qstr_data(q, &len);
+    mp_print_str(print, "\"");
+    for (const byte *top = str + len; str < top; str++) {
+        if (*str == '"' || *str == '\\') {
+            mp_printf(print, "\\%c", *str);
+        } else if (*str >= 32) {
+            mp_printf(print, "%c", *str);
+        } else {
+            mp_printf(print, "\\u%04x", *str);
+        }
+    }
+    mp_print_str(print, "\"");
+}
+
+void mp_vm_profile_print_json(const mp_print_t *print) {
+    char buf[40];
+    const char *sep = "";
+    mp_printf(print, "{\"opcodes\": {");
+    for (uint op = 0; op < 256; ++op) {
+        mp_vm_profile_op_t *p = &MP_STATE_VM(vm_profile_ops)[op];
+        if (p->count != 0) {
+            opcode_name(buf, sizeof(buf), op);
+            mp_printf(print, "%s\n  \"%s\": [", sep, buf);
+            print_u64(print, p->count);
+            mp_print_str(print, ", ");
+            print_u64(print, p->ticks);
+            mp_print_str(print, "]");
+            sep = ",";
+        }
+    }
+    mp_printf(print, "},\n\"pairs\": [");
+    sep = "";
+    #if MICROPY_VM_PROFILE_PAIRS
+    for (uint a = 0; a < 256; ++a) {
+        for (uint b = 0; b < 256; ++b) {
+            uint32_t n = MP_STATE_VM(vm_profile_pairs)[a][b];
+            if (n != 0) {
+                opcode_name(buf, sizeof(buf), a);
+                mp_printf(print, "%s\n  [\"%s\", ", sep, buf);
+                opcode_name(buf, sizeof(buf), b);
+                mp_printf(print, "\"%s\", %u]", buf, (uint)n);
+                sep = ",";
+            }
+        }
+    }
+    #endif
+    mp_printf(print, "],\n\"functions\": [");
+    sep = "";
+    for (size_t i = 0; i < MICROPY_VM_PROFILE_NUM_FUNS; ++i) {
+        mp_vm_profile_fun_t *f = &MP_STATE_VM(vm_profile_funs)[i];
+        if (f->calls != 0) {
+            qstr block_name, source_file;
+            fun_names(f->bytecode, &block_name, &source_file);
+            mp_printf(print, "%s\n  [", sep);
+            print_json_qstr(print, block_name);
+            mp_print_str(print, ", ");
+            print_json_qstr(print, source_file);
+            mp_print_str(print, ", ");
+            print_u64(print, f->calls);
+            mp_print_str(print, ", ");
+            print_u64(print, f->ticks);
+            mp_print_str(print, "]");
+            sep = ",";
+        }
+    }
+    mp_printf(print, "]}\n");
+}
+
+#endif // MICROPY_VM_PROFILE
@@ -0,0 +1,60 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Damien P. George
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __MICROPY_INCLUDED_PY_VMPROFILE_H__
+#define __MICROPY_INCLUDED_PY_VMPROFILE_H__
+
+#include "py/mpstate.h"
+#include "py/mphal.h"
+
+#if MICROPY_VM_PROFILE
+
+#define MP_VM_PROFILE_NO_OP (256)
+
+// Called by the VM as it dispatches op.  The time since the previous dispatch
+// in this thread is given to the previous opcode.
+static inline void mp_vm_profile_op(byte op) {
+    mp_uint_t last = MP_STATE_THREAD(vm_profile_last_op);
+    if (last != MP_VM_PROFILE_NO_OP) {
+        MP_STATE_VM(vm_profile_ops)[last].ticks += MICROPY_VM_PROFILE_TICKS() - MP_STATE_THREAD(vm_profile_last_ticks);
+        #if MICROPY_VM_PROFILE_PAIRS
+        MP_STATE_VM(vm_profile_pairs)[last][op] += 1;
+        #endif
+    }
+    MP_STATE_VM(vm_profile_ops)[op].count += 1;
+    MP_STATE_THREAD(vm_profile_last_op) = op;
+    // read the clock again so the profiler's own time is left out
+    MP_STATE_THREAD(vm_profile_last_ticks) = MICROPY_VM_PROFILE_TICKS();
+}
+
+void mp_vm_profile_init_thread(void);
+mp_vm_profile_fun_t *mp_vm_profile_fun_enter(const byte *bytecode);
+void mp_vm_profile_fun_exit(mp_vm_profile_fun_t *f);
+mp_obj_t mp_vm_profile_get(bool clear);
+void mp_vm_profile_print_json(const mp_print_t *print);
+
+#endif // MICROPY_VM_PROFILE
+
+#endif // __MICROPY_INCLUDED_PY_VMPROFILE_H__
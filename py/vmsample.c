@@ -0,0 +1,176 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Damien P. George
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "py/runtime.h"
+#include "py/bc.h"
+#include "py/gc.h"
+#include "py/vmsample.h"
+
+#if MICROPY_VM_SAMPLING
+
+// Each sample in the ring buffer is the number of frames n, followed by n
+// frames of 3 words each (function name, source file, line), innermost first.
+#define RING(i) (MP_STATE_VM(vm_sample_ring)[(i) % MICROPY_VM_SAMPLING_RING_SIZE])
+#define FRAME_SIZE (3)
+
+// Any thread can take a sample, so the ring and the dict of stacks are only
+// accessed with the lock held.  A thread that can't get the lock straight away
+// skips its sample, rather than wait in the middle of running bytecode; this
+// also covers a sample requested while aggregating, eg from a finaliser.
+#if MICROPY_PY_THREAD
+#define SAMPLE_TRY_ENTER() (mp_thread_mutex_lock(&MP_STATE_VM(vm_sample_mutex), 0) == 1)
+#define SAMPLE_ENTER() mp_thread_mutex_lock(&MP_STATE_VM(vm_sample_mutex), 1)
+#define SAMPLE_EXIT() mp_thread_mutex_unlock(&MP_STATE_VM(vm_sample_mutex))
+#else
+#define SAMPLE_TRY_ENTER() (true)
+#define SAMPLE_ENTER()
+#define SAMPLE_EXIT()
+#endif
+
+// Starts aggregating samples; samples requested before this are ignored.
+// The VM only tracks the call stack while sampling, so this must be called
+// when no Python code is running.
+void mp_vm_sample_start(void) {
+    #if MICROPY_PY_THREAD
+    mp_thread_mutex_init(&MP_STATE_VM(vm_sample_mutex));
+    #endif
+    MP_STATE_VM(vm_sample_head) = 0;
+    MP_STATE_VM(vm_sample_tail) = 0;
+    MP_STATE_VM(vm_sample_dropped) = 0;
+    MP_STATE_VM(vm_sample_stacks) = mp_obj_new_dict(0);
+}
+
+// Records the frame of code_state, which is at ip, into the ring buffer.
+STATIC size_t record_frame(size_t head, const mp_code_state_t *code_state, const byte *ip_cur) {
+    const byte *ip = code_state->fun_bc->bytecode;
+    mp_decode_uint(&ip); // skip n_state
+    mp_decode_uint(&ip); // skip n_exc_stack
+    ip += 4; // skip scope_params, n_pos_args, n_kwonly_args, n_def_pos_args
+    size_t bc = ip_cur - ip;
+    bc -= mp_decode_uint(&ip); // code_info_size
+    #if MICROPY_PERSISTENT_CODE
+    RING(head) = ip[0] | (ip[1] << 8);
+    RING(head + 1) = ip[2] | (ip[3] << 8);
+    ip += 4;
+    #else
+    RING(head) = mp_decode_uint(&ip);
+    RING(head + 1) = mp_decode_uint(&ip);
+    #endif
+    RING(head + 2) = mp_bytecode_get_source_line(ip, bc);
+    return head + FRAME_SIZE;
+}
+
+// Moves the samples from the ring buffer to the dict of stacks, keyed by the
+// frames from the outermost, in the "collapsed" format of flame graph tools.
+// The sample lock must be held.
+STATIC void aggregate(void) {
+    size_t tail = MP_STATE_VM(vm_sample_tail);
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        mp_map_t *map = mp_obj_dict_get_map(MP_STATE_VM(vm_sample_stacks));
+        vstr_t vstr;
+        mp_print_t print;
+        vstr_init_print(&vstr, 64, &print);
+        while (tail != MP_STATE_VM(vm_sample_head)) {
+            size_t n = RING(tail);
+            vstr_reset(&vstr);
+            for (size_t i = n; i-- > 0;) {
+                size_t f = tail + 1 + i * FRAME_SIZE;
+                mp_printf(&print, "%q (%q:%u);", (qstr)RING(f), (qstr)RING(f + 1), (uint)RING(f + 2));
+            }
+            vstr_cut_tail_bytes(&vstr, 1);
+            mp_map_elem_t *elem = mp_map_lookup(map, mp_obj_new_str(vstr.buf, vstr.len, false), MP_MAP_LOOKUP_ADD_IF_NOT_FOUND);
+            mp_int_t count = elem->value == MP_OBJ_NULL ? 0 : MP_OBJ_SMALL_INT_VALUE(elem->value);
+            elem->value = MP_OBJ_NEW_SMALL_INT(count + 1);
+            tail += 1 + n * FRAME_SIZE;
+            MP_STATE_VM(vm_sample_tail) = tail;
+        }
+        vstr_clear(&vstr);
+        nlr_pop();
+    } else {
+        // out of memory, so lose the samples that are left
+        MP_STATE_VM(vm_sample_dropped) += 1;
+        MP_STATE_VM(vm_sample_tail) = MP_STATE_VM(vm_sample_head);
+    }
+}
+
+// Called by the VM when a sample is pending, with the ip of the running code.
+void mp_vm_sample(const byte *ip) {
+    MP_STATE_VM(vm_sample_pending) = false;
+    if (MP_STATE_VM(vm_sample_stacks) == MP_OBJ_NULL || !SAMPLE_TRY_ENTER()) {
+        return;
+    }
+
+    size_t n = 0;
+    for (const mp_code_state_t *c = MP_STATE_THREAD(current_code_state);
+        c != NULL && n < MICROPY_VM_SAMPLING_MAX_DEPTH; c = c->prev_state) {
+        ++n;
+    }
+
+    size_t head = MP_STATE_VM(vm_sample_head);
+    if (head + 1 + n * FRAME_SIZE - MP_STATE_VM(vm_sample_tail) > MICROPY_VM_SAMPLING_RING_SIZE) {
+        // the ring is full, which can only happen while the heap is locked
+        MP_STATE_VM(vm_sample_dropped) += 1;
+        SAMPLE_EXIT();
+        return;
+    }
+    RING(head++) = n;
+    const mp_code_state_t *c = MP_STATE_THREAD(current_code_state);
+    for (size_t i = 0; i < n; ++i) {
+        head = record_frame(head, c, i == 0 ? ip : c->ip);
+        c = c->prev_state;
+    }
+    MP_STATE_VM(vm_sample_head) = head;
+
+    // aggregating allocates, so is done in batches when the heap is usable
+    if (head - MP_STATE_VM(vm_sample_tail) > MICROPY_VM_SAMPLING_RING_SIZE / 2
+        #if MICROPY_ENABLE_GC
+        && !gc_is_locked()
+        #endif
+        ) {
+        aggregate();
+    }
+    SAMPLE_EXIT();
+}
+
+// Prints each sampled stack with its count, one per line.
+void mp_vm_sample_print_collapsed(const mp_print_t *print) {
+    if (MP_STATE_VM(vm_sample_stacks) == MP_OBJ_NULL) {
+        return;
+    }
+    SAMPLE_ENTER();
+    aggregate();
+    mp_map_t *map = mp_obj_dict_get_map(MP_STATE_VM(vm_sample_stacks));
+    for (size_t i = 0; i < map->alloc; i++) {
+        if (MP_MAP_SLOT_IS_FILLED(map, i)) {
+            mp_printf(print, "%s " INT_FMT "\n", mp_obj_str_get_str(map->table[i].key),
+                MP_OBJ_SMALL_INT_VALUE(map->table[i].value));
+        }
+    }
+    SAMPLE_EXIT();
+}
+
+#endif // MICROPY_VM_SAMPLING
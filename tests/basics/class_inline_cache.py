@@ -0,0 +1,77 @@
+# test that cached attribute lookups see changes to classes and instances
+
+class A:
+    x = 1
+    def f(self):
+        return 'A.f'
+
+class B(A):
+    pass
+
+class C(B):
+    pass
+
+def get(o):
+    return o.x, o.f()
+
+c = C()
+print(get(c), get(c))
+
+# change a method and a class attribute of a base class
+def f2(self):
+    return 'A.f2'
+A.f = f2
+A.x = 2
+print(get(c))
+
+# override them in a subclass
+def f3(self):
+    return 'B.f3'
+B.f = f3
+B.x = 3
+print(get(c))
+
+# and remove the overrides
+del B.f
+del B.x
+print(get(c))
+
+# instance members hide class attributes
+c.x = 4
+c.f = lambda: 'c.f'
+print(get(c))
+del c.x
+del c.f
+print(get(c))
+
+# different types at the same call site
+class D:
+    x = 5
+    def f(self):
+        return 'D.f'
+for o in (c, D(), c, D()):
+    print(get(o))
+
+# static and class methods, and loads from the class itself
+class E:
+    @staticmethod
+    def s():
+        return 'E.s'
+    @classmethod
+    def c(cls):
+        return cls.__name__
+class F(E):
+    pass
+for o in (E, F, E(), F()):
+    print(o.s(), o.c())
+
+# a class made by type() doesn't see later changes to the dict given
+d = {'x': 6}
+G = type('G', (), d)
+print(G().x)
+d['x'] = 7
+print(G().x)
+
+# builtin methods
+for o in ([1], [2, 3], (4,)):
+    print(o.count(1))
@@ -0,0 +1,58 @@
+# test repeated calls with keyword args, which may be cached per callee
+
+def f(a, b, c=3, *, d=4):
+    return (a, b, c, d)
+
+for i in range(3):
+    print(f(1, b=2), f(b=i, a=1), f(1, 2, d=i, c=0), f(c=i, b=2, a=1))
+
+def g(a, **kw):
+    return a, sorted(kw.items())
+
+for i in range(3):
+    print(g(a=i, x=1), g(x=i, a=1), g(1, y=2, x=i))
+
+# errors must still be raised on a cached call
+for i in range(3):
+    try:
+        f(1, a=i)
+    except TypeError:
+        print('TypeError multiple')
+    try:
+        f(1, 2, e=i)
+    except TypeError:
+        print('TypeError unexpected')
+    try:
+        f(1, 2, **{'b': i})
+    except TypeError:
+        print('TypeError multiple')
+
+# same keyword names to different callees, and to a redefined function
+def h(b, a):
+    return (a, b)
+for i in range(2):
+    print(f(a=1, b=i), h(a=1, b=i))
+def h(a, b):
+    return (a, b)
+print(h(a=1, b=2))
+
+# methods and class construction
+class A:
+    def __init__(self, x, y=0):
+        self.v = (x, y)
+    def m(self, p, q):
+        return p - q
+for i in range(3):
+    a = A(y=i, x=5)
+    print(a.v, a.m(q=i, p=10))
+
+# builtins that parse keyword args
+for i in range(3):
+    print(list(enumerate('ab', start=i)), sorted([3, 1, 2], reverse=bool(i), key=lambda x: -x))
+    l = [2, 3, 1]
+    l.sort(reverse=bool(i))
+    print(l)
+    try:
+        enumerate('ab', stop=i)
+    except TypeError:
+        print('TypeError')
@@ -0,0 +1,59 @@
+# test calls to functions that take only positional args
+
+def f0():
+    return 0
+
+def f2(a, b):
+    return a - b
+
+def f3(a, b, c=3):
+    return (a, b, c)
+
+print(f0(), f2(5, 2), f2(b=5, a=2), f2(*(7, 1)))
+print(f3(1, 2), f3(1, 2, 4), f3(1, 2, c=5))
+
+# wrong number of args
+for args in ((), (1,), (1, 2, 3)):
+    try:
+        f2(*args)
+    except TypeError:
+        print('TypeError', len(args))
+
+# locals other than args start unbound
+def f4(a):
+    if a:
+        b = 1
+    return b
+print(f4(1))
+try:
+    f4(0)
+except NameError:
+    print('NameError')
+
+# free vars are passed as extra positional args
+def outer(x):
+    def inner(y):
+        return x + y
+    return inner
+print(outer(10)(5))
+
+# an arg that is closed over must be wrapped in a cell
+def cell(a):
+    return lambda: a
+print(cell(7)())
+
+# methods and generators
+class A:
+    def meth(self, x):
+        return x * 2
+print(A().meth(21))
+
+def gen(a, b):
+    yield a
+    yield b
+print(list(gen(1, 2)))
+
+# recursion
+def fib(n):
+    return n if n < 2 else fib(n - 1) + fib(n - 2)
+print(fib(15))
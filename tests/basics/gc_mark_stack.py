@@ -0,0 +1,23 @@
+# test that wide and deep structures, which overflow the GC's mark stack,
+# survive collections
+
+import gc
+
+wide = [[i] for i in range(5000)]
+tree = [[[[j, k] for k in range(10)] for j in range(10)] for i in range(10)]
+head = None
+for i in range(5000):
+    head = (head, [i])
+
+for i in range(3):
+    gc.collect()
+    # allocate, so any memory freed wrongly gets reused
+    junk = [[j] for j in range(1000)]
+
+print(sum(x[0] for x in wide))
+print(sum(l[0] + l[1] for a in tree for b in a for l in b))
+n = 0
+while head is not None:
+    n += head[1][0]
+    head = head[0]
+print(n)
@@ -0,0 +1,56 @@
+# test that loads of globals and builtins see changes made after they ran
+
+def get_len():
+    return len
+
+def get_x():
+    return x
+
+# builtin, then a global shadowing it, then the builtin again
+for i in range(3):
+    print(get_len()("abc"))
+len = lambda s: -1
+for i in range(3):
+    print(get_len()("abc"))
+del len
+for i in range(3):
+    print(get_len()("abc"))
+
+# a global that is stored to, deleted and redefined
+x = 1
+for i in range(3):
+    print(get_x())
+    x += 1
+del x
+try:
+    get_x()
+except NameError:
+    print('NameError')
+x = 10
+print(get_x())
+
+# changes made through the globals dict
+globals()['x'] = 20
+print(get_x())
+for i in range(20):
+    globals()['y%d' % i] = i
+print(get_x(), y19)
+globals().pop('x')
+try:
+    get_x()
+except NameError:
+    print('NameError')
+globals().update({'len': lambda s: -2})
+print(get_len()("abc"))
+globals().clear()
+print(len("abc"))
+
+# freed bytecode can be reallocated at the same address with another name
+import gc
+a = 1
+b = 2
+r = []
+for s in ('a', 'b', 'a', 'b', 'a', 'b'):
+    gc.collect()
+    r.append(eval(s))
+print(r)
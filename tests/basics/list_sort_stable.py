@@ -0,0 +1,43 @@
+# test that sort is stable and calls the key function once per item
+
+l = [(1, 'a'), (0, 'b'), (1, 'c'), (0, 'd'), (1, 'e'), (0, 'f')]
+print(sorted(l, key=lambda x: x[0]))
+print(sorted(l, key=lambda x: x[0], reverse=True))
+
+# long enough to be split into several runs which need merging
+l = [(i * 7 % 5, i) for i in range(300)]
+s = sorted(l, key=lambda x: x[0])
+print(s == [x for k in range(5) for x in l if x[0] == k])
+s = sorted(l, key=lambda x: x[0], reverse=True)
+print(s == [x for k in range(4, -1, -1) for x in l if x[0] == k])
+
+# already sorted, reversed and partially sorted inputs
+l = list(range(200))
+print(sorted(l) == l, sorted(l, reverse=True) == l[::-1])
+l = list(range(200, 0, -1)) + list(range(100))
+print(sorted(l) == sorted(l, key=lambda x: x))
+
+# key function is called once per item
+n = 0
+def key(x):
+    global n
+    n += 1
+    return -x
+l = list(range(100))
+l.sort(key=key)
+print(n, l[0], l[-1])
+
+# exception during comparison leaves the list with its original items
+class A:
+    def __init__(self, x):
+        self.x = x
+    def __lt__(self, other):
+        if self.x == 3 or other.x == 3:
+            raise ValueError
+        return self.x < other.x
+l = [A(i) for i in range(10, 0, -1)]
+try:
+    l.sort()
+except ValueError:
+    print('ValueError')
+print(sorted(a.x for a in l))
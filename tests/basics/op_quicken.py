@@ -0,0 +1,84 @@
+# test that binary ops and subscripts give the right result when a call site
+# sees operands of different types over time
+
+def add(a, b):
+    return a + b
+
+def iadd(a, b):
+    a += b
+    return a
+
+def sub(a, b):
+    return a - b
+
+def mul(a, b):
+    return a * b
+
+def div(a, b):
+    return a / b
+
+def lt(a, b):
+    return a < b
+
+def ne(a, b):
+    return a != b
+
+def load(a, i):
+    return a[i]
+
+def store(a, i, v):
+    a[i] = v
+
+# small ints, then overflow to big ints, then other types
+for args in ((1, 2), (1, 2), (1 << 29, 1 << 29), (1 << 61, 1 << 61), (1, 2.5), ('a', 'b'), ([1], [2]), (1, 2)):
+    print(add(*args), iadd(*args))
+for args in ((5, 3), (-(1 << 61), 1 << 61), (5, 3), (5.5, 1), (5, 3)):
+    print(sub(*args))
+for args in ((3, 4), (1 << 40, 1 << 40), (3, 4), ('ab', 2), (2.5, 2), (3, 4)):
+    print(mul(*args))
+for args in ((1, 2), (1, 2), (1, 2.0), ('a', 'b'), (1, 2)):
+    print(lt(*args), ne(*args))
+
+# floats, including division by zero
+for args in ((1.5, 0.5), (1.5, 2), (1.5, 0.5), (3, 2), (1.5, 0.5)):
+    print(div(*args))
+for args in ((1.0, 0.0), (1.0, 0)):
+    try:
+        div(*args)
+    except ZeroDivisionError:
+        print('ZeroDivisionError')
+for args in ((1.5, 2.25), (1.5, 1), (1.5, 'a'), (1.5, 2.25)):
+    try:
+        print(add(*args))
+    except TypeError:
+        print('TypeError')
+
+# strs
+for args in (('a', 'b'), ('a', 'b'), ('a', 1), (b'a', b'b'), ('a', 'b')):
+    try:
+        print(add(*args))
+    except TypeError:
+        print('TypeError')
+
+# list and dict subscripts
+class L(list):
+    def __getitem__(self, i):
+        return 'L'
+class D(dict):
+    def __getitem__(self, k):
+        return 'D'
+l = [1, 2, 3]
+d = {1: 'a', 'b': 2}
+for args in ((l, 0), (l, -1), (l, 1), (L([1]), 0), (l, 2), ((4, 5), 1), (d, 1), (d, 'b'), (D(), 1), (d, 1), ('abc', 1), (l, 0)):
+    print(load(*args))
+for args in ((l, 3), (l, -4), (d, 2), ({}, 1)):
+    try:
+        load(*args)
+    except (IndexError, KeyError) as e:
+        print(type(e).__name__)
+for args in ((l, 0, 'x'), (l, -1, 'y'), (d, 0, 'z'), (l, 1, 'w'), (l, 5, 'v')):
+    try:
+        store(*args)
+    except IndexError:
+        print('IndexError')
+print(l, sorted(d.items(), key=str))
@@ -0,0 +1,13 @@
+import bench
+
+def func(a, b, c):
+    pass
+
+def wrapper(*args):
+    return func(*args)
+
+def test(num):
+    for i in iter(range(num)):
+        wrapper(i, 2, 3)
+
+bench.run(test)
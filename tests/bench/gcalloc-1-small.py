@@ -0,0 +1,11 @@
+import bench
+
+def test(num):
+    # a large live heap of small objects, so free blocks are scattered
+    keep = [[i] for i in range(20000)]
+    for i in iter(range(num // 10)):
+        t = (i, i)
+        l = [i]
+        keep[i % 20000] = l
+
+bench.run(test)
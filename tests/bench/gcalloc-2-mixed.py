@@ -0,0 +1,10 @@
+import bench
+
+def test(num):
+    # retain a window of objects of mixed sizes, so the heap fragments
+    keep = [None] * 1000
+    for i in iter(range(num // 40)):
+        keep[(i * 7) % 1000] = bytearray((i * 37) % 400)
+        keep[(i * 13) % 1000] = [0] * ((i * 11) % 30)
+
+bench.run(test)
@@ -0,0 +1,12 @@
+import bench
+
+def test(num):
+    # interleave long-lived small objects with short-lived large buffers
+    keep = []
+    for i in iter(range(num // 200)):
+        keep.append([i])
+        if len(keep) > 5000:
+            keep = keep[2500:]
+        b = bytearray(1000 + (i * 53) % 3000)
+
+bench.run(test)
@@ -0,0 +1,10 @@
+import bench
+import gc
+
+def test(num):
+    # large live byte buffers, which the GC does not need to scan
+    bufs = [bytearray(1 << 18) for i in range(4)]
+    for i in iter(range(num // 20000)):
+        gc.collect()
+
+bench.run(test)
@@ -0,0 +1,11 @@
+import bench
+import gc
+
+def test(num):
+    # many live str and bytes objects
+    strs = [str(i) * 20 for i in range(5000)]
+    b = [bytes(200) for i in range(2000)]
+    for i in iter(range(num // 20000)):
+        gc.collect()
+
+bench.run(test)
@@ -0,0 +1,10 @@
+import bench
+import gc
+
+def test(num):
+    # a list of many lists, which overflows the mark stack
+    l = [[i] for i in range(10000)]
+    for i in iter(range(num // 20000)):
+        gc.collect()
+
+bench.run(test)
@@ -0,0 +1,13 @@
+import bench
+
+class Foo:
+    pass
+
+def test(num):
+    o = Foo()
+    o.attr = 1
+    name = "at" + "tr"
+    for i in iter(range(num // 20)):
+        getattr(o, name)
+
+bench.run(test)
@@ -0,0 +1,16 @@
+import bench
+
+class Foo:
+    pass
+
+def test(num):
+    o = Foo()
+    o.attr = 1
+    # intern lots of extra names so that lookups have many qstrs to search
+    for i in range(10000):
+        getattr(o, "name%d" % i, None)
+    name = "at" + "tr"
+    for i in iter(range(num // 20)):
+        getattr(o, name)
+
+bench.run(test)
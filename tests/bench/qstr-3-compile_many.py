@@ -0,0 +1,10 @@
+import bench
+
+def test(num):
+    # each compile interns the identifiers through the lexer, which is
+    # what happens when importing a module
+    src = "\n".join("ident%d = %d" % (i, i) for i in range(2000))
+    for i in iter(range(num // 1000000)):
+        compile(src, "bench", "exec")
+
+bench.run(test)
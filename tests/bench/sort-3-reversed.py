@@ -0,0 +1,8 @@
+import bench
+
+def test(num):
+    l = list(range(10000, 0, -1))
+    for i in iter(range(num // 200000)):
+        sorted(l)
+
+bench.run(test)
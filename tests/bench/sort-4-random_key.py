@@ -0,0 +1,12 @@
+import bench
+
+def test(num):
+    x = 1
+    l = []
+    for i in range(10000):
+        x = (x * 1103515245 + 12345) & 0x3fffffff
+        l.append((i, 'item', x))
+    for i in iter(range(num // 200000)):
+        sorted(l, key=lambda r: r[2])
+
+bench.run(test)
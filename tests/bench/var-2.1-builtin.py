@@ -0,0 +1,11 @@
+import bench
+
+ITERS = 20000000
+
+def test(num):
+    i = 0
+    while i < ITERS:
+        len
+        i += 1
+
+bench.run(test)
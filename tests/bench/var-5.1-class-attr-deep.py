@@ -0,0 +1,24 @@
+import bench
+
+class Foo0:
+    num = 20000000
+
+class Foo1(Foo0):
+    pass
+
+class Foo2(Foo1):
+    pass
+
+class Foo3(Foo2):
+    pass
+
+class Foo4(Foo3):
+    pass
+
+def test(num):
+    o = Foo4()
+    i = 0
+    while i < o.num:
+        i += 1
+
+bench.run(test)
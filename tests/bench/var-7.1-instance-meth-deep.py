@@ -0,0 +1,29 @@
+import bench
+
+class Foo0:
+
+    def __init__(self):
+        self._num = 20000000
+
+    def num(self):
+        return self._num
+
+class Foo1(Foo0):
+    pass
+
+class Foo2(Foo1):
+    pass
+
+class Foo3(Foo2):
+    pass
+
+class Foo4(Foo3):
+    pass
+
+def test(num):
+    o = Foo4()
+    i = 0
+    while i < o.num():
+        i += 1
+
+bench.run(test)
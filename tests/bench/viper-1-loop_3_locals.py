@@ -0,0 +1,11 @@
+import bench
+
+@micropython.viper
+def test(num:int):
+    i = 0
+    acc = 0
+    while i < num:
+        acc += i
+        i += 1
+
+bench.run(test)
@@ -0,0 +1,15 @@
+import bench
+
+@micropython.viper
+def test(num:int):
+    i = 0
+    a = 0
+    b = 1
+    c = 2
+    while i < num:
+        a += b
+        b ^= c
+        c += a
+        i += 1
+
+bench.run(test)
@@ -0,0 +1,18 @@
+import bench
+
+# the locals used in the loop are not the first ones
+@micropython.viper
+def test(num:int):
+    w = 1
+    x = 2
+    y = 3
+    z = w + x + y
+    i = 0
+    a = 0
+    b = z
+    while i < num:
+        a += b
+        b ^= i
+        i += 1
+
+bench.run(test)
@@ -0,0 +1,14 @@
+import bench
+
+@micropython.viper
+def test(num:int):
+    buf = bytearray(range(256))
+    p = ptr8(buf)
+    acc = 0
+    n = num >> 8
+    while n > 0:
+        for i in range(256):
+            acc += p[i]
+        n -= 1
+
+bench.run(test)
@@ -0,0 +1,40 @@
+# cmdline: -X heapsize=64k -X heapmax=1m
+# test that the heap grows up to heapmax, and shrinks again
+import gc
+
+gc.collect()
+total = gc.mem_alloc() + gc.mem_free()
+
+# the lists are cleared before they are dropped, so that a stale pointer to
+# one left on the C stack doesn't keep all of its items alive
+def alloc(n):
+    l = []
+    try:
+        for i in range(n):
+            l.append(bytearray(1000))
+    except MemoryError:
+        l.clear()
+        raise
+    return l
+
+# more than the initial heap
+l = alloc(200)
+peak = gc.mem_alloc() + gc.mem_free()
+print(len(l), peak > total)
+
+# areas that become empty are given back; a stray reference may keep one
+# alive, so don't require getting back to the initial size
+l.clear()
+l = None
+gc.collect()
+print(gc.mem_alloc() + gc.mem_free() < peak)
+
+# but not more than heapmax
+try:
+    alloc(2000)
+except MemoryError:
+    print('MemoryError')
+
+# the heap still works after failing to grow
+gc.collect()
+print(len(alloc(100)))
@@ -0,0 +1,13 @@
+# cmdline: -v -v
+# test the bytecode peephole pass: fused instructions, threaded jumps and
+# dropped unreachable code
+def f(a, b):
+    c = a + b
+    d = c - 1
+    for i in a:
+        if i:
+            d = 1
+        else:
+            d = 2
+    return d
+    d = 3
@@ -0,0 +1,38 @@
+# cmdline: -X profile=cmdline/cmd_profile.prof
+# test that code runs the same while the Python stack is being sampled, and
+# that the samples are written out; run-tests summarises them
+
+def f(n):
+    s = 0
+    for i in range(n):
+        s += i
+    return s
+
+def rec(n):
+    return rec(n - 1) + 1 if n else 0
+
+def gen(n):
+    for i in range(n):
+        yield f(i)
+
+def exc():
+    try:
+        raise ValueError(f(10))
+    except ValueError as e:
+        return e.args[0]
+
+def fail():
+    raise TypeError
+
+for i in range(200):
+    x = f(1000) + rec(20) + sum(gen(20)) + exc()
+    try:
+        fail()
+    except TypeError:
+        pass
+print(x)
+
+# a hot loop, so that f is sampled
+for i in range(1000):
+    x = f(2000)
+print(x)
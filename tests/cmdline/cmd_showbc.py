@@ -1,4 +1,4 @@
-# cmdline: -v -v
+# cmdline: -v -v -fno-peephole
 # test printing of all bytecodes
 
 def f():
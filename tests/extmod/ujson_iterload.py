@@ -0,0 +1,39 @@
+try:
+    from uio import StringIO
+    import ujson as json
+except ImportError:
+    print("SKIP")
+    import sys
+    sys.exit()
+
+if not hasattr(json, 'iterload'):
+    print("SKIP")
+    import sys
+    sys.exit()
+
+# newline delimited values
+for v in json.iterload(StringIO('{"a": 1}\n[1, 2]\n"abc"\n3\nnull\n')):
+    print(v)
+
+# concatenated values, with and without whitespace
+print(list(json.iterload(StringIO('{"a":[1,{"b":2}]}[3][]{} true false'))))
+
+# empty input
+print(list(json.iterload(StringIO(''))))
+print(list(json.iterload(StringIO('  \n '))))
+
+# values spanning many buffer refills
+s = '\n'.join(json.dumps({'k%d' % i: list(range(i))}) for i in range(100))
+l = list(json.iterload(StringIO(s)))
+print(len(l), l[-1] == {'k99': list(range(99))})
+
+# the iterator can be resumed
+it = json.iterload(StringIO('[1] [2] [3]'))
+print(next(it))
+print(list(it))
+
+# incomplete value
+try:
+    list(json.iterload(StringIO('[1] [2')))
+except ValueError:
+    print('ValueError')
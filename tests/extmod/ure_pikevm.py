@@ -0,0 +1,65 @@
+# test the linear-time (Pike VM) engine of ure, and the compiled pattern cache
+
+try:
+    import ure
+except ImportError:
+    import sys
+    print("SKIP")
+    sys.exit()
+
+if not hasattr(ure, "PIKEVM"):
+    print("SKIP")
+    import sys
+    sys.exit()
+
+# patterns that are exponential for a backtracking matcher
+print(ure.match("(a|a)*b", "a" * 1000))
+print(ure.search("(a|aa)*c", "a" * 1000))
+print(ure.match("(a|a)*b", "a" * 1000 + "b").group(0) == "a" * 1000 + "b")
+
+# an empty loop body must not loop forever
+print(ure.match("(a*)*b", "aab").group(0))
+print(ure.match("(a*)*b", "aac"))
+
+# a long subject does not need deep recursion
+m = ure.match(".*(x)", "a" * 100000 + "x")
+print(m.group(1))
+
+# both engines give the same leftmost-first results
+for pat, subj in (
+    ("a|ab", "abc"),
+    ("ab|a", "abc"),
+    ("(a|ab)(c|bcd)(d*)", "abcd"),
+    (".*?(\\d+)", "ab 12 34"),
+    ("(..)+?x", "1234x"),
+    ("(a)(b)?(c)", "ac"),
+    ("^a+$", "aaa"),
+    ("[^x]*x$", "abxx"),
+):
+    rb = ure.compile(pat, ure.BACKTRACK)
+    rp = ure.compile(pat, ure.PIKEVM)
+    for f in ("match", "search"):
+        mb = getattr(rb, f)(subj)
+        mp = getattr(rp, f)(subj)
+        n = pat.count("(") + 1
+        gb = mb and [mb.group(i) for i in range(n)]
+        gp = mp and [mp.group(i) for i in range(n)]
+        print(pat, f, gp, gb == gp)
+
+# split with the Pike VM
+print(ure.compile("a+", ure.PIKEVM).split("baaacaad"))
+
+# module-level functions with more patterns than the cache holds
+for i in range(20):
+    for j in range(3):
+        m = ure.match("x" * i + "(y)", "x" * i + "yz")
+        print(i, m.group(0) == "x" * i + "y", end=" ")
+print()
+print(ure.compile("ab") is ure.compile("ab"))
+
+# jumps too long for the bytecode are rejected instead of aborting a match
+for pat in ("(" + "a" * 100 + ")*", "x|" + "b" * 140, "[" + "a" * 300 + "]"):
+    try:
+        ure.compile(pat)
+    except ValueError:
+        print("ValueError")
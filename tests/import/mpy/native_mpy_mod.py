@@ -0,0 +1,23 @@
+# native code for the native_mpy test, which compiles it to a .mpy file
+
+X = 'global'
+
+# the names are QSTR relocations, the float and bytes OBJ ones, the calls
+# into the runtime FUN_TABLE ones and the nested function a RAW_CODE one
+@micropython.native
+def native(a):
+    def inner(b):
+        return (X, a, b)
+    return inner(len(a) + 1.5), b'bytes'.decode()
+
+@micropython.native
+def native_gen(n):
+    for i in range(n):
+        yield i * 2
+
+@micropython.viper
+def viper_sum(n: int) -> int:
+    s = 0
+    for i in range(n):
+        s += i
+    return s
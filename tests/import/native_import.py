@@ -0,0 +1,14 @@
+# native and viper functions imported from another module must see the
+# globals of that module, and the caller's globals must be restored after
+
+X = 2
+
+from pkg9.mod import get_native, get_viper, raise_native
+
+print(get_native())
+print(get_viper())
+try:
+    raise_native()
+except ValueError as er:
+    print(repr(er))
+print(X)
@@ -0,0 +1,20 @@
+# test importing native code from a .mpy file made by mpy-cross
+# mpy-cross: -mcache-lookup-bc -march=x64 -o import/native_mpy_mod.mpy import/mpy/native_mpy_mod.py
+# mpy-cross: -mcache-lookup-bc -march=x64 -mnlr-buf-words=1 -o import/native_mpy_bad.mpy import/mpy/native_mpy_mod.py
+
+try:
+    import native_mpy_mod
+except (ImportError, ValueError):
+    # mpy-cross isn't available, or the target isn't the unix port on x64
+    print('SKIP')
+    raise SystemExit
+
+print(native_mpy_mod.native('abc'))
+print(list(native_mpy_mod.native_gen(4)))
+print(native_mpy_mod.viper_sum(10))
+
+# a file made for a different structure layout is rejected
+try:
+    import native_mpy_bad
+except ValueError as er:
+    print(er)
@@ -0,0 +1,13 @@
+X = 1
+
+@micropython.native
+def get_native():
+    return X
+
+@micropython.viper
+def get_viper():
+    return X
+
+@micropython.native
+def raise_native():
+    raise ValueError(X)
@@ -0,0 +1,43 @@
+# test that files which are not closed are closed when they are collected
+
+import gc
+
+try:
+    open("io/data/file1").fileno
+except AttributeError:
+    print("SKIP")
+    import sys
+    sys.exit()
+
+def next_fd():
+    f = open("io/data/file1")
+    fd = f.fileno()
+    f.close()
+    return fd
+
+def leak(n):
+    for i in range(n):
+        f = open("io/data/file1")
+        f.read(1)
+
+gc.collect()
+fd = next_fd()
+
+# without finalisers these would use up 1000 descriptors
+for i in range(10):
+    leak(100)
+    gc.collect()
+
+# the descriptors were freed and get reused (a few files may still be
+# referenced from the stack)
+print(next_fd() - fd < 10)
+
+# closing a file, and then collecting it, doesn't close another file that
+# was given the same descriptor
+f = open("io/data/file1")
+f.close()
+f2 = open("io/data/file1")
+f = None
+gc.collect()
+print(f2.read(5))
+f2.close()
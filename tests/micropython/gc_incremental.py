@@ -0,0 +1,76 @@
+# test incremental garbage collection, with objects being stored into
+# containers while marking is in progress
+
+import gc
+
+try:
+    gc.incremental
+except AttributeError:
+    print("SKIP")
+    import sys
+    sys.exit()
+
+class A:
+    pass
+
+def gen():
+    acc = []
+    i = 0
+    while True:
+        acc.append([i])
+        if len(acc) > 20:
+            acc = acc[10:]
+        i += 1
+        yield acc
+
+def make_cell(v):
+    x = v
+    def get():
+        return x
+    def put(y):
+        nonlocal x
+        x = y
+    return get, put
+
+print(gc.incremental())
+gc.incremental(True, 1024)
+print(gc.incremental())
+gc.pauses(True)
+
+d = {}
+l = []
+s = set()
+objs = [A() for i in range(50)]
+cells = [make_cell(i) for i in range(50)]
+g = gen()
+for i in range(20000):
+    v = [str(i), (i, i + 1)]
+    d[i % 101] = v
+    if len(l) < 100:
+        l.append(v)
+    else:
+        l[i % 100] = v
+    objs[i % 50].x = v
+    cells[i % 50][1]([i, str(i)])
+    s.add(str(i % 77) + "s")
+    next(g)
+
+# check that nothing reachable was freed (and reused)
+print(all(v[0] == str(v[1][0]) for v in d.values()))
+print(all(v[0] == str(v[1][0]) for v in l))
+print(all(o.x[0] == str(o.x[1][0]) for o in objs))
+print(all(c[0]()[1] == str(c[0]()[0]) for c in cells))
+print(len(s), next(g)[-1][0])
+
+# an explicit collection completes any cycle in progress
+gc.collect()
+max_pause, hist = gc.pauses()
+print(type(max_pause), len(hist), sum(hist) > 0)
+
+gc.incremental(False)
+print(gc.incremental())
+
+try:
+    gc.incremental(True, 1)
+except ValueError:
+    print("ValueError")
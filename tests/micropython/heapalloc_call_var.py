@@ -0,0 +1,62 @@
+# check that calls with *args and **kwargs can be made without allocating
+
+import micropython
+
+def f(a, b=2, c=3):
+    return a + b + c
+
+def fkw(a, *, k=0):
+    return a + k
+
+class A:
+    def m(self, a, b):
+        return a - b
+
+t1 = (1,)
+t3 = (1, 2, 3)
+l2 = [4, 5]
+d0 = {}
+d1 = {'c': 30}
+dk = {'k': 9}
+a = A()
+
+# check that this port forwards the args of such calls without allocating
+def probe(a, b=0):
+    pass
+try:
+    micropython.heap_lock()
+    probe(*t1, **d0)
+    micropython.heap_unlock()
+except MemoryError:
+    micropython.heap_unlock()
+    print('SKIP')
+    raise SystemExit
+
+def test():
+    print(f(*t1), f(*t3), f(*t3, **d0))     # tuple passed as is
+    print(f(1, *l2), f(*l2, **d1))          # small arrays on the stack
+    print(f(10, **d1), fkw(1, **dk))
+    print(a.m(*l2), a.m(1, *t1))            # method calls
+
+# call test() with heap allocation disabled
+micropython.heap_lock()
+test()
+micropython.heap_unlock()
+
+# forwarding wrappers still behave normally
+def wrap(*args, **kw):
+    return f(*args, **kw)
+print(wrap(1), wrap(1, 2), wrap(1, c=5), wrap(*t3))
+
+# a large number of args goes through the heap
+def g(*args, **kw):
+    return len(args), sorted(kw)
+print(g(*range(20)), g(1, 2, *[3, 4], x=1, y=2, **{'z': 3, 'w': 4}))
+
+# a mapping that isn't a dict may grow the array of args
+class M:
+    def keys(self):
+        return ['p', 'q', 'r', 's', 't']
+    def __getitem__(self, k):
+        return k.upper()
+print(g(1, x=2, **M()))
@@ -0,0 +1,142 @@
+# test native emitter can handle generators correctly
+
+# basic generator, with state held across yields
+@micropython.native
+def gen1(n):
+    for i in range(n):
+        yield i * 2
+print(list(gen1(5)))
+
+# send, and return value
+@micropython.native
+def gen2(a, b, c, d):
+    x = yield a + b
+    print('got', x)
+    y = yield c + d + x
+    print('got', y)
+    return y + 1
+g = gen2(1, 2, 3, 4)
+print(next(g))
+print(g.send(10))
+try:
+    g.send(20)
+except StopIteration as er:
+    print('StopIteration', er.args)
+
+# many locals, and a deep stack at the yield
+@micropython.native
+def gen3():
+    a0, a1, a2, a3, a4, a5, a6, a7, a8, a9 = range(10)
+    b0, b1, b2, b3, b4, b5, b6, b7, b8, b9 = range(10, 20)
+    for i in range(2):
+        for j in range(2):
+            print([a0, a9, b0, b9, i, (yield a5 + b5 + i + j), j])
+            a0 += 1
+            b9 += 1
+g = gen3()
+print(next(g))
+while True:
+    try:
+        print(g.send(100))
+    except StopIteration:
+        break
+
+# throw into a generator at a yield inside a try
+@micropython.native
+def gen4():
+    try:
+        yield 1
+        yield 2
+    except ValueError as e:
+        print('caught', type(e))
+        yield 3
+    finally:
+        print('finally')
+g = gen4()
+print(next(g))
+print(g.throw(ValueError))
+try:
+    next(g)
+except StopIteration:
+    print('StopIteration')
+
+# close a generator inside nested try blocks
+@micropython.native
+def gen5():
+    try:
+        try:
+            yield 1
+        finally:
+            print('inner finally')
+    except GeneratorExit:
+        print('GeneratorExit')
+g = gen5()
+print(next(g))
+g.close()
+
+# exception escaping from a generator
+@micropython.native
+def gen6():
+    yield 1
+    raise KeyError(2)
+try:
+    print(list(gen6()))
+except KeyError as e:
+    print('KeyError', e)
+
+# yield from, with values sent and thrown through to the inner generator
+@micropython.native
+def gen7():
+    x = yield from gen2(1, 2, 3, 4)
+    print('gen2 returned', x)
+    try:
+        yield from gen4()
+    except ValueError:
+        print('ValueError')
+g = gen7()
+print(next(g))
+print(g.send(5))
+print(g.send(6))
+print(g.throw(ValueError))
+try:
+    next(g)
+except StopIteration:
+    print('StopIteration')
+g = gen7()
+next(g)
+g.send(1)
+print(g.send(2))
+try:
+    g.throw(IndexError)
+except IndexError:
+    print('IndexError')
+
+# with statement across a yield
+class CM:
+    def __enter__(self):
+        print('enter')
+        return 1
+    def __exit__(self, a, b, c):
+        print('exit', a)
+@micropython.native
+def gen8():
+    with CM() as x:
+        yield x
+        yield x + 1
+print(list(gen8()))
+g = gen8()
+print(next(g))
+try:
+    g.throw(OSError)
+except OSError:
+    print('OSError')
+
+# generator expression and generator closure within a native function
+@micropython.native
+def f(n):
+    @micropython.native
+    def g():
+        for i in range(n):
+            yield i
+    return sum(x * x for x in g())
+print(f(4))
@@ -0,0 +1,67 @@
+# test the bytecode peephole pass, which can be switched at runtime
+
+import micropython
+
+try:
+    micropython.opt_peephole
+except AttributeError:
+    print('SKIP')
+    raise SystemExit
+
+# check we can get and set the flag
+micropython.opt_peephole(False)
+print(micropython.opt_peephole())
+micropython.opt_peephole(True)
+print(micropython.opt_peephole())
+
+# code exercising the superinstructions, threaded jumps and unreachable code
+src = """
+def f(a, b):
+    c = a + b
+    d = c - 1
+    e = d * 15
+    for i in range(a):
+        if i % 2:
+            e = e + i
+        else:
+            continue
+    while True:
+        if b:
+            break
+        b = 1
+    return c, d, e
+    print('unreachable')
+print(f(10, 0))
+def g(x):
+    if x:
+        return x
+    else:
+        raise ValueError(x)
+    print('unreachable')
+print(g(1))
+try:
+    g(0)
+except ValueError as er:
+    print(repr(er))
+"""
+for flag in (False, True):
+    micropython.opt_peephole(flag)
+    exec(src)
+
+# an unbound local in each position of the fused instructions
+def f1():
+    a = 1
+    return a, b
+    b = 2
+def f2():
+    b = 1
+    return a, b
+    a = 2
+def f3():
+    return a + 1
+    a = 2
+for f in (f1, f2, f3):
+    try:
+        f()
+    except NameError:
+        print('NameError')
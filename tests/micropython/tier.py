@@ -0,0 +1,91 @@
+# test promotion of hot bytecode functions to native code
+
+import micropython
+
+try:
+    micropython.opt_tier
+except AttributeError:
+    print('SKIP')
+    raise SystemExit
+
+# check we can get and set the threshold
+print(micropython.opt_tier())
+micropython.opt_tier(8)
+print(micropython.opt_tier())
+
+# calls and backward jumps count towards the threshold, and the function is
+# promoted on the call after reaching it
+def f(n):
+    s = 0
+    for i in range(n):
+        s += i
+    return s
+print(f(2), micropython.tier_info(f))
+print(f(10), micropython.tier_info(f))
+print(f(10), micropython.tier_info(f))
+
+# promoted code raises exceptions, and takes default and keyword args
+def g(a, b=2, *c, **d):
+    if a < 0:
+        raise ValueError(a)
+    return [i * b for i in range(a)], c, d
+for i in range(10):
+    g(1)
+print(micropython.tier_info(g)[1])
+print(g(3), g(2, 3, 4, k=5))
+try:
+    g(-1)
+except ValueError as er:
+    print(repr(er))
+
+# a function with a local that may be unbound stays as bytecode
+def u(c):
+    if c:
+        y = 1
+    return y
+for i in range(10):
+    u(1)
+print(micropython.tier_info(u)[1])
+try:
+    u(0)
+except NameError:
+    print('NameError')
+
+# as does one with an exception handler
+def h():
+    try:
+        return 1
+    except:
+        return 2
+for i in range(10):
+    h()
+print(micropython.tier_info(h)[1])
+
+# the count of a function that stays as bytecode no longer changes
+def r(n):
+    try:
+        for i in range(n):
+            pass
+    except:
+        pass
+for i in range(10):
+    r(1)
+c = micropython.tier_info(r)
+r(10)
+print(c == micropython.tier_info(r), c[1])
+
+# a promoted function uses the globals it was defined with
+x = 'main'
+d = {}
+exec("x = 'exec'\ndef k():\n    return x", d)
+for i in range(10):
+    d['k']()
+print(micropython.tier_info(d['k'])[1], d['k']())
+
+# only bytecode functions have a count
+try:
+    micropython.tier_info(print)
+except TypeError:
+    print('TypeError')
+
+micropython.opt_tier(0)
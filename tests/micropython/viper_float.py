@@ -0,0 +1,62 @@
+# test the float type in viper code
+
+try:
+    exec("@micropython.viper\ndef f(x:float):\n    pass")
+except:
+    print("SKIP")
+    raise SystemExit
+
+@micropython.viper
+def arith(x:float, y:float):
+    print(x + y, x - y, x * y, x / y)
+arith(1.5, 2.0)
+arith(-3.0, 0.25)
+
+@micropython.viper
+def mixed(x:float, n:int) -> float:
+    return n * x + 1 - x / 2.0
+print(mixed(0.5, 3))
+
+@micropython.viper
+def compare(x:float, y:float):
+    print(x < y, x <= y, x > y, x >= y, x == y, x != y)
+compare(1.0, 2.0)
+compare(2.0, 2.0)
+compare(3.0, 2.0)
+nan = float('nan')
+compare(nan, 1.0)
+compare(nan, nan)
+
+@micropython.viper
+def cast(x:float):
+    print(int(x), float(int(x)), float(3))
+cast(2.75)
+cast(-2.75)
+
+@micropython.viper
+def accumulate(n:int) -> float:
+    s = float(0)
+    for i in range(n):
+        s += float(i) * 0.5
+    return s
+print(accumulate(10))
+
+# an object operand must be a number
+@micropython.viper
+def add_obj(x:float, y) -> float:
+    return x + y
+print(add_obj(1.5, 2))
+try:
+    add_obj(1.5, 'a')
+except TypeError:
+    print('TypeError')
+
+# type errors at compile time
+def test(code):
+    try:
+        exec(code)
+    except ViperTypeError as e:
+        print(repr(e))
+test("@micropython.viper\ndef f():\n    x = float(1)\n    x = 1")
+test("@micropython.viper\ndef f():\n    x = float(1)\n    ptr(x)")
+test("@micropython.viper\ndef f():\n    x = float(1)\n    x // x")
@@ -0,0 +1,71 @@
+import micropython
+
+# test viper and native functions with many locals
+
+# more live locals than there are registers for them
+@micropython.viper
+def f(a:int, b:int, c:int, d:int) -> int:
+    e = a + b
+    g = c + d
+    h = e * g
+    i = 0
+    j = 0
+    while i < 10:
+        j += a + b + c + d + e + g + h
+        i += 1
+    return j
+print(f(1, 2, 3, 4))
+
+# the locals used most are not the first ones
+@micropython.viper
+def f(x:int) -> int:
+    w = x
+    y = x + 1
+    z = x + 2
+    s = 0
+    for i in range(100):
+        for j in range(3):
+            s += i * j
+    return w + y + z + s
+print(f(1))
+
+# swap locals through the stack
+@micropython.viper
+def f(a:int, b:int, c:int, d:int) -> int:
+    e = 5
+    a, b, c = c, a, b
+    d, e = e, d
+    return (((a * 10 + b) * 10 + c) * 10 + d) * 10 + e
+print(f(1, 2, 3, 4))
+
+# index a pointer with a loop variable held in a register
+@micropython.viper
+def f(src:ptr8) -> int:
+    x = 0
+    for i in range(4):
+        x = src[i]
+    return x
+print(f(bytearray(b'1234')))
+
+# assignments to locals must survive an exception being caught
+@micropython.viper
+def f(a:int) -> int:
+    try:
+        a = 2
+        raise ValueError
+    except ValueError:
+        pass
+    return a
+print(f(1))
+
+@micropython.native
+def f(a):
+    b = 1
+    try:
+        a = 2
+        b = a + 1
+        raise ValueError
+    except ValueError:
+        pass
+    return a, b
+print(f(1))
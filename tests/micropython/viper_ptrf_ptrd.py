@@ -0,0 +1,51 @@
+# test load and store via the ptrf and ptrd types
+
+try:
+    import array
+    exec("@micropython.viper\ndef f(x:ptrf):\n    pass")
+except:
+    print("SKIP")
+    raise SystemExit
+
+@micropython.viper
+def get(src:ptrf, i:int) -> float:
+    return src[0] + src[1] + src[i]
+
+@micropython.viper
+def set(dest:ptrf, i:int, val:float):
+    dest[0] = val
+    dest[i] = val * 2.0
+
+@micropython.viper
+def getd(src:ptrd, i:int) -> float:
+    return src[0] + src[1] + src[i]
+
+@micropython.viper
+def setd(dest:ptrd, i:int, val:float):
+    dest[0] = val
+    dest[i] = val * 2.0
+
+@micropython.viper
+def scale(buf, k:float):
+    p = ptrd(buf)
+    for i in range(int(len(buf))):
+        p[i] = p[i] * k
+
+@micropython.viper
+def sum_large_index(buf) -> float:
+    p = ptrf(buf)
+    return p[40] + p[-1 + 41]
+
+a = array.array('f', [0.5, 1.5, 2.5])
+print(get(a, 2))
+set(a, 2, 0.25)
+print(list(a))
+
+d = array.array('d', [0.5, 1.5, 2.5])
+print(getd(d, 2))
+setd(d, 1, 1.25)
+print(list(d))
+scale(d, 4.0)
+print(list(d))
+
+print(sum_large_index(array.array('f', range(41))))
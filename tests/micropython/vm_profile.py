@@ -0,0 +1,43 @@
+# test the opcode-level VM profiler, which is only in profiling builds
+
+import micropython
+
+try:
+    micropython.vm_profile
+except AttributeError:
+    print('SKIP')
+    raise SystemExit
+
+def f(x):
+    return x
+
+def fact(n):
+    return n * fact(n - 1) if n > 1 else 1
+
+# start from zero
+micropython.vm_profile(True)
+
+for i in range(10):
+    f(i)
+fact(5)
+
+p = micropython.vm_profile(True)
+print(sorted(p.keys()))
+
+# each call returns once
+print(p['opcodes']['RETURN_VALUE'][0])
+print(p['opcodes']['CALL_FUNCTION'][0])
+
+# opcodes have a count and a time
+print(all(len(v) == 2 and v[0] > 0 and v[1] >= 0 for v in p['opcodes'].values()))
+
+# every opcode counted is the second of a pair
+print(sum(p['pairs'].values()) == sum(v[0] for v in p['opcodes'].values()))
+
+# functions have a name, file, call count and time; recursion is counted per call
+funs = {fun[0]: fun[2] for fun in p['functions']}
+print(funs['f'], funs['fact'])
+
+# the counters were cleared
+p = micropython.vm_profile()
+print('f' in [fun[0] for fun in p['functions']])
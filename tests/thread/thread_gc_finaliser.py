@@ -0,0 +1,40 @@
+# test that files left open by threads are closed when collected, with the
+# threads collecting concurrently
+
+import gc
+import _thread
+
+def thread_entry(n):
+    for i in range(n):
+        f = open("thread/thread_gc_finaliser.py")
+        f.read(10)
+        if i % 10 == 0:
+            gc.collect()
+    with lock:
+        global n_finished
+        n_finished += 1
+
+def next_fd():
+    f = open("thread/thread_gc_finaliser.py")
+    fd = f.fileno()
+    f.close()
+    return fd
+
+lock = _thread.allocate_lock()
+n_thread = 4
+n_finished = 0
+
+gc.collect()
+fd = next_fd()
+
+# spawn threads
+for i in range(n_thread):
+    _thread.start_new_thread(thread_entry, (200,))
+
+# busy wait for threads to finish
+while n_finished < n_thread:
+    pass
+
+gc.collect()
+gc.collect()
+print(next_fd() - fd < 20)
@@ -57,7 +57,7 @@ class FreezeError(Exception):
         return 'error while freezing %s: %s' % (self.rawcode.source_file, self.msg)
 
 class Config:
-    MPY_VERSION = 1
+    MPY_VERSION = 3
     MICROPY_LONGINT_IMPL_NONE = 0
     MICROPY_LONGINT_IMPL_LONGLONG = 1
     MICROPY_LONGINT_IMPL_MPZ = 2
@@ -72,6 +72,9 @@ MP_OPCODE_OFFSET = 3
 MP_BC_MAKE_CLOSURE = 0x62
 MP_BC_MAKE_CLOSURE_DEFARGS = 0x63
 MP_BC_RAISE_VARARGS = 0x5c
+MP_BC_LOAD_FAST_LOAD_FAST = 0x2c
+MP_BC_STORE_FAST_LOAD_FAST = 0x2d
+MP_BC_LOAD_FAST_LOAD_CONST_SMALL_INT = 0x2e
 # extra byte if caching enabled:
 MP_BC_LOAD_NAME = 0x1c
 MP_BC_LOAD_GLOBAL = 0x1d
@@ -99,7 +102,7 @@ def make_opcode_format():
     OC4(B, B, V, V), # 0x20-0x23
     OC4(Q, Q, Q, B), # 0x24-0x27
     OC4(V, V, Q, Q), # 0x28-0x2b
-    OC4(U, U, U, U), # 0x2c-0x2f
+    OC4(B, B, B, U), # 0x2c-0x2f
     OC4(B, B, B, B), # 0x30-0x33
     OC4(B, O, O, O), # 0x34-0x37
     OC4(O, O, U, U), # 0x38-0x3b
@@ -172,6 +175,9 @@ def mp_opcode_format(bytecode, ip, opcode_format=make_opcode_format()):
             opcode == MP_BC_RAISE_VARARGS
             or opcode == MP_BC_MAKE_CLOSURE
             or opcode == MP_BC_MAKE_CLOSURE_DEFARGS
+            or opcode == MP_BC_LOAD_FAST_LOAD_FAST
+            or opcode == MP_BC_STORE_FAST_LOAD_FAST
+            or opcode == MP_BC_LOAD_FAST_LOAD_CONST_SMALL_INT
             or config.MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE and (
                 opcode == MP_BC_LOAD_NAME
                 or opcode == MP_BC_LOAD_GLOBAL
@@ -393,6 +399,12 @@ def read_obj(f):
     obj_type = f.read(1)
     if obj_type == b'e':
         return Ellipsis
+    elif obj_type == b'N':
+        return None
+    elif obj_type == b'F':
+        return False
+    elif obj_type == b'T':
+        return True
     else:
         buf = f.read(read_uint(f))
         if obj_type == b's':
@@ -421,7 +433,10 @@ def read_bytecode_qstrs(file, bytecode, ip):
         ip += sz
 
 def read_raw_code(f):
-    bc_len = read_uint(f)
+    kind_len = read_uint(f)
+    if kind_len & 3 != 0:
+        raise Exception('freezing of native code is not supported')
+    bc_len = kind_len >> 2
     bytecode = bytearray(f.read(bc_len))
     ip, ip2, prelude = extract_prelude(bytecode)
     read_qstr_and_pack(f, bytecode, ip2) # simple_name
@@ -442,6 +457,8 @@ def read_mpy(filename):
         if header[1] != config.MPY_VERSION:
             raise Exception('incompatible .mpy version')
         feature_flags = header[2]
+        if feature_flags >> 2 != 0:
+            raise Exception('freezing of native code is not supported')
         config.MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE = (feature_flags & 1) != 0
         config.MICROPY_PY_BUILTINS_STR_UNICODE = (feature_flags & 2) != 0
         config.mp_small_int_bits = header[3]
@@ -33,12 +33,36 @@
 #include "py/mpstate.h"
 #include "py/gc.h"
 
-#if MICROPY_EMIT_NATIVE || (MICROPY_PY_FFI && MICROPY_FORCE_PLAT_ALLOC_EXEC)
-
 #if defined(__OpenBSD__) || defined(__MACH__)
 #define MAP_ANONYMOUS MAP_ANON
 #endif
 
+#if MICROPY_GC_SPLIT_HEAP_AUTO
+
+// Number of bytes that the GC may still add to its heap, set by main()
+size_t mp_unix_heap_room;
+
+void *mp_unix_alloc_heap(size_t size) {
+    if (size > mp_unix_heap_room) {
+        return NULL;
+    }
+    void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) {
+        return NULL;
+    }
+    mp_unix_heap_room -= size;
+    return ptr;
+}
+
+void mp_unix_free_heap(void *ptr, size_t size) {
+    munmap(ptr, size);
+    mp_unix_heap_room += size;
+}
+
+#endif // MICROPY_GC_SPLIT_HEAP_AUTO
+
+#if MICROPY_EMIT_NATIVE || (MICROPY_PY_FFI && MICROPY_FORCE_PLAT_ALLOC_EXEC)
+
 // The memory allocated here is not on the GC heap (and it may contain pointers
 // that need to be GC'd) so we must somehow trace this memory.  We do it by
 // keeping a linked list of all mmap'd regions, and tracing them explicitly.
@@ -127,10 +127,12 @@ STATIC mp_uint_t fdfile_ioctl(mp_obj_t o_in, mp_uint_t request, uintptr_t arg, i
 
 STATIC mp_obj_t fdfile_close(mp_obj_t self_in) {
     mp_obj_fdfile_t *self = MP_OBJ_TO_PTR(self_in);
-    close(self->fd);
-#ifdef MICROPY_CPYTHON_COMPAT
-    self->fd = -1;
-#endif
+    // the descriptor is forgotten, so that closing again (eg by the
+    // finaliser) can't close another file that was given the same number
+    if (self->fd >= 0) {
+        close(self->fd);
+        self->fd = -1;
+    }
     return mp_const_none;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(fdfile_close_obj, fdfile_close);
@@ -159,7 +161,6 @@ STATIC const mp_arg_t file_open_args[] = {
 #define FILE_OPEN_NUM_ARGS MP_ARRAY_SIZE(file_open_args)
 
 STATIC mp_obj_t fdfile_open(const mp_obj_type_t *type, mp_arg_val_t *args) {
-    mp_obj_fdfile_t *o = m_new_obj(mp_obj_fdfile_t);
     const char *mode_s = mp_obj_str_get_str(args[1].u_obj);
 
     int mode_rw = 0, mode_x = 0;
@@ -191,16 +192,20 @@ STATIC mp_obj_t fdfile_open(const mp_obj_type_t *type, mp_arg_val_t *args) {
         }
     }
 
-    o->base.type = type;
-
     mp_obj_t fid = args[0].u_obj;
 
     if (MP_OBJ_IS_SMALL_INT(fid)) {
+        // a descriptor owned by the caller, which is not closed on collection
+        mp_obj_fdfile_t *o = m_new_obj(mp_obj_fdfile_t);
+        o->base.type = type;
         o->fd = MP_OBJ_SMALL_INT_VALUE(fid);
         return MP_OBJ_FROM_PTR(o);
     }
 
     const char *fname = mp_obj_str_get_str(fid);
+    mp_obj_fdfile_t *o = m_new_obj_with_finaliser(mp_obj_fdfile_t);
+    o->base.type = type;
+    o->fd = -1;
     int fd = open(fname, mode_x | mode_rw, 0644);
     if (fd == -1) {
         mp_raise_OSError(errno);
@@ -226,6 +231,7 @@ STATIC const mp_rom_map_elem_t rawfile_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_tell), MP_ROM_PTR(&mp_stream_tell_obj) },
     { MP_ROM_QSTR(MP_QSTR_flush), MP_ROM_PTR(&mp_stream_flush_obj) },
     { MP_ROM_QSTR(MP_QSTR_close), MP_ROM_PTR(&fdfile_close_obj) },
+    { MP_ROM_QSTR(MP_QSTR___del__), MP_ROM_PTR(&fdfile_close_obj) },
     { MP_ROM_QSTR(MP_QSTR___enter__), MP_ROM_PTR(&mp_identity_obj) },
     { MP_ROM_QSTR(MP_QSTR___exit__), MP_ROM_PTR(&fdfile___exit___obj) },
 };
@@ -44,8 +44,11 @@
 #include "py/repl.h"
 #include "py/gc.h"
 #include "py/stackctrl.h"
+#include "py/pystack.h"
 #include "py/mphal.h"
 #include "py/mpthread.h"
+#include "py/vmprofile.h"
+#include "py/vmsample.h"
 #include "extmod/misc.h"
 #include "genhdr/mpversion.h"
 #include "input.h"
@@ -58,6 +61,16 @@ STATIC uint emit_opt = MP_EMIT_OPT_NONE;
 // Heap size of GC heap (if enabled)
 // Make it larger on a 64 bit machine, because pointers are larger.
 long heap_size = 1024*1024 * (sizeof(mp_uint_t) / 4);
+#if MICROPY_GC_SPLIT_HEAP_AUTO
+// Size that the heap may grow to; by default it doesn't grow
+long heap_max = 0;
+extern size_t mp_unix_heap_room;
+#endif
+#endif
+
+#if MICROPY_ENABLE_PYSTACK
+// Size of the Python stack of the main thread
+long pystack_size = 64*1024 * (sizeof(mp_uint_t) / 4);
 #endif
 
 STATIC void stderr_print_strn(void *env, const char *str, size_t len) {
@@ -69,6 +82,60 @@ STATIC void stderr_print_strn(void *env, const char *str, size_t len) {
 
 const mp_print_t mp_stderr_print = {NULL, stderr_print_strn};
 
+#if MICROPY_VM_PROFILE || MICROPY_VM_SAMPLING
+STATIC void file_print_strn(void *env, const char *str, size_t len) {
+    fwrite(str, 1, len, (FILE*)env);
+}
+
+// Writes a profile to the named file using the given printer
+STATIC void write_profile(const char *name, void (*write)(const mp_print_t *print)) {
+    FILE *f = fopen(name, "w");
+    if (f == NULL) {
+        mp_printf(&mp_stderr_print, "can't write profile to '%s': [Errno %d] %s\n", name, errno, strerror(errno));
+        return;
+    }
+    mp_print_t print = {f, file_print_strn};
+    write(&print);
+    fclose(f);
+}
+#endif
+
+#if MICROPY_VM_PROFILE
+// File to write the VM profile to at exit, given by -X vmprofile=<file>
+STATIC const char *vm_profile_file = NULL;
+#endif
+
+#if MICROPY_VM_SAMPLING
+#include <signal.h>
+#include <sys/time.h>
+
+// File to write the sampled stacks to at exit, given by -X profile=<file>
+STATIC const char *sample_profile_file = NULL;
+
+// Interval between samples of the Python stack, in microseconds of CPU time
+#define SAMPLE_INTERVAL_US (1000)
+
+STATIC void sigprof_handler(int signum) {
+    (void)signum;
+    MP_STATE_VM(vm_sample_pending) = true;
+}
+
+STATIC void set_sample_timer(bool enable) {
+    if (enable) {
+        struct sigaction sa;
+        sa.sa_flags = SA_RESTART;
+        sa.sa_handler = sigprof_handler;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGPROF, &sa, NULL);
+    }
+    struct itimerval timer;
+    timer.it_interval.tv_sec = 0;
+    timer.it_interval.tv_usec = enable ? SAMPLE_INTERVAL_US : 0;
+    timer.it_value = timer.it_interval;
+    setitimer(ITIMER_PROF, &timer, NULL);
+}
+#endif
+
 #define FORCED_EXIT (0x100)
 // If exc is SystemExit, return value where FORCED_EXIT bit set,
 // and lower 8 bits are SystemExit value. For all other exceptions,
@@ -305,6 +372,9 @@ STATIC int usage(char **argv) {
 "Options:\n"
 "-v : verbose (trace various operations); can be multiple\n"
 "-O[N] : apply bytecode optimizations of level N\n"
+#if MICROPY_COMP_BC_PEEPHOLE
+"-fno-peephole : don't run the bytecode peephole pass\n"
+#endif
 "\n"
 "Implementation specific options (-X):\n", argv[0]
 );
@@ -320,6 +390,31 @@ STATIC int usage(char **argv) {
 , heap_size);
     impl_opts_cnt++;
 #endif
+#if MICROPY_GC_SPLIT_HEAP_AUTO
+    printf(
+"  heapmax=<n>[w][K|M] -- let the GC heap grow up to this size (default 0, no growth)\n"
+);
+    impl_opts_cnt++;
+#endif
+#if MICROPY_ENABLE_PYSTACK
+    printf(
+"  pystack=<n>[w][K|M] -- set the size of the Python stack (default %ld)\n"
+, pystack_size);
+    impl_opts_cnt++;
+#endif
+#if MICROPY_VM_PROFILE
+    printf(
+"  vmprofile=<file> -- write the VM profile to <file> as JSON at exit\n"
+);
+    impl_opts_cnt++;
+#endif
+#if MICROPY_VM_SAMPLING
+    printf(
+"  profile=<file> -- sample the Python stack and write it to <file> at exit,\n"
+"                    in the collapsed format of flame graph tools\n"
+);
+    impl_opts_cnt++;
+#endif
 
     if (impl_opts_cnt == 0) {
         printf("  (none)\n");
@@ -328,6 +423,40 @@ STATIC int usage(char **argv) {
     return 1;
 }
 
+#if MICROPY_ENABLE_GC
+// Parse a heap size given as <n>[w][K|M]; returns -1 if it is invalid
+STATIC long parse_heap_size(const char *arg) {
+    char *end;
+    long size = strtol(arg, &end, 0);
+    // Don't bring unneeded libc dependencies like tolower()
+    // If there's 'w' immediately after number, adjust it for
+    // target word size. Note that it should be *before* size
+    // suffix like K or M, to avoid confusion with kilowords,
+    // etc. the size is still in bytes, just can be adjusted
+    // for word size (taking 32bit as baseline).
+    bool word_adjust = false;
+    if ((*end | 0x20) == 'w') {
+        word_adjust = true;
+        end++;
+    }
+    if ((*end | 0x20) == 'k') {
+        size *= 1024;
+    } else if ((*end | 0x20) == 'm') {
+        size *= 1024 * 1024;
+    } else {
+        // Compensate for ++ below
+        --end;
+    }
+    if (*++end != 0) {
+        return -1;
+    }
+    if (word_adjust) {
+        size = size * BYTES_PER_WORD / 4;
+    }
+    return size;
+}
+#endif
+
 // Process options which set interpreter init options
 STATIC void pre_process_options(int argc, char **argv) {
     for (int a = 1; a < argc; a++) {
@@ -347,33 +476,32 @@ STATIC void pre_process_options(int argc, char **argv) {
                     emit_opt = MP_EMIT_OPT_VIPER;
 #if MICROPY_ENABLE_GC
                 } else if (strncmp(argv[a + 1], "heapsize=", sizeof("heapsize=") - 1) == 0) {
-                    char *end;
-                    heap_size = strtol(argv[a + 1] + sizeof("heapsize=") - 1, &end, 0);
-                    // Don't bring unneeded libc dependencies like tolower()
-                    // If there's 'w' immediately after number, adjust it for
-                    // target word size. Note that it should be *before* size
-                    // suffix like K or M, to avoid confusion with kilowords,
-                    // etc. the size is still in bytes, just can be adjusted
-                    // for word size (taking 32bit as baseline).
-                    bool word_adjust = false;
-                    if ((*end | 0x20) == 'w') {
-                        word_adjust = true;
-                        end++;
-                    }
-                    if ((*end | 0x20) == 'k') {
-                        heap_size *= 1024;
-                    } else if ((*end | 0x20) == 'm') {
-                        heap_size *= 1024 * 1024;
-                    } else {
-                        // Compensate for ++ below
-                        --end;
+                    heap_size = parse_heap_size(argv[a + 1] + sizeof("heapsize=") - 1);
+                    if (heap_size < 0) {
+                        goto invalid_arg;
                     }
-                    if (*++end != 0) {
+#endif
+#if MICROPY_GC_SPLIT_HEAP_AUTO
+                } else if (strncmp(argv[a + 1], "heapmax=", sizeof("heapmax=") - 1) == 0) {
+                    heap_max = parse_heap_size(argv[a + 1] + sizeof("heapmax=") - 1);
+                    if (heap_max < 0) {
                         goto invalid_arg;
                     }
-                    if (word_adjust) {
-                        heap_size = heap_size * BYTES_PER_WORD / 4;
+#endif
+#if MICROPY_ENABLE_PYSTACK
+                } else if (strncmp(argv[a + 1], "pystack=", sizeof("pystack=") - 1) == 0) {
+                    pystack_size = parse_heap_size(argv[a + 1] + sizeof("pystack=") - 1);
+                    if (pystack_size < 0) {
+                        goto invalid_arg;
                     }
+#endif
+#if MICROPY_VM_PROFILE
+                } else if (strncmp(argv[a + 1], "vmprofile=", sizeof("vmprofile=") - 1) == 0) {
+                    vm_profile_file = argv[a + 1] + sizeof("vmprofile=") - 1;
+#endif
+#if MICROPY_VM_SAMPLING
+                } else if (strncmp(argv[a + 1], "profile=", sizeof("profile=") - 1) == 0) {
+                    sample_profile_file = argv[a + 1] + sizeof("profile=") - 1;
 #endif
                 } else {
 invalid_arg:
@@ -421,6 +549,16 @@ MP_NOINLINE int main_(int argc, char **argv) {
 #if MICROPY_ENABLE_GC
     char *heap = malloc(heap_size);
     gc_init(heap, heap + heap_size);
+#if MICROPY_GC_SPLIT_HEAP_AUTO
+    if (heap_max > heap_size) {
+        mp_unix_heap_room = heap_max - heap_size;
+    }
+#endif
+#endif
+
+#if MICROPY_ENABLE_PYSTACK
+    char *pystack = malloc(pystack_size);
+    mp_pystack_init(pystack, pystack + pystack_size);
 #endif
 
     mp_init();
@@ -482,6 +620,13 @@ MP_NOINLINE int main_(int argc, char **argv) {
     }
     #endif
 
+    #if MICROPY_VM_SAMPLING
+    if (sample_profile_file != NULL) {
+        mp_vm_sample_start();
+        set_sample_timer(true);
+    }
+    #endif
+
     // Here is some example code to create a class and instance of that class.
     // First is the Python, then the C code.
     //
@@ -565,6 +710,10 @@ MP_NOINLINE int main_(int argc, char **argv) {
                     MP_STATE_VM(mp_optimise_value) = 0;
                     for (char *p = argv[a] + 1; *p && *p == 'O'; p++, MP_STATE_VM(mp_optimise_value)++);
                 }
+            #if MICROPY_COMP_BC_PEEPHOLE
+            } else if (strcmp(argv[a], "-fno-peephole") == 0) {
+                MP_STATE_VM(mp_bc_peephole) = false;
+            #endif
             } else {
                 return usage(argv);
             }
@@ -605,12 +754,28 @@ MP_NOINLINE int main_(int argc, char **argv) {
     }
     #endif
 
+    #if MICROPY_VM_PROFILE
+    if (vm_profile_file != NULL) {
+        write_profile(vm_profile_file, mp_vm_profile_print_json);
+    }
+    #endif
+
+    #if MICROPY_VM_SAMPLING
+    if (sample_profile_file != NULL) {
+        set_sample_timer(false);
+        write_profile(sample_profile_file, mp_vm_sample_print_collapsed);
+    }
+    #endif
+
     mp_deinit();
 
 #if MICROPY_ENABLE_GC && !defined(NDEBUG)
     // We don't really need to free memory since we are about to exit the
     // process, but doing so helps to find memory leaks.
     free(heap);
+#if MICROPY_ENABLE_PYSTACK
+    free(pystack);
+#endif
 #endif
 
     //printf("total bytes = %d\n", m_get_total_bytes_allocated());
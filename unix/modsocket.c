@@ -78,7 +78,7 @@ static inline mp_obj_t mp_obj_from_sockaddr(const struct sockaddr *addr, socklen
 }
 
 STATIC mp_obj_socket_t *socket_new(int fd) {
-    mp_obj_socket_t *o = m_new_obj(mp_obj_socket_t);
+    mp_obj_socket_t *o = m_new_obj_with_finaliser(mp_obj_socket_t);
     o->base.type = &mp_type_socket;
     o->fd = fd;
     return o;
@@ -119,8 +119,12 @@ STATIC mp_obj_t socket_close(mp_obj_t self_in) {
     // http://austingroupbugs.net/view.php?id=529
     // The rationale MicroPython follows is that close() just releases
     // file descriptor. If you're interested to catch I/O errors before
-    // closing fd, fsync() it.
-    close(self->fd);
+    // closing fd, fsync() it.  The fd is forgotten so that closing again
+    // (eg by the finaliser) can't close a reused descriptor.
+    if (self->fd >= 0) {
+        close(self->fd);
+        self->fd = -1;
+    }
     return mp_const_none;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(socket_close_obj, socket_close);
@@ -363,6 +367,7 @@ STATIC const mp_rom_map_elem_t usocket_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_setsockopt), MP_ROM_PTR(&socket_setsockopt_obj) },
     { MP_ROM_QSTR(MP_QSTR_setblocking), MP_ROM_PTR(&socket_setblocking_obj) },
     { MP_ROM_QSTR(MP_QSTR_close), MP_ROM_PTR(&socket_close_obj) },
+    { MP_ROM_QSTR(MP_QSTR___del__), MP_ROM_PTR(&socket_close_obj) },
 };
 
 STATIC MP_DEFINE_CONST_DICT(usocket_locals_dict, usocket_locals_dict_table);
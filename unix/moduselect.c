@@ -38,6 +38,7 @@
 #include "py/objlist.h"
 #include "py/objtuple.h"
 #include "py/mphal.h"
+#include "py/gc.h"
 #include "fdfile.h"
 
 #if MICROPY_PY_SOCKET
@@ -121,6 +122,7 @@ STATIC mp_obj_t poll_register(size_t n_args, const mp_obj_t *args) {
             self->obj_map = m_new0(mp_obj_t, self->alloc);
         }
         self->obj_map[free_slot - self->entries] = args[1];
+        gc_write_barrier(self->obj_map);
     }
 
     free_slot->fd = fd;
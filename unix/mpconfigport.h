@@ -43,10 +43,18 @@
 #if !defined(MICROPY_EMIT_ARM) && defined(__arm__) && !defined(__thumb2__)
     #define MICROPY_EMIT_ARM        (1)
 #endif
+#define MICROPY_QSTR_HASH_INDEX     (1)
 #define MICROPY_COMP_MODULE_CONST   (1)
 #define MICROPY_COMP_TRIPLE_TUPLE_ASSIGN (1)
+#define MICROPY_COMP_BC_PEEPHOLE    (1)
 #define MICROPY_ENABLE_GC           (1)
 #define MICROPY_ENABLE_FINALISER    (1)
+#define MICROPY_GC_FREE_LISTS       (1)
+#define MICROPY_GC_LEAF             (1)
+#define MICROPY_GC_INCREMENTAL      (1)
+#define MICROPY_GC_STACK_SPILL      (1)
+#define MICROPY_GC_SPLIT_HEAP       (1)
+#define MICROPY_GC_SPLIT_HEAP_AUTO  (1)
 #define MICROPY_STACK_CHECK         (1)
 #define MICROPY_MALLOC_USES_ALLOCATED_SIZE (1)
 #define MICROPY_MEM_STATS           (1)
@@ -69,6 +77,30 @@
 #ifndef MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE
 #define MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE (1)
 #endif
+#ifndef MICROPY_OPT_ATTR_INLINE_CACHE
+#define MICROPY_OPT_ATTR_INLINE_CACHE (1)
+#endif
+#ifndef MICROPY_OPT_LOAD_GLOBAL_CACHE
+#define MICROPY_OPT_LOAD_GLOBAL_CACHE (1)
+#endif
+#ifndef MICROPY_OPT_KW_CALL_CACHE
+#define MICROPY_OPT_KW_CALL_CACHE (1)
+#endif
+#ifndef MICROPY_OPT_CALL_VAR_FORWARD
+#define MICROPY_OPT_CALL_VAR_FORWARD (1)
+#endif
+#ifndef MICROPY_OPT_QUICKEN
+#define MICROPY_OPT_QUICKEN (1)
+#endif
+#ifndef MICROPY_OPT_SIMPLE_ARGS_CALL
+#define MICROPY_OPT_SIMPLE_ARGS_CALL (1)
+#endif
+#ifndef MICROPY_TIERING
+#define MICROPY_TIERING (1)
+#endif
+#ifndef MICROPY_VM_SAMPLING
+#define MICROPY_VM_SAMPLING (1)
+#endif
 #define MICROPY_CAN_OVERRIDE_BUILTINS (1)
 #define MICROPY_PY_FUNCTION_ATTRS   (1)
 #define MICROPY_PY_DESCRIPTORS      (1)
@@ -103,6 +135,8 @@
 #define MICROPY_PY_GC_COLLECT_RETVAL (1)
 #define MICROPY_MODULE_FROZEN_STR   (1)
 
+#define MICROPY_ENABLE_PYSTACK      (1)
+#define MICROPY_PY_THREAD_PYSTACK_SIZE (16 * 1024)
 #define MICROPY_STACKLESS           (0)
 #define MICROPY_STACKLESS_STRICT    (0)
 
@@ -113,7 +147,10 @@
 #define MICROPY_PY_UCTYPES          (1)
 #define MICROPY_PY_UZLIB            (1)
 #define MICROPY_PY_UJSON            (1)
+#define MICROPY_PY_UJSON_READ_BUF_SIZE (512)
 #define MICROPY_PY_URE              (1)
+#define MICROPY_PY_URE_PIKEVM       (1)
+#define MICROPY_PY_URE_CACHE_SIZE   (8)
 #define MICROPY_PY_UHEAPQ           (1)
 #define MICROPY_PY_UTIMEQ           (1)
 #define MICROPY_PY_UHASHLIB         (1)
@@ -245,6 +282,10 @@ void mp_unix_free_exec(void *ptr, size_t size);
 void mp_unix_mark_exec(void);
 #define MP_PLAT_ALLOC_EXEC(min_size, ptr, size) mp_unix_alloc_exec(min_size, ptr, size)
 #define MP_PLAT_FREE_EXEC(ptr, size) mp_unix_free_exec(ptr, size)
+void *mp_unix_alloc_heap(size_t size);
+void mp_unix_free_heap(void *ptr, size_t size);
+#define MP_PLAT_ALLOC_HEAP(size) mp_unix_alloc_heap(size)
+#define MP_PLAT_FREE_HEAP(ptr, size) mp_unix_free_heap(ptr, size)
 #ifndef MICROPY_FORCE_PLAT_ALLOC_EXEC
 // Use MP_PLAT_ALLOC_EXEC for any executable memory allocation, including for FFI
 // (overriding libffi own implementation)
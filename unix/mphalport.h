@@ -38,7 +38,7 @@ void mp_hal_stdio_mode_orig(void);
 // "The useconds argument shall be less than one million."
 static inline void mp_hal_delay_ms(mp_uint_t ms) { usleep((ms) * 1000); }
 static inline void mp_hal_delay_us(mp_uint_t us) { usleep(us); }
-#define mp_hal_ticks_cpu() 0
+mp_uint_t mp_hal_ticks_cpu(void);
 
 #define RAISE_ERRNO(err_flag, error_val) \
     { if (err_flag == -1) \
@@ -63,6 +63,11 @@ STATIC void mp_thread_gc(int signo, siginfo_t *info, void *context) {
     if (signo == SIGUSR1) {
         void gc_collect_regs_and_stack(void);
         gc_collect_regs_and_stack();
+        #if MICROPY_ENABLE_PYSTACK
+        // the Python stack of this thread may not be on its C stack
+        gc_collect_root((void**)(void*)MP_STATE_THREAD(pystack_start),
+            (MP_STATE_THREAD(pystack_cur) - MP_STATE_THREAD(pystack_start)) / sizeof(void*));
+        #endif
         // We have access to the context (regs, stack) of the thread but it seems
         // that we don't need the extra information, enough is captured by the
         // gc_collect_regs_and_stack function above
@@ -156,6 +161,11 @@ void mp_thread_create(void *(*entry)(void*), void *arg, size_t *stack_size) {
         goto er;
     }
 
+    // adjust stack_size to provide room to recover from hitting the limit
+    // this value seems to be about right for both 32-bit and 64-bit builds
+    // it must be done before the thread is created because the thread reads it
+    *stack_size -= 8192;
+
     pthread_mutex_lock(&thread_mutex);
 
     // create thread
@@ -166,10 +176,6 @@ void mp_thread_create(void *(*entry)(void*), void *arg, size_t *stack_size) {
         goto er;
     }
 
-    // adjust stack_size to provide room to recover from hitting the limit
-    // this value seems to be about right for both 32-bit and 64-bit builds
-    *stack_size -= 8192;
-
     // add thread to linked list of all threads
     thread_t *th = malloc(sizeof(thread_t));
     th->id = id;
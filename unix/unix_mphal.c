@@ -28,6 +28,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/time.h>
+#include <time.h>
 
 #include "py/mpstate.h"
 #include "py/mphal.h"
@@ -197,3 +198,14 @@ mp_uint_t mp_hal_ticks_us(void) {
     gettimeofday(&tv, NULL);
     return tv.tv_sec * 1000000 + tv.tv_usec;
 }
+
+mp_uint_t mp_hal_ticks_cpu(void) {
+    #if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+    #else
+    // no portable cycle counter, so count nanoseconds instead
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (mp_uint_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    #endif
+}